@@ -1,4 +1,5 @@
 #version 330 core
+#pragma keywords APPLY_SSAO APPLY_SHADOWS
 
 const uint NUM_CASCADED_SHADOWS = 3u;
 const float SHADOW_BLUR_BAND = 1.0;
@@ -6,12 +7,14 @@ const float SHADOW_BLUR_BAND = 1.0;
 uniform sampler2D texPosition;
 uniform sampler2D texNormal;
 uniform sampler2D texAlbedoSpec;
+#if APPLY_SSAO
 uniform sampler2D texSSAO;
-uniform bool applySSAO;
+#endif
+#if APPLY_SHADOWS
 uniform sampler2DShadow shadowMap[NUM_CASCADED_SHADOWS];
 uniform mat4 viewToLightSpace[NUM_CASCADED_SHADOWS];
 uniform float shadowZEnds[NUM_CASCADED_SHADOWS];
-uniform bool applyShadows;
+#endif
 uniform vec3 lightDirectionVS;
 uniform vec3 color;
 uniform vec3 phongVals;
@@ -20,6 +23,7 @@ in vec2 fTexCoords;
 
 out vec4 fragColor;
 
+#if APPLY_SHADOWS
 float calculateShadow(uint cascadeIndex, vec3 position, vec3 normal, vec3 lightDir) {
     vec4 positionLightSpace = viewToLightSpace[cascadeIndex] * vec4(position, 1.0);
     vec3 normalizedDeviceCoords = (positionLightSpace.xyz / positionLightSpace.w) * 0.5 + 0.5;
@@ -42,6 +46,7 @@ float calculateShadow(uint cascadeIndex, vec3 position, vec3 normal, vec3 lightD
     }
     return brightness;
 }
+#endif
 
 vec3 calculateLight(vec3 position, vec3 normal, vec3 albedoColor, float specularColor, float ambientOcclusion, vec3 viewDir) {    // Computes the color of a fragment with one light source. All positions/directions in view space.
     vec3 lightDir = normalize(-lightDirectionVS);
@@ -49,26 +54,26 @@ vec3 calculateLight(vec3 position, vec3 normal, vec3 albedoColor, float specular
     
     vec3 ambient = color * phongVals.x * albedoColor * lightScalar * ambientOcclusion;
     
-    if (applyShadows) {
-        uint cascadeIndex = 0u;
-        for (uint i = 0u; i < NUM_CASCADED_SHADOWS - 1u; ++i) {
-            cascadeIndex += (-position.z > shadowZEnds[i]) ? 1u : 0u;
-        }
-        
-        /*if (cascadeIndex == 0u) {    // Draw color for each cascade.
-            tempColor = vec3(1.0, 0.5, 0.5);
-        } else if (cascadeIndex == 1u) {
-            tempColor = vec3(0.5, 1.0, 0.5);
-        } else if (cascadeIndex == 2u) {
-            tempColor = vec3(0.5, 0.5, 1.0);
-        }*/
-        
-        if (cascadeIndex == NUM_CASCADED_SHADOWS - 1u || shadowZEnds[cascadeIndex] + position.z > SHADOW_BLUR_BAND) {    // Blur between cascades to remove seam between shadow maps.
-            lightScalar *= calculateShadow(cascadeIndex, position, normal, lightDir);
-        } else {
-            lightScalar *= mix(calculateShadow(cascadeIndex + 1u, position, normal, lightDir), calculateShadow(cascadeIndex, position, normal, lightDir), (shadowZEnds[cascadeIndex] + position.z) / SHADOW_BLUR_BAND);
-        }
+#if APPLY_SHADOWS
+    uint cascadeIndex = 0u;
+    for (uint i = 0u; i < NUM_CASCADED_SHADOWS - 1u; ++i) {
+        cascadeIndex += (-position.z > shadowZEnds[i]) ? 1u : 0u;
+    }
+    
+    /*if (cascadeIndex == 0u) {    // Draw color for each cascade.
+        tempColor = vec3(1.0, 0.5, 0.5);
+    } else if (cascadeIndex == 1u) {
+        tempColor = vec3(0.5, 1.0, 0.5);
+    } else if (cascadeIndex == 2u) {
+        tempColor = vec3(0.5, 0.5, 1.0);
+    }*/
+    
+    if (cascadeIndex == NUM_CASCADED_SHADOWS - 1u || shadowZEnds[cascadeIndex] + position.z > SHADOW_BLUR_BAND) {    // Blur between cascades to remove seam between shadow maps.
+        lightScalar *= calculateShadow(cascadeIndex, position, normal, lightDir);
+    } else {
+        lightScalar *= mix(calculateShadow(cascadeIndex + 1u, position, normal, lightDir), calculateShadow(cascadeIndex, position, normal, lightDir), (shadowZEnds[cascadeIndex] + position.z) / SHADOW_BLUR_BAND);
     }
+#endif
     
     float diffuseScalar = max(dot(normal, lightDir), 0.0);
     vec3 diffuse = color * phongVals.y * diffuseScalar * albedoColor * lightScalar;
@@ -85,7 +90,11 @@ void main() {
     vec3 normal = texture(texNormal, fTexCoords).rgb;
     vec3 albedoColor = texture(texAlbedoSpec, fTexCoords).rgb;
     float specularColor = texture(texAlbedoSpec, fTexCoords).a;
-    float ambientOcclusion = (applySSAO ? texture(texSSAO, fTexCoords).r : 1.0);
+#if APPLY_SSAO
+    float ambientOcclusion = texture(texSSAO, fTexCoords).r;
+#else
+    float ambientOcclusion = 1.0;
+#endif
     vec3 viewDir = normalize(-position);
     
     fragColor = vec4(calculateLight(position, normal, albedoColor, specularColor, ambientOcclusion, viewDir), 1.0);
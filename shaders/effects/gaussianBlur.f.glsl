@@ -1,7 +1,7 @@
 #version 330 core
+#pragma keywords BLUR_HORIZONTAL
 
 uniform sampler2D image;
-uniform bool blurHorizontal;
 uniform float weights[5] = float[] (0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
 
 in vec2 fTexCoords;
@@ -10,17 +10,15 @@ out vec4 fragColor;
 
 void main() {
     vec2 texelSize = 1.0 / textureSize(image, 0);
+#if BLUR_HORIZONTAL
+    vec2 offset = vec2(texelSize.x, 0.0);
+#else
+    vec2 offset = vec2(0.0, texelSize.y);
+#endif
     vec3 color = texture(image, fTexCoords).rgb * weights[0];
-    if (blurHorizontal) {
-        for (int i = 1; i < 5; ++i) {
-            color += texture(image, fTexCoords + vec2(texelSize.x * i, 0.0)).rgb * weights[i];
-            color += texture(image, fTexCoords - vec2(texelSize.x * i, 0.0)).rgb * weights[i];
-        }
-    } else {
-        for (int i = 1; i < 5; ++i) {
-            color += texture(image, fTexCoords + vec2(0.0, texelSize.y * i)).rgb * weights[i];
-            color += texture(image, fTexCoords - vec2(0.0, texelSize.y * i)).rgb * weights[i];
-        }
+    for (int i = 1; i < 5; ++i) {
+        color += texture(image, fTexCoords + offset * i).rgb * weights[i];
+        color += texture(image, fTexCoords - offset * i).rgb * weights[i];
     }
     fragColor = vec4(color, 1.0);
 }
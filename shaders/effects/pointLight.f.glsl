@@ -1,10 +1,12 @@
 #version 330 core
+#pragma keywords APPLY_SSAO
 
 uniform sampler2D texPosition;
 uniform sampler2D texNormal;
 uniform sampler2D texAlbedoSpec;
+#if APPLY_SSAO
 uniform sampler2D texSSAO;
-uniform bool applySSAO;
+#endif
 uniform vec2 renderSize;
 uniform vec3 color;
 uniform vec3 phongVals;
@@ -37,7 +39,11 @@ void main() {
     vec3 normal = texture(texNormal, texCoords).rgb;
     vec3 albedoColor = texture(texAlbedoSpec, texCoords).rgb;
     float specularColor = texture(texAlbedoSpec, texCoords).a;
-    float ambientOcclusion = (applySSAO ? texture(texSSAO, texCoords).r : 1.0);
+#if APPLY_SSAO
+    float ambientOcclusion = texture(texSSAO, texCoords).r;
+#else
+    float ambientOcclusion = 1.0;
+#endif
     vec3 viewDir = normalize(-position);
     
     fragColor = vec4(calculateLight(position, normal, albedoColor, specularColor, ambientOcclusion, viewDir), 1.0);
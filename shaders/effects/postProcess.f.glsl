@@ -1,11 +1,13 @@
 #version 330 core
+#pragma keywords APPLY_BLOOM
 
 const float GAMMA = 2.2;    // Gamma correction should match the implementation in World.cpp to compute light volumes correctly.
 
 uniform sampler2D image;
+#if APPLY_BLOOM
 uniform sampler2D bloomBlur;
+#endif
 uniform float exposure;
-uniform bool applyBloom;
 
 in vec2 fTexCoords;
 
@@ -24,9 +26,9 @@ vec3 toneMapUncharted2(vec3 x) {
 
 void main() {
     vec3 hdrColor = texture(image, fTexCoords).rgb;
-    if (applyBloom) {
-        hdrColor += texture(bloomBlur, fTexCoords).rgb;    // Additive blending of image and bloom colors.
-    }
+#if APPLY_BLOOM
+    hdrColor += texture(bloomBlur, fTexCoords).rgb;    // Additive blending of image and bloom colors.
+#endif
     //vec3 mappedColor = hdrColor / (hdrColor + vec3(1.0));    // Reinhard tone mapping.
     //vec3 mappedColor = vec3(1.0) - exp(-hdrColor * exposure);    // Exposure tone mapping.
     vec3 mappedColor = toneMapUncharted2(hdrColor * exposure * 2.0) / toneMapUncharted2(vec3(11.2));    // Uncharted 2 tone mapping.
@@ -1,10 +1,24 @@
 #version 330 core
+#pragma keywords NORMAL_MAP
+
+#if NORMAL_MAP
+const float ALPHA_CUTOFF = 0.1;
+#else
+const float ALPHA_CUTOFF = 0.5;
+#endif
 
 uniform sampler2D texDiffuse;
 uniform sampler2D texSpecular;
+#if NORMAL_MAP
+uniform sampler2D texNormal;
+#endif
 
 in vec3 fPosition;
+#if NORMAL_MAP
+in mat3 fTBNMtx;
+#else
 in vec3 fNormal;
+#endif
 in vec2 fTexCoords;
 
 layout (location = 0) out vec3 position;
@@ -13,9 +27,13 @@ layout (location = 2) out vec4 albedoSpec;
 
 void main() {
     position = fPosition;
+#if NORMAL_MAP
+    normal = normalize(fTBNMtx * (texture(texNormal, fTexCoords).rgb * 2.0 - 1.0));
+#else
     normal = normalize(fNormal);
+#endif
     albedoSpec = texture(texDiffuse, fTexCoords);
-    if (albedoSpec.a < 0.5) {
+    if (albedoSpec.a < ALPHA_CUTOFF) {
         discard;
     }
     albedoSpec.a = texture(texSpecular, fTexCoords).r;
@@ -1,22 +1,142 @@
 #version 330 core
+#pragma keywords NORMAL_MAP SKINNING BONE_BUFFER AFFINE_PALETTE DUAL_QUAT_PALETTE BAKED_ANIMATION
+
+const uint MAX_NUM_BONES = 128u;
 
 uniform mat4 modelMtx;
 layout (std140) uniform ViewProjectionMtx {
     uniform mat4 viewMtx;
     uniform mat4 projectionMtx;
 };
+#if SKINNING && BAKED_ANIMATION
+uniform sampler2D animationFrames;    // Baked bone transforms with one frame per row, see AnimationTexture.
+uniform samplerBuffer crowdInstances;    // Instance data, see Crowd for the layout.
+uniform float animationTime;    // In seconds.
+#elif SKINNING && BONE_BUFFER
+uniform samplerBuffer bonePalettes;    // Model matrix of each instance followed by its bone transforms, see BonePaletteBuffer for the layout of each format.
+uniform int paletteOffset;    // First texel of instance 0.
+uniform int paletteStride;    // Texels per instance.
+#elif SKINNING
+uniform mat4 boneTransforms[MAX_NUM_BONES];
+#endif
 
 layout (location = 0) in vec3 vPosition;
 layout (location = 1) in vec3 vNormal;
 layout (location = 2) in vec2 vTexCoords;
+#if NORMAL_MAP
+layout (location = 3) in vec4 vTangent;    // Bitangent sign stored in w.
+#endif
+#if SKINNING
+layout (location = 5) in uint vBone;
+layout (location = 6) in vec4 vWeight;
+#endif
 
 out vec3 fPosition;
+#if NORMAL_MAP
+out mat3 fTBNMtx;
+#else
 out vec3 fNormal;
+#endif
 out vec2 fTexCoords;
 
+#if SKINNING && BAKED_ANIMATION
+mat4 fetchBakedMatrix(int frame, uint bone) {    // Stored as the top 3 rows.
+    int x = int(bone) * 3;
+    return transpose(mat4(texelFetch(animationFrames, ivec2(x, frame), 0), texelFetch(animationFrames, ivec2(x + 1, frame), 0), texelFetch(animationFrames, ivec2(x + 2, frame), 0), vec4(0.0, 0.0, 0.0, 1.0)));
+}
+#define BONE_TRANSFORM(bone) (fetchBakedMatrix(frame, bone) * (1.0 - frameBlend) + fetchBakedMatrix(frame + 1, bone) * frameBlend)
+#elif SKINNING && BONE_BUFFER
+mat4 fetchMatrix(int texel) {
+    return mat4(texelFetch(bonePalettes, texel), texelFetch(bonePalettes, texel + 1), texelFetch(bonePalettes, texel + 2), texelFetch(bonePalettes, texel + 3));
+}
+mat4 fetchAffineMatrix(int texel) {    // Stored as the top 3 rows.
+    return transpose(mat4(texelFetch(bonePalettes, texel), texelFetch(bonePalettes, texel + 1), texelFetch(bonePalettes, texel + 2), vec4(0.0, 0.0, 0.0, 1.0)));
+}
+#if DUAL_QUAT_PALETTE
+mat4 blendDualQuaternions(int texel, uint bones, vec4 weights) {    // Quaternions are stored as (x, y, z, w).
+    vec4 pivot = texelFetch(bonePalettes, texel + int(bones & 0xFFu) * 2);
+    vec4 real = vec4(0.0);
+    vec4 dual = vec4(0.0);
+    for (uint i = 0u; i < 4u; ++i) {
+        int boneTexel = texel + int((bones >> (i * 8u)) & 0xFFu) * 2;
+        vec4 boneReal = texelFetch(bonePalettes, boneTexel);
+        float weight = (dot(boneReal, pivot) < 0.0 ? -weights[i] : weights[i]);    // Keep the rotations on the same hemisphere so the blend takes the short way around.
+        real += boneReal * weight;
+        dual += texelFetch(bonePalettes, boneTexel + 1) * weight;
+    }
+    float invLength = 1.0 / length(real);
+    real *= invLength;
+    dual *= invLength;
+    vec3 translation = 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+    vec3 r2 = real.xyz * 2.0;
+    vec3 rr = real.xyz * r2;
+    float xy = real.x * r2.y, xz = real.x * r2.z, yz = real.y * r2.z;
+    float wx = real.w * r2.x, wy = real.w * r2.y, wz = real.w * r2.z;
+    return mat4(
+        vec4(1.0 - rr.y - rr.z, xy + wz, xz - wy, 0.0),
+        vec4(xy - wz, 1.0 - rr.x - rr.z, yz + wx, 0.0),
+        vec4(xz + wy, yz - wx, 1.0 - rr.x - rr.y, 0.0),
+        vec4(translation, 1.0)
+    );
+}
+#elif AFFINE_PALETTE
+#define BONE_TRANSFORM(bone) fetchAffineMatrix(paletteBase + 3 + int(bone) * 3)
+#else
+#define BONE_TRANSFORM(bone) fetchMatrix(paletteBase + 4 + int(bone) * 4)
+#endif
+#elif SKINNING
+#define BONE_TRANSFORM(bone) boneTransforms[bone]
+#endif
+#if SKINNING && (BAKED_ANIMATION || BONE_BUFFER && (AFFINE_PALETTE || DUAL_QUAT_PALETTE))
+mat3 normalMatrix(mat3 m) {    // Same direction as transpose(inverse(m)), without the inverse. The cofactor matrix is that times determinant(m), so the sign is flipped back for mirrored matrices.
+    mat3 c = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+    return (dot(m[0], c[0]) < 0.0 ? -c : c);
+}
+#endif
+
 void main() {
-    fPosition = vec3(viewMtx * modelMtx * vec4(vPosition, 1.0));    // Fragment position in view space.
-    fNormal = transpose(inverse(mat3(viewMtx * modelMtx))) * vNormal;    // Need to put the normal into view space too.
+#if SKINNING
+#if BAKED_ANIMATION
+    int instanceTexel = gl_InstanceID * 4;
+    mat4 instanceMtx = transpose(mat4(texelFetch(crowdInstances, instanceTexel), texelFetch(crowdInstances, instanceTexel + 1), texelFetch(crowdInstances, instanceTexel + 2), vec4(0.0, 0.0, 0.0, 1.0))) * modelMtx;
+    vec4 clip = texelFetch(crowdInstances, instanceTexel + 3);
+    float clipFrame = mod((animationTime + clip.z) * clip.w, clip.y - 1.0);    // The last frame matches the first, so the loop wraps one before it.
+    int frame = int(clip.x) + int(clipFrame);
+    float frameBlend = fract(clipFrame);
+#elif BONE_BUFFER && (AFFINE_PALETTE || DUAL_QUAT_PALETTE)
+    int paletteBase = paletteOffset + gl_InstanceID * paletteStride;
+    mat4 instanceMtx = fetchAffineMatrix(paletteBase) * modelMtx;
+#elif BONE_BUFFER
+    int paletteBase = paletteOffset + gl_InstanceID * paletteStride;
+    mat4 instanceMtx = fetchMatrix(paletteBase) * modelMtx;
+#else
+    mat4 instanceMtx = modelMtx;
+#endif
+#if !BAKED_ANIMATION && BONE_BUFFER && DUAL_QUAT_PALETTE
+    mat4 boneMtx = blendDualQuaternions(paletteBase + 3, vBone, vWeight);
+#else
+    mat4 boneMtx = BONE_TRANSFORM(vBone & 0xFFu) * vWeight[0];
+    boneMtx +=     BONE_TRANSFORM((vBone >> 8) & 0xFFu) * vWeight[1];
+    boneMtx +=     BONE_TRANSFORM((vBone >> 16) & 0xFFu) * vWeight[2];
+    boneMtx +=     BONE_TRANSFORM((vBone >> 24) & 0xFFu) * vWeight[3];
+#endif
+    mat4 modelViewMtx = viewMtx * instanceMtx * boneMtx;
+#else
+    mat4 modelViewMtx = viewMtx * modelMtx;
+#endif
+    
+    fPosition = vec3(modelViewMtx * vec4(vPosition, 1.0));    // Fragment position in view space.
+#if SKINNING && (BAKED_ANIMATION || BONE_BUFFER && (AFFINE_PALETTE || DUAL_QUAT_PALETTE))
+    mat3 normalMtx = normalMatrix(mat3(modelViewMtx));    // Need to put the normal into view space too.
+#else
+    mat3 normalMtx = transpose(inverse(mat3(modelViewMtx)));    // Need to put the normal into view space too.
+#endif
+#if NORMAL_MAP
+    vec3 bitangent = cross(vNormal, vTangent.xyz) * (vTangent.w < 0.0 ? -1.0 : 1.0);
+    fTBNMtx = mat3(normalize(normalMtx * vTangent.xyz), normalize(normalMtx * bitangent), normalize(normalMtx * vNormal));
+#else
+    fNormal = normalMtx * vNormal;
+#endif
     fTexCoords = vTexCoords;
     
     gl_Position = projectionMtx * vec4(fPosition, 1.0);
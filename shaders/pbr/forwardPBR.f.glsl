@@ -1,4 +1,5 @@
 #version 330 core
+#pragma keywords LIGHT_0 LIGHT_1 LIGHT_2 LIGHT_3
 
 const float PI = 3.14159265359;
 const uint NUM_LIGHTS = 4u;
@@ -7,12 +8,12 @@ const uint POINT_LIGHT = 1u;
 const uint SPOT_LIGHT = 2u;
 const float GAMMA = 2.2;
 const float MAX_REFLECTION_LOD = 4.0;
+const bool lightStates[NUM_LIGHTS] = bool[](LIGHT_0 != 0, LIGHT_1 != 0, LIGHT_2 != 0, LIGHT_3 != 0);    // Disabled lights are removed at compile time.
 
 layout (std140) uniform ViewProjectionMtx {
     uniform mat4 viewMtx;
     uniform mat4 projectionMtx;
 };
-uniform bool lightStates[NUM_LIGHTS];
 uniform sampler2D texAlbedo;
 uniform sampler2D texMetallic;
 uniform sampler2D texNormal;
@@ -9,8 +9,7 @@ layout (std140) uniform ViewProjectionMtx {
 layout (location = 0) in vec3 vPosition;
 layout (location = 1) in vec3 vNormal;
 layout (location = 2) in vec2 vTexCoords;
-layout (location = 3) in vec3 vTangent;
-layout (location = 4) in vec3 vBitangent;
+layout (location = 3) in vec4 vTangent;    // Bitangent sign stored in w.
 
 out vec3 fPosition;
 out mat3 fTBNMtx;
@@ -19,7 +18,8 @@ out vec2 fTexCoords;
 void main() {
     fPosition = vec3(viewMtx * modelMtx * vec4(vPosition, 1.0));    // Fragment position in view space.
     mat3 normalMtx = transpose(inverse(mat3(viewMtx * modelMtx)));    // Note that inverse operation is expensive and this should be passed in as a uniform ########################################################
-    fTBNMtx = mat3(normalize(normalMtx * vTangent), normalize(normalMtx * vBitangent), normalize(normalMtx * vNormal));    // Need to put the normal into view space too.
+    vec3 bitangent = cross(vNormal, vTangent.xyz) * (vTangent.w < 0.0 ? -1.0 : 1.0);
+    fTBNMtx = mat3(normalize(normalMtx * vTangent.xyz), normalize(normalMtx * bitangent), normalize(normalMtx * vNormal));    // Need to put the normal into view space too.
     fTexCoords = vTexCoords;
     
     gl_Position = projectionMtx * vec4(fPosition, 1.0);
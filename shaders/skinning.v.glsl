@@ -0,0 +1,88 @@
+#version 330 core
+#pragma keywords AFFINE_PALETTE DUAL_QUAT_PALETTE
+
+uniform mat4 modelMtx;
+uniform samplerBuffer bonePalettes;    // Model matrix of each instance followed by its bone transforms, see BonePaletteBuffer for the layout of each format.
+uniform int paletteOffset;    // First texel of instance 0.
+uniform int paletteStride;    // Texels per instance.
+
+layout (location = 0) in vec3 vPosition;
+layout (location = 1) in vec3 vNormal;
+layout (location = 2) in vec2 vTexCoords;
+layout (location = 3) in vec4 vTangent;    // Bitangent sign stored in w.
+layout (location = 5) in uint vBone;
+layout (location = 6) in vec4 vWeight;
+
+out vec3 tfPosition;    // Captured in this order with transform feedback, see PreSkinning for the buffer layout.
+out vec3 tfNormal;
+out vec2 tfTexCoords;
+out vec4 tfTangent;
+
+mat4 fetchMatrix(int texel) {
+    return mat4(texelFetch(bonePalettes, texel), texelFetch(bonePalettes, texel + 1), texelFetch(bonePalettes, texel + 2), texelFetch(bonePalettes, texel + 3));
+}
+mat4 fetchAffineMatrix(int texel) {    // Stored as the top 3 rows.
+    return transpose(mat4(texelFetch(bonePalettes, texel), texelFetch(bonePalettes, texel + 1), texelFetch(bonePalettes, texel + 2), vec4(0.0, 0.0, 0.0, 1.0)));
+}
+#if DUAL_QUAT_PALETTE
+mat4 blendDualQuaternions(int texel, uint bones, vec4 weights) {    // Quaternions are stored as (x, y, z, w).
+    vec4 pivot = texelFetch(bonePalettes, texel + int(bones & 0xFFu) * 2);
+    vec4 real = vec4(0.0);
+    vec4 dual = vec4(0.0);
+    for (uint i = 0u; i < 4u; ++i) {
+        int boneTexel = texel + int((bones >> (i * 8u)) & 0xFFu) * 2;
+        vec4 boneReal = texelFetch(bonePalettes, boneTexel);
+        float weight = (dot(boneReal, pivot) < 0.0 ? -weights[i] : weights[i]);    // Keep the rotations on the same hemisphere so the blend takes the short way around.
+        real += boneReal * weight;
+        dual += texelFetch(bonePalettes, boneTexel + 1) * weight;
+    }
+    float invLength = 1.0 / length(real);
+    real *= invLength;
+    dual *= invLength;
+    vec3 translation = 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+    vec3 r2 = real.xyz * 2.0;
+    vec3 rr = real.xyz * r2;
+    float xy = real.x * r2.y, xz = real.x * r2.z, yz = real.y * r2.z;
+    float wx = real.w * r2.x, wy = real.w * r2.y, wz = real.w * r2.z;
+    return mat4(
+        vec4(1.0 - rr.y - rr.z, xy + wz, xz - wy, 0.0),
+        vec4(xy - wz, 1.0 - rr.x - rr.z, yz + wx, 0.0),
+        vec4(xz + wy, yz - wx, 1.0 - rr.x - rr.y, 0.0),
+        vec4(translation, 1.0)
+    );
+}
+#elif AFFINE_PALETTE
+#define BONE_TRANSFORM(bone) fetchAffineMatrix(paletteBase + 3 + int(bone) * 3)
+#else
+#define BONE_TRANSFORM(bone) fetchMatrix(paletteBase + 4 + int(bone) * 4)
+#endif
+#endif
+mat3 normalMatrix(mat3 m) {    // Same direction as transpose(inverse(m)), without the inverse. The cofactor matrix is that times determinant(m), so the sign is flipped back for mirrored matrices.
+    mat3 c = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+    return (dot(m[0], c[0]) < 0.0 ? -c : c);
+}
+
+void main() {
+    int paletteBase = paletteOffset + gl_InstanceID * paletteStride;
+#if AFFINE_PALETTE || DUAL_QUAT_PALETTE
+    mat4 instanceMtx = fetchAffineMatrix(paletteBase) * modelMtx;
+#else
+    mat4 instanceMtx = fetchMatrix(paletteBase) * modelMtx;
+#endif
+#if DUAL_QUAT_PALETTE
+    mat4 boneMtx = blendDualQuaternions(paletteBase + 3, vBone, vWeight);
+#else
+    mat4 boneMtx = BONE_TRANSFORM(vBone & 0xFFu) * vWeight[0];
+    boneMtx +=     BONE_TRANSFORM((vBone >> 8) & 0xFFu) * vWeight[1];
+    boneMtx +=     BONE_TRANSFORM((vBone >> 16) & 0xFFu) * vWeight[2];
+    boneMtx +=     BONE_TRANSFORM((vBone >> 24) & 0xFFu) * vWeight[3];
+#endif
+    mat4 skinMtx = instanceMtx * boneMtx;
+    mat3 normalMtx = normalMatrix(mat3(skinMtx));    // The outputs are normalized, so the scale from the cofactor doesn't matter.
+    float handedness = (determinant(mat3(skinMtx)) < 0.0 ? -1.0 : 1.0);    // The bitangent is rebuilt from the world space normal and tangent, so mirroring flips it.
+    
+    tfPosition = vec3(skinMtx * vec4(vPosition, 1.0));    // Vertex position in world space.
+    tfNormal = normalize(normalMtx * vNormal);
+    tfTexCoords = vTexCoords;
+    tfTangent = vec4(normalize(normalMtx * vTangent.xyz), vTangent.w * handedness);
+}
@@ -0,0 +1,65 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    atomic<size_t> allocationCount(0);    // Constant initialized, so it's ready for allocations made by other static constructors.
+    
+    void* allocate(size_t size, size_t alignment) {    // Over-aligned blocks keep the pointer from malloc just before the returned address.
+        allocationCount.fetch_add(1, memory_order_relaxed);
+        if (alignment <= alignof(max_align_t)) {
+            void* p = malloc(size > 0 ? size : 1);
+            if (p == nullptr) {
+                throw bad_alloc();
+            }
+            return p;
+        }
+        void* base = malloc(size + alignment + sizeof(void*));
+        if (base == nullptr) {
+            throw bad_alloc();
+        }
+        uintptr_t address = (reinterpret_cast<uintptr_t>(base) + sizeof(void*) + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+        reinterpret_cast<void**>(address)[-1] = base;
+        return reinterpret_cast<void*>(address);
+    }
+    
+    void deallocateAligned(void* p) {
+        if (p != nullptr) {
+            free(reinterpret_cast<void**>(p)[-1]);
+        }
+    }
+}
+
+size_t AllocationCounter::getCount() {
+    return allocationCount.load(memory_order_relaxed);
+}
+
+void* operator new(size_t size) {    // The array and nothrow forms call these by default.
+    return allocate(size, 0);
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+    return allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t /*size*/) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, align_val_t alignment) noexcept {
+    if (static_cast<size_t>(alignment) <= alignof(max_align_t)) {
+        free(p);
+    } else {
+        deallocateAligned(p);
+    }
+}
+
+void operator delete(void* p, size_t /*size*/, align_val_t alignment) noexcept {
+    operator delete(p, alignment);
+}
@@ -0,0 +1,13 @@
+#ifndef ALLOCATION_COUNTER_H_
+#define ALLOCATION_COUNTER_H_
+
+#include <cstddef>
+
+using namespace std;
+
+class AllocationCounter {    // Counts calls to the global operator new, which AllocationCounter.cpp replaces with versions that bump the count and then use malloc. Comparing the count between frames shows if the steady state still touches the heap.
+    public:
+    static size_t getCount();    // Allocations since the program started, from all threads.
+};
+
+#endif
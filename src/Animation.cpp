@@ -1,8 +1,119 @@
 #include "Animation.h"
+#include "BinaryModel.h"
+#include "CommonMath.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
 #include <iostream>
+#include <stdexcept>
+
+namespace {
+    constexpr float QUAT_COMPONENT_MAX = 0.70710678f;    // Largest magnitude of the three smallest components of a unit quaternion.
+    
+    template<typename T, typename Interpolate, typename Error>
+    vector<pair<T, double>> reduceKeys(const vector<pair<T, double>>& keys, float tolerance, Interpolate interpolate, Error error) {    // Greedily drops keys while interpolating across the gap stays within the tolerance for every dropped key.
+        bool constant = true;
+        for (const pair<T, double>& k : keys) {
+            if (error(k.first, keys[0].first) > tolerance) {
+                constant = false;
+                break;
+            }
+        }
+        if (constant) {
+            return vector<pair<T, double>>(keys.begin(), keys.begin() + 1);
+        }
+        
+        vector<pair<T, double>> result;
+        result.push_back(keys[0]);
+        size_t anchor = 0;
+        for (size_t i = 2; i < keys.size(); ++i) {
+            bool fits = true;
+            for (size_t j = anchor + 1; j < i && fits; ++j) {
+                float t = static_cast<float>((keys[j].second - keys[anchor].second) / (keys[i].second - keys[anchor].second));
+                fits = error(interpolate(keys[anchor].first, keys[i].first, t), keys[j].first) <= tolerance;
+            }
+            if (!fits) {
+                result.push_back(keys[i - 1]);
+                anchor = i - 1;
+            }
+        }
+        result.push_back(keys.back());
+        return result;
+    }
+    
+    void packQuat(glm::quat q, uint16_t* dest) {
+        q = glm::normalize(q);
+        int largest = 0;
+        for (int i = 1; i < 4; ++i) {
+            if (abs(q[i]) > abs(q[largest])) {
+                largest = i;
+            }
+        }
+        if (q[largest] < 0.0f) {    // The largest component is rebuilt as positive, q and -q are the same rotation.
+            q = -q;
+        }
+        uint64_t bits = static_cast<uint64_t>(largest) << 45;
+        int shift = 30;
+        for (int i = 0; i < 4; ++i) {
+            if (i != largest) {
+                float v = glm::clamp(q[i] / QUAT_COMPONENT_MAX, -1.0f, 1.0f);
+                bits |= static_cast<uint64_t>(lround((v * 0.5f + 0.5f) * 32767.0f)) << shift;
+                shift -= 15;
+            }
+        }
+        dest[0] = static_cast<uint16_t>(bits);
+        dest[1] = static_cast<uint16_t>(bits >> 16);
+        dest[2] = static_cast<uint16_t>(bits >> 32);
+    }
+    
+    glm::quat unpackQuat(const uint16_t* src) {
+        uint64_t bits = static_cast<uint64_t>(src[0]) | (static_cast<uint64_t>(src[1]) << 16) | (static_cast<uint64_t>(src[2]) << 32);
+        int largest = static_cast<int>((bits >> 45) & 3);
+        glm::quat q;
+        float sumSquares = 0.0f;
+        int shift = 30;
+        for (int i = 0; i < 4; ++i) {
+            if (i != largest) {
+                q[i] = (static_cast<float>((bits >> shift) & 0x7fff) / 32767.0f * 2.0f - 1.0f) * QUAT_COMPONENT_MAX;
+                sumSquares += q[i] * q[i];
+                shift -= 15;
+            }
+        }
+        q[largest] = sqrt(max(1.0f - sumSquares, 0.0f));
+        return q;
+    }
+    
+    glm::vec3 unpackVec3(const Animation::CompressedVec3Track& track, size_t index) {
+        const uint16_t* v = &track.values[index * 3];
+        return track.rangeMin + glm::vec3(v[0], v[1], v[2]) * (track.rangeExtent / 65535.0f);
+    }
+}
 
 void Animation::loadFile(const string& filename, unordered_map<string, Animation>* animations) {
+    uint64_t sourceHash = BinaryModel::hashSourceFile(filename);
+    string binaryFilename = BinaryModel::getFilename(filename);
+    MappedFile binaryFile(binaryFilename);
+    if (binaryFile.isOpen()) {
+        try {
+            BinaryModel::Reader reader(binaryFile.getData(), binaryFile.getSize());
+            if (BinaryModel::readHeader(reader, BinaryModel::AnimationSet, sourceHash)) {
+                vector<Animation> fileAnimations;
+                uint32_t numAnimations = reader.read<uint32_t>();
+                fileAnimations.reserve(numAnimations);
+                for (uint32_t i = 0; i < numAnimations; ++i) {
+                    fileAnimations.emplace_back(reader);
+                }
+                insertAll(move(fileAnimations), animations);
+                return;
+            }
+        } catch (runtime_error& ex) {
+            cout << "Warn: Preprocessed animations \"" << binaryFilename << "\" are damaged (" << ex.what() << "), loading the source file instead.\n";
+        }
+        binaryFile.close();    // Unmap before the file gets rewritten.
+    }
+    
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(filename, aiProcess_JoinIdenticalVertices | aiProcess_Triangulate);
     
@@ -11,24 +122,63 @@ void Animation::loadFile(const string& filename, unordered_map<string, Animation
         return;
     }
     
+    vector<Animation> fileAnimations = loadAllFromScene(scene);
+    BinaryModel::Writer writer(binaryFilename);
+    if (writer.isOpen()) {
+        BinaryModel::writeHeader(writer, BinaryModel::AnimationSet, sourceHash);
+        writer.write<uint32_t>(static_cast<uint32_t>(fileAnimations.size()));
+        for (const Animation& a : fileAnimations) {
+            a.saveBinary(writer);
+        }
+    } else {
+        cout << "Warn: Unable to write preprocessed animations \"" << binaryFilename << "\".\n";
+    }
+    insertAll(move(fileAnimations), animations);
+}
+
+vector<Animation> Animation::loadAllFromScene(const aiScene* scene) {
+    vector<Animation> animationList;
+    animationList.reserve(scene->mNumAnimations);
     for (unsigned int i = 0; i < scene->mNumAnimations; ++i) {    // Load all animations of the model.
-        auto insertResult = animations->insert({string(scene->mAnimations[i]->mName.C_Str()), Animation(scene, i)});
+        animationList.emplace_back(scene, i);
+    }
+    return animationList;
+}
+
+void Animation::insertAll(vector<Animation>&& animationList, unordered_map<string, Animation>* animations) {
+    for (Animation& a : animationList) {
+        string name = a.name_;
+        auto insertResult = animations->insert({name, move(a)});
         if (!insertResult.second) {
             cout << "Error: Found animation with the same name as an existing one.\n";
         }
     }
+    animationList.clear();
 }
 
-Animation::Animation(const string& name, double duration, double ticksPerSecond) : name_(name), duration_(duration), ticksPerSecond_(ticksPerSecond) {}
+uint64_t Animation::Id::next() {
+    static atomic<uint64_t> nextValue(1);
+    return nextValue.fetch_add(1, memory_order_relaxed);
+}
+
+Animation::Animation(const string& name, double duration, double ticksPerSecond) : name_(name), duration_(duration), ticksPerSecond_(ticksPerSecond), keyInterval_(0.0), compressed_(false) {}
 
 Animation::Animation(const aiScene* scene, unsigned int index) {
     loadFromScene(scene, index);
 }
 
+Animation::Animation(BinaryModel::Reader& reader) {
+    loadBinary(reader);
+}
+
 void Animation::loadFromScene(const aiScene* scene, unsigned int index) {
     name_ = string(scene->mAnimations[index]->mName.C_Str());
     duration_ = scene->mAnimations[index]->mDuration;
     ticksPerSecond_ = (scene->mAnimations[index]->mTicksPerSecond != 0.0 ? scene->mAnimations[index]->mTicksPerSecond : 20.0);
+    keyInterval_ = 0.0;
+    compressed_ = false;
+    channels_.clear();
+    id_.renew();
     
     //cout << "Loading animation " << name_ << " with duration " << duration_ << "s at " << ticksPerSecond_ << " TPS.\n";
     
@@ -63,48 +213,321 @@ void Animation::loadFromScene(const aiScene* scene, unsigned int index) {
     }
 }
 
-glm::mat4 Animation::calcChannelTransform(const Channel& channel, double animationTime) const {
-    glm::mat4 transform = glm::translate(glm::mat4(1.0f), interpolateVec3Keys(channel.translationKeys, animationTime));
-    transform *= glm::mat4_cast(interpolateQuatKeys(channel.rotationKeys, animationTime));
-    transform = glm::scale(transform, interpolateVec3Keys(channel.scalingKeys, animationTime));
+void Animation::loadBinary(BinaryModel::Reader& reader) {
+    name_ = reader.readString();
+    duration_ = reader.read<double>();
+    ticksPerSecond_ = reader.read<double>();
+    keyInterval_ = reader.read<double>();
+    compressed_ = (reader.read<uint8_t>() != 0);
+    uint32_t numChannels = reader.read<uint32_t>();
+    channels_.clear();
+    channels_.reserve(numChannels);
+    id_.renew();
+    for (uint32_t i = 0; i < numChannels; ++i) {
+        string channelName = reader.readString();
+        Channel& channel = channels_[channelName];
+        if (!compressed_) {
+            reader.readVector(channel.translationKeys);
+            reader.readVector(channel.rotationKeys);
+            reader.readVector(channel.scalingKeys);
+            continue;
+        }
+        for (CompressedVec3Track* track : {&channel.compressedTranslation, &channel.compressedScaling}) {
+            track->rangeMin = reader.read<glm::vec3>();
+            track->rangeExtent = reader.read<glm::vec3>();
+            reader.readVector(track->times);
+            reader.readVector(track->values);
+            if (track->values.size() != track->times.size() * 3) {
+                throw runtime_error("Compressed track size mismatch.");
+            }
+        }
+        reader.readVector(channel.compressedRotation.times);
+        reader.readVector(channel.compressedRotation.values);
+        if (channel.compressedRotation.values.size() != channel.compressedRotation.times.size() * 3) {
+            throw runtime_error("Compressed track size mismatch.");
+        }
+    }
+}
+
+void Animation::saveBinary(BinaryModel::Writer& writer) const {
+    writer.writeString(name_);
+    writer.write<double>(duration_);
+    writer.write<double>(ticksPerSecond_);
+    writer.write<double>(keyInterval_);
+    writer.write<uint8_t>(compressed_ ? 1 : 0);
+    writer.write<uint32_t>(static_cast<uint32_t>(channels_.size()));
+    for (const pair<const string, Channel>& channel : channels_) {
+        writer.writeString(channel.first);
+        if (!compressed_) {
+            writer.writeVector(channel.second.translationKeys);
+            writer.writeVector(channel.second.rotationKeys);
+            writer.writeVector(channel.second.scalingKeys);
+            continue;
+        }
+        for (const CompressedVec3Track* track : {&channel.second.compressedTranslation, &channel.second.compressedScaling}) {
+            writer.write<glm::vec3>(track->rangeMin);
+            writer.write<glm::vec3>(track->rangeExtent);
+            writer.writeVector(track->times);
+            writer.writeVector(track->values);
+        }
+        writer.writeVector(channel.second.compressedRotation.times);
+        writer.writeVector(channel.second.compressedRotation.values);
+    }
+}
+
+bool Animation::isCompressed() const {
+    return compressed_;
+}
+
+size_t Animation::getMemoryUsage() const {
+    size_t numBytes = 0;
+    for (const pair<const string, Channel>& channel : channels_) {
+        const Channel& c = channel.second;
+        numBytes += c.translationKeys.size() * sizeof(c.translationKeys[0]) + c.rotationKeys.size() * sizeof(c.rotationKeys[0]) + c.scalingKeys.size() * sizeof(c.scalingKeys[0]);
+        for (const CompressedVec3Track* track : {&c.compressedTranslation, &c.compressedScaling}) {
+            if (!track->times.empty()) {
+                numBytes += sizeof(track->rangeMin) + sizeof(track->rangeExtent) + (track->times.size() + track->values.size()) * sizeof(uint16_t);
+            }
+        }
+        numBytes += (c.compressedRotation.times.size() + c.compressedRotation.values.size()) * sizeof(uint16_t);
+    }
+    return numBytes;
+}
+
+void Animation::resampleUniform(double keyInterval) {
+    assert(keyInterval > 0.0);
+    if (compressed_) {
+        cout << "Warn: Unable to resample compressed animation \"" << name_ << "\".\n";
+        return;
+    }
+    unsigned int numKeys = static_cast<unsigned int>(ceil(duration_ / keyInterval)) + 1;    // Last key is at or past the end so every time in the animation has a next key.
+    keyInterval_ = 0.0;    // Sample the old keys with a search.
+    for (pair<const string, Channel>& channel : channels_) {
+        resampleKeys(channel.second.translationKeys, numKeys, keyInterval, &Animation::interpolateVec3Keys);
+        resampleKeys(channel.second.rotationKeys, numKeys, keyInterval, &Animation::interpolateQuatKeys);
+        resampleKeys(channel.second.scalingKeys, numKeys, keyInterval, &Animation::interpolateVec3Keys);
+    }
+    keyInterval_ = keyInterval;
+}
+
+void Animation::compress(float tolerance) {
+    if (compressed_) {
+        return;
+    }
+    size_t uncompressedSize = getMemoryUsage();
+    for (pair<const string, Channel>& channel : channels_) {
+        Channel& c = channel.second;
+        c.compressedTranslation = compressVec3Keys(c.translationKeys, tolerance);
+        c.compressedRotation = compressQuatKeys(c.rotationKeys, tolerance);
+        c.compressedScaling = compressVec3Keys(c.scalingKeys, tolerance);
+        vector<pair<glm::vec3, double>>().swap(c.translationKeys);
+        vector<pair<glm::quat, double>>().swap(c.rotationKeys);
+        vector<pair<glm::vec3, double>>().swap(c.scalingKeys);
+    }
+    keyInterval_ = 0.0;    // Dropped keys leave uneven spacing.
+    compressed_ = true;
+    if (VERBOSE_OUTPUT_ && uncompressedSize > 0) {
+        cout << "Animation \"" << name_ << "\" compressed from " << uncompressedSize << " to " << getMemoryUsage() << " bytes (" << 100.0 * getMemoryUsage() / uncompressedSize << "%).\n";
+    }
+}
+
+glm::mat4 Animation::calcChannelTransform(const Channel& channel, double animationTime, KeyCursor* cursor) const {
+    glm::vec3 translation(0.0f), scale(1.0f);
+    glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+    sampleChannel(channel, animationTime, cursor, &translation, &rotation, &scale);
     
-    return transform;
+    return CommonMath::composeTransform(translation, rotation, scale);
 }
 
-glm::vec3 Animation::interpolateVec3Keys(const vector<pair<glm::vec3, double>>& keys, double animationTime) const {
-    if (keys.size() == 1) {
-        return keys[0].first;
+void Animation::sampleChannel(const Channel& channel, double animationTime, KeyCursor* cursor, glm::vec3* translation, glm::quat* rotation, glm::vec3* scale) const {
+    if (compressed_) {
+        if (!channel.compressedTranslation.times.empty()) {
+            *translation = interpolateCompressedVec3(channel.compressedTranslation, animationTime, (cursor != nullptr ? &cursor->translationKey : nullptr));
+        }
+        if (!channel.compressedRotation.times.empty()) {
+            *rotation = interpolateCompressedQuat(channel.compressedRotation, animationTime, (cursor != nullptr ? &cursor->rotationKey : nullptr));
+        }
+        if (!channel.compressedScaling.times.empty()) {
+            *scale = interpolateCompressedVec3(channel.compressedScaling, animationTime, (cursor != nullptr ? &cursor->scalingKey : nullptr));
+        }
+        return;
+    }
+    if (!channel.translationKeys.empty()) {
+        *translation = interpolateVec3Keys(channel.translationKeys, animationTime, (cursor != nullptr ? &cursor->translationKey : nullptr));
+    }
+    if (!channel.rotationKeys.empty()) {
+        *rotation = interpolateQuatKeys(channel.rotationKeys, animationTime, (cursor != nullptr ? &cursor->rotationKey : nullptr));
     }
-    unsigned int i = 0;
-    while (i < keys.size() - 1) {
-        if (animationTime < keys[i + 1].second) {
-            break;
+    if (!channel.scalingKeys.empty()) {
+        *scale = interpolateVec3Keys(channel.scalingKeys, animationTime, (cursor != nullptr ? &cursor->scalingKey : nullptr));
+    }
+}
+
+template<typename T>
+unsigned int Animation::findKeyIndex(const vector<pair<T, double>>& keys, double animationTime, unsigned int* cursor) const {
+    unsigned int numKeys = static_cast<unsigned int>(keys.size());
+    if (keyInterval_ > 0.0) {    // Keys are evenly spaced and start at zero.
+        return min(static_cast<unsigned int>(max(animationTime, 0.0) / keyInterval_), numKeys - 2);
+    }
+    return findKeyIndex(numKeys, animationTime, cursor, [&keys](unsigned int i) {
+        return keys[i].second;
+    });
+}
+
+template<typename GetTime>
+unsigned int Animation::findKeyIndex(unsigned int numKeys, double animationTime, unsigned int* cursor, GetTime getTime) const {
+    unsigned int lastIndex = numKeys - 2;
+    if (cursor != nullptr) {    // Try moving the cursor forward first, this handles normal playback.
+        unsigned int i = min(*cursor, lastIndex);
+        if (getTime(i) <= animationTime || i == 0) {
+            for (unsigned int step = 0; step < MAX_CURSOR_STEPS && i < lastIndex && animationTime >= getTime(i + 1); ++step) {
+                ++i;
+            }
+            if (i == lastIndex || animationTime < getTime(i + 1)) {
+                *cursor = i;
+                return i;
+            }
         }
-        ++i;
     }
-    if (i >= keys.size() - 1) {
-        assert(false);
+    
+    unsigned int low = 1, high = numKeys - 1;    // Seeking or looping, find the first key after animationTime.
+    while (low < high) {
+        unsigned int middle = (low + high) / 2;
+        if (animationTime < getTime(middle)) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    unsigned int i = low - 1;
+    if (cursor != nullptr) {
+        *cursor = i;
+    }
+    return i;
+}
+
+template<typename T>
+void Animation::resampleKeys(vector<pair<T, double>>& keys, unsigned int numKeys, double keyInterval, T (Animation::*interpolate)(const vector<pair<T, double>>&, double, unsigned int*) const) const {
+    if (keys.size() <= 1) {
+        return;
     }
+    vector<pair<T, double>> resampledKeys;
+    resampledKeys.reserve(numKeys);
+    unsigned int cursor = 0;
+    for (unsigned int i = 0; i < numKeys; ++i) {
+        double keyTime = i * keyInterval;
+        resampledKeys.emplace_back((this->*interpolate)(keys, keyTime, &cursor), keyTime);
+    }
+    keys = move(resampledKeys);
+}
+
+glm::vec3 Animation::interpolateVec3Keys(const vector<pair<glm::vec3, double>>& keys, double animationTime, unsigned int* cursor) const {
+    if (keys.size() == 1) {
+        return keys[0].first;
+    }
+    unsigned int i = findKeyIndex(keys, animationTime, cursor);
     
     float t = static_cast<float>((animationTime - keys[i].second) / (keys[i + 1].second - keys[i].second));
-    return glm::mix(keys[i].first, keys[i + 1].first, t);
+    return glm::mix(keys[i].first, keys[i + 1].first, glm::clamp(t, 0.0f, 1.0f));
 }
 
-glm::quat Animation::interpolateQuatKeys(const vector<pair<glm::quat, double>>& keys, double animationTime) const {
+glm::quat Animation::interpolateQuatKeys(const vector<pair<glm::quat, double>>& keys, double animationTime, unsigned int* cursor) const {
     if (keys.size() == 1) {
         return keys[0].first;
     }
-    unsigned int i = 0;
-    while (i < keys.size() - 1) {
-        if (animationTime < keys[i + 1].second) {
-            break;
+    unsigned int i = findKeyIndex(keys, animationTime, cursor);
+    
+    float t = static_cast<float>((animationTime - keys[i].second) / (keys[i + 1].second - keys[i].second));
+    return glm::slerp(keys[i].first, keys[i + 1].first, glm::clamp(t, 0.0f, 1.0f));
+}
+
+glm::vec3 Animation::interpolateCompressedVec3(const CompressedVec3Track& track, double animationTime, unsigned int* cursor) const {
+    unsigned int numKeys = static_cast<unsigned int>(track.times.size());
+    if (numKeys == 1) {
+        return unpackVec3(track, 0);
+    }
+    unsigned int i = findKeyIndex(numKeys, animationTime, cursor, [this, &track](unsigned int k) {
+        return dequantizeTime(track.times[k]);
+    });
+    
+    double startTime = dequantizeTime(track.times[i]), endTime = dequantizeTime(track.times[i + 1]);
+    float t = (endTime > startTime ? static_cast<float>((animationTime - startTime) / (endTime - startTime)) : 0.0f);
+    return glm::mix(unpackVec3(track, i), unpackVec3(track, i + 1), glm::clamp(t, 0.0f, 1.0f));
+}
+
+glm::quat Animation::interpolateCompressedQuat(const CompressedQuatTrack& track, double animationTime, unsigned int* cursor) const {
+    unsigned int numKeys = static_cast<unsigned int>(track.times.size());
+    if (numKeys == 1) {
+        return unpackQuat(&track.values[0]);
+    }
+    unsigned int i = findKeyIndex(numKeys, animationTime, cursor, [this, &track](unsigned int k) {
+        return dequantizeTime(track.times[k]);
+    });
+    
+    double startTime = dequantizeTime(track.times[i]), endTime = dequantizeTime(track.times[i + 1]);
+    float t = (endTime > startTime ? static_cast<float>((animationTime - startTime) / (endTime - startTime)) : 0.0f);
+    return glm::slerp(unpackQuat(&track.values[i * 3]), unpackQuat(&track.values[(i + 1) * 3]), glm::clamp(t, 0.0f, 1.0f));
+}
+
+uint16_t Animation::quantizeTime(double time) const {
+    if (duration_ <= 0.0) {
+        return 0;
+    }
+    return static_cast<uint16_t>(lround(glm::clamp(time / duration_, 0.0, 1.0) * 65535.0));
+}
+
+double Animation::dequantizeTime(uint16_t time) const {
+    return time / 65535.0 * duration_;
+}
+
+Animation::CompressedVec3Track Animation::compressVec3Keys(const vector<pair<glm::vec3, double>>& keys, float tolerance) const {
+    CompressedVec3Track track;
+    track.rangeMin = glm::vec3(0.0f);
+    track.rangeExtent = glm::vec3(0.0f);
+    if (keys.empty()) {
+        return track;
+    }
+    vector<pair<glm::vec3, double>> reducedKeys = reduceKeys(keys, tolerance, [](const glm::vec3& a, const glm::vec3& b, float t) {
+        return glm::mix(a, b, t);
+    }, [](const glm::vec3& a, const glm::vec3& b) {
+        return glm::distance(a, b);
+    });
+    
+    glm::vec3 rangeMax = reducedKeys[0].first;
+    track.rangeMin = reducedKeys[0].first;
+    for (const pair<glm::vec3, double>& k : reducedKeys) {
+        track.rangeMin = glm::min(track.rangeMin, k.first);
+        rangeMax = glm::max(rangeMax, k.first);
+    }
+    track.rangeExtent = rangeMax - track.rangeMin;
+    track.times.reserve(reducedKeys.size());
+    track.values.reserve(reducedKeys.size() * 3);
+    for (const pair<glm::vec3, double>& k : reducedKeys) {
+        track.times.push_back(quantizeTime(k.second));
+        for (int i = 0; i < 3; ++i) {
+            float v = (track.rangeExtent[i] > 0.0f ? (k.first[i] - track.rangeMin[i]) / track.rangeExtent[i] : 0.0f);
+            track.values.push_back(static_cast<uint16_t>(lround(glm::clamp(v, 0.0f, 1.0f) * 65535.0f)));
         }
-        ++i;
     }
-    if (i >= keys.size() - 1) {
-        assert(false);
+    return track;
+}
+
+Animation::CompressedQuatTrack Animation::compressQuatKeys(const vector<pair<glm::quat, double>>& keys, float tolerance) const {
+    CompressedQuatTrack track;
+    if (keys.empty()) {
+        return track;
     }
+    vector<pair<glm::quat, double>> reducedKeys = reduceKeys(keys, tolerance, [](const glm::quat& a, const glm::quat& b, float t) {
+        return glm::slerp(a, b, t);
+    }, [](const glm::quat& a, const glm::quat& b) {
+        return 2.0f * acos(min(abs(glm::dot(glm::normalize(a), glm::normalize(b))), 1.0f));    // Angle between the rotations.
+    });
     
-    float t = static_cast<float>((animationTime - keys[i].second) / (keys[i + 1].second - keys[i].second));
-    return glm::slerp(keys[i].first, keys[i + 1].first, t);
+    track.times.reserve(reducedKeys.size());
+    track.values.resize(reducedKeys.size() * 3);
+    for (size_t i = 0; i < reducedKeys.size(); ++i) {
+        track.times.push_back(quantizeTime(reducedKeys[i].second));
+        packQuat(reducedKeys[i].first, &track.values[i * 3]);
+    }
+    return track;
 }
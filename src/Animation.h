@@ -1,12 +1,19 @@
 #ifndef ANIMATION_H_
 #define ANIMATION_H_
 
+namespace BinaryModel {
+    class Reader;
+    class Writer;
+}
+
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <glm/gtc/quaternion.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -16,21 +23,74 @@ using namespace std;
 
 class Animation {
     public:
+    class Id {    // Different for each Animation object, a copy or assignment takes a new one. Bindings are cached by address, and a destroyed animation can leave its address to a new one.
+        public:
+        Id() : value_(next()) {}
+        Id(const Id& /*id*/) : value_(next()) {}
+        Id& operator=(const Id& /*id*/) {
+            value_ = next();
+            return *this;
+        }
+        uint64_t get() const {
+            return value_;
+        }
+        void renew() {    // Called when the channels are replaced.
+            value_ = next();
+        }
+        
+        private:
+        uint64_t value_;
+        
+        static uint64_t next();
+    };
+    struct CompressedVec3Track {    // Each component is quantized to 16 bits within the range of the track. Times are quantized to 16 bits over the animation duration.
+        glm::vec3 rangeMin, rangeExtent;
+        vector<uint16_t> times;
+        vector<uint16_t> values;    // Three per key.
+    };
+    struct CompressedQuatTrack {    // Smallest-three encoding, the index of the dropped component and the other three at 15 bits each are packed into 48 bits.
+        vector<uint16_t> times;
+        vector<uint16_t> values;    // Three per key.
+    };
     struct Channel {
-        vector<pair<glm::vec3, double>> translationKeys;
+        vector<pair<glm::vec3, double>> translationKeys;    // The uncompressed keys are cleared by compress().
         vector<pair<glm::quat, double>> rotationKeys;
         vector<pair<glm::vec3, double>> scalingKeys;
+        CompressedVec3Track compressedTranslation;
+        CompressedQuatTrack compressedRotation;
+        CompressedVec3Track compressedScaling;
+    };
+    struct KeyCursor {    // Last key used for each key type in a channel. Keeping one per channel for each playback makes lookups constant time while the time moves forward.
+        unsigned int translationKey, rotationKey, scalingKey;
+        
+        KeyCursor() : translationKey(0), rotationKey(0), scalingKey(0) {}
     };
     
+    static constexpr bool VERBOSE_OUTPUT_ = false;
+    static constexpr unsigned int MAX_CURSOR_STEPS = 4;    // Keys the cursor can move forward before falling back to a binary search.
+    static constexpr float DEFAULT_COMPRESSION_TOLERANCE = 0.0005f;
     unordered_map<string, Channel> channels_;
     string name_;
     double duration_, ticksPerSecond_;
+    Id id_;
+    double keyInterval_;    // Time between keys after resampleUniform(), or zero if the keys can be spaced unevenly.
+    bool compressed_;
     
-    static void loadFile(const string& filename, unordered_map<string, Animation>* animations);
+    static void loadFile(const string& filename, unordered_map<string, Animation>* animations);    // Loads the animations from a preprocessed file if it is up to date, otherwise assimp is used and the preprocessed file is written.
+    static vector<Animation> loadAllFromScene(const aiScene* scene);
+    static void insertAll(vector<Animation>&& animationList, unordered_map<string, Animation>* animations);    // Moves the animations into the map by name, duplicate names are reported and skipped.
     Animation(const string& name, double duration, double ticksPerSecond);
     Animation(const aiScene* scene, unsigned int index);
+    Animation(BinaryModel::Reader& reader);
     void loadFromScene(const aiScene* scene, unsigned int index);
-    glm::mat4 calcChannelTransform(const Channel& channel, double animationTime) const;
+    void loadBinary(BinaryModel::Reader& reader);
+    void saveBinary(BinaryModel::Writer& writer) const;
+    bool isCompressed() const;
+    size_t getMemoryUsage() const;    // Bytes used by the keys of all channels.
+    void resampleUniform(double keyInterval);    // Opt-in for clips played by many instances. Replaces the keys with ones spaced keyInterval ticks apart, so finding a key becomes a division and needs no cursor. Channels with a single key are left as-is, and compress() undoes the even spacing.
+    void compress(float tolerance = DEFAULT_COMPRESSION_TOLERANCE);    // Drops keys that can be interpolated from their neighbors within the tolerance (in model units for translation and scale, radians for rotation), then quantizes the rest. This can't be undone.
+    glm::mat4 calcChannelTransform(const Channel& channel, double animationTime, KeyCursor* cursor = nullptr) const;    // The cursor is optional, it only speeds up finding the keys.
+    void sampleChannel(const Channel& channel, double animationTime, KeyCursor* cursor, glm::vec3* translation, glm::quat* rotation, glm::vec3* scale) const;    // Same as calcChannelTransform() but keeps the components separate. Components without keys are left unchanged.
     
     private:
     static inline glm::vec3 castVec3(const aiVector3D& v) { return glm::vec3(v.x, v.y, v.z); }
@@ -38,8 +98,20 @@ class Animation {
     static inline glm::quat castQuat(const aiQuaternion& q) { return glm::quat(q.w, q.x, q.y, q.z); }
     static inline glm::mat4 castMat4(const aiMatrix4x4& m) { return glm::transpose(glm::make_mat4(&m.a1)); }
     static inline glm::mat3 castMat3(const aiMatrix3x3& m) { return glm::transpose(glm::make_mat3(&m.a1)); }
-    glm::vec3 interpolateVec3Keys(const vector<pair<glm::vec3, double>>& keys, double animationTime) const;
-    glm::quat interpolateQuatKeys(const vector<pair<glm::quat, double>>& keys, double animationTime) const;
+    template<typename T>
+    unsigned int findKeyIndex(const vector<pair<T, double>>& keys, double animationTime, unsigned int* cursor) const;    // Returns the index of the key at or before animationTime, clamped so that the next key always exists.
+    template<typename GetTime>
+    unsigned int findKeyIndex(unsigned int numKeys, double animationTime, unsigned int* cursor, GetTime getTime) const;
+    template<typename T>
+    void resampleKeys(vector<pair<T, double>>& keys, unsigned int numKeys, double keyInterval, T (Animation::*interpolate)(const vector<pair<T, double>>&, double, unsigned int*) const) const;
+    glm::vec3 interpolateVec3Keys(const vector<pair<glm::vec3, double>>& keys, double animationTime, unsigned int* cursor) const;
+    glm::quat interpolateQuatKeys(const vector<pair<glm::quat, double>>& keys, double animationTime, unsigned int* cursor) const;
+    glm::vec3 interpolateCompressedVec3(const CompressedVec3Track& track, double animationTime, unsigned int* cursor) const;
+    glm::quat interpolateCompressedQuat(const CompressedQuatTrack& track, double animationTime, unsigned int* cursor) const;
+    uint16_t quantizeTime(double time) const;
+    double dequantizeTime(uint16_t time) const;
+    CompressedVec3Track compressVec3Keys(const vector<pair<glm::vec3, double>>& keys, float tolerance) const;
+    CompressedQuatTrack compressQuatKeys(const vector<pair<glm::quat, double>>& keys, float tolerance) const;
 };
 
 #endif
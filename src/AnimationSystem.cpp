@@ -0,0 +1,188 @@
+#include "AnimationSystem.h"
+#include "Animator.h"
+#include "BonePaletteBuffer.h"
+#include "Ragdoll.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+AnimationSystem::AnimationSystem(ThreadPool* threadPool) :
+    threadPool_(threadPool),
+    physics_(threadPool),
+    numRagdolls_(0),
+    frontBuffer_(0),
+    deltaTime_(0.0) {
+}
+
+AnimationSystem::~AnimationSystem() {
+    wait();
+}
+
+unsigned int AnimationSystem::addInstance(const ModelRigged& model, const Animation& animation, const map<int, ModelRigged::DynamicBone>* dynamicBones) {
+    return addInstance(model, &animation, nullptr, dynamicBones);
+}
+
+unsigned int AnimationSystem::addInstance(const ModelRigged& model, Animator* animator, const map<int, ModelRigged::DynamicBone>* dynamicBones) {
+    return addInstance(model, nullptr, animator, dynamicBones);
+}
+
+size_t AnimationSystem::getNumInstances() const {
+    return instances_.size();
+}
+
+void AnimationSystem::setModelMtx(unsigned int instance, const glm::mat4& modelMtx) {
+    instances_[instance].nextModelMtx = modelMtx;
+}
+
+void AnimationSystem::setRagdoll(unsigned int instance, Ragdoll* ragdoll) {
+    numRagdolls_ += (ragdoll != nullptr ? 1 : 0) - (instances_[instance].ragdoll != nullptr ? 1 : 0);
+    instances_[instance].ragdoll = ragdoll;
+}
+
+PositionBasedSolver& AnimationSystem::getPhysics() {
+    return physics_;
+}
+
+void AnimationSystem::setPreSkinning(const ModelRigged& model, bool enable) {
+    getModelGroup(model).preSkinned = enable;
+}
+
+const vector<glm::mat4>& AnimationSystem::getBoneTransforms(unsigned int instance) const {
+    return instances_[instance].boneTransforms[frontBuffer_];
+}
+
+void AnimationSystem::update(double deltaTime) {
+    wait();
+    frontBuffer_ ^= 1;
+    for (Instance& instance : instances_) {
+        instance.modelMtx = instance.nextModelMtx;
+    }
+    deltaTime_ = deltaTime;
+    if (dynamicBoneSolver_.getNumBones() == 0 && numRagdolls_ == 0) {
+        threadPool_->parallelFor(taskGroup_, instances_.size(), INSTANCES_PER_TASK, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                evaluateInstance(instances_[i]);
+            }
+        });
+    } else {
+        if (dynamicBoneSolver_.getNumBones() > 0) {
+            dynamicBoneSolver_.beginFrame(deltaTime);
+        }
+        threadPool_->submit(taskGroup_, [this] {
+            evaluateInstances();
+        });
+    }
+}
+
+void AnimationSystem::wait() {
+    threadPool_->wait(taskGroup_);
+}
+
+void AnimationSystem::writePalettes(BonePaletteBuffer& buffer, bool allowPreSkinning) {
+    paletteBatches_.clear();
+    for (const ModelGroup& group : modelGroups_) {
+        if (group.instances.empty()) {
+            continue;
+        }
+        PaletteBatch batch = {group.model, 0, buffer.getPaletteSize(static_cast<unsigned int>(group.model->boneOffsetMatrices_.size())), static_cast<unsigned int>(group.instances.size()), group.preSkinned && allowPreSkinning};
+        for (size_t i = 0; i < group.instances.size(); ++i) {
+            const Instance& instance = instances_[group.instances[i]];
+            unsigned int offset = buffer.addPalette(instance.modelMtx, instance.boneTransforms[frontBuffer_]);
+            if (i == 0) {
+                batch.paletteOffset = offset;
+            }
+        }
+        paletteBatches_.push_back(batch);
+    }
+}
+
+const vector<AnimationSystem::PaletteBatch>& AnimationSystem::getPaletteBatches() const {
+    return paletteBatches_;
+}
+
+unsigned int AnimationSystem::addInstance(const ModelRigged& model, const Animation* animation, Animator* animator, const map<int, ModelRigged::DynamicBone>* dynamicBones) {
+    wait();    // The instances can move when the vector grows.
+    assert(model.boneOffsetMatrices_.size() <= ModelRigged::MAX_NUM_BONES);
+    instances_.emplace_back();
+    Instance& instance = instances_.back();
+    instance.model = &model;
+    instance.animation = animation;
+    instance.animator = animator;
+    instance.ragdoll = nullptr;
+    instance.dynamicCharacter = (dynamicBones != nullptr ? static_cast<int>(dynamicBoneSolver_.addCharacter(model, *dynamicBones)) : -1);
+    instance.time = 0.0;
+    instance.modelMtx = glm::mat4(1.0f);
+    instance.nextModelMtx = glm::mat4(1.0f);
+    for (vector<glm::mat4>& boneTransforms : instance.boneTransforms) {
+        boneTransforms.resize(model.boneOffsetMatrices_.size(), glm::mat4(1.0f));
+    }
+    unsigned int instanceIndex = static_cast<unsigned int>(instances_.size() - 1);
+    getModelGroup(model).instances.push_back(instanceIndex);
+    return instanceIndex;
+}
+
+AnimationSystem::ModelGroup& AnimationSystem::getModelGroup(const ModelRigged& model) {
+    auto findResult = find_if(modelGroups_.begin(), modelGroups_.end(), [&model](const ModelGroup& g) { return g.model == &model; });
+    if (findResult != modelGroups_.end()) {
+        return *findResult;
+    }
+    modelGroups_.push_back({&model, false, vector<unsigned int>()});
+    return modelGroups_.back();
+}
+
+void AnimationSystem::evaluateInstances() {
+    threadPool_->parallelFor(stageGroup_, instances_.size(), INSTANCES_PER_TASK, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            evaluateInstance(instances_[i]);
+        }
+    });
+    threadPool_->wait(stageGroup_);
+    for (unsigned int level = 0; level < dynamicBoneSolver_.getNumLevels(); ++level) {    // Each level only depends on the transforms above it, so all characters step it together.
+        threadPool_->parallelFor(stageGroup_, dynamicBoneSolver_.getNumBlocks(level), DYNAMIC_BONE_BLOCKS_PER_TASK, [this, level](size_t begin, size_t end) {
+            dynamicBoneSolver_.solveLevel(level, begin, end);
+        });
+        threadPool_->wait(stageGroup_);
+        threadPool_->parallelFor(stageGroup_, dynamicBoneSolver_.getNumCharacters(), INSTANCES_PER_TASK, [this, level](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                dynamicBoneSolver_.concatenateStage(static_cast<unsigned int>(i), level + 1);
+            }
+        });
+        threadPool_->wait(stageGroup_);
+    }
+    if (numRagdolls_ > 0) {    // The solver splits each step across the workers on its own.
+        physics_.step(deltaTime_);
+        threadPool_->parallelFor(stageGroup_, instances_.size(), INSTANCES_PER_TASK, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                Instance& instance = instances_[i];
+                if (instance.ragdoll != nullptr) {
+                    instance.ragdoll->getBoneTransforms(instance.boneTransforms[frontBuffer_ ^ 1]);
+                }
+            }
+        });
+        threadPool_->wait(stageGroup_);
+    }
+}
+
+void AnimationSystem::evaluateInstance(Instance& instance) {
+    static thread_local ModelRigged::LocalPose clipPose;    // Reused between calls to avoid allocating each frame.
+    const ModelRigged::LocalPose* pose;
+    if (instance.animator != nullptr) {
+        instance.animator->update(deltaTime_);
+        pose = &instance.animator->evaluate();
+    } else {
+        const Animation& animation = *instance.animation;
+        instance.time += deltaTime_;
+        double animationTime = fmod(instance.time * animation.ticksPerSecond_, animation.duration_);
+        instance.model->sampleAnimation(animation, animationTime, clipPose, &instance.keyCursors);
+        pose = &clipPose;
+    }
+    
+    vector<glm::mat4>& boneTransforms = instance.boneTransforms[frontBuffer_ ^ 1];
+    if (instance.dynamicCharacter != -1) {
+        dynamicBoneSolver_.beginCharacter(static_cast<unsigned int>(instance.dynamicCharacter), *pose, instance.modelMtx, boneTransforms);
+    } else if (instance.ragdoll != nullptr) {
+        instance.ragdoll->setPose(*pose, instance.modelMtx);    // Only touches the particles of this ragdoll, so the instances can still run in parallel.
+    } else {
+        instance.model->applyPose(*pose, boneTransforms);
+    }
+}
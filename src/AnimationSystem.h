@@ -0,0 +1,83 @@
+#ifndef ANIMATION_SYSTEM_H_
+#define ANIMATION_SYSTEM_H_
+
+class Animator;
+class BonePaletteBuffer;
+class Ragdoll;
+
+#include "Animation.h"
+#include "DynamicBoneSolver.h"
+#include "ModelRigged.h"
+#include "PositionBasedSolver.h"
+#include "ThreadPool.h"
+#include <glm/glm.hpp>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+class AnimationSystem {    // Evaluates the bone transforms for many rigged model instances on a thread pool. The results are double-buffered, one update runs in the background while rendering reads the transforms from the one before it.
+    public:
+    struct PaletteBatch {    // Instances of one model with palettes next to each other in the BonePaletteBuffer.
+        const ModelRigged* model;
+        unsigned int paletteOffset, paletteStride, count;    // Offset and stride are in texels.
+        bool preSkinned;    // Skinned once per frame by PreSkinning instead of in every pass.
+    };
+    
+    static constexpr size_t INSTANCES_PER_TASK = 4;
+    static constexpr size_t DYNAMIC_BONE_BLOCKS_PER_TASK = 64;
+    
+    AnimationSystem(ThreadPool* threadPool);
+    ~AnimationSystem();    // Waits for the update in progress.
+    AnimationSystem(const AnimationSystem& system) = delete;
+    AnimationSystem& operator=(const AnimationSystem& system) = delete;
+    unsigned int addInstance(const ModelRigged& model, const Animation& animation, const map<int, ModelRigged::DynamicBone>* dynamicBones = nullptr);    // Plays the animation on a loop. Dynamic bones are optional, they get copied into a DynamicBoneSolver shared by all instances.
+    unsigned int addInstance(const ModelRigged& model, Animator* animator, const map<int, ModelRigged::DynamicBone>* dynamicBones = nullptr);    // The animator is updated and evaluated on a worker thread, so it should only be changed after wait().
+    size_t getNumInstances() const;
+    void setModelMtx(unsigned int instance, const glm::mat4& modelMtx);    // Used by the dynamic bones and ragdolls, takes effect on the next update.
+    void setRagdoll(unsigned int instance, Ragdoll* ragdoll);    // The ragdoll gets the pose of the instance and replaces its bone transforms after the physics step. It must use getPhysics() for the solver, and like the animator it's only changed after wait().
+    PositionBasedSolver& getPhysics();    // Shared by all ragdolls and stepped on the thread pool during the update, so particles and constraints can only be added after wait().
+    void setPreSkinning(const ModelRigged& model, bool enable);    // Picks whether the instances of a model get skinned once per frame with transform feedback (see PreSkinning). Helps models drawn in many passes, like shadow casters.
+    const vector<glm::mat4>& getBoneTransforms(unsigned int instance) const;    // Results from the last finished update, these don't change while the next one runs.
+    void update(double deltaTime);    // Finishes the update in progress and swaps the results, then starts the next one in the background. Must be called from a single thread.
+    void wait();    // Blocks until the update in progress is done.
+    void writePalettes(BonePaletteBuffer& buffer, bool allowPreSkinning = true);    // Adds the current bone transforms of each instance grouped by model, then the buffer can be uploaded once for all passes. Without allowPreSkinning, no batch is marked as pre-skinned.
+    const vector<PaletteBatch>& getPaletteBatches() const;    // Set by writePalettes(), these can be drawn with ModelRigged::drawPalettes().
+    
+    private:
+    struct Instance {
+        const ModelRigged* model;
+        const Animation* animation;    // Only used when there is no animator.
+        Animator* animator;
+        Ragdoll* ragdoll;
+        int dynamicCharacter;    // Index in the dynamicBoneSolver_, or -1 if the instance has no dynamic bones.
+        double time;    // Playback time in seconds for the animation.
+        vector<Animation::KeyCursor> keyCursors;
+        glm::mat4 modelMtx, nextModelMtx;    // The workers only read modelMtx, setModelMtx() writes to the other one.
+        vector<glm::mat4> boneTransforms[2];
+    };
+    struct ModelGroup {
+        const ModelRigged* model;
+        bool preSkinned;
+        vector<unsigned int> instances;
+    };
+    
+    ThreadPool* threadPool_;
+    ThreadPool::TaskGroup taskGroup_;
+    ThreadPool::TaskGroup stageGroup_;    // Used inside the update when the dynamic bones split it into stages.
+    DynamicBoneSolver dynamicBoneSolver_;
+    PositionBasedSolver physics_;
+    size_t numRagdolls_;
+    vector<Instance> instances_;
+    vector<ModelGroup> modelGroups_;    // Instance indices for each model, in the order the models were first added.
+    vector<PaletteBatch> paletteBatches_;
+    unsigned int frontBuffer_;
+    double deltaTime_;
+    
+    unsigned int addInstance(const ModelRigged& model, const Animation* animation, Animator* animator, const map<int, ModelRigged::DynamicBone>* dynamicBones);
+    ModelGroup& getModelGroup(const ModelRigged& model);    // Adds the group if the model hasn't been seen before.
+    void evaluateInstances();    // Runs on a worker thread. Goes through the stages of the dynamic bones one after another, each one split across the workers, then steps the physics for the ragdolls.
+    void evaluateInstance(Instance& instance);    // Runs on a worker thread. Instances with dynamic bones or a ragdoll only get the transforms that don't depend on them, the rest are set by the later stages.
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include "Animation.h"
+#include "AnimationTexture.h"
+#include "ModelRigged.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+
+AnimationTexture::AnimationTexture(const ModelRigged& model, float sampleRate) :
+    model_(&model),
+    sampleRate_(sampleRate),
+    numBones_(static_cast<unsigned int>(model.boneOffsetMatrices_.size())) {
+    
+    glGenTextures(1, &textureHandle_);
+    glBindTexture(GL_TEXTURE_2D, textureHandle_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);    // Only read with texelFetch(), the shader blends between frames itself.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+AnimationTexture::~AnimationTexture() {
+    glDeleteTextures(1, &textureHandle_);
+}
+
+unsigned int AnimationTexture::addClip(const Animation& animation) {
+    assert(animation.ticksPerSecond_ > 0.0);
+    double duration = animation.duration_ / animation.ticksPerSecond_;    // In seconds.
+    unsigned int numIntervals = max(static_cast<unsigned int>(ceil(duration * sampleRate_)), 1u);
+    Clip clip;
+    clip.firstFrame = getNumFrames();
+    clip.numFrames = numIntervals + 1;
+    clip.framesPerSecond = static_cast<float>(duration > 0.0 ? numIntervals / duration : sampleRate_);
+    
+    vector<glm::mat4> boneTransforms(numBones_);
+    vector<Animation::KeyCursor> keyCursors;
+    texels_.reserve(texels_.size() + static_cast<size_t>(clip.numFrames) * numBones_ * 3);
+    for (unsigned int i = 0; i < clip.numFrames; ++i) {    // The last frame lands on the end of the clip, which animate() wraps back to the start.
+        model_->animate(animation, i / static_cast<double>(clip.framesPerSecond), boneTransforms, &keyCursors);
+        for (const glm::mat4& boneTransform : boneTransforms) {
+            glm::mat4 rows = glm::transpose(boneTransform);
+            texels_.push_back(rows[0]);
+            texels_.push_back(rows[1]);
+            texels_.push_back(rows[2]);
+        }
+    }
+    clips_.push_back(clip);
+    return static_cast<unsigned int>(clips_.size() - 1);
+}
+
+const AnimationTexture::Clip& AnimationTexture::getClip(unsigned int clip) const {
+    return clips_[clip];
+}
+
+size_t AnimationTexture::getNumClips() const {
+    return clips_.size();
+}
+
+unsigned int AnimationTexture::getNumFrames() const {
+    return (numBones_ == 0 ? 0 : static_cast<unsigned int>(texels_.size() / (numBones_ * 3)));
+}
+
+size_t AnimationTexture::getMemoryUsage() const {
+    return texels_.size() * sizeof(glm::vec4);
+}
+
+void AnimationTexture::upload() {
+    int maxTextureSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    if (getNumFrames() > static_cast<unsigned int>(maxTextureSize)) {
+        cout << "Warn: Animation texture has " << getNumFrames() << " frames but textures can only be " << maxTextureSize << " texels high, use a lower sample rate or fewer clips.\n";
+    }
+    glBindTexture(GL_TEXTURE_2D, textureHandle_);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, numBones_ * 3, getNumFrames(), 0, GL_RGBA, GL_FLOAT, texels_.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void AnimationTexture::bind(unsigned int textureUnit) const {
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D, textureHandle_);
+}
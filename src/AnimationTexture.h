@@ -0,0 +1,42 @@
+#ifndef ANIMATION_TEXTURE_H_
+#define ANIMATION_TEXTURE_H_
+
+class Animation;
+class ModelRigged;
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+
+using namespace std;
+
+class AnimationTexture {    // Animations of a rigged model baked into a texture at a fixed sample rate. Each row is one frame of bone transforms, stored as the top 3 rows of each matrix, so the vertex shader can skin without evaluating the skeleton (see Crowd).
+    public:
+    struct Clip {
+        unsigned int firstFrame, numFrames;    // Rows in the texture. The last frame is the same pose as the first, so looping playback wraps at numFrames - 1.
+        float framesPerSecond;    // Close to the sample rate, but adjusted so the frames evenly divide the clip.
+    };
+    
+    AnimationTexture(const ModelRigged& model, float sampleRate = 30.0f);
+    ~AnimationTexture();
+    AnimationTexture(const AnimationTexture& texture) = delete;
+    AnimationTexture& operator=(const AnimationTexture& texture) = delete;
+    unsigned int addClip(const Animation& animation);    // Samples the animation with ModelRigged::animate() and returns the clip index. Call upload() once all clips are added.
+    const Clip& getClip(unsigned int clip) const;
+    size_t getNumClips() const;
+    unsigned int getNumFrames() const;    // Total for all clips.
+    size_t getMemoryUsage() const;    // Bytes used by the texture.
+    void upload();
+    void bind(unsigned int textureUnit) const;
+    
+    private:
+    const ModelRigged* model_;
+    float sampleRate_;
+    unsigned int numBones_;
+    vector<Clip> clips_;
+    vector<glm::vec4> texels_;    // Kept so more clips can be added later.
+    unsigned int textureHandle_;
+};
+
+#endif
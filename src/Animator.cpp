@@ -0,0 +1,169 @@
+#include "Animator.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+Animator::Animator(const ModelRigged& model) :
+    model_(model),
+    posePool_(model.getNumNodes()) {
+    
+    current_.state = -1;
+    current_.time = 0.0;
+    previous_.state = -1;
+    previous_.time = 0.0;
+    result_ = posePool_.acquire();
+    *result_ = model_.getBindPose();
+    frozenPose_ = posePool_.acquire();
+    fadeFromFrozen_ = false;
+    fadeDuration_ = 0.0f;
+    fadeTime_ = 0.0f;
+}
+
+Animator::~Animator() {
+    for (Layer& l : layers_) {
+        if (l.referencePose != nullptr) {
+            posePool_.release(l.referencePose);
+        }
+    }
+    posePool_.release(frozenPose_);
+    posePool_.release(result_);
+}
+
+void Animator::addState(const string& name, const Animation& animation, bool loop, float speed) {
+    if (findState(name) != -1) {
+        cout << "Error: Animator already has a state named \"" << name << "\".\n";
+        return;
+    }
+    stateIndices_[name] = static_cast<unsigned int>(states_.size());
+    states_.push_back({name, &animation, loop, speed, -1, 0.0f});
+}
+
+void Animator::addTransition(const string& fromState, const string& toState, float fadeDuration) {
+    int fromIndex = findState(fromState), toIndex = findState(toState);
+    if (fromIndex == -1 || toIndex == -1) {
+        cout << "Error: Unable to add transition from \"" << fromState << "\" to \"" << toState << "\".\n";
+        return;
+    }
+    states_[fromIndex].transitionState = toIndex;
+    states_[fromIndex].transitionFadeDuration = fadeDuration;
+}
+
+void Animator::setState(const string& name, float fadeDuration) {
+    int stateIndex = findState(name);
+    if (stateIndex == -1) {
+        cout << "Error: Unable to find animator state \"" << name << "\".\n";
+        return;
+    }
+    
+    if (current_.state == -1 || fadeDuration <= 0.0f) {
+        fadeDuration_ = 0.0f;
+        previous_.state = -1;
+    } else {
+        if (fadeTime_ < fadeDuration_) {    // Already fading, continue from the pose on screen instead of popping to one of the states.
+            *frozenPose_ = *result_;
+            fadeFromFrozen_ = true;
+            previous_.state = -1;
+        } else {
+            fadeFromFrozen_ = false;
+            swap(previous_, current_);    // Swapping keeps the key cursor buffers, so nothing gets allocated.
+        }
+        fadeDuration_ = fadeDuration;
+    }
+    fadeTime_ = 0.0f;
+    current_.state = stateIndex;
+    current_.time = 0.0;
+}
+
+const string& Animator::getState() const {
+    static const string noState;
+    return (current_.state != -1 ? states_[current_.state].name : noState);
+}
+
+unsigned int Animator::addLayer(const Animation& animation, vector<float>&& boneMask, float weight, bool additive) {
+    assert(boneMask.empty() || boneMask.size() == model_.getNumNodes());
+    layers_.push_back({&animation, move(boneMask), weight, additive, 0.0, {}, nullptr});
+    if (additive) {
+        layers_.back().referencePose = posePool_.acquire();
+        model_.sampleAnimation(animation, 0.0, *layers_.back().referencePose);
+    }
+    return static_cast<unsigned int>(layers_.size() - 1);
+}
+
+void Animator::setLayerWeight(unsigned int index, float weight) {
+    layers_[index].weight = weight;
+}
+
+void Animator::update(double deltaTime) {
+    if (current_.state != -1) {
+        const State& state = states_[current_.state];
+        current_.time += deltaTime * state.speed;
+        if (!state.loop && state.transitionState != -1) {
+            double endTime = state.animation->duration_ / state.animation->ticksPerSecond_;    // The playback time already includes the speed, so the fade (in real seconds) is scaled to match.
+            if (current_.time >= endTime - state.transitionFadeDuration * state.speed) {
+                setState(states_[state.transitionState].name, state.transitionFadeDuration);
+            }
+        }
+    }
+    if (previous_.state != -1) {
+        previous_.time += deltaTime * states_[previous_.state].speed;
+    }
+    fadeTime_ = min(fadeTime_ + static_cast<float>(deltaTime), fadeDuration_);
+    for (Layer& l : layers_) {
+        l.time += deltaTime;
+    }
+}
+
+const ModelRigged::LocalPose& Animator::evaluate() {
+    if (current_.state == -1) {
+        *result_ = model_.getBindPose();
+    } else {
+        samplePlayback(current_, *result_);
+    }
+    
+    if (fadeTime_ < fadeDuration_) {
+        ModelRigged::LocalPose* fromPose = posePool_.acquire();
+        if (fadeFromFrozen_) {
+            *fromPose = *frozenPose_;
+        } else {
+            samplePlayback(previous_, *fromPose);
+        }
+        PoseBlending::blend(*fromPose, *result_, fadeTime_ / fadeDuration_, nullptr, *result_);
+        posePool_.release(fromPose);
+    }
+    
+    for (Layer& l : layers_) {
+        if (l.weight <= 0.0f) {
+            continue;
+        }
+        ModelRigged::LocalPose* layerPose = posePool_.acquire();
+        model_.sampleAnimation(*l.animation, getAnimationTime(*l.animation, l.time, true), *layerPose, &l.keyCursors);
+        const float* boneMask = (l.boneMask.empty() ? nullptr : l.boneMask.data());
+        if (l.additive) {
+            PoseBlending::addAdditive(*result_, *layerPose, *l.referencePose, l.weight, boneMask, *result_);
+        } else {
+            PoseBlending::blend(*result_, *layerPose, l.weight, boneMask, *result_);
+        }
+        posePool_.release(layerPose);
+    }
+    return *result_;
+}
+
+int Animator::findState(const string& name) const {
+    auto findResult = stateIndices_.find(name);
+    return (findResult != stateIndices_.end() ? static_cast<int>(findResult->second) : -1);
+}
+
+double Animator::getAnimationTime(const Animation& animation, double time, bool loop) const {
+    double animationTime = time * animation.ticksPerSecond_;
+    if (loop) {
+        return fmod(animationTime, animation.duration_);
+    }
+    return min(animationTime, animation.duration_);
+}
+
+void Animator::samplePlayback(Playback& playback, ModelRigged::LocalPose& pose) const {
+    const State& state = states_[playback.state];
+    model_.sampleAnimation(*state.animation, getAnimationTime(*state.animation, playback.time, state.loop), pose, &playback.keyCursors);
+}
@@ -0,0 +1,68 @@
+#ifndef ANIMATOR_H_
+#define ANIMATOR_H_
+
+#include "Animation.h"
+#include "ModelRigged.h"
+#include "PoseBlending.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+class Animator {    // Small state machine that plays animations on a rigged model, with timed crossfades between states and masked layers on top.
+    public:
+    Animator(const ModelRigged& model);
+    ~Animator();
+    Animator(const Animator& animator) = delete;
+    Animator& operator=(const Animator& animator) = delete;
+    void addState(const string& name, const Animation& animation, bool loop = true, float speed = 1.0f);
+    void addTransition(const string& fromState, const string& toState, float fadeDuration);    // Taken automatically when a state that doesn't loop reaches the end.
+    void setState(const string& name, float fadeDuration = 0.0f);    // Crossfades from the current pose to the new state over fadeDuration seconds.
+    const string& getState() const;
+    unsigned int addLayer(const Animation& animation, vector<float>&& boneMask, float weight = 1.0f, bool additive = false);    // Layers are applied in order after the states. An additive layer adds the difference from the first frame of its animation.
+    void setLayerWeight(unsigned int index, float weight);
+    void update(double deltaTime);    // Advances the states, layers, and crossfade.
+    const ModelRigged::LocalPose& evaluate();    // Returns the blended pose for ModelRigged::applyPose(), this doesn't allocate after the first frame.
+    
+    private:
+    struct State {
+        string name;
+        const Animation* animation;
+        bool loop;
+        float speed;
+        int transitionState;    // State to fade into at the end, or -1 if none.
+        float transitionFadeDuration;
+    };
+    struct Playback {
+        int state;    // Or -1 if nothing is playing.
+        double time;    // In seconds.
+        vector<Animation::KeyCursor> keyCursors;
+    };
+    struct Layer {
+        const Animation* animation;
+        vector<float> boneMask;
+        float weight;
+        bool additive;
+        double time;
+        vector<Animation::KeyCursor> keyCursors;
+        ModelRigged::LocalPose* referencePose;    // First frame of the animation, only used for additive layers.
+    };
+    
+    const ModelRigged& model_;
+    PoseBlending::PosePool posePool_;
+    vector<State> states_;
+    unordered_map<string, unsigned int> stateIndices_;
+    vector<Layer> layers_;
+    Playback current_, previous_;
+    ModelRigged::LocalPose* result_;
+    ModelRigged::LocalPose* frozenPose_;    // Snapshot of the result used as the fade source when a crossfade gets interrupted.
+    bool fadeFromFrozen_;
+    float fadeDuration_, fadeTime_;
+    
+    int findState(const string& name) const;
+    double getAnimationTime(const Animation& animation, double time, bool loop) const;    // Converts seconds to ticks, wrapping or clamping at the end.
+    void samplePlayback(Playback& playback, ModelRigged::LocalPose& pose) const;
+};
+
+#endif
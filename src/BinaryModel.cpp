@@ -0,0 +1,83 @@
+#include "BinaryModel.h"
+#include "CommonMath.h"
+#include "MappedFile.h"
+#include <stdexcept>
+
+BinaryModel::Writer::Writer(const string& filename) : file_(filename, ios::binary | ios::trunc) {}
+
+bool BinaryModel::Writer::isOpen() const {
+    return file_.is_open();
+}
+
+void BinaryModel::Writer::writeBytes(const void* data, size_t numBytes) {
+    file_.write(static_cast<const char*>(data), numBytes);
+}
+
+void BinaryModel::Writer::writeBlock(const void* data, size_t numBytes) {
+    write<uint64_t>(numBytes);
+    writeBytes(data, numBytes);
+}
+
+void BinaryModel::Writer::writeString(const string& str) {
+    writeBlock(str.data(), str.size());
+}
+
+BinaryModel::Reader::Reader(const uint8_t* data, size_t size) : data_(data), size_(size), position_(0) {}
+
+const uint8_t* BinaryModel::Reader::readBytes(size_t numBytes) {
+    if (numBytes > size_ - position_) {
+        throw runtime_error("Unexpected end of file.");
+    }
+    const uint8_t* result = data_ + position_;
+    position_ += numBytes;
+    return result;
+}
+
+const uint8_t* BinaryModel::Reader::readBlock(size_t* numBytes) {
+    uint64_t blockSize = read<uint64_t>();
+    if (blockSize > size_ - position_) {    // Check before the cast in case size_t is smaller.
+        throw runtime_error("Unexpected end of file.");
+    }
+    *numBytes = static_cast<size_t>(blockSize);
+    return readBytes(*numBytes);
+}
+
+string BinaryModel::Reader::readString() {
+    size_t numBytes;
+    const uint8_t* data = readBlock(&numBytes);
+    return string(reinterpret_cast<const char*>(data), numBytes);
+}
+
+void BinaryModel::Reader::checkBlockSize(size_t numBytes, size_t elementSize) const {
+    if (numBytes % elementSize != 0) {
+        throw runtime_error("Block size does not match the element type.");
+    }
+}
+
+string BinaryModel::getFilename(const string& sourceFilename) {
+    return sourceFilename + ".bin";
+}
+
+uint64_t BinaryModel::hashSourceFile(const string& sourceFilename) {
+    MappedFile sourceFile(sourceFilename);
+    if (!sourceFile.isOpen()) {
+        return NO_SOURCE_HASH;
+    }
+    uint64_t hash = CommonMath::hashFNV1a(sourceFile.getData(), sourceFile.getSize());
+    return (hash != NO_SOURCE_HASH ? hash : hash + 1);
+}
+
+void BinaryModel::writeHeader(Writer& writer, ContentType contentType, uint64_t sourceHash) {
+    writer.write<uint32_t>(MAGIC);
+    writer.write<uint32_t>(VERSION);
+    writer.write<uint32_t>(contentType);
+    writer.write<uint64_t>(sourceHash);
+}
+
+bool BinaryModel::readHeader(Reader& reader, ContentType contentType, uint64_t sourceHash) {
+    if (reader.read<uint32_t>() != MAGIC || reader.read<uint32_t>() != VERSION || reader.read<uint32_t>() != contentType) {
+        return false;
+    }
+    uint64_t fileSourceHash = reader.read<uint64_t>();
+    return sourceHash == NO_SOURCE_HASH || fileSourceHash == sourceHash;
+}
@@ -0,0 +1,78 @@
+#ifndef BINARY_MODEL_H_
+#define BINARY_MODEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace BinaryModel {    // Preprocessed model files. Data is stored in the native layout used by the GPU buffers and model classes, so these are not portable between platforms.
+    enum ContentType : uint32_t {
+        StaticModel = 0,
+        RiggedModel = 1,
+        AnimationSet = 2
+    };
+    
+    constexpr uint32_t MAGIC = 0x4d584c47;    // "GLXM" in a little-endian file.
+    constexpr uint32_t VERSION = 5;    // Increase this whenever anything written to the file changes layout, old files then get rebuilt from the source.
+    constexpr uint64_t NO_SOURCE_HASH = 0;    // Used when the source file is missing, the preprocessed file is trusted as-is.
+    
+    class Writer {
+        public:
+        Writer(const string& filename);
+        bool isOpen() const;
+        void writeBytes(const void* data, size_t numBytes);
+        void writeBlock(const void* data, size_t numBytes);    // Writes the size followed by the data.
+        void writeString(const string& str);
+        template<typename T>
+        void write(const T& value) {
+            writeBytes(&value, sizeof(T));
+        }
+        template<typename T>
+        void writeVector(const vector<T>& values) {
+            writeBlock(values.data(), values.size() * sizeof(T));
+        }
+        
+        private:
+        ofstream file_;
+    };
+    
+    class Reader {    // Reads from memory (usually a MappedFile), running past the end throws a runtime_error.
+        public:
+        Reader(const uint8_t* data, size_t size);
+        const uint8_t* readBytes(size_t numBytes);    // Returns a pointer into the data, this has no alignment.
+        const uint8_t* readBlock(size_t* numBytes);
+        string readString();
+        template<typename T>
+        T read() {
+            T value;
+            memcpy(&value, readBytes(sizeof(T)), sizeof(T));
+            return value;
+        }
+        template<typename T>
+        void readVector(vector<T>& values) {
+            size_t numBytes;
+            const uint8_t* data = readBlock(&numBytes);
+            checkBlockSize(numBytes, sizeof(T));
+            values.resize(numBytes / sizeof(T));
+            memcpy(static_cast<void*>(values.data()), data, numBytes);    // Only used with plain data, key pairs included.
+        }
+        
+        private:
+        const uint8_t* data_;
+        size_t size_, position_;
+        
+        void checkBlockSize(size_t numBytes, size_t elementSize) const;
+    };
+    
+    string getFilename(const string& sourceFilename);    // Preprocessed files are kept next to the source file.
+    uint64_t hashSourceFile(const string& sourceFilename);    // Returns NO_SOURCE_HASH if the file can't be read.
+    void writeHeader(Writer& writer, ContentType contentType, uint64_t sourceHash);
+    bool readHeader(Reader& reader, ContentType contentType, uint64_t sourceHash);    // Returns false if the file is from another version, has different content, or the source has changed since it was written.
+}
+
+#endif
@@ -0,0 +1,113 @@
+#include "BonePaletteBuffer.h"
+#include "CommonMath.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <iostream>
+
+const char* BonePaletteBuffer::getShaderKeyword(Format format) {
+    if (format == AffineMatrix) {
+        return "AFFINE_PALETTE";
+    } else if (format == DualQuaternion) {
+        return "DUAL_QUAT_PALETTE";
+    }
+    return nullptr;
+}
+
+unsigned int BonePaletteBuffer::encodePalette(Format format, const glm::mat4& modelMtx, const vector<glm::mat4>& boneTransforms, vector<glm::vec4>* texels) {
+    unsigned int offset = static_cast<unsigned int>(texels->size());
+    addMatrix(modelMtx, format != FullMatrix, texels);
+    for (const glm::mat4& m : boneTransforms) {
+        if (format == DualQuaternion) {
+            addDualQuaternion(m, texels);
+        } else {
+            addMatrix(m, format == AffineMatrix, texels);
+        }
+    }
+    return offset;
+}
+
+BonePaletteBuffer::BonePaletteBuffer(Format format) : format_(format) {
+    glGenBuffers(1, &bufferHandle_);
+    glGenTextures(1, &textureHandle_);
+    glBindTexture(GL_TEXTURE_BUFFER, textureHandle_);    // The texture keeps pointing at the same buffer when it gets resized or orphaned.
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, bufferHandle_);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    bufferCapacity_ = 0;
+    int maxTexels;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    maxNumTexels_ = static_cast<size_t>(maxTexels);
+}
+
+BonePaletteBuffer::~BonePaletteBuffer() {
+    glDeleteTextures(1, &textureHandle_);
+    glDeleteBuffers(1, &bufferHandle_);
+}
+
+BonePaletteBuffer::Format BonePaletteBuffer::getFormat() const {
+    return format_;
+}
+
+void BonePaletteBuffer::setFormat(Format format) {
+    format_ = format;
+    texels_.clear();
+}
+
+unsigned int BonePaletteBuffer::getPaletteSize(unsigned int numBones) const {
+    if (format_ == AffineMatrix) {
+        return 3 + numBones * 3;
+    } else if (format_ == DualQuaternion) {
+        return 3 + numBones * 2;    // The model matrix is always affine, it can have scale.
+    }
+    return 4 + numBones * 4;
+}
+
+void BonePaletteBuffer::clear() {
+    texels_.clear();
+}
+
+unsigned int BonePaletteBuffer::addPalette(const glm::mat4& modelMtx, const vector<glm::mat4>& boneTransforms) {
+    return encodePalette(format_, modelMtx, boneTransforms, &texels_);
+}
+
+size_t BonePaletteBuffer::getNumTexels() const {
+    return texels_.size();
+}
+
+void BonePaletteBuffer::upload() {
+    if (texels_.size() > maxNumTexels_) {
+        cout << "Warn: Bone palettes need " << texels_.size() << " texels but the texture buffer only fits " << maxNumTexels_ << ", some instances will be skinned wrong.\n";
+        texels_.resize(maxNumTexels_);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, bufferHandle_);
+    if (texels_.size() > bufferCapacity_) {
+        bufferCapacity_ = min(max(texels_.size(), bufferCapacity_ * 2), maxNumTexels_);
+    }
+    glBufferData(GL_TEXTURE_BUFFER, bufferCapacity_ * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+    if (!texels_.empty()) {
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, texels_.size() * sizeof(glm::vec4), texels_.data());
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void BonePaletteBuffer::bind(unsigned int textureUnit) const {
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, textureHandle_);
+}
+
+void BonePaletteBuffer::addMatrix(const glm::mat4& mtx, bool affine, vector<glm::vec4>* texels) {
+    if (!affine) {
+        texels->insert(texels->end(), {mtx[0], mtx[1], mtx[2], mtx[3]});
+        return;
+    }
+    glm::mat4 rows = glm::transpose(mtx);    // The bottom row is always (0, 0, 0, 1), so only the other rows are stored.
+    texels->insert(texels->end(), {rows[0], rows[1], rows[2]});
+}
+
+void BonePaletteBuffer::addDualQuaternion(const glm::mat4& mtx, vector<glm::vec4>* texels) {
+    glm::vec3 translation, scale;
+    glm::quat rotation;
+    CommonMath::decomposeTransform(mtx, &translation, &rotation, &scale);
+    glm::quat dual = glm::quat(0.0f, translation.x, translation.y, translation.z) * rotation * 0.5f;
+    texels->emplace_back(rotation.x, rotation.y, rotation.z, rotation.w);
+    texels->emplace_back(dual.x, dual.y, dual.z, dual.w);
+}
@@ -0,0 +1,47 @@
+#ifndef BONE_PALETTE_BUFFER_H_
+#define BONE_PALETTE_BUFFER_H_
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class BonePaletteBuffer {    // Texture buffer with the bone transforms of every skinned instance drawn in a frame. Each palette is the model matrix of the instance followed by its bone transforms, so the shaders can find one from an offset and gl_InstanceID.
+    public:
+    enum Format {
+        FullMatrix = 0,    // 4 texels (64 bytes) per bone.
+        AffineMatrix = 1,    // Top 3 rows of the matrix, 3 texels (48 bytes) per bone. Gives the same result as FullMatrix.
+        DualQuaternion = 2    // Rotation and translation, 2 texels (32 bytes) per bone. Scale in the bone transforms is dropped, but joints bend without the volume loss of blended matrices.
+    };
+    static constexpr unsigned int NUM_FORMATS = 3;
+    
+    static const char* getShaderKeyword(Format format);    // Keyword the skinning shaders need for the format, or null for FullMatrix.
+    static unsigned int encodePalette(Format format, const glm::mat4& modelMtx, const vector<glm::mat4>& boneTransforms, vector<glm::vec4>* texels);    // Appends a palette to the texels and returns its offset. This is all addPalette() does to the data, it's separate so the formats can be checked without OpenGL.
+    BonePaletteBuffer(Format format = FullMatrix);
+    ~BonePaletteBuffer();
+    BonePaletteBuffer(const BonePaletteBuffer& buffer) = delete;
+    BonePaletteBuffer& operator=(const BonePaletteBuffer& buffer) = delete;
+    Format getFormat() const;
+    void setFormat(Format format);    // Clears the buffer.
+    unsigned int getPaletteSize(unsigned int numBones) const;    // Number of texels a palette takes.
+    void clear();    // Starts a new frame, the palettes from before are still in the buffer until upload().
+    unsigned int addPalette(const glm::mat4& modelMtx, const vector<glm::mat4>& boneTransforms);    // Returns the texel offset of the palette. Palettes for the same model added back to back can be drawn with one instanced draw.
+    size_t getNumTexels() const;
+    void upload();    // Sends the palettes to OpenGL once for all passes that use them. The buffer is orphaned first so this doesn't wait on draws from the last frame.
+    void bind(unsigned int textureUnit) const;
+    
+    private:
+    Format format_;
+    vector<glm::vec4> texels_;
+    unsigned int bufferHandle_, textureHandle_;
+    size_t bufferCapacity_;    // In texels.
+    size_t maxNumTexels_;
+    
+    static void addMatrix(const glm::mat4& mtx, bool affine, vector<glm::vec4>* texels);
+    static void addDualQuaternion(const glm::mat4& mtx, vector<glm::vec4>* texels);
+};
+
+#endif
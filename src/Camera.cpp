@@ -39,7 +39,7 @@ void Camera::processMouseScroll(float xoffset, float yoffset) {
     }
 }
 
-void Camera::draw() const {}
+void Camera::draw(const Shader& /*shader*/, const glm::mat4& /*modelMtx*/) const {}
 
 Camera::Camera(const string& name, const glm::vec3& worldUp, float yaw, float pitch) :
     SceneObject(name),
@@ -20,7 +20,7 @@ class Camera : public SceneObject {
     void processMouseScroll(float xoffset, float yoffset);
     
     protected:
-    void draw() const;
+    void draw(const Shader& shader, const glm::mat4& modelMtx) const;
     
     private:
     Camera(const string& name, const glm::vec3& worldUp = glm::vec3(0.0f, 1.0f, 0.0f), float yaw = -90.0f, float pitch = 0.0f);
@@ -1,12 +1,28 @@
 #include "CharacterTest.h"
-#include "Shader.h"
-#include <glad/glad.h>
-#include <GLFW/glfw3.h>
-#include <cmath>
-#include <iostream>
+#include "AnimationSystem.h"
+#include "ModelLoader.h"
+#include "RenderApp.h"
+#include <cassert>
+#include <chrono>
 
-void CharacterTest::init() {
-    model_.loadFile("models/miku/miku.fbx", &animations_);
+CharacterTest::CharacterTest() :
+    animationSystem_(nullptr) {
+}
+
+CharacterTest::~CharacterTest() {
+    if (animationSystem_ != nullptr) {
+        animationSystem_->wait();
+    }
+    if (model_ != nullptr) {    // The clips go before the model, so their bindings are dropped here.
+        for (const pair<const string, Animation>& animation : animations_) {
+            model_->unbindAnimation(animation.second);
+        }
+    }
+}
+
+void CharacterTest::init(RenderApp& app) {
+    animationSystem_ = app.getAnimationSystem();
+    modelFuture_ = app.getModelLoader()->loadAsync<ModelRigged>("models/miku/miku.fbx", &animations_);    // The clips below load in the meantime.
     //model_.loadFile("models/aiya/aiya.fbx", &animations2_);
     transform_.setPosition(glm::vec3(-2.0f, 0.0f, 2.0f));
     //transform_.setPitchYawRoll(glm::vec3(glm::pi<float>() / 2.0f, 0.0f, 0.0f));
@@ -29,104 +45,51 @@ void CharacterTest::init() {
     moveForwardAnimation.channels_["Hips"].rotationKeys.emplace_back(glm::quat(0.657933f, 0.657933f, 0.259084f, 0.259084f), 0.0);
     moveForwardAnimation.channels_["Hips"].scalingKeys.emplace_back(glm::vec3(1.0f, 1.0f, 1.0f), 0.0);
     animations_.insert({"moveForward", moveForwardAnimation});
-    
-    assert(model_.boneOffsetMatrices_.size() <= ModelRigged::MAX_NUM_BONES);
-    boneTransforms_.resize(model_.boneOffsetMatrices_.size(), glm::mat4(1.0f));
-    
-    ////////////// Miku bones //////////////
-    ModelRigged::DynamicBone breastBone(0.03f, 1.9f, glm::vec3(0.0f, 1.0f, 0.0f), DampedSpringMotion(1.0f, 0.2f, 0.5f), DampedSpringMotion(1.0f, 0.2f, 0.5f));
-    dynamicBones_[model_.findNode("Breast_R")->boneIndex] = breastBone;
-    dynamicBones_[model_.findNode("Breast_L")->boneIndex] = breastBone;
-    
-    ModelRigged::DynamicBone hairBone(0.0f, 2.0f, glm::vec3(0.0f, 1.0f, 0.0f), DampedSpringMotion(), DampedSpringMotion(1.0f, 0.2f, 0.5f));
-    dynamicBones_[model_.findNode("Antenna1")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Antenna2")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Sideburn1_R")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Sideburn2_R")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Sideburn1_L")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Sideburn2_L")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("FrontHair1")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("FrontHair1_2")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("FrontHair2")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("FrontHair2_2")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("FrontHair3")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("FrontHair3_2")->boneIndex] = hairBone;
-    
-    dynamicBones_[model_.findNode("Hair1_R")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair2_R")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair3_R")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair4_R")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair5_R")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair6_R")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair7_R")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair8_R")->boneIndex] = hairBone;
-    
-    dynamicBones_[model_.findNode("Hair1_L")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair2_L")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair3_L")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair4_L")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair5_L")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair6_L")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair7_L")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Hair8_L")->boneIndex] = hairBone;
-    
-    ModelRigged::DynamicBone ribbonBone(0.0f, 2.0f, glm::vec3(0.0f, 1.0f, 0.0f), DampedSpringMotion(), DampedSpringMotion(1.0f, 0.1f, 0.7f));
-    ModelRigged::DynamicBone ribbonBoneReversed = ribbonBone;
-    ribbonBoneReversed.centerOfMassOffset = glm::vec3(0.0f, -1.0f, 0.0f);
-    dynamicBones_[model_.findNode("HairRibbonTip_R")->boneIndex] = ribbonBoneReversed;
-    dynamicBones_[model_.findNode("HairRibbonTip+_R")->boneIndex] = ribbonBoneReversed;
-    dynamicBones_[model_.findNode("RibbonBack1_R")->boneIndex] = ribbonBone;
-    dynamicBones_[model_.findNode("RibbonBack2_R")->boneIndex] = ribbonBone;
-    dynamicBones_[model_.findNode("RibbonLeg1_R")->boneIndex] = ribbonBone;
-    dynamicBones_[model_.findNode("RibbonLeg2_R")->boneIndex] = ribbonBone;
-    
-    dynamicBones_[model_.findNode("HairRibbonTip_L")->boneIndex] = ribbonBoneReversed;
-    dynamicBones_[model_.findNode("HairRibbonTip+_L")->boneIndex] = ribbonBoneReversed;
-    dynamicBones_[model_.findNode("RibbonBack1_L")->boneIndex] = ribbonBone;
-    dynamicBones_[model_.findNode("RibbonBack2_L")->boneIndex] = ribbonBone;
-    dynamicBones_[model_.findNode("RibbonLeg1_L")->boneIndex] = ribbonBone;
-    dynamicBones_[model_.findNode("RibbonLeg2_L")->boneIndex] = ribbonBone;
-    
-    ////////////// Aiya bones //////////////
-    /*ModelRigged::DynamicBone breastBone(0.02f, 1.9f, glm::vec3(0.0f, 1.0f, 0.0f), DampedSpringMotion(1.0f, 0.2f, 0.5f), DampedSpringMotion(1.0f, 0.2f, 0.5f));
-    dynamicBones_[model_.findNode("Breast_R")->boneIndex] = breastBone;
-    dynamicBones_[model_.findNode("Breast_L")->boneIndex] = breastBone;
-    
-    ModelRigged::DynamicBone hairBone(0.0f, 2.0f, glm::vec3(0.0f, 1.0f, 0.0f), DampedSpringMotion(), DampedSpringMotion(1.0f, 0.2f, 0.5f));
-    dynamicBones_[model_.findNode("Ear_R.001")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Ear_R.002")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Ear_L.001")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Ear_L.002")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Tail.001")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Tail.002")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Tail.006")->boneIndex] = hairBone;
-    dynamicBones_[model_.findNode("Tail.003")->boneIndex] = hairBone;
-    
-    ModelRigged::DynamicBone clothesBone(0.0f, 0.05f, glm::vec3(0.0f, 1.0f, 0.0f), DampedSpringMotion(), DampedSpringMotion(1.0f, 0.1f, 0.7f));
-    dynamicBones_[model_.findNode("Jacket_Root_R.001")->boneIndex] = clothesBone;
-    dynamicBones_[model_.findNode("Jacket_Root_R.002")->boneIndex] = clothesBone;
-    dynamicBones_[model_.findNode("Skirt_Right")->boneIndex] = clothesBone;
-    dynamicBones_[model_.findNode("Jacket_Root_L.001")->boneIndex] = clothesBone;
-    dynamicBones_[model_.findNode("Jacket_Root_L.002")->boneIndex] = clothesBone;
-    dynamicBones_[model_.findNode("Skirt_Left")->boneIndex] = clothesBone;*/
 }
 
 void CharacterTest::update() {
-    //model_.ragdoll(transform_.getTransform(), dynamicBones_, boneTransforms_);
-    //model_.animate(animations_.at("Armature|Armature|mixamo.com|Layer0"), glfwGetTime(), boneTransforms_);
-    //model_.animate(animations_.at("moveForward"), glfwGetTime(), boneTransforms_);
-    if (true) {
-        model_.animateWithDynamics(animations_.at("Armature|wave"), glfwGetTime(), transform_.getTransform(), dynamicBones_, boneTransforms_);
-        //model_.animateWithDynamics(animations2_.at("Armature|walkInCircle"), glfwGetTime(), transform_.getTransform(), dynamicBones_, boneTransforms_);
-        //model_.animateWithDynamics(animations_.at("null"), glfwGetTime(), transform_.getTransform(), dynamicBones_, boneTransforms_);
-    } else {
-        model_.animate(animations_.at("Armature|hipHopDancing"), glfwGetTime(), boneTransforms_);
-        //model_.animate(animations2_.at("Armature|walkInCircle"), glfwGetTime(), boneTransforms_);
-        //model_.animate(animations_.at("null"), glfwGetTime(), boneTransforms_);
+    if (!modelFuture_.valid() || modelFuture_.wait_for(chrono::seconds(0)) != future_status::ready) {
+        return;
     }
-}
-
-void CharacterTest::draw(const Shader& shader, const glm::mat4& modelMtx) const {
-    shader.setMat4Array("boneTransforms", static_cast<unsigned int>(boneTransforms_.size()), boneTransforms_.data());
-    model_.draw(shader, transform_.getTransform());
+    model_ = modelFuture_.get();
+    modelFuture_ = shared_future<shared_ptr<ModelRigged>>();    // Only set up once.
+    if (model_ == nullptr) {
+        return;
+    }
+    for (pair<const string, Animation>& animation : animations_) {    // The clips only need to be close to the source, compression keeps the library small.
+        animation.second.compress();
+    }
+    assert(model_->boneOffsetMatrices_.size() <= ModelRigged::MAX_NUM_BONES);
+    
+    animationSystem_->wait();    // The solver is stepped during the update, so the particles can't be added while it runs.
+    PositionBasedSolver& physics = animationSystem_->getPhysics();
+    ragdoll_ = make_unique<Ragdoll>(*model_, physics);    // Chains swing on the body and bump into it.
+    ragdoll_->addChain("Breast_R", glm::radians(20.0f));
+    ragdoll_->addChain("Breast_L", glm::radians(20.0f));
+    for (const char* nodeName : {"Antenna1", "Antenna2", "Sideburn1_R", "Sideburn2_R", "Sideburn1_L", "Sideburn2_L", "FrontHair1", "FrontHair1_2", "FrontHair2", "FrontHair2_2", "FrontHair3", "FrontHair3_2"}) {
+        ragdoll_->addChain(nodeName);
+    }
+    for (const char* nodeName : {"Hair1_R", "Hair2_R", "Hair3_R", "Hair4_R", "Hair5_R", "Hair6_R", "Hair7_R", "Hair8_R", "Hair1_L", "Hair2_L", "Hair3_L", "Hair4_L", "Hair5_L", "Hair6_L", "Hair7_L", "Hair8_L"}) {
+        ragdoll_->addChain(nodeName);
+    }
+    for (const char* nodeName : {"HairRibbonTip_R", "HairRibbonTip+_R", "HairRibbonTip_L", "HairRibbonTip+_L"}) {
+        ragdoll_->addChain(nodeName, glm::radians(60.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+    }
+    for (const char* nodeName : {"RibbonBack1_R", "RibbonBack2_R", "RibbonLeg1_R", "RibbonLeg2_R", "RibbonBack1_L", "RibbonBack2_L", "RibbonLeg1_L", "RibbonLeg2_L"}) {
+        ragdoll_->addChain(nodeName, glm::radians(60.0f));
+    }
+    ragdoll_->addBody("Hips");    // Follows the animation until the body weight is raised.
+    ragdoll_->addCapsule("Hips", 0.12f);
+    physics.setGroundHeight(transform_.getPosition().y);
+    
+    animator_ = make_unique<Animator>(*model_);
+    animator_->addState("wave", animations_.at("Armature|wave"), false);
+    animator_->addState("hipHopDancing", animations_.at("Armature|hipHopDancing"));
+    animator_->addTransition("wave", "hipHopDancing", 0.5f);
+    animator_->setState("wave");
+    
+    unsigned int instance = animationSystem_->addInstance(*model_, animator_.get());
+    animationSystem_->setModelMtx(instance, transform_.getTransform());
+    animationSystem_->setRagdoll(instance, ragdoll_.get());
+    animationSystem_->setPreSkinning(*model_, true);    // The forward pass only has variants without skinning.
 }
@@ -1,33 +1,39 @@
 #ifndef CHARACTER_TEST_H_
 #define CHARACTER_TEST_H_
 
-class Shader;
+class AnimationSystem;
+class RenderApp;
 
 #include "Animation.h"
-#include "DrawableInterface.h"
+#include "Animator.h"
 #include "ModelRigged.h"
+#include "Ragdoll.h"
 #include "Transformable.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <map>
+#include <future>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 using namespace std;
 
-class CharacterTest : public DrawableInterface {
+class CharacterTest {    // Miku with a ragdoll for her hair and ribbons. The model loads in the background, then it's animated and drawn by the AnimationSystem of the app.
     public:
-    ModelRigged model_;
+    AnimationSystem* animationSystem_;
+    shared_future<shared_ptr<ModelRigged>> modelFuture_;
+    shared_ptr<ModelRigged> model_;    // Null until the load finishes.
     Transformable transform_;
     unordered_map<string, Animation> animations_, animations2_;
-    vector<glm::mat4> boneTransforms_;
-    map<int, ModelRigged::DynamicBone> dynamicBones_;
+    unique_ptr<Animator> animator_;
+    unique_ptr<Ragdoll> ragdoll_;
     
-    void init();
-    void update();
-    void draw(const Shader& shader, const glm::mat4& modelMtx) const;
+    CharacterTest();
+    ~CharacterTest();    // Waits for the update in progress, it might still be using the animator and ragdoll. Then unbinds the animations from the model.
+    void init(RenderApp& app);    // Starts loading the model.
+    void update();    // Called once per tick, adds the character to the AnimationSystem once the model is ready.
 };
 
 #endif
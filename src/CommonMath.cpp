@@ -40,3 +40,37 @@ glm::mat4 CommonMath::orientAt(glm::vec3 eye, glm::vec3 center, glm::vec3 up) {
     
     return result;
 }
+
+glm::mat4 CommonMath::composeTransform(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+    glm::mat4 result = glm::mat4_cast(rotation);
+    result[0] *= scale.x;
+    result[1] *= scale.y;
+    result[2] *= scale.z;
+    result[3] = glm::vec4(translation, 1.0f);
+    
+    return result;
+}
+
+void CommonMath::decomposeTransform(const glm::mat4& transform, glm::vec3* translation, glm::quat* rotation, glm::vec3* scale) {
+    *translation = glm::vec3(transform[3]);
+    glm::mat3 rotationMtx(transform);
+    *scale = glm::vec3(glm::length(rotationMtx[0]), glm::length(rotationMtx[1]), glm::length(rotationMtx[2]));
+    if (glm::determinant(rotationMtx) < 0.0f) {    // Mirrored, put the flip in the scale so the rest is a rotation.
+        scale->x = -scale->x;
+    }
+    for (int i = 0; i < 3; ++i) {
+        if ((*scale)[i] != 0.0f) {
+            rotationMtx[i] /= (*scale)[i];
+        }
+    }
+    *rotation = glm::normalize(glm::quat_cast(rotationMtx));
+}
+
+uint64_t CommonMath::hashFNV1a(const void* data, size_t numBytes, uint64_t hash) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < numBytes; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
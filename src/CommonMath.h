@@ -3,13 +3,19 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <cstddef>
+#include <cstdint>
 
 using namespace std;
 
 namespace CommonMath {    // may want to move more functions in here ##############################################################
     glm::quat findRotationBetweenVectors(glm::vec3 source, glm::vec3 destination);    // Computes the quaternion to rotate from source to destination direction vectors.
     glm::mat4 orientAt(glm::vec3 eye, glm::vec3 center, glm::vec3 up);    // Similar to glm::lookAt but instead of finding the view matrix, it computes an object transform.
+    glm::mat4 composeTransform(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale);    // Same as translate * mat4_cast(rotation) * scale without the matrix multiplies.
+    void decomposeTransform(const glm::mat4& transform, glm::vec3* translation, glm::quat* rotation, glm::vec3* scale);    // Splits a transform made of translation, rotation, and scale. Any shear is lost.
+    uint64_t hashFNV1a(const void* data, size_t numBytes, uint64_t hash = 14695981039346656037ull);    // 64-bit FNV-1a hash, pass a previous result as the hash to combine multiple blocks of data.
 }
 
 #endif
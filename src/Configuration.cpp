@@ -30,3 +30,19 @@ bool Configuration::getSSAO() const {
 void Configuration::setSSAO(bool state) {
     SSAO_ = state;
 }
+
+BonePaletteBuffer::Format Configuration::getBonePaletteFormat() const {
+    return bonePaletteFormat_;
+}
+
+void Configuration::setBonePaletteFormat(BonePaletteBuffer::Format format) {
+    bonePaletteFormat_ = format;
+}
+
+bool Configuration::getPreSkinning() const {
+    return preSkinning_;
+}
+
+void Configuration::setPreSkinning(bool state) {
+    preSkinning_ = state;
+}
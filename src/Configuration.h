@@ -1,6 +1,7 @@
 #ifndef CONFIGURATION_H_
 #define CONFIGURATION_H_
 
+#include "BonePaletteBuffer.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -15,9 +16,14 @@ class Configuration {
     void setBloom(bool state);
     bool getSSAO() const;
     void setSSAO(bool state);
+    BonePaletteBuffer::Format getBonePaletteFormat() const;
+    void setBonePaletteFormat(BonePaletteBuffer::Format format);    // Takes effect on the next frame.
+    bool getPreSkinning() const;
+    void setPreSkinning(bool state);    // When off, models marked with AnimationSystem::setPreSkinning() are skinned in every pass instead, for comparing the two. The forward pass has no skinning variants, so it only draws pre-skinned models.
     
     private:
-    bool vsync_, bloom_, SSAO_;
+    bool vsync_, bloom_, SSAO_, preSkinning_;
+    BonePaletteBuffer::Format bonePaletteFormat_;
 };
 
 #endif
@@ -0,0 +1,72 @@
+#include "AnimationTexture.h"
+#include "Crowd.h"
+#include "ModelRigged.h"
+#include "RenderApp.h"
+#include "Shader.h"
+#include <glad/glad.h>
+
+Crowd::Crowd(const ModelRigged& model, const AnimationTexture& animationTexture) :
+    model_(&model),
+    animationTexture_(&animationTexture),
+    uploadNeeded_(false) {
+    
+    glGenBuffers(1, &bufferHandle_);
+    glGenTextures(1, &textureHandle_);
+    glBindTexture(GL_TEXTURE_BUFFER, textureHandle_);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, bufferHandle_);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+Crowd::~Crowd() {
+    glDeleteTextures(1, &textureHandle_);
+    glDeleteBuffers(1, &bufferHandle_);
+}
+
+unsigned int Crowd::addInstance(const glm::mat4& modelMtx, unsigned int clip, float timeOffset, float speed) {
+    unsigned int instance = static_cast<unsigned int>(getNumInstances());
+    texels_.resize(texels_.size() + TEXELS_PER_INSTANCE);
+    setModelMtx(instance, modelMtx);
+    setClip(instance, clip, timeOffset, speed);
+    return instance;
+}
+
+size_t Crowd::getNumInstances() const {
+    return texels_.size() / TEXELS_PER_INSTANCE;
+}
+
+void Crowd::setModelMtx(unsigned int instance, const glm::mat4& modelMtx) {
+    glm::mat4 rows = glm::transpose(modelMtx);
+    texels_[instance * TEXELS_PER_INSTANCE] = rows[0];
+    texels_[instance * TEXELS_PER_INSTANCE + 1] = rows[1];
+    texels_[instance * TEXELS_PER_INSTANCE + 2] = rows[2];
+    uploadNeeded_ = true;
+}
+
+void Crowd::setClip(unsigned int instance, unsigned int clip, float timeOffset, float speed) {
+    const AnimationTexture::Clip& c = animationTexture_->getClip(clip);
+    texels_[instance * TEXELS_PER_INSTANCE + 3] = glm::vec4(static_cast<float>(c.firstFrame), static_cast<float>(c.numFrames), timeOffset, c.framesPerSecond * speed);
+    uploadNeeded_ = true;
+}
+
+void Crowd::draw(const Shader& shader, float time) const {
+    if (texels_.empty()) {
+        return;
+    }
+    if (uploadNeeded_) {
+        glBindBuffer(GL_TEXTURE_BUFFER, bufferHandle_);
+        glBufferData(GL_TEXTURE_BUFFER, texels_.size() * sizeof(glm::vec4), texels_.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        uploadNeeded_ = false;
+    }
+    
+    shader.setInt("animationFrames", RenderApp::TEXTURE_UNIT_ANIMATION_FRAMES);
+    shader.setInt("crowdInstances", RenderApp::TEXTURE_UNIT_CROWD_INSTANCES);
+    shader.setFloat("animationTime", time);
+    animationTexture_->bind(RenderApp::TEXTURE_UNIT_ANIMATION_FRAMES);
+    glActiveTexture(GL_TEXTURE0 + RenderApp::TEXTURE_UNIT_CROWD_INSTANCES);
+    glBindTexture(GL_TEXTURE_BUFFER, textureHandle_);
+    unsigned int count = static_cast<unsigned int>(getNumInstances());
+    for (size_t i = 0; i < model_->meshes_.size(); ++i) {
+        model_->meshes_[i].drawInstanced(shader, model_->meshTransforms_[i], count);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef CROWD_H_
+#define CROWD_H_
+
+class AnimationTexture;
+class ModelRigged;
+class Shader;
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+
+using namespace std;
+
+class Crowd {    // Instances of a rigged model playing looped clips from an AnimationTexture. Each instance is only a model matrix and a clip, the vertex shader finds the pose from the time. Drawing thousands of them costs one instanced draw per mesh and nothing per instance on the CPU.
+    public:
+    static constexpr unsigned int TEXELS_PER_INSTANCE = 4;    // Top 3 rows of the model matrix, then (first frame, number of frames, time offset, frames per second).
+    
+    Crowd(const ModelRigged& model, const AnimationTexture& animationTexture);
+    ~Crowd();
+    Crowd(const Crowd& crowd) = delete;
+    Crowd& operator=(const Crowd& crowd) = delete;
+    unsigned int addInstance(const glm::mat4& modelMtx, unsigned int clip, float timeOffset = 0.0f, float speed = 1.0f);    // The time offset (in seconds) keeps instances playing the same clip out of step.
+    size_t getNumInstances() const;
+    void setModelMtx(unsigned int instance, const glm::mat4& modelMtx);
+    void setClip(unsigned int instance, unsigned int clip, float timeOffset = 0.0f, float speed = 1.0f);
+    void draw(const Shader& shader, float time) const;    // Draws every instance at the time (in seconds), the shader needs the SKINNING and BAKED_ANIMATION keywords. Changed instances are uploaded first.
+    
+    private:
+    const ModelRigged* model_;
+    const AnimationTexture* animationTexture_;
+    vector<glm::vec4> texels_;
+    unsigned int bufferHandle_, textureHandle_;
+    mutable bool uploadNeeded_;
+};
+
+#endif
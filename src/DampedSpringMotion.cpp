@@ -3,7 +3,86 @@
 #include <cassert>
 #include <cmath>
 
-DampedSpringMotion::DampedSpringMotion() : posPosCoef_(1.0f), posVelCoef_(0.0f), velPosCoef_(0.0f), velVelCoef_(1.0f) {}
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DAMPED_SPRING_MOTION_SSE
+#include <xmmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))    // The AVX2 kernels are built for it on their own, and only run if the CPU has it.
+#define DAMPED_SPRING_MOTION_AVX2
+#define DAMPED_SPRING_MOTION_AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define DAMPED_SPRING_MOTION_AVX2
+#define DAMPED_SPRING_MOTION_AVX2_TARGET
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+static_assert(sizeof(DampedSpringMotion) == 4 * sizeof(float), "The AVX2 indexed batch update gathers the coefficients of motion n from n * 4 floats past the first.");
+
+#if defined(DAMPED_SPRING_MOTION_AVX2)
+namespace {
+    bool detectAvx2() {
+#if defined(__GNUC__)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#else
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {    // Needs OSXSAVE and AVX.
+            return false;
+        }
+        if ((_xgetbv(0) & 6) != 6) {    // The OS has to save the YMM registers.
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#endif
+    }
+    
+    bool hasAvx2() {
+        static const bool supported = detectAvx2();
+        return supported;
+    }
+    
+    DAMPED_SPRING_MOTION_AVX2_TARGET size_t updateSharedAvx2(const float* coefs, float* pos, float* vel, const float* equilibriumPos, size_t count) {    // Returns the number of springs updated, a multiple of 8.
+        __m256 posPosCoef = _mm256_set1_ps(coefs[0]), posVelCoef = _mm256_set1_ps(coefs[1]);
+        __m256 velPosCoef = _mm256_set1_ps(coefs[2]), velVelCoef = _mm256_set1_ps(coefs[3]);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {    // No fused multiply-add, it would round differently from the scalar version.
+            __m256 equilibrium = _mm256_loadu_ps(equilibriumPos + i);
+            __m256 oldPos = _mm256_sub_ps(_mm256_loadu_ps(pos + i), equilibrium);
+            __m256 oldVel = _mm256_loadu_ps(vel + i);
+            _mm256_storeu_ps(pos + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(oldPos, posPosCoef), _mm256_mul_ps(oldVel, posVelCoef)), equilibrium));
+            _mm256_storeu_ps(vel + i, _mm256_add_ps(_mm256_mul_ps(oldPos, velPosCoef), _mm256_mul_ps(oldVel, velVelCoef)));
+        }
+        return i;
+    }
+    
+    DAMPED_SPRING_MOTION_AVX2_TARGET size_t updateIndexedAvx2(const float* coefs, const uint32_t* motionIndices, float* pos, float* vel, const float* equilibriumPos, size_t count) {    // Coefficients of motion n start at coefs[n * 4].
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i coefIndices = _mm256_slli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(motionIndices + i)), 2);
+            __m256 posPosCoef = _mm256_i32gather_ps(coefs, coefIndices, 4);
+            __m256 posVelCoef = _mm256_i32gather_ps(coefs + 1, coefIndices, 4);
+            __m256 velPosCoef = _mm256_i32gather_ps(coefs + 2, coefIndices, 4);
+            __m256 velVelCoef = _mm256_i32gather_ps(coefs + 3, coefIndices, 4);
+            __m256 equilibrium = _mm256_loadu_ps(equilibriumPos + i);
+            __m256 oldPos = _mm256_sub_ps(_mm256_loadu_ps(pos + i), equilibrium);
+            __m256 oldVel = _mm256_loadu_ps(vel + i);
+            _mm256_storeu_ps(pos + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(oldPos, posPosCoef), _mm256_mul_ps(oldVel, posVelCoef)), equilibrium));
+            _mm256_storeu_ps(vel + i, _mm256_add_ps(_mm256_mul_ps(oldPos, velPosCoef), _mm256_mul_ps(oldVel, velVelCoef)));
+        }
+        return i;
+    }
+}
+#endif
+
+DampedSpringMotion::DampedSpringMotion() : coefs_{1.0f, 0.0f, 0.0f, 1.0f} {}
 
 DampedSpringMotion::DampedSpringMotion(float timeStep, float angularFrequency, float dampingRatio) {
     computeMotionParams(timeStep, angularFrequency, dampingRatio);
@@ -16,10 +95,10 @@ void DampedSpringMotion::computeMotionParams(float timeStep, float angularFreque
     
     assert(angularFrequency >= 0.0f && dampingRatio >= 0.0f);
     if (angularFrequency < EPSILON) {    // If no angular frequency, spring will not move.
-        posPosCoef_ = 1.0f;
-        posVelCoef_ = 0.0f;
-        velPosCoef_ = 0.0f;
-        velVelCoef_ = 1.0f;
+        coefs_[PosPos] = 1.0f;
+        coefs_[PosVel] = 0.0f;
+        coefs_[VelPos] = 0.0f;
+        coefs_[VelVel] = 1.0f;
         return;
     }
     
@@ -40,10 +119,10 @@ void DampedSpringMotion::computeMotionParams(float timeStep, float angularFreque
         float z1E1OverTwoZb = z1 * e1OverTwoZb;
         float z2E2OverTwoZb = z2 * e2OverTwoZb;
         
-        posPosCoef_ = e1OverTwoZb * z2 - z2E2OverTwoZb + e2;
-        posVelCoef_ = -e1OverTwoZb + e2OverTwoZb;
-        velPosCoef_ = (z1E1OverTwoZb - z2E2OverTwoZb + e2) * z2;
-        velVelCoef_ = -z1E1OverTwoZb + z2E2OverTwoZb;
+        coefs_[PosPos] = e1OverTwoZb * z2 - z2E2OverTwoZb + e2;
+        coefs_[PosVel] = -e1OverTwoZb + e2OverTwoZb;
+        coefs_[VelPos] = (z1E1OverTwoZb - z2E2OverTwoZb + e2) * z2;
+        coefs_[VelVel] = -z1E1OverTwoZb + z2E2OverTwoZb;
         
     } else if (dampingRatio < 1.0f - EPSILON) {    // Under-damped spring.
         float omegaZeta = angularFrequency * dampingRatio;
@@ -59,40 +138,53 @@ void DampedSpringMotion::computeMotionParams(float timeStep, float angularFreque
         float expCos = expTerm * cosTerm;
         float expOmegaZetaSinOverAlpha = expTerm * omegaZeta * sinTerm * invAlpha;
         
-        posPosCoef_ = expCos + expOmegaZetaSinOverAlpha;
-        posVelCoef_ = expSin * invAlpha;
-        velPosCoef_ = -expSin * alpha - omegaZeta * expOmegaZetaSinOverAlpha;
-        velVelCoef_ = expCos - expOmegaZetaSinOverAlpha;
+        coefs_[PosPos] = expCos + expOmegaZetaSinOverAlpha;
+        coefs_[PosVel] = expSin * invAlpha;
+        coefs_[VelPos] = -expSin * alpha - omegaZeta * expOmegaZetaSinOverAlpha;
+        coefs_[VelVel] = expCos - expOmegaZetaSinOverAlpha;
         
     } else {    // Critically-damped spring.
         float expTerm = exp(-angularFrequency * timeStep);
         float timeExp = timeStep * expTerm;
         float timeExpFreq = timeExp * angularFrequency;
         
-        posPosCoef_ = timeExpFreq + expTerm;
-        posVelCoef_ = timeExp;
-        velPosCoef_ = -angularFrequency * timeExpFreq;
-        velVelCoef_ = -timeExpFreq + expTerm;
+        coefs_[PosPos] = timeExpFreq + expTerm;
+        coefs_[PosVel] = timeExp;
+        coefs_[VelPos] = -angularFrequency * timeExpFreq;
+        coefs_[VelVel] = -timeExpFreq + expTerm;
     }
 }
 
+float DampedSpringMotion::getPosPosCoef() const {
+    return coefs_[PosPos];
+}
+
+float DampedSpringMotion::getPosVelCoef() const {
+    return coefs_[PosVel];
+}
+
+float DampedSpringMotion::getVelPosCoef() const {
+    return coefs_[VelPos];
+}
+
+float DampedSpringMotion::getVelVelCoef() const {
+    return coefs_[VelVel];
+}
+
 void DampedSpringMotion::updateMotion(float* pos, float* vel, float equilibriumPos) const {
     float oldPos = *pos - equilibriumPos;    // Update in equilibrium relative space.
     float oldVel = *vel;
     
-    *pos = oldPos * posPosCoef_ + oldVel * posVelCoef_ + equilibriumPos;
-    *vel = oldPos * velPosCoef_ + oldVel * velVelCoef_;
+    *pos = oldPos * coefs_[PosPos] + oldVel * coefs_[PosVel] + equilibriumPos;
+    *vel = oldPos * coefs_[VelPos] + oldVel * coefs_[VelVel];
 }
 
 void DampedSpringMotion::updateMotion(glm::vec2* pos, glm::vec2* vel, const glm::vec2& equilibriumPos) const {
-    updateMotion(&(pos->x), &(vel->x), equilibriumPos.x);
-    updateMotion(&(pos->y), &(vel->y), equilibriumPos.y);
+    updateMotion(&(pos->x), &(vel->x), &(equilibriumPos.x), 2);
 }
 
 void DampedSpringMotion::updateMotion(glm::vec3* pos, glm::vec3* vel, const glm::vec3& equilibriumPos) const {
-    updateMotion(&(pos->x), &(vel->x), equilibriumPos.x);
-    updateMotion(&(pos->y), &(vel->y), equilibriumPos.y);
-    updateMotion(&(pos->z), &(vel->z), equilibriumPos.z);
+    updateMotion(&(pos->x), &(vel->x), &(equilibriumPos.x), 3);
 }
 
 void DampedSpringMotion::updateMotion(glm::quat* angle, glm::quat* angularVel, const glm::quat& equilibriumAngle) const {
@@ -100,6 +192,55 @@ void DampedSpringMotion::updateMotion(glm::quat* angle, glm::quat* angularVel, c
     glm::quat oldAngularVel = *angularVel;
     
     // This may require further testing for correctness, but it theoretically works for now.
-    *angle = glm::angleAxis(glm::angle(oldAngle) * posPosCoef_, glm::axis(oldAngle)) * glm::angleAxis(glm::angle(oldAngularVel) * posVelCoef_, glm::axis(oldAngularVel)) * equilibriumAngle;
-    *angularVel = glm::angleAxis(glm::angle(oldAngle) * velPosCoef_, glm::axis(oldAngle)) * glm::angleAxis(glm::angle(oldAngularVel) * velVelCoef_, glm::axis(oldAngularVel));
+    *angle = glm::angleAxis(glm::angle(oldAngle) * coefs_[PosPos], glm::axis(oldAngle)) * glm::angleAxis(glm::angle(oldAngularVel) * coefs_[PosVel], glm::axis(oldAngularVel)) * equilibriumAngle;
+    *angularVel = glm::angleAxis(glm::angle(oldAngle) * coefs_[VelPos], glm::axis(oldAngle)) * glm::angleAxis(glm::angle(oldAngularVel) * coefs_[VelVel], glm::axis(oldAngularVel));
+}
+
+void DampedSpringMotion::updateMotion(float* pos, float* vel, const float* equilibriumPos, size_t count) const {
+    size_t i = 0;
+#if defined(DAMPED_SPRING_MOTION_AVX2)
+    if (hasAvx2()) {
+        i = updateSharedAvx2(coefs_, pos, vel, equilibriumPos, count);
+    }
+#endif
+#if defined(DAMPED_SPRING_MOTION_SSE)
+    __m128 posPosCoef = _mm_set1_ps(coefs_[PosPos]), posVelCoef = _mm_set1_ps(coefs_[PosVel]);
+    __m128 velPosCoef = _mm_set1_ps(coefs_[VelPos]), velVelCoef = _mm_set1_ps(coefs_[VelVel]);
+    for (; i + 4 <= count; i += 4) {    // Picks up after the AVX2 kernel, or does everything without it.
+        __m128 equilibrium = _mm_loadu_ps(equilibriumPos + i);
+        __m128 oldPos = _mm_sub_ps(_mm_loadu_ps(pos + i), equilibrium);
+        __m128 oldVel = _mm_loadu_ps(vel + i);
+        _mm_storeu_ps(pos + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(oldPos, posPosCoef), _mm_mul_ps(oldVel, posVelCoef)), equilibrium));
+        _mm_storeu_ps(vel + i, _mm_add_ps(_mm_mul_ps(oldPos, velPosCoef), _mm_mul_ps(oldVel, velVelCoef)));
+    }
+#endif
+    for (; i < count; ++i) {    // Remainder, or everything without SIMD.
+        updateMotion(pos + i, vel + i, equilibriumPos[i]);
+    }
+}
+
+void DampedSpringMotion::updateMotion(const DampedSpringMotion* motions, const uint32_t* motionIndices, float* pos, float* vel, const float* equilibriumPos, size_t count) {
+    size_t i = 0;
+#if defined(DAMPED_SPRING_MOTION_AVX2)
+    if (hasAvx2()) {
+        i = updateIndexedAvx2(motions->coefs_, motionIndices, pos, vel, equilibriumPos, count);
+    }
+#endif
+#if defined(DAMPED_SPRING_MOTION_SSE)
+    for (; i + 4 <= count; i += 4) {    // SSE has no gather, the coefficient sets are transposed from four loads instead.
+        __m128 posPosCoef = _mm_loadu_ps(motions[motionIndices[i]].coefs_);
+        __m128 posVelCoef = _mm_loadu_ps(motions[motionIndices[i + 1]].coefs_);
+        __m128 velPosCoef = _mm_loadu_ps(motions[motionIndices[i + 2]].coefs_);
+        __m128 velVelCoef = _mm_loadu_ps(motions[motionIndices[i + 3]].coefs_);
+        _MM_TRANSPOSE4_PS(posPosCoef, posVelCoef, velPosCoef, velVelCoef);
+        __m128 equilibrium = _mm_loadu_ps(equilibriumPos + i);
+        __m128 oldPos = _mm_sub_ps(_mm_loadu_ps(pos + i), equilibrium);
+        __m128 oldVel = _mm_loadu_ps(vel + i);
+        _mm_storeu_ps(pos + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(oldPos, posPosCoef), _mm_mul_ps(oldVel, posVelCoef)), equilibrium));
+        _mm_storeu_ps(vel + i, _mm_add_ps(_mm_mul_ps(oldPos, velPosCoef), _mm_mul_ps(oldVel, velVelCoef)));
+    }
+#endif
+    for (; i < count; ++i) {
+        motions[motionIndices[i]].updateMotion(pos + i, vel + i, equilibriumPos[i]);
+    }
 }
@@ -4,6 +4,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <cstddef>
+#include <cstdint>
 
 using namespace std;
 
@@ -12,14 +14,26 @@ class DampedSpringMotion {
     DampedSpringMotion();
     DampedSpringMotion(float timeStep, float angularFrequency, float dampingRatio);
     void computeMotionParams(float timeStep, float angularFrequency, float dampingRatio);
+    float getPosPosCoef() const;    // The coefficients give the new position and velocity relative to the equilibrium from the old ones.
+    float getPosVelCoef() const;
+    float getVelPosCoef() const;
+    float getVelVelCoef() const;
     void updateMotion(float* pos, float* vel, float equilibriumPos) const;
     void updateMotion(glm::vec2* pos, glm::vec2* vel, const glm::vec2& equilibriumPos) const;
     void updateMotion(glm::vec3* pos, glm::vec3* vel, const glm::vec3& equilibriumPos) const;
     void updateMotion(glm::quat* angle, glm::quat* angularVel, const glm::quat& equilibriumAngle) const;
+    void updateMotion(float* pos, float* vel, const float* equilibriumPos, size_t count) const;    // Updates count springs sharing these coefficients, arrays of vectors can be passed as their components. Uses AVX2 if the CPU has it, otherwise SSE when the target has it, and the results match the scalar version exactly.
+    static void updateMotion(const DampedSpringMotion* motions, const uint32_t* motionIndices, float* pos, float* vel, const float* equilibriumPos, size_t count);    // Same as above, but each spring i uses the coefficients of motions[motionIndices[i]] so groups of springs can have different stiffness.
     
     private:
-    float posPosCoef_, posVelCoef_;
-    float velPosCoef_, velVelCoef_;
+    enum Coef : unsigned int {
+        PosPos = 0,
+        PosVel = 1,
+        VelPos = 2,
+        VelVel = 3
+    };
+    
+    float coefs_[4];    // Indexed by Coef, the indexed batch update loads all four at once.
 };
 
 #endif
@@ -0,0 +1,318 @@
+#include "CommonMath.h"
+#include "DynamicBoneSolver.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DYNAMIC_BONE_SOLVER_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace {
+    float getClampRadius(float maxDisplacement, float scaleAvg) {    // Infinite radius turns off the clamp without a branch in the loop.
+        return (maxDisplacement != numeric_limits<float>::max() ? maxDisplacement * scaleAvg : numeric_limits<float>::infinity());
+    }
+}
+
+DynamicBoneSolver::DynamicBoneSolver() :
+    simulationLead_(0.0),
+    alpha_(1.0f) {
+}
+
+unsigned int DynamicBoneSolver::addCharacter(const ModelRigged& model, const map<int, ModelRigged::DynamicBone>& dynamicBones) {
+    characters_.emplace_back();
+    Character& character = characters_.back();
+    unsigned int numNodes = model.getNumNodes();
+    character.model = &model;
+    character.nodeBones.assign(numNodes, -1);
+    character.localTransforms.resize(numNodes);
+    character.combinedTransforms.resize(numNodes);
+    character.armatureRoot = glm::mat4(1.0f);
+    character.scaleAvg = 1.0f;
+    character.boneTransforms = nullptr;
+    character.hasEquilibrium = false;
+    
+    vector<unsigned int> nodeStages(numNodes);
+    unsigned int numStages = 1;
+    for (unsigned int i = 0; i < numNodes; ++i) {
+        int parentIndex = model.getParentIndex(i);
+        unsigned int stage = (parentIndex >= 0 ? nodeStages[parentIndex] : 0);
+        int boneIndex = model.getBoneIndex(i);
+        auto findResult = (boneIndex != -1 ? dynamicBones.find(boneIndex) : dynamicBones.end());
+        if (findResult != dynamicBones.end()) {    // The level of a dynamic bone is the stage of its parent, then the bone and its children go in the stage after.
+            if (stage == levels_.size()) {
+                levels_.emplace_back();
+                levels_.back().numBones = 0;
+            }
+            Level& level = levels_[stage];
+            const ModelRigged::DynamicBone& params = findResult->second;
+            character.nodeBones[i] = static_cast<int>(bones_.size());
+            character.levelBones.push_back(static_cast<unsigned int>(bones_.size()));
+            unsigned int lane = level.numBones % BLOCK_SIZE;
+            if (lane == 0) {
+                level.springs.emplace_back();
+                level.springsCOM.emplace_back();
+            }
+            bones_.push_back({params, i, stage, level.numBones, glm::mat4(1.0f)});
+            level.springs.back().setSpring(lane, params.lastPosition, params.linearVel, params.springMotion);
+            level.springsCOM.back().setSpring(lane, params.lastPositionCOM, params.linearVelCOM, params.springMotionCOM);
+            ++level.numBones;
+            ++stage;
+        }
+        nodeStages[i] = stage;
+        numStages = max(numStages, stage + 1);
+    }
+    
+    character.stageOffsets.assign(numStages + 1, 0);    // Counting sort of the nodes by stage, this keeps the pre-order within each stage.
+    for (unsigned int stage : nodeStages) {
+        ++character.stageOffsets[stage + 1];
+    }
+    for (unsigned int stage = 0; stage < numStages; ++stage) {
+        character.stageOffsets[stage + 1] += character.stageOffsets[stage];
+    }
+    vector<unsigned int> stageEnds(character.stageOffsets.begin(), character.stageOffsets.end() - 1);
+    character.nodeOrder.resize(numNodes);
+    for (unsigned int i = 0; i < numNodes; ++i) {
+        character.nodeOrder[stageEnds[nodeStages[i]]++] = i;
+    }
+    
+    stable_sort(character.levelBones.begin(), character.levelBones.end(), [this](unsigned int a, unsigned int b) { return bones_[a].level < bones_[b].level; });
+    character.levelOffsets.assign(numStages, 0);
+    for (unsigned int boneId : character.levelBones) {
+        ++character.levelOffsets[bones_[boneId].level + 1];
+    }
+    for (unsigned int level = 0; level + 1 < numStages; ++level) {
+        character.levelOffsets[level + 1] += character.levelOffsets[level];
+    }
+    return static_cast<unsigned int>(characters_.size() - 1);
+}
+
+size_t DynamicBoneSolver::getNumCharacters() const {
+    return characters_.size();
+}
+
+size_t DynamicBoneSolver::getNumBones() const {
+    return bones_.size();
+}
+
+unsigned int DynamicBoneSolver::getNumLevels() const {
+    return static_cast<unsigned int>(levels_.size());
+}
+
+size_t DynamicBoneSolver::getNumBlocks(unsigned int level) const {
+    return levels_[level].springs.size();
+}
+
+void DynamicBoneSolver::beginFrame(double deltaTime) {
+    stepWeights_.clear();
+    double simulatedTime = simulationLead_;    // Relative to the start of the frame.
+    while (simulatedTime < deltaTime && stepWeights_.size() < MAX_STEPS_PER_FRAME) {    // Step until the springs reach the end of the frame, the equilibrium moves linearly over the frame.
+        simulatedTime += TIME_STEP;
+        stepWeights_.push_back(static_cast<float>(min(simulatedTime / deltaTime, 1.0)));
+    }
+    simulationLead_ = max(simulatedTime - deltaTime, 0.0);
+    alpha_ = static_cast<float>(1.0 - simulationLead_ / TIME_STEP);
+}
+
+void DynamicBoneSolver::beginCharacter(unsigned int character, const ModelRigged::LocalPose& pose, const glm::mat4& modelMtx, vector<glm::mat4>& boneTransforms) {
+    Character& c = characters_[character];
+    const ModelRigged& model = *c.model;
+    assert(boneTransforms.size() == model.boneOffsetMatrices_.size());
+    for (size_t i = 0; i < c.localTransforms.size(); ++i) {    // Later stages run on other threads, so the pose is copied in while it's still around.
+        c.localTransforms[i] = CommonMath::composeTransform(pose.translations[i], pose.rotations[i], pose.scales[i]);
+    }
+    
+    float scaleX = glm::length(glm::vec3(modelMtx[0][0], modelMtx[0][1], modelMtx[0][2]));
+    float scaleY = glm::length(glm::vec3(modelMtx[1][0], modelMtx[1][1], modelMtx[1][2]));
+    float scaleZ = glm::length(glm::vec3(modelMtx[2][0], modelMtx[2][1], modelMtx[2][2]));
+    c.scaleAvg = (scaleX + scaleY + scaleZ) / 3.0f;    // Average scaling of the model used to approximate radial clamp in world space.
+    c.armatureRoot = modelMtx * glm::inverse(model.getArmatureRootInv());
+    c.boneTransforms = &boneTransforms;
+    concatenateStage(character, 0);
+}
+
+void DynamicBoneSolver::solveLevel(unsigned int level, size_t begin, size_t end) {
+    assert(end <= getNumBlocks(level));
+    vector<SpringBlock>& springs = levels_[level].springs;
+    vector<SpringBlock>& springsCOM = levels_[level].springsCOM;
+    for (size_t i = begin; i < end; ++i) {    // All steps for one block at a time while it's in cache.
+        for (float weight : stepWeights_) {
+            springs[i].step(weight);
+            springsCOM[i].step(weight);
+        }
+    }
+}
+
+void DynamicBoneSolver::concatenateStage(unsigned int character, unsigned int stage) {
+    Character& c = characters_[character];
+    unsigned int numLevels = static_cast<unsigned int>(c.levelOffsets.size() - 1);
+    if (stage > numLevels) {
+        return;
+    }
+    concatenateNodes(c, stage);
+    if (stage < numLevels) {
+        gatherLevel(c, stage);
+    } else {
+        c.hasEquilibrium = true;
+    }
+}
+
+DynamicBoneSolver::SpringBlock::SpringBlock() {
+    for (unsigned int i = 0; i < BLOCK_SIZE; ++i) {
+        setSpring(i, glm::vec3(0.0f), glm::vec3(0.0f), DampedSpringMotion());
+        setEquilibrium(i, glm::vec3(0.0f), numeric_limits<float>::infinity(), true);
+    }
+}
+
+void DynamicBoneSolver::SpringBlock::setSpring(unsigned int lane, const glm::vec3& pos, const glm::vec3& vel, const DampedSpringMotion& motion) {
+    posX[lane] = pos.x;
+    posY[lane] = pos.y;
+    posZ[lane] = pos.z;
+    prevPosX[lane] = pos.x;
+    prevPosY[lane] = pos.y;
+    prevPosZ[lane] = pos.z;
+    velX[lane] = vel.x;
+    velY[lane] = vel.y;
+    velZ[lane] = vel.z;
+    posPosCoef[lane] = motion.getPosPosCoef();
+    posVelCoef[lane] = motion.getPosVelCoef();
+    velPosCoef[lane] = motion.getVelPosCoef();
+    velVelCoef[lane] = motion.getVelVelCoef();
+}
+
+void DynamicBoneSolver::SpringBlock::setEquilibrium(unsigned int lane, const glm::vec3& equilibrium, float clampRadius, bool resetPrevious) {
+    prevEquilibriumX[lane] = (resetPrevious ? equilibrium.x : equilibriumX[lane]);
+    prevEquilibriumY[lane] = (resetPrevious ? equilibrium.y : equilibriumY[lane]);
+    prevEquilibriumZ[lane] = (resetPrevious ? equilibrium.z : equilibriumZ[lane]);
+    equilibriumX[lane] = equilibrium.x;
+    equilibriumY[lane] = equilibrium.y;
+    equilibriumZ[lane] = equilibrium.z;
+    radius[lane] = clampRadius;
+}
+
+glm::vec3 DynamicBoneSolver::SpringBlock::getPosition(unsigned int lane, float alpha) const {
+    float prevWeight = 1.0f - alpha;    // Written so an alpha of one gives exactly the latest position.
+    return glm::vec3(
+        prevPosX[lane] * prevWeight + posX[lane] * alpha,
+        prevPosY[lane] * prevWeight + posY[lane] * alpha,
+        prevPosZ[lane] * prevWeight + posZ[lane] * alpha
+    );
+}
+
+#ifdef DYNAMIC_BONE_SOLVER_SSE
+void DynamicBoneSolver::SpringBlock::step(float weight) {    // The lanes do the same operations in the same order as the scalar version, so the results match it exactly.
+    static_assert(BLOCK_SIZE == 4, "Blocks must fill one SSE register.");
+    __m128 currentWeight = _mm_set1_ps(weight);
+    __m128 prevWeight = _mm_set1_ps(1.0f - weight);
+    __m128 equilibriumX4 = _mm_add_ps(_mm_mul_ps(_mm_load_ps(prevEquilibriumX), prevWeight), _mm_mul_ps(_mm_load_ps(equilibriumX), currentWeight));
+    __m128 equilibriumY4 = _mm_add_ps(_mm_mul_ps(_mm_load_ps(prevEquilibriumY), prevWeight), _mm_mul_ps(_mm_load_ps(equilibriumY), currentWeight));
+    __m128 equilibriumZ4 = _mm_add_ps(_mm_mul_ps(_mm_load_ps(prevEquilibriumZ), prevWeight), _mm_mul_ps(_mm_load_ps(equilibriumZ), currentWeight));
+    
+    __m128 posX4 = _mm_load_ps(posX);    // Clamp the position within a sphere around the equilibrium, the mask keeps positions inside the sphere as they are.
+    __m128 posY4 = _mm_load_ps(posY);
+    __m128 posZ4 = _mm_load_ps(posZ);
+    __m128 deltaX = _mm_sub_ps(posX4, equilibriumX4);
+    __m128 deltaY = _mm_sub_ps(posY4, equilibriumY4);
+    __m128 deltaZ = _mm_sub_ps(posZ4, equilibriumZ4);
+    __m128 deltaLength = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(deltaX, deltaX), _mm_mul_ps(deltaY, deltaY)), _mm_mul_ps(deltaZ, deltaZ)));
+    __m128 radius4 = _mm_load_ps(radius);
+    __m128 outside = _mm_cmpgt_ps(deltaLength, radius4);
+    __m128 clampedX = _mm_add_ps(equilibriumX4, _mm_div_ps(_mm_mul_ps(deltaX, radius4), deltaLength));
+    __m128 clampedY = _mm_add_ps(equilibriumY4, _mm_div_ps(_mm_mul_ps(deltaY, radius4), deltaLength));
+    __m128 clampedZ = _mm_add_ps(equilibriumZ4, _mm_div_ps(_mm_mul_ps(deltaZ, radius4), deltaLength));
+    __m128 oldPosX = _mm_sub_ps(_mm_or_ps(_mm_and_ps(outside, clampedX), _mm_andnot_ps(outside, posX4)), equilibriumX4);    // Update in equilibrium relative space.
+    __m128 oldPosY = _mm_sub_ps(_mm_or_ps(_mm_and_ps(outside, clampedY), _mm_andnot_ps(outside, posY4)), equilibriumY4);
+    __m128 oldPosZ = _mm_sub_ps(_mm_or_ps(_mm_and_ps(outside, clampedZ), _mm_andnot_ps(outside, posZ4)), equilibriumZ4);
+    
+    __m128 oldVelX = _mm_load_ps(velX);
+    __m128 oldVelY = _mm_load_ps(velY);
+    __m128 oldVelZ = _mm_load_ps(velZ);
+    __m128 posPosCoef4 = _mm_load_ps(posPosCoef);
+    __m128 posVelCoef4 = _mm_load_ps(posVelCoef);
+    __m128 velPosCoef4 = _mm_load_ps(velPosCoef);
+    __m128 velVelCoef4 = _mm_load_ps(velVelCoef);
+    _mm_store_ps(prevPosX, posX4);
+    _mm_store_ps(prevPosY, posY4);
+    _mm_store_ps(prevPosZ, posZ4);
+    _mm_store_ps(posX, _mm_add_ps(_mm_add_ps(_mm_mul_ps(oldPosX, posPosCoef4), _mm_mul_ps(oldVelX, posVelCoef4)), equilibriumX4));
+    _mm_store_ps(posY, _mm_add_ps(_mm_add_ps(_mm_mul_ps(oldPosY, posPosCoef4), _mm_mul_ps(oldVelY, posVelCoef4)), equilibriumY4));
+    _mm_store_ps(posZ, _mm_add_ps(_mm_add_ps(_mm_mul_ps(oldPosZ, posPosCoef4), _mm_mul_ps(oldVelZ, posVelCoef4)), equilibriumZ4));
+    _mm_store_ps(velX, _mm_add_ps(_mm_mul_ps(oldPosX, velPosCoef4), _mm_mul_ps(oldVelX, velVelCoef4)));
+    _mm_store_ps(velY, _mm_add_ps(_mm_mul_ps(oldPosY, velPosCoef4), _mm_mul_ps(oldVelY, velVelCoef4)));
+    _mm_store_ps(velZ, _mm_add_ps(_mm_mul_ps(oldPosZ, velPosCoef4), _mm_mul_ps(oldVelZ, velVelCoef4)));
+}
+#else
+void DynamicBoneSolver::SpringBlock::step(float weight) {
+    float prevWeight = 1.0f - weight;
+    for (unsigned int i = 0; i < BLOCK_SIZE; ++i) {
+        float equilibriumPosX = prevEquilibriumX[i] * prevWeight + equilibriumX[i] * weight;
+        float equilibriumPosY = prevEquilibriumY[i] * prevWeight + equilibriumY[i] * weight;
+        float equilibriumPosZ = prevEquilibriumZ[i] * prevWeight + equilibriumZ[i] * weight;
+        
+        float deltaX = posX[i] - equilibriumPosX;    // Clamp the position within a sphere around the equilibrium, positions inside the sphere keep their exact value.
+        float deltaY = posY[i] - equilibriumPosY;
+        float deltaZ = posZ[i] - equilibriumPosZ;
+        float deltaLength = sqrt(deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ);
+        bool outside = deltaLength > radius[i];
+        float oldPosX = (outside ? equilibriumPosX + deltaX * radius[i] / deltaLength : posX[i]) - equilibriumPosX;    // Update in equilibrium relative space.
+        float oldPosY = (outside ? equilibriumPosY + deltaY * radius[i] / deltaLength : posY[i]) - equilibriumPosY;
+        float oldPosZ = (outside ? equilibriumPosZ + deltaZ * radius[i] / deltaLength : posZ[i]) - equilibriumPosZ;
+        
+        float oldVelX = velX[i];
+        float oldVelY = velY[i];
+        float oldVelZ = velZ[i];
+        prevPosX[i] = posX[i];
+        prevPosY[i] = posY[i];
+        prevPosZ[i] = posZ[i];
+        posX[i] = oldPosX * posPosCoef[i] + oldVelX * posVelCoef[i] + equilibriumPosX;
+        posY[i] = oldPosY * posPosCoef[i] + oldVelY * posVelCoef[i] + equilibriumPosY;
+        posZ[i] = oldPosZ * posPosCoef[i] + oldVelZ * posVelCoef[i] + equilibriumPosZ;
+        velX[i] = oldPosX * velPosCoef[i] + oldVelX * velVelCoef[i];
+        velY[i] = oldPosY * velPosCoef[i] + oldVelY * velVelCoef[i];
+        velZ[i] = oldPosZ * velPosCoef[i] + oldVelZ * velVelCoef[i];
+    }
+}
+#endif
+
+void DynamicBoneSolver::concatenateNodes(Character& character, unsigned int stage) {
+    const ModelRigged& model = *character.model;
+    vector<glm::mat4>& combinedTransforms = character.combinedTransforms;
+    for (unsigned int n = character.stageOffsets[stage]; n < character.stageOffsets[stage + 1]; ++n) {
+        unsigned int i = character.nodeOrder[n];
+        int parentIndex = model.getParentIndex(i);
+        const glm::mat4& parentTransform = (parentIndex >= 0 ? combinedTransforms[parentIndex] : model.getArmatureRootInv());
+        int boneId = character.nodeBones[i];
+        if (boneId != -1) {    // Dynamic bone solved in the level before, this overrides any keyframes it may have.
+            Bone& bone = bones_[boneId];
+            const Level& level = levels_[bone.level];
+            bone.params.lastPosition = level.springs[bone.index / BLOCK_SIZE].getPosition(bone.index % BLOCK_SIZE, alpha_);
+            bone.params.lastPositionCOM = level.springsCOM[bone.index / BLOCK_SIZE].getPosition(bone.index % BLOCK_SIZE, alpha_);
+            combinedTransforms[i] = parentTransform * model.getNodeTransform(i) * model.getDynamicBoneTransform(bone.params, bone.localToWorldSpace);
+        } else {
+            combinedTransforms[i] = parentTransform * character.localTransforms[i];
+        }
+        
+        int boneIndex = model.getBoneIndex(i);
+        if (boneIndex != -1) {
+            (*character.boneTransforms)[boneIndex] = combinedTransforms[i] * model.boneOffsetMatrices_[boneIndex];
+        }
+    }
+}
+
+void DynamicBoneSolver::gatherLevel(Character& character, unsigned int level) {
+    const ModelRigged& model = *character.model;
+    for (unsigned int n = character.levelOffsets[level]; n < character.levelOffsets[level + 1]; ++n) {
+        Bone& bone = bones_[character.levelBones[n]];
+        int parentIndex = model.getParentIndex(bone.node);
+        const glm::mat4& parentTransform = (parentIndex >= 0 ? character.combinedTransforms[parentIndex] : model.getArmatureRootInv());
+        bone.localToWorldSpace = character.armatureRoot * parentTransform * model.getNodeTransform(bone.node);
+        
+        glm::vec3 equilibriumPos = glm::vec3(bone.localToWorldSpace * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        glm::vec3 equilibriumPosCOM = glm::vec3(bone.localToWorldSpace * glm::vec4(bone.params.centerOfMassOffset, 1.0f));
+        unsigned int block = bone.index / BLOCK_SIZE, lane = bone.index % BLOCK_SIZE;
+        levels_[level].springs[block].setEquilibrium(lane, equilibriumPos, getClampRadius(bone.params.maxDisplacement, character.scaleAvg), !character.hasEquilibrium);
+        levels_[level].springsCOM[block].setEquilibrium(lane, equilibriumPosCOM, getClampRadius(bone.params.maxDisplacementCOM, character.scaleAvg), !character.hasEquilibrium);
+    }
+}
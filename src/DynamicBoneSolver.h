@@ -0,0 +1,78 @@
+#ifndef DYNAMIC_BONE_SOLVER_H_
+#define DYNAMIC_BONE_SOLVER_H_
+
+#include "ModelRigged.h"
+#include <glm/glm.hpp>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+class DynamicBoneSolver {    // Simulates the dynamic bones of many rigged model instances (characters) together. The springs are stored as a structure of arrays in blocks of BLOCK_SIZE bones, grouped by level (the number of dynamic bones above each bone), and each block is stepped with SIMD across its bones. A frame runs in stages: beginCharacter() for every character, then for each level solveLevel() over its bones and concatenateStage(level + 1) for every character. Calls within a stage can run in parallel.
+    public:
+    static constexpr double TIME_STEP = 1.0 / 60.0;    // The springs take fixed steps of this length, at 60 Hz the results match ModelRigged::applyPoseWithDynamics().
+    static constexpr unsigned int MAX_STEPS_PER_FRAME = 8;    // Time past this is dropped so a long frame doesn't make the next one longer.
+    static constexpr unsigned int BLOCK_SIZE = 4;    // Bones in a block, one SSE register per component.
+    
+    DynamicBoneSolver();
+    unsigned int addCharacter(const ModelRigged& model, const map<int, ModelRigged::DynamicBone>& dynamicBones);    // Copies the bones along with their current motion, the map isn't used after this. Returns the character index.
+    size_t getNumCharacters() const;
+    size_t getNumBones() const;
+    unsigned int getNumLevels() const;    // Longest chain of dynamic bones in any character.
+    size_t getNumBlocks(unsigned int level) const;
+    void beginFrame(double deltaTime);    // Picks the steps to take for the frame, called before the stages.
+    void beginCharacter(unsigned int character, const ModelRigged::LocalPose& pose, const glm::mat4& modelMtx, vector<glm::mat4>& boneTransforms);    // Stage 0, sets the bone transforms that don't depend on dynamic bones. The rest are set in boneTransforms by the later stages, so it must stay alive until then.
+    void solveLevel(unsigned int level, size_t begin, size_t end);    // Steps the springs in blocks [begin, end) of the level.
+    void concatenateStage(unsigned int character, unsigned int stage);    // Sets the bone transforms below the level that was just solved. Does nothing past the last level of the character.
+    
+    private:
+    struct alignas(16) SpringBlock {    // One spring per bone with each component packed in its own array.
+        float posX[BLOCK_SIZE], posY[BLOCK_SIZE], posZ[BLOCK_SIZE];
+        float prevPosX[BLOCK_SIZE], prevPosY[BLOCK_SIZE], prevPosZ[BLOCK_SIZE];    // Position before the last step, the result is interpolated between the two.
+        float velX[BLOCK_SIZE], velY[BLOCK_SIZE], velZ[BLOCK_SIZE];
+        float equilibriumX[BLOCK_SIZE], equilibriumY[BLOCK_SIZE], equilibriumZ[BLOCK_SIZE];
+        float prevEquilibriumX[BLOCK_SIZE], prevEquilibriumY[BLOCK_SIZE], prevEquilibriumZ[BLOCK_SIZE];    // Equilibrium from the frame before, the steps move between the two.
+        float radius[BLOCK_SIZE];    // Clamp distance from the equilibrium (infinite for none), scaled by the model.
+        float posPosCoef[BLOCK_SIZE], posVelCoef[BLOCK_SIZE], velPosCoef[BLOCK_SIZE], velVelCoef[BLOCK_SIZE];
+        
+        SpringBlock();    // The lanes start as springs that don't move.
+        void setSpring(unsigned int lane, const glm::vec3& pos, const glm::vec3& vel, const DampedSpringMotion& motion);
+        void setEquilibrium(unsigned int lane, const glm::vec3& equilibrium, float clampRadius, bool resetPrevious);
+        glm::vec3 getPosition(unsigned int lane, float alpha) const;
+        void step(float weight);    // Same motion as ModelRigged::updateDynamicBone(), the weight moves the equilibrium from the previous one to the current.
+    };
+    struct Level {    // Bones with the same number of dynamic bones above them, these only depend on the levels before.
+        vector<SpringBlock> springs, springsCOM;
+        unsigned int numBones;
+    };
+    struct Bone {
+        ModelRigged::DynamicBone params;    // The positions are set to the interpolated ones each frame.
+        unsigned int node, level, index;    // Index is the spring in the level arrays.
+        glm::mat4 localToWorldSpace;    // Bind transform of the bone in world space for this frame.
+    };
+    struct Character {
+        const ModelRigged* model;
+        vector<unsigned int> nodeOrder;    // Nodes sorted by stage, a node is in the stage after the level of its closest dynamic bone (including itself). Pre-order is kept within each stage.
+        vector<unsigned int> stageOffsets;    // Start of each stage in nodeOrder, with the end at the back.
+        vector<int> nodeBones;    // Bone id for dynamic nodes, -1 for the rest.
+        vector<unsigned int> levelBones;    // Bone ids sorted by level, with levelOffsets giving the start of each level.
+        vector<unsigned int> levelOffsets;
+        vector<glm::mat4> localTransforms, combinedTransforms;
+        glm::mat4 armatureRoot;
+        float scaleAvg;
+        vector<glm::mat4>* boneTransforms;
+        bool hasEquilibrium;    // False until the first frame is done, the first steps have no previous equilibrium to move from.
+    };
+    
+    vector<Character> characters_;
+    vector<Bone> bones_;
+    vector<Level> levels_;
+    vector<float> stepWeights_;    // Weight of the current equilibrium for each step this frame.
+    double simulationLead_;    // How far the springs are ahead of the frame time, always less than one step.
+    float alpha_;    // Interpolation from the position before the last step to the latest one.
+    
+    void concatenateNodes(Character& character, unsigned int stage);
+    void gatherLevel(Character& character, unsigned int level);    // Sets the equilibrium of the bones in the level from the transforms above them.
+};
+
+#endif
@@ -1,12 +1,11 @@
 #include "Entity.h"
-#include "Mesh.h"
 
 const shared_ptr<Mesh>& Entity::getMesh() const {
     return mesh_;
 }
 
-void Entity::draw() const {
-    mesh_->drawGeometry();
+void Entity::draw(const Shader& shader, const glm::mat4& modelMtx) const {
+    mesh_->drawGeometry(shader, modelMtx, lodState_);
 }
 
 Entity::Entity(const string& name, shared_ptr<Mesh> mesh) :
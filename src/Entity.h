@@ -1,8 +1,7 @@
 #ifndef ENTITY_H_
 #define ENTITY_H_
 
-class Mesh;
-
+#include "Mesh.h"
 #include "SceneObject.h"
 #include <memory>
 #include <string>
@@ -14,10 +13,11 @@ class Entity : public SceneObject {
     const shared_ptr<Mesh>& getMesh() const;
     
     protected:
-    void draw() const;
+    void draw(const Shader& shader, const glm::mat4& modelMtx) const;
     
     private:
     shared_ptr<Mesh> mesh_;
+    mutable Mesh::LodState lodState_;    // Updated each time the entity is drawn.
     
     Entity(const string& name, shared_ptr<Mesh> mesh);
     
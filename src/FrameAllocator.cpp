@@ -0,0 +1,68 @@
+#include "FrameAllocator.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+
+FrameAllocator::FrameAllocator(size_t capacity) :
+    block_(new unsigned char[capacity]),
+    capacity_(capacity),
+    offset_(0),
+    overflowBytes_(0) {
+}
+
+const char* FrameAllocator::format(const char* format, ...) {
+    va_list args, argsCopy;
+    va_start(args, format);
+    va_copy(argsCopy, args);
+    char* str = reinterpret_cast<char*>(block_.get() + offset_);    // Try writing straight into the rest of the block first.
+    size_t length = static_cast<size_t>(vsnprintf(str, capacity_ - offset_, format, args));
+    va_end(args);
+    if (length < capacity_ - offset_) {
+        offset_ += length + 1;
+    } else {
+        str = static_cast<char*>(allocate(length + 1, 1));
+        vsnprintf(str, length + 1, format, argsCopy);
+    }
+    va_end(argsCopy);
+    return str;
+}
+
+void FrameAllocator::reset() {
+    if (overflowBytes_ > 0) {
+        capacity_ = max(capacity_ * 2, offset_ + overflowBytes_ * 2);
+        block_.reset(new unsigned char[capacity_]);
+        overflowBlocks_.clear();
+        overflowBytes_ = 0;
+    }
+    offset_ = 0;
+}
+
+size_t FrameAllocator::getBytesUsed() const {
+    return offset_ + overflowBytes_;
+}
+
+size_t FrameAllocator::getCapacity() const {
+    return capacity_;
+}
+
+void* FrameAllocator::do_allocate(size_t bytes, size_t alignment) {
+    uintptr_t blockStart = reinterpret_cast<uintptr_t>(block_.get());
+    uintptr_t address = (blockStart + offset_ + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+    if (address + bytes <= blockStart + capacity_) {
+        offset_ = address + bytes - blockStart;
+        return reinterpret_cast<void*>(address);
+    }
+    
+    overflowBlocks_.emplace_back(new unsigned char[bytes + alignment]);    // Out of space, this frame falls back to the heap.
+    overflowBytes_ += bytes + alignment;
+    uintptr_t overflowStart = reinterpret_cast<uintptr_t>(overflowBlocks_.back().get());
+    return reinterpret_cast<void*>((overflowStart + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+}
+
+void FrameAllocator::do_deallocate(void* /*p*/, size_t /*bytes*/, size_t /*alignment*/) {
+}
+
+bool FrameAllocator::do_is_equal(const pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
@@ -0,0 +1,34 @@
+#ifndef FRAME_ALLOCATOR_H_
+#define FRAME_ALLOCATOR_H_
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+using namespace std;
+
+class FrameAllocator : public pmr::memory_resource {    // Linear (bump) allocator for data that only lives until the end of the frame. Allocating moves an offset forward, deallocating does nothing, and reset() frees everything at once. Containers use it through pmr::polymorphic_allocator, for example pmr::vector<glm::vec3> v(&frameAllocator). Only for the render thread.
+    public:
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+    
+    FrameAllocator(size_t capacity = DEFAULT_CAPACITY);
+    FrameAllocator(const FrameAllocator& allocator) = delete;
+    FrameAllocator& operator=(const FrameAllocator& allocator) = delete;
+    const char* format(const char* format, ...);    // Writes a printf style string into the frame, it stays valid until reset().
+    void reset();    // Called at the end of each frame. If the frame ran out of space, the block grows so the next one fits without going to the heap.
+    size_t getBytesUsed() const;    // Since the last reset(), including anything that didn't fit in the block.
+    size_t getCapacity() const;
+    
+    private:
+    unique_ptr<unsigned char[]> block_;
+    size_t capacity_, offset_;
+    vector<unique_ptr<unsigned char[]>> overflowBlocks_;    // Heap allocations for requests that didn't fit, freed at the next reset().
+    size_t overflowBytes_;
+    
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;    // Does nothing, the memory is reclaimed by reset().
+    bool do_is_equal(const pmr::memory_resource& other) const noexcept override;
+};
+
+#endif
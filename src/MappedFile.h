@@ -0,0 +1,32 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+class MappedFile {    // Read-only memory mapping of a whole file, the OS pages in the contents as they are accessed.
+    public:
+    MappedFile();
+    MappedFile(const string& filename);
+    ~MappedFile();
+    MappedFile(const MappedFile& file) = delete;
+    MappedFile& operator=(const MappedFile& file) = delete;
+    bool open(const string& filename);    // Returns false if the file doesn't exist, is empty, or can't be mapped.
+    void close();
+    bool isOpen() const;
+    const uint8_t* getData() const;
+    size_t getSize() const;
+    
+    private:
+    const uint8_t* data_;
+    size_t size_;
+#ifdef _WIN32
+    void* fileHandle_;
+    void* mappingHandle_;
+#endif
+};
+
+#endif
@@ -1,13 +1,70 @@
+#include "BinaryModel.h"
+#include "MappedFile.h"
 #include "Mesh.h"
+#include "MeshOptimizer.h"
 #include "RenderApp.h"
 #include "Shader.h"
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 #include <utility>
 
+namespace {
+    constexpr unsigned int DEPTH_STREAM_ATTRIBUTES = (1u << RenderApp::ATTRIBUTE_LOCATION_V_POSITION) | (1u << RenderApp::ATTRIBUTE_LOCATION_V_BONE) | (1u << RenderApp::ATTRIBUTE_LOCATION_V_WEIGHT);
+    
+    void writeBufferContents(BinaryModel::Writer& writer, unsigned int bufferHandle) {    // Reads back through the copy target so the element buffer bound to the current vertex array is left alone.
+        int bufferSize = 0;
+        vector<uint8_t> data;
+        if (bufferHandle != 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, bufferHandle);
+            glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &bufferSize);
+            data.resize(bufferSize);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, bufferSize, data.data());
+        }
+        writer.writeVector(data);
+    }
+}
+
+void Mesh::VertexLayout::addAttribute(unsigned int location, int numComponents, unsigned int type, bool normalized, bool integer) {
+    unsigned int size;
+    if (type == GL_INT_2_10_10_10_REV || type == GL_UNSIGNED_INT_2_10_10_10_REV) {
+        size = 4;
+    } else if (type == GL_BYTE || type == GL_UNSIGNED_BYTE) {
+        size = numComponents;
+    } else if (type == GL_SHORT || type == GL_UNSIGNED_SHORT || type == GL_HALF_FLOAT) {
+        size = numComponents * 2;
+    } else {
+        size = numComponents * 4;
+    }
+    attributes.emplace_back(location, numComponents, type, normalized, integer, stride);
+    stride += (size + 3) / 4 * 4;
+}
+
+void Mesh::VertexLayout::apply() const {
+    for (const VertexAttribute& a : attributes) {
+        glEnableVertexAttribArray(a.location);
+        if (a.integer) {
+            glVertexAttribIPointer(a.location, a.numComponents, a.type, stride, reinterpret_cast<void*>(static_cast<size_t>(a.offset)));
+        } else {
+            glVertexAttribPointer(a.location, a.numComponents, a.type, a.normalized, stride, reinterpret_cast<void*>(static_cast<size_t>(a.offset)));
+        }
+    }
+}
+
+void Mesh::MultiDrawArrays::resize(size_t count) {
+    if (count > indexCounts.size()) {
+        indexCounts.resize(count);
+        indexOffsets.resize(count, nullptr);
+        baseVertices.resize(count);
+    }
+}
+
 void Mesh::VertexBone::addBone(uint8_t id, float w) {
     if (weight.x == 0.0f) {
         bone |= static_cast<uint32_t>(id);
@@ -26,53 +83,130 @@ void Mesh::VertexBone::addBone(uint8_t id, float w) {
     }
 }
 
+glm::vec3 Mesh::lodCameraPosition_(0.0f);
+float Mesh::lodProjectionScale_ = 0.0f;
+float Mesh::lodBias_ = 1.0f;
+unsigned int Mesh::lodViewIndex_ = 0;
+
+void Mesh::setLodView(const glm::vec3& cameraPosition, float projectionScale, float lodBias, unsigned int viewIndex) {
+    assert(viewIndex < NUM_LOD_VIEWS);
+    lodCameraPosition_ = cameraPosition;
+    lodProjectionScale_ = projectionScale;
+    lodBias_ = lodBias;
+    lodViewIndex_ = viewIndex;
+}
+
 Mesh::Mesh() {
     vertexArrayHandle_ = 0;
     vertexBufferHandle_ = 0;
     elementBufferHandle_ = 0;
+    depthVertexArrayHandle_ = 0;
+    depthVertexBufferHandle_ = 0;
+    skinnedVertexArrayHandle_ = 0;
+    skinnedVertexBufferHandle_ = 0;
+    numVertices_ = 0;
+    indexType_ = GL_UNSIGNED_INT;
+    vertexFormat_ = PackedAttributes;
+    hasBones_ = false;
+    positionDecodeMtx_ = glm::mat4(1.0f);
+    boundsCenter_ = glm::vec3(0.0f);
+    boundsRadius_ = 0.0f;
 }
 
-Mesh::Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices) {
+Mesh::Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, unsigned int vertexFormat) {
     vertexArrayHandle_ = 0;
     vertexBufferHandle_ = 0;
     elementBufferHandle_ = 0;
-    generateMesh(move(vertices), move(indices));
+    depthVertexArrayHandle_ = 0;
+    depthVertexBufferHandle_ = 0;
+    skinnedVertexArrayHandle_ = 0;
+    skinnedVertexBufferHandle_ = 0;
+    numVertices_ = 0;
+    indexType_ = GL_UNSIGNED_INT;
+    vertexFormat_ = PackedAttributes;
+    hasBones_ = false;
+    positionDecodeMtx_ = glm::mat4(1.0f);
+    boundsCenter_ = glm::vec3(0.0f);
+    boundsRadius_ = 0.0f;
+    generateMesh(move(vertices), move(indices), vertexFormat);
 }
 
-Mesh::Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures) {
+Mesh::Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, unsigned int vertexFormat) {
     vertexArrayHandle_ = 0;
     vertexBufferHandle_ = 0;
     elementBufferHandle_ = 0;
-    generateMesh(move(vertices), move(indices), move(textures));
+    depthVertexArrayHandle_ = 0;
+    depthVertexBufferHandle_ = 0;
+    skinnedVertexArrayHandle_ = 0;
+    skinnedVertexBufferHandle_ = 0;
+    numVertices_ = 0;
+    indexType_ = GL_UNSIGNED_INT;
+    vertexFormat_ = PackedAttributes;
+    hasBones_ = false;
+    positionDecodeMtx_ = glm::mat4(1.0f);
+    boundsCenter_ = glm::vec3(0.0f);
+    boundsRadius_ = 0.0f;
+    generateMesh(move(vertices), move(indices), move(textures), vertexFormat);
 }
 
-Mesh::Mesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices) {
+Mesh::Mesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, unsigned int vertexFormat) {
     vertexArrayHandle_ = 0;
     vertexBufferHandle_ = 0;
     elementBufferHandle_ = 0;
-    generateMesh(move(vertices), move(indices));
+    depthVertexArrayHandle_ = 0;
+    depthVertexBufferHandle_ = 0;
+    skinnedVertexArrayHandle_ = 0;
+    skinnedVertexBufferHandle_ = 0;
+    numVertices_ = 0;
+    indexType_ = GL_UNSIGNED_INT;
+    vertexFormat_ = PackedAttributes;
+    hasBones_ = false;
+    positionDecodeMtx_ = glm::mat4(1.0f);
+    boundsCenter_ = glm::vec3(0.0f);
+    boundsRadius_ = 0.0f;
+    generateMesh(move(vertices), move(indices), vertexFormat);
 }
 
-Mesh::Mesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures) {
+Mesh::Mesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, unsigned int vertexFormat) {
     vertexArrayHandle_ = 0;
     vertexBufferHandle_ = 0;
     elementBufferHandle_ = 0;
-    generateMesh(move(vertices), move(indices), move(textures));
+    depthVertexArrayHandle_ = 0;
+    depthVertexBufferHandle_ = 0;
+    skinnedVertexArrayHandle_ = 0;
+    skinnedVertexBufferHandle_ = 0;
+    numVertices_ = 0;
+    indexType_ = GL_UNSIGNED_INT;
+    vertexFormat_ = PackedAttributes;
+    hasBones_ = false;
+    positionDecodeMtx_ = glm::mat4(1.0f);
+    boundsCenter_ = glm::vec3(0.0f);
+    boundsRadius_ = 0.0f;
+    generateMesh(move(vertices), move(indices), move(textures), vertexFormat);
 }
 
 Mesh::~Mesh() {
-    glDeleteVertexArrays(1, &vertexArrayHandle_);
-    glDeleteBuffers(1, &vertexBufferHandle_);
-    glDeleteBuffers(1, &elementBufferHandle_);
+    if (vertexArrayHandle_ != 0) {    // Meshes that were never uploaded may be destroyed on threads without an OpenGL context.
+        glDeleteVertexArrays(1, &vertexArrayHandle_);
+        glDeleteBuffers(1, &vertexBufferHandle_);
+        glDeleteBuffers(1, &elementBufferHandle_);
+        glDeleteVertexArrays(1, &depthVertexArrayHandle_);
+        glDeleteBuffers(1, &depthVertexBufferHandle_);
+        glDeleteVertexArrays(1, &skinnedVertexArrayHandle_);
+    }
 }
 
-Mesh::Mesh(Mesh&& mesh) : vertexArrayHandle_(mesh.vertexArrayHandle_), vertexBufferHandle_(mesh.vertexBufferHandle_), elementBufferHandle_(mesh.elementBufferHandle_) {
+Mesh::Mesh(Mesh&& mesh) : vertexArrayHandle_(mesh.vertexArrayHandle_), vertexBufferHandle_(mesh.vertexBufferHandle_), elementBufferHandle_(mesh.elementBufferHandle_), depthVertexArrayHandle_(mesh.depthVertexArrayHandle_), depthVertexBufferHandle_(mesh.depthVertexBufferHandle_), skinnedVertexArrayHandle_(mesh.skinnedVertexArrayHandle_), skinnedVertexBufferHandle_(mesh.skinnedVertexBufferHandle_), numVertices_(mesh.numVertices_), indexType_(mesh.indexType_), vertexFormat_(mesh.vertexFormat_), hasBones_(mesh.hasBones_), positionDecodeMtx_(mesh.positionDecodeMtx_), lods_(move(mesh.lods_)), boundsCenter_(mesh.boundsCenter_), boundsRadius_(mesh.boundsRadius_) {
+    pendingUpload_ = move(mesh.pendingUpload_);
     vertexPositions_ = move(mesh.vertexPositions_);
     indices_ = move(mesh.indices_);
     textures_ = move(mesh.textures_);
     mesh.vertexArrayHandle_ = 0;
     mesh.vertexBufferHandle_ = 0;
     mesh.elementBufferHandle_ = 0;
+    mesh.depthVertexArrayHandle_ = 0;
+    mesh.depthVertexBufferHandle_ = 0;
+    mesh.skinnedVertexArrayHandle_ = 0;
 }
 
 Mesh& Mesh::operator=(Mesh&& mesh) {
@@ -82,74 +216,126 @@ Mesh& Mesh::operator=(Mesh&& mesh) {
     vertexArrayHandle_ = mesh.vertexArrayHandle_;
     vertexBufferHandle_ = mesh.vertexBufferHandle_;
     elementBufferHandle_ = mesh.elementBufferHandle_;
+    depthVertexArrayHandle_ = mesh.depthVertexArrayHandle_;
+    depthVertexBufferHandle_ = mesh.depthVertexBufferHandle_;
+    skinnedVertexArrayHandle_ = mesh.skinnedVertexArrayHandle_;
+    skinnedVertexBufferHandle_ = mesh.skinnedVertexBufferHandle_;
+    numVertices_ = mesh.numVertices_;
+    indexType_ = mesh.indexType_;
+    vertexFormat_ = mesh.vertexFormat_;
+    hasBones_ = mesh.hasBones_;
+    positionDecodeMtx_ = mesh.positionDecodeMtx_;
+    lods_ = move(mesh.lods_);
+    boundsCenter_ = mesh.boundsCenter_;
+    boundsRadius_ = mesh.boundsRadius_;
+    pendingUpload_ = move(mesh.pendingUpload_);
     mesh.vertexArrayHandle_ = 0;
     mesh.vertexBufferHandle_ = 0;
     mesh.elementBufferHandle_ = 0;
+    mesh.depthVertexArrayHandle_ = 0;
+    mesh.depthVertexBufferHandle_ = 0;
+    mesh.skinnedVertexArrayHandle_ = 0;
     return *this;
 }
 
+unsigned int Mesh::getVertexFormat() const {
+    return vertexFormat_;
+}
+
+unsigned int Mesh::getNumVertices() const {
+    return numVertices_;
+}
+
+const glm::mat4& Mesh::getPositionDecodeMtx() const {
+    return positionDecodeMtx_;
+}
+
+const vector<Mesh::LevelOfDetail>& Mesh::getLods() const {
+    return lods_;
+}
+
 void Mesh::bindVAO() const {
     glBindVertexArray(vertexArrayHandle_);
 }
 
-void Mesh::generateMesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices) {
+bool Mesh::isUploaded() const {
+    return vertexArrayHandle_ != 0;
+}
+
+void Mesh::generateMesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, unsigned int vertexFormat) {
+    prepareMesh(move(vertices), move(indices), vector<Texture>(), vertexFormat);
+    upload();
+}
+
+void Mesh::generateMesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, unsigned int vertexFormat) {
+    prepareMesh(move(vertices), move(indices), move(textures), vertexFormat);
+    upload();
+}
+
+void Mesh::generateMesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, unsigned int vertexFormat) {
+    prepareMesh(move(vertices), move(indices), vector<Texture>(), vertexFormat);
+    upload();
+}
+
+void Mesh::generateMesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, unsigned int vertexFormat) {
+    prepareMesh(move(vertices), move(indices), move(textures), vertexFormat);
+    upload();
+}
+
+void Mesh::prepareMesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, unsigned int vertexFormat) {
     vertexPositions_.reserve(vertices.size());
     for (const Vertex& v : vertices) {
         vertexPositions_.emplace_back(v.pos);
     }
     indices_ = indices;
-    
-    generateBuffers();    // Generate handles for VAO, VBO, and EBO and send data.
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size() * sizeof(unsigned int), indices_.data(), GL_STATIC_DRAW);
-    
-    glEnableVertexAttribArray(RenderApp::ATTRIBUTE_LOCATION_V_POSITION);    // Specify the position and stride for vertices, normals, and tex coords in the array.
-    glVertexAttribPointer(RenderApp::ATTRIBUTE_LOCATION_V_POSITION, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(0));
-    glEnableVertexAttribArray(RenderApp::ATTRIBUTE_LOCATION_V_NORMAL);
-    glVertexAttribPointer(RenderApp::ATTRIBUTE_LOCATION_V_NORMAL, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(sizeof(float) * 3));
-    glEnableVertexAttribArray(RenderApp::ATTRIBUTE_LOCATION_V_TEX_COORDS);
-    glVertexAttribPointer(RenderApp::ATTRIBUTE_LOCATION_V_TEX_COORDS, 2, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(sizeof(float) * 6));
-    glEnableVertexAttribArray(RenderApp::ATTRIBUTE_LOCATION_V_TANGENT);
-    glVertexAttribPointer(RenderApp::ATTRIBUTE_LOCATION_V_TANGENT, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(sizeof(float) * 8));
-    glEnableVertexAttribArray(RenderApp::ATTRIBUTE_LOCATION_V_BITANGENT);
-    glVertexAttribPointer(RenderApp::ATTRIBUTE_LOCATION_V_BITANGENT, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(sizeof(float) * 11));
-}
-
-void Mesh::generateMesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures) {
-    generateMesh(move(vertices), move(indices));
     textures_ = textures;
+    hasBones_ = false;
+    setVertexFormat(vertexFormat);
+    packVertexBuffers(vertices);
 }
 
-void Mesh::generateMesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices) {
+void Mesh::prepareMesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, unsigned int vertexFormat) {
     vertexPositions_.reserve(vertices.size());
     for (const VertexBone& v : vertices) {
         vertexPositions_.emplace_back(v.pos);
     }
     indices_ = indices;
+    textures_ = textures;
+    if (vertexFormat & QuantizedPositions) {    // Bone transforms are applied before the modelMtx, so the position decode can't be folded into it.
+        cout << "Warn: Quantized positions are not supported for meshes with bones.\n";
+        vertexFormat &= ~QuantizedPositions;
+    }
+    hasBones_ = true;
+    setVertexFormat(vertexFormat);
+    packVertexBuffers(vertices);
+}
+
+void Mesh::upload() {
+    assert(pendingUpload_);
+    for (Texture& t : textures_) {
+        if (t.handle == 0 && !t.filename.empty()) {
+            t.handle = RenderApp::loadTexture(t.filename, t.gammaCorrection);
+        }
+    }
     
     generateBuffers();    // Generate handles for VAO, VBO, and EBO and send data.
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(VertexBone), vertices.data(), GL_STATIC_DRAW);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size() * sizeof(unsigned int), indices_.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, pendingUpload_->vertexDataSize, pendingUpload_->vertexData, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, pendingUpload_->indexDataSize, pendingUpload_->indexData, GL_STATIC_DRAW);
+    VertexLayout layout = generateLayout(false);
+    layout.apply();
+    numVertices_ = static_cast<unsigned int>(pendingUpload_->vertexDataSize / layout.stride);
     
-    glEnableVertexAttribArray(RenderApp::ATTRIBUTE_LOCATION_V_POSITION);    // Specify the position and stride for vertices, normals, and tex coords in the array.
-    glVertexAttribPointer(RenderApp::ATTRIBUTE_LOCATION_V_POSITION, 3, GL_FLOAT, false, sizeof(VertexBone), reinterpret_cast<void*>(0));
-    glEnableVertexAttribArray(RenderApp::ATTRIBUTE_LOCATION_V_NORMAL);
-    glVertexAttribPointer(RenderApp::ATTRIBUTE_LOCATION_V_NORMAL, 3, GL_FLOAT, false, sizeof(VertexBone), reinterpret_cast<void*>(sizeof(float) * 3));
-    glEnableVertexAttribArray(RenderApp::ATTRIBUTE_LOCATION_V_TEX_COORDS);
-    glVertexAttribPointer(RenderApp::ATTRIBUTE_LOCATION_V_TEX_COORDS, 2, GL_FLOAT, false, sizeof(VertexBone), reinterpret_cast<void*>(sizeof(float) * 6));
-    glEnableVertexAttribArray(RenderApp::ATTRIBUTE_LOCATION_V_TANGENT);
-    glVertexAttribPointer(RenderApp::ATTRIBUTE_LOCATION_V_TANGENT, 3, GL_FLOAT, false, sizeof(VertexBone), reinterpret_cast<void*>(sizeof(float) * 8));
-    glEnableVertexAttribArray(RenderApp::ATTRIBUTE_LOCATION_V_BITANGENT);
-    glVertexAttribPointer(RenderApp::ATTRIBUTE_LOCATION_V_BITANGENT, 3, GL_FLOAT, false, sizeof(VertexBone), reinterpret_cast<void*>(sizeof(float) * 11));
-    glEnableVertexAttribArray(RenderApp::ATTRIBUTE_LOCATION_V_BONE);
-    glVertexAttribIPointer(RenderApp::ATTRIBUTE_LOCATION_V_BONE, 1, GL_UNSIGNED_INT, sizeof(VertexBone), reinterpret_cast<void*>(sizeof(float) * 14));
-    glEnableVertexAttribArray(RenderApp::ATTRIBUTE_LOCATION_V_WEIGHT);
-    glVertexAttribPointer(RenderApp::ATTRIBUTE_LOCATION_V_WEIGHT, 4, GL_FLOAT, false, sizeof(VertexBone), reinterpret_cast<void*>(sizeof(float) * 14 + sizeof(unsigned int)));
-}
-
-void Mesh::generateMesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures) {
-    generateMesh(move(vertices), move(indices));
-    textures_ = textures;
+    if (pendingUpload_->depthVertexDataSize > 0) {    // Second VAO shares the element buffer but reads from the depth buffer.
+        assert(depthVertexArrayHandle_ == 0);
+        glGenVertexArrays(1, &depthVertexArrayHandle_);
+        glBindVertexArray(depthVertexArrayHandle_);
+        glGenBuffers(1, &depthVertexBufferHandle_);
+        glBindBuffer(GL_ARRAY_BUFFER, depthVertexBufferHandle_);
+        glBufferData(GL_ARRAY_BUFFER, pendingUpload_->depthVertexDataSize, pendingUpload_->depthVertexData, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBufferHandle_);
+        generateLayout(true).apply();
+    }
+    pendingUpload_.reset();
 }
 
 void Mesh::generateCube(float sideLength) {
@@ -248,7 +434,7 @@ void Mesh::generateSphere(float radius, int numSectors, int numStacks) {
         }
     }
     
-    generateMesh(move(vertices), move(indices));
+    generateMesh(move(vertices), move(indices), PackedAttributes | GenerateLODs);
 }
 
 void Mesh::generateCylinder(float radiusBase, float radiusTop, float height, int numSectors, int numStacks, bool originAtBase) {
@@ -364,6 +550,62 @@ void Mesh::generateCylinder(float radiusBase, float radiusTop, float height, int
     generateMesh(move(vertices), move(indices));
 }
 
+void Mesh::loadBinary(BinaryModel::Reader& reader, const shared_ptr<const MappedFile>& file) {
+    vertexFormat_ = reader.read<uint32_t>();    // Read everything before creating any buffers, the reader throws if the file is cut short.
+    hasBones_ = reader.read<uint8_t>() != 0;
+    indexType_ = reader.read<uint32_t>();
+    positionDecodeMtx_ = reader.read<glm::mat4>();
+    boundsCenter_ = reader.read<glm::vec3>();
+    boundsRadius_ = reader.read<float>();
+    reader.readVector(lods_);
+    if (lods_.empty() || (indexType_ != GL_UNSIGNED_SHORT && indexType_ != GL_UNSIGNED_INT)) {
+        throw runtime_error("Invalid mesh data.");
+    }
+    vector<Texture> textures(reader.read<uint32_t>());
+    for (Texture& t : textures) {
+        t.handle = 0;    // Loaded in upload().
+        t.index = reader.read<uint32_t>();
+        t.gammaCorrection = reader.read<uint8_t>() != 0;
+        t.filename = reader.readString();
+    }
+    unique_ptr<PendingUpload> pendingUpload(new PendingUpload());
+    pendingUpload->file = file;
+    pendingUpload->vertexData = reader.readBlock(&pendingUpload->vertexDataSize);
+    pendingUpload->depthVertexData = reader.readBlock(&pendingUpload->depthVertexDataSize);
+    pendingUpload->indexData = reader.readBlock(&pendingUpload->indexDataSize);
+    
+    textures_ = move(textures);
+    pendingUpload_ = move(pendingUpload);
+}
+
+void Mesh::saveBinary(BinaryModel::Writer& writer) const {
+    writer.write<uint32_t>(vertexFormat_);
+    writer.write<uint8_t>(hasBones_ ? 1 : 0);
+    writer.write<uint32_t>(indexType_);
+    writer.write<glm::mat4>(positionDecodeMtx_);
+    writer.write<glm::vec3>(boundsCenter_);
+    writer.write<float>(boundsRadius_);
+    writer.writeVector(lods_);
+    uint32_t numTextures = static_cast<uint32_t>(count_if(textures_.begin(), textures_.end(), [](const Texture& t) { return !t.filename.empty(); }));
+    writer.write<uint32_t>(numTextures);
+    for (const Texture& t : textures_) {
+        if (!t.filename.empty()) {
+            writer.write<uint32_t>(t.index);
+            writer.write<uint8_t>(t.gammaCorrection ? 1 : 0);
+            writer.writeString(t.filename);
+        }
+    }
+    if (pendingUpload_) {    // Prepared meshes still have the data on the CPU side, so this doesn't need OpenGL.
+        writer.writeBlock(pendingUpload_->vertexData, pendingUpload_->vertexDataSize);
+        writer.writeBlock(pendingUpload_->depthVertexData, pendingUpload_->depthVertexDataSize);
+        writer.writeBlock(pendingUpload_->indexData, pendingUpload_->indexDataSize);
+    } else {
+        writeBufferContents(writer, vertexBufferHandle_);
+        writeBufferContents(writer, depthVertexBufferHandle_);
+        writeBufferContents(writer, elementBufferHandle_);
+    }
+}
+
 void Mesh::applyMat4InstanceBuffer(unsigned int startIndex, unsigned int stride, size_t offset) const {
     glBindVertexArray(vertexArrayHandle_);
     glEnableVertexAttribArray(startIndex);
@@ -388,15 +630,43 @@ void Mesh::draw(const Shader& shader, const glm::mat4& modelMtx) const {
     drawGeometry(shader, modelMtx);
 }
 
+void Mesh::draw(const Shader& shader, const glm::mat4& modelMtx, LodState& lodState) const {
+    for (const Texture& t : textures_) {
+        glActiveTexture(GL_TEXTURE0 + t.index);
+        glBindTexture(GL_TEXTURE_2D, t.handle);
+    }
+    drawGeometry(shader, modelMtx, lodState);
+}
+
 void Mesh::drawGeometry() const {
+    if (vertexArrayHandle_ == 0) {    // Not uploaded yet.
+        return;
+    }
     glBindVertexArray(vertexArrayHandle_);
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices_.size()), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(lods_[0].indexCount), indexType_, 0);
 }
 
-void Mesh::drawGeometry(const Shader& shader, const glm::mat4& modelMtx) const {
-    shader.setMat4("modelMtx", modelMtx);
-    glBindVertexArray(vertexArrayHandle_);
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices_.size()), GL_UNSIGNED_INT, 0);
+void Mesh::drawGeometry(const Shader& shader, const glm::mat4& modelMtx) const {    // LOD selection only happens here since the other draw functions don't know where the mesh is.
+    drawLod(shader, modelMtx, nullptr);
+}
+
+void Mesh::drawGeometry(const Shader& shader, const glm::mat4& modelMtx, LodState& lodState) const {
+    drawLod(shader, modelMtx, &lodState);
+}
+
+void Mesh::drawLod(const Shader& shader, const glm::mat4& modelMtx, LodState* lodState) const {
+    if (vertexArrayHandle_ == 0) {
+        return;
+    }
+    shader.setMat4("modelMtx", (vertexFormat_ & QuantizedPositions) ? modelMtx * positionDecodeMtx_ : modelMtx);
+    bindVertexArray(shader);
+    if (lods_.size() > 1) {
+        const LevelOfDetail& lod = lods_[selectLod(modelMtx, lodState)];
+        size_t indexSize = (indexType_ == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int));
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(lod.indexCount), indexType_, reinterpret_cast<void*>(lod.indexOffset * indexSize));
+    } else {
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(lods_[0].indexCount), indexType_, 0);
+    }
 }
 
 void Mesh::drawInstanced(unsigned int count) const {
@@ -408,8 +678,291 @@ void Mesh::drawInstanced(unsigned int count) const {
 }
 
 void Mesh::drawGeometryInstanced(unsigned int count) const {
+    if (vertexArrayHandle_ == 0) {
+        return;
+    }
     glBindVertexArray(vertexArrayHandle_);
-    glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(indices_.size()), GL_UNSIGNED_INT, 0, count);
+    glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(lods_[0].indexCount), indexType_, 0, count);
+}
+
+void Mesh::drawInstanced(const Shader& shader, const glm::mat4& modelMtx, unsigned int count) const {
+    for (const Texture& t : textures_) {
+        glActiveTexture(GL_TEXTURE0 + t.index);
+        glBindTexture(GL_TEXTURE_2D, t.handle);
+    }
+    drawGeometryInstanced(shader, modelMtx, count);
+}
+
+void Mesh::drawGeometryInstanced(const Shader& shader, const glm::mat4& modelMtx, unsigned int count) const {
+    if (vertexArrayHandle_ == 0) {
+        return;
+    }
+    shader.setMat4("modelMtx", (vertexFormat_ & QuantizedPositions) ? modelMtx * positionDecodeMtx_ : modelMtx);
+    bindVertexArray(shader);
+    glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(lods_[0].indexCount), indexType_, 0, count);
+}
+
+void Mesh::drawPoints(unsigned int count) const {
+    if (vertexArrayHandle_ == 0) {
+        return;
+    }
+    glBindVertexArray(vertexArrayHandle_);
+    glDrawArraysInstanced(GL_POINTS, 0, static_cast<GLsizei>(numVertices_), count);
+}
+
+void Mesh::drawSkinned(const Shader& shader, unsigned int skinnedBufferHandle, const VertexLayout& layout, unsigned int baseVertex, unsigned int count, MultiDrawArrays& drawArrays) const {
+    if (vertexArrayHandle_ == 0) {
+        return;
+    }
+    for (const Texture& t : textures_) {
+        glActiveTexture(GL_TEXTURE0 + t.index);
+        glBindTexture(GL_TEXTURE_2D, t.handle);
+    }
+    if (skinnedVertexArrayHandle_ == 0) {    // Shares the element buffer, so the same indices (and LODs) address each copy with a base vertex.
+        glGenVertexArrays(1, &skinnedVertexArrayHandle_);
+        glBindVertexArray(skinnedVertexArrayHandle_);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBufferHandle_);
+    } else {
+        glBindVertexArray(skinnedVertexArrayHandle_);
+    }
+    if (skinnedVertexBufferHandle_ != skinnedBufferHandle) {
+        glBindBuffer(GL_ARRAY_BUFFER, skinnedBufferHandle);
+        layout.apply();
+        skinnedVertexBufferHandle_ = skinnedBufferHandle;
+    }
+    
+    shader.setMat4("modelMtx", glm::mat4(1.0f));    // The skinned vertices are already in world space.
+    assert(drawArrays.indexCounts.size() >= count);
+    for (unsigned int i = 0; i < count; ++i) {
+        drawArrays.indexCounts[i] = static_cast<GLsizei>(lods_[0].indexCount);
+        drawArrays.baseVertices[i] = static_cast<GLint>(baseVertex + i * numVertices_);
+    }
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawArrays.indexCounts.data(), indexType_, drawArrays.indexOffsets.data(), static_cast<GLsizei>(count), drawArrays.baseVertices.data());
+}
+
+void Mesh::setVertexFormat(unsigned int vertexFormat) {
+    vertexFormat_ = vertexFormat;
+    positionDecodeMtx_ = glm::mat4(1.0f);
+    if (!(vertexFormat_ & QuantizedPositions) || vertexPositions_.empty()) {
+        return;
+    }
+    
+    glm::vec3 minPosition = vertexPositions_[0], maxPosition = vertexPositions_[0];
+    for (const glm::vec3& p : vertexPositions_) {
+        minPosition = glm::min(minPosition, p);
+        maxPosition = glm::max(maxPosition, p);
+    }
+    glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+    float halfExtent = max(max(maxPosition.x - center.x, maxPosition.y - center.y), maxPosition.z - center.z);
+    if (halfExtent <= 0.0f) {
+        halfExtent = 1.0f;
+    }
+    positionDecodeMtx_ = glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(halfExtent));    // Scale is uniform so the normal matrix is unaffected (besides length).
+}
+
+Mesh::VertexLayout Mesh::generateLayout(bool positionOnly) const {
+    VertexLayout layout;
+    if (vertexFormat_ & QuantizedPositions) {
+        layout.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_POSITION, 3, GL_SHORT, true);
+    } else {
+        layout.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_POSITION, 3, GL_FLOAT);
+    }
+    if (!positionOnly) {
+        if (vertexFormat_ & PackedAttributes) {
+            layout.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_NORMAL, 4, GL_INT_2_10_10_10_REV, true);
+            layout.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_TEX_COORDS, 2, GL_HALF_FLOAT);
+            layout.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_TANGENT, 4, GL_INT_2_10_10_10_REV, true);
+        } else {
+            layout.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_NORMAL, 3, GL_FLOAT);
+            layout.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_TEX_COORDS, 2, GL_FLOAT);
+            layout.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_TANGENT, 4, GL_FLOAT);
+        }
+    }
+    if (hasBones_) {
+        layout.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_BONE, 1, GL_UNSIGNED_INT, false, true);
+        if (vertexFormat_ & PackedAttributes) {
+            layout.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_WEIGHT, 4, GL_UNSIGNED_BYTE, true);
+        } else {
+            layout.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_WEIGHT, 4, GL_FLOAT);
+        }
+    }
+    return layout;
+}
+
+template<typename V>
+void Mesh::packVertexBuffers(const vector<V>& vertices) {
+    unique_ptr<PendingUpload> pendingUpload(new PendingUpload());
+    VertexLayout layout = generateLayout(false);    // Pack the vertices into the layout for the chosen format.
+    vector<uint8_t>& vertexData = pendingUpload->vertexStorage;
+    vertexData.resize(vertices.size() * layout.stride);
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        packVertexAttributes(&vertexData[i * layout.stride], layout, vertices[i]);
+        packBoneAttributes(&vertexData[i * layout.stride], layout, vertices[i]);
+    }
+    
+    if (vertexFormat_ & DepthStream) {    // Tightly packed position (and bone) buffer for depth-only passes.
+        VertexLayout depthLayout = generateLayout(true);
+        vector<uint8_t>& depthVertexData = pendingUpload->depthVertexStorage;
+        depthVertexData.resize(vertices.size() * depthLayout.stride);
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            packVertexAttributes(&depthVertexData[i * depthLayout.stride], depthLayout, vertices[i]);
+            packBoneAttributes(&depthVertexData[i * depthLayout.stride], depthLayout, vertices[i]);
+        }
+    }
+    
+    vector<unsigned int> lodIndices = generateLods();
+    vector<uint8_t>& indexData = pendingUpload->indexStorage;
+    if (vertices.size() <= 65536) {    // Use 16-bit indices when all vertices can be addressed.
+        indexType_ = GL_UNSIGNED_SHORT;
+        indexData.resize(lodIndices.size() * sizeof(uint16_t));
+        for (size_t i = 0; i < lodIndices.size(); ++i) {
+            uint16_t index = static_cast<uint16_t>(lodIndices[i]);
+            memcpy(&indexData[i * sizeof(uint16_t)], &index, sizeof(uint16_t));
+        }
+    } else {
+        indexType_ = GL_UNSIGNED_INT;
+        indexData.resize(lodIndices.size() * sizeof(unsigned int));
+        memcpy(indexData.data(), lodIndices.data(), indexData.size());
+    }
+    
+    pendingUpload->vertexData = pendingUpload->vertexStorage.data();
+    pendingUpload->vertexDataSize = pendingUpload->vertexStorage.size();
+    pendingUpload->depthVertexData = pendingUpload->depthVertexStorage.data();
+    pendingUpload->depthVertexDataSize = pendingUpload->depthVertexStorage.size();
+    pendingUpload->indexData = pendingUpload->indexStorage.data();
+    pendingUpload->indexDataSize = pendingUpload->indexStorage.size();
+    pendingUpload_ = move(pendingUpload);
+}
+
+template<typename V>
+void Mesh::packVertexAttributes(uint8_t* dest, const VertexLayout& layout, const V& vertex) const {
+    for (const VertexAttribute& a : layout.attributes) {
+        if (a.location == RenderApp::ATTRIBUTE_LOCATION_V_POSITION) {
+            if (vertexFormat_ & QuantizedPositions) {
+                glm::vec3 p = glm::clamp((vertex.pos - glm::vec3(positionDecodeMtx_[3])) / positionDecodeMtx_[0][0], -1.0f, 1.0f);
+                int16_t position[3] = {static_cast<int16_t>(round(p.x * 32767.0f)), static_cast<int16_t>(round(p.y * 32767.0f)), static_cast<int16_t>(round(p.z * 32767.0f))};
+                memcpy(dest + a.offset, position, sizeof(position));
+            } else {
+                memcpy(dest + a.offset, &vertex.pos, sizeof(glm::vec3));
+            }
+        } else if (a.location == RenderApp::ATTRIBUTE_LOCATION_V_NORMAL) {
+            if (vertexFormat_ & PackedAttributes) {
+                uint32_t normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.norm, 0.0f));
+                memcpy(dest + a.offset, &normal, sizeof(uint32_t));
+            } else {
+                memcpy(dest + a.offset, &vertex.norm, sizeof(glm::vec3));
+            }
+        } else if (a.location == RenderApp::ATTRIBUTE_LOCATION_V_TEX_COORDS) {
+            if (vertexFormat_ & PackedAttributes) {
+                uint32_t texCoords = glm::packHalf2x16(vertex.tex);
+                memcpy(dest + a.offset, &texCoords, sizeof(uint32_t));
+            } else {
+                memcpy(dest + a.offset, &vertex.tex, sizeof(glm::vec2));
+            }
+        } else if (a.location == RenderApp::ATTRIBUTE_LOCATION_V_TANGENT) {
+            glm::vec4 tangent(vertex.tan, glm::dot(glm::cross(vertex.norm, vertex.tan), vertex.bitan) < 0.0f ? -1.0f : 1.0f);    // Only the handedness of the bitangent is kept, the shader reconstructs it from the normal and tangent.
+            if (vertexFormat_ & PackedAttributes) {
+                uint32_t packedTangent = glm::packSnorm3x10_1x2(tangent);
+                memcpy(dest + a.offset, &packedTangent, sizeof(uint32_t));
+            } else {
+                memcpy(dest + a.offset, &tangent, sizeof(glm::vec4));
+            }
+        }
+    }
+}
+
+void Mesh::packBoneAttributes(uint8_t* /*dest*/, const VertexLayout& /*layout*/, const Vertex& /*vertex*/) const {}    // No bones to write.
+
+void Mesh::packBoneAttributes(uint8_t* dest, const VertexLayout& layout, const VertexBone& vertex) const {
+    for (const VertexAttribute& a : layout.attributes) {
+        if (a.location == RenderApp::ATTRIBUTE_LOCATION_V_BONE) {
+            memcpy(dest + a.offset, &vertex.bone, sizeof(uint32_t));
+        } else if (a.location == RenderApp::ATTRIBUTE_LOCATION_V_WEIGHT) {
+            if (vertexFormat_ & PackedAttributes) {
+                uint8_t weight[4];
+                int weightSum = 0, largestIndex = 0;
+                for (int i = 0; i < 4; ++i) {
+                    weight[i] = static_cast<uint8_t>(round(glm::clamp(vertex.weight[i], 0.0f, 1.0f) * 255.0f));
+                    weightSum += weight[i];
+                    largestIndex = (vertex.weight[i] > vertex.weight[largestIndex] ? i : largestIndex);
+                }
+                int targetSum = static_cast<int>(round(glm::clamp(vertex.weight.x + vertex.weight.y + vertex.weight.z + vertex.weight.w, 0.0f, 1.0f) * 255.0f));
+                weight[largestIndex] = static_cast<uint8_t>(glm::clamp(weight[largestIndex] + targetSum - weightSum, 0, 255));    // Put the rounding error on the largest weight so the weights still add up.
+                memcpy(dest + a.offset, weight, sizeof(weight));
+            } else {
+                memcpy(dest + a.offset, &vertex.weight, sizeof(glm::vec4));
+            }
+        }
+    }
+}
+
+vector<unsigned int> Mesh::generateLods() {
+    glm::vec3 minPosition(0.0f), maxPosition(0.0f);    // Bounding sphere is used to find the distance to the mesh.
+    if (!vertexPositions_.empty()) {
+        minPosition = vertexPositions_[0];
+        maxPosition = vertexPositions_[0];
+    }
+    for (const glm::vec3& p : vertexPositions_) {
+        minPosition = glm::min(minPosition, p);
+        maxPosition = glm::max(maxPosition, p);
+    }
+    boundsCenter_ = (minPosition + maxPosition) * 0.5f;
+    boundsRadius_ = glm::length(maxPosition - boundsCenter_);
+    
+    lods_.clear();
+    lods_.emplace_back(0, static_cast<unsigned int>(indices_.size()), 0.0f);
+    vector<unsigned int> lodIndices(indices_);
+    if (!(vertexFormat_ & GenerateLODs) || indices_.size() % 3 != 0) {
+        return lodIndices;
+    }
+    
+    constexpr float MAX_LOD_ERROR = 0.1f;    // Relative to the bounding radius.
+    vector<unsigned int> previousLod(indices_);
+    while (lods_.size() < MAX_NUM_LODS) {    // Each LOD is simplified from the previous one to about half the triangles.
+        float error;
+        vector<unsigned int> simplified = MeshOptimizer::simplify(previousLod, vertexPositions_, previousLod.size() / 6 * 3, MAX_LOD_ERROR * boundsRadius_, &error);
+        if (simplified.empty() || simplified.size() > previousLod.size() * 3 / 4) {    // Stop once simplification isn't removing much.
+            break;
+        }
+        MeshOptimizer::optimizeVertexCache(simplified, vertexPositions_.size());
+        lods_.emplace_back(static_cast<unsigned int>(lodIndices.size()), static_cast<unsigned int>(simplified.size()), max(error, lods_.back().error));
+        lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
+        previousLod.swap(simplified);
+    }
+    return lodIndices;
+}
+
+unsigned int Mesh::selectLod(const glm::mat4& modelMtx, LodState* lodState) const {
+    if (lodProjectionScale_ <= 0.0f) {    // No view set.
+        return 0;
+    }
+    constexpr float MAX_PIXEL_ERROR = 1.0f;
+    constexpr float HYSTERESIS = 0.25f;    // A coarser LOD must be this much under the threshold before switching to it, this stops LODs flickering at the boundary.
+    float scale = sqrt(max(max(glm::dot(modelMtx[0], modelMtx[0]), glm::dot(modelMtx[1], modelMtx[1])), glm::dot(modelMtx[2], modelMtx[2])));
+    glm::vec3 center = glm::vec3(modelMtx * glm::vec4(boundsCenter_, 1.0f));
+    float distance = max(glm::length(center - lodCameraPosition_) - boundsRadius_ * scale, 0.001f);
+    float pixelsPerUnit = scale * lodProjectionScale_ / (distance * lodBias_);    // Projected size of one model space unit at the closest point of the bounds.
+    
+    float hysteresis = (lodState != nullptr ? HYSTERESIS : 0.0f);
+    unsigned int lod = (lodState != nullptr ? min(lodState->currentLods[lodViewIndex_], static_cast<unsigned int>(lods_.size() - 1)) : 0);
+    while (lod > 0 && lods_[lod].error * pixelsPerUnit > MAX_PIXEL_ERROR) {
+        --lod;
+    }
+    while (lod + 1 < lods_.size() && lods_[lod + 1].error * pixelsPerUnit < MAX_PIXEL_ERROR * (1.0f - hysteresis)) {
+        ++lod;
+    }
+    if (lodState != nullptr) {
+        lodState->currentLods[lodViewIndex_] = lod;
+    }
+    return lod;
+}
+
+void Mesh::bindVertexArray(const Shader& shader) const {
+    if (depthVertexArrayHandle_ != 0 && (shader.getAttributeMask() & ~DEPTH_STREAM_ATTRIBUTES) == 0) {
+        glBindVertexArray(depthVertexArrayHandle_);
+    } else {
+        glBindVertexArray(vertexArrayHandle_);
+    }
 }
 
 void Mesh::generateBuffers() {
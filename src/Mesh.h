@@ -1,18 +1,70 @@
 #ifndef MESH_H_
 #define MESH_H_
 
+class MappedFile;
 class Shader;
+namespace BinaryModel {
+    class Reader;
+    class Writer;
+}
 
 #include "DrawableInterface.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <memory>
+#include <string>
 #include <vector>
 
 using namespace std;
 
 class Mesh : public DrawableInterface {
     public:
+    enum VertexFormat : unsigned int {    // Flags for the vertex data layout stored in the buffer.
+        FullPrecision = 0,
+        PackedAttributes = 1 << 0,    // Normal and tangent use 2_10_10_10 format, tex coords use half-floats, and bone weights use 8-bit values.
+        QuantizedPositions = 1 << 1,    // Positions use normalized 16-bit values with a per-mesh scale and bias (static meshes only).
+        DepthStream = 1 << 2,    // Keeps a second buffer with only positions (and bones) for depth-only passes.
+        GenerateLODs = 1 << 3    // Adds simplified versions of the mesh to the index buffer, these are picked by screen size when drawing with a modelMtx.
+    };
+    
+    struct LevelOfDetail {
+        unsigned int indexOffset, indexCount;
+        float error;    // Estimated distance from the full detail mesh (in model units). This is the square root of the largest area weighted mean quadric error of the edge collapses so far, not a strict maximum.
+        
+        LevelOfDetail() {}
+        LevelOfDetail(unsigned int indexOffset, unsigned int indexCount, float error) : indexOffset(indexOffset), indexCount(indexCount), error(error) {}
+    };
+    
+    struct VertexAttribute {
+        unsigned int location;
+        int numComponents;
+        unsigned int type;    // Component type (GLenum).
+        bool normalized;
+        bool integer;    // Integer attributes are not converted to floats.
+        unsigned int offset;
+        
+        VertexAttribute() {}
+        VertexAttribute(unsigned int location, int numComponents, unsigned int type, bool normalized, bool integer, unsigned int offset) : location(location), numComponents(numComponents), type(type), normalized(normalized), integer(integer), offset(offset) {}
+    };
+    
+    struct VertexLayout {
+        vector<VertexAttribute> attributes;
+        unsigned int stride;
+        
+        VertexLayout() : stride(0) {}
+        void addAttribute(unsigned int location, int numComponents, unsigned int type, bool normalized = false, bool integer = false);    // Appends an attribute to the end of the vertex, each attribute is aligned to 4 bytes.
+        void apply() const;    // Sets the attribute pointers for the currently bound vertex array and buffer.
+    };
+    
+    struct MultiDrawArrays {    // Arguments for glMultiDrawElementsBaseVertex(), owned by the caller so drawSkinned() doesn't allocate each pass.
+        vector<int> indexCounts;    // GLsizei for each draw.
+        vector<const void*> indexOffsets;    // Always null, the copies share the indices.
+        vector<int> baseVertices;
+        
+        void resize(size_t count);    // Only grows, so the arrays fit the most copies drawn so far.
+    };
+    
     struct Vertex {
         glm::vec3 pos;    // Position.
         glm::vec3 norm;    // Normal.
@@ -42,43 +94,107 @@ class Mesh : public DrawableInterface {
     struct Texture {
         unsigned int handle;
         unsigned int index;
+        string filename;    // Image the texture was loaded from, only textures with a filename are kept in preprocessed model files.
+        bool gammaCorrection;
         
         Texture() {}
-        Texture(unsigned int handle, unsigned int index) : handle(handle), index(index) {}
+        Texture(unsigned int handle, unsigned int index) : handle(handle), index(index), gammaCorrection(false) {}
+        Texture(unsigned int handle, unsigned int index, const string& filename, bool gammaCorrection) : handle(handle), index(index), filename(filename), gammaCorrection(gammaCorrection) {}
+    };
+    
+    static constexpr unsigned int MAX_NUM_LODS = 4;
+    static constexpr unsigned int NUM_LOD_VIEWS = 2;    // Views keep separate LOD state for hysteresis, 0 is the main view and 1 is for shadows.
+    
+    struct LodState {    // LOD picked last time for each view, kept by whatever owns the instance so that instances of the same mesh at different distances don't share it.
+        unsigned int currentLods[NUM_LOD_VIEWS];
+        
+        LodState() : currentLods{} {}
     };
     
-    vector<glm::vec3> vertexPositions_;
+    vector<glm::vec3> vertexPositions_;    // The vertex positions and indices are left empty when the mesh is loaded with loadBinary().
     vector<unsigned int> indices_;
     vector<Texture> textures_;
     
+    static void setLodView(const glm::vec3& cameraPosition, float projectionScale, float lodBias = 1.0f, unsigned int viewIndex = 0);    // Sets the camera used for LOD selection. The projectionScale is the viewport height divided by 2 * tan(fov / 2), larger lodBias picks coarser LODs.
     Mesh();
-    Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices);
-    Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures);
-    Mesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices);
-    Mesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures);
+    Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, unsigned int vertexFormat = PackedAttributes);
+    Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, unsigned int vertexFormat = PackedAttributes);
+    Mesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, unsigned int vertexFormat = PackedAttributes);
+    Mesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, unsigned int vertexFormat = PackedAttributes);
     ~Mesh();
     Mesh(const Mesh& mesh) = delete;
     Mesh& operator=(const Mesh& mesh) = delete;
     Mesh(Mesh&& mesh);
     Mesh& operator=(Mesh&& mesh);
+    unsigned int getVertexFormat() const;
+    unsigned int getNumVertices() const;    // Zero until the mesh is uploaded.
+    const glm::mat4& getPositionDecodeMtx() const;    // Transform from quantized positions back to model space, this is applied to the modelMtx when drawing with a shader.
+    const vector<LevelOfDetail>& getLods() const;    // Full detail first, then each simplified version. Meshes without GenerateLODs only have the first.
     void bindVAO() const;
-    void generateMesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices);    // Sets up the mesh buffers and vertex array given the Vertex data.
-    void generateMesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures);
-    void generateMesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices);     // Sets up the mesh buffers and vertex array given the VertexBone data.
-    void generateMesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures);
+    bool isUploaded() const;    // Meshes that haven't been uploaded yet draw nothing.
+    void generateMesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, unsigned int vertexFormat = PackedAttributes);    // Sets up the mesh buffers and vertex array given the Vertex data.
+    void generateMesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, unsigned int vertexFormat = PackedAttributes);
+    void generateMesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, unsigned int vertexFormat = PackedAttributes);     // Sets up the mesh buffers and vertex array given the VertexBone data.
+    void generateMesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, unsigned int vertexFormat = PackedAttributes);
+    void prepareMesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, unsigned int vertexFormat = PackedAttributes);    // CPU part of generateMesh() that packs the buffer contents, this doesn't use OpenGL so it can run on a worker thread. Call upload() on the GL thread afterwards.
+    void prepareMesh(vector<VertexBone>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, unsigned int vertexFormat = PackedAttributes);
+    void upload();    // Creates the buffers and vertex arrays for a prepared mesh, and loads any textures that only have a filename.
     void generateCube(float sideLength = 1.0f);
     void generateSphere(float radius = 1.0f, int numSectors = 32, int numStacks = 16);
     void generateCylinder(float radiusBase = 1.0f, float radiusTop = 1.0f, float height = 2.0f, int numSectors = 32, int numStacks = 1, bool originAtBase = false);
+    void loadBinary(BinaryModel::Reader& reader, const shared_ptr<const MappedFile>& file);    // Prepares the mesh from data written by saveBinary(), the buffer contents are sent to OpenGL unchanged by upload(). The file stays mapped until then.
+    void saveBinary(BinaryModel::Writer& writer) const;    // Writes the buffer contents (read back from OpenGL if already uploaded) and the state needed to draw them.
     void applyMat4InstanceBuffer(unsigned int startIndex, unsigned int stride, size_t offset) const;    // Binds the vertex array and sets attributes for the currently bound buffer (buffer should contain mat4 data). This uses attributes startIndex to startIndex + 3.
     void draw(const Shader& shader, const glm::mat4& modelMtx) const;
+    void draw(const Shader& shader, const glm::mat4& modelMtx, LodState& lodState) const;
     void drawGeometry() const;
-    void drawGeometry(const Shader& shader, const glm::mat4& modelMtx) const;
+    void drawGeometry(const Shader& shader, const glm::mat4& modelMtx) const;    // Picks the LOD without hysteresis.
+    void drawGeometry(const Shader& shader, const glm::mat4& modelMtx, LodState& lodState) const;    // Picks the LOD with hysteresis, starting from the one the instance used last time.
     void drawInstanced(unsigned int count) const;
     void drawGeometryInstanced(unsigned int count) const;
+    void drawInstanced(const Shader& shader, const glm::mat4& modelMtx, unsigned int count) const;    // Sets the modelMtx shared by all instances, per-instance data comes from the shader (like the bone palettes). Always uses the full detail LOD.
+    void drawGeometryInstanced(const Shader& shader, const glm::mat4& modelMtx, unsigned int count) const;
+    void drawPoints(unsigned int count) const;    // Draws each vertex once as a point for count instances, this is how the skinned vertices get captured with transform feedback (see PreSkinning).
+    void drawSkinned(const Shader& shader, unsigned int skinnedBufferHandle, const VertexLayout& layout, unsigned int baseVertex, unsigned int count, MultiDrawArrays& drawArrays) const;    // Draws count copies of the mesh that were captured into the buffer back to back from baseVertex. The shader should be a non-skinning variant, and drawArrays must already be resized to at least count.
     
     private:
+    struct PendingUpload {    // Buffer contents waiting for upload().
+        vector<uint8_t> vertexStorage, depthVertexStorage, indexStorage;    // Data packed by prepareMesh().
+        shared_ptr<const MappedFile> file;    // Keeps the data mapped when it comes from a preprocessed file instead.
+        const uint8_t* vertexData;
+        const uint8_t* depthVertexData;
+        const uint8_t* indexData;
+        size_t vertexDataSize, depthVertexDataSize, indexDataSize;
+    };
+    
+    static glm::vec3 lodCameraPosition_;
+    static float lodProjectionScale_, lodBias_;
+    static unsigned int lodViewIndex_;
     unsigned int vertexArrayHandle_, vertexBufferHandle_, elementBufferHandle_;
+    unsigned int depthVertexArrayHandle_, depthVertexBufferHandle_;
+    mutable unsigned int skinnedVertexArrayHandle_, skinnedVertexBufferHandle_;    // Created on the first drawSkinned(), the buffer belongs to the caller.
+    unsigned int numVertices_;
+    unsigned int indexType_;
+    unsigned int vertexFormat_;
+    bool hasBones_;
+    glm::mat4 positionDecodeMtx_;
+    vector<LevelOfDetail> lods_;
+    glm::vec3 boundsCenter_;
+    float boundsRadius_;
+    unique_ptr<PendingUpload> pendingUpload_;
     
+    void setVertexFormat(unsigned int vertexFormat);    // Also finds the position scale and bias from vertexPositions_ if positions are quantized.
+    VertexLayout generateLayout(bool positionOnly) const;
+    template<typename V>
+    void packVertexBuffers(const vector<V>& vertices);    // Packs the vertices and LOD indices into pendingUpload_.
+    template<typename V>
+    void packVertexAttributes(uint8_t* dest, const VertexLayout& layout, const V& vertex) const;    // Writes the position, normal, tex coords, and tangent of the vertex if they are in the layout.
+    void packBoneAttributes(uint8_t* dest, const VertexLayout& layout, const Vertex& vertex) const;
+    void packBoneAttributes(uint8_t* dest, const VertexLayout& layout, const VertexBone& vertex) const;
+    vector<unsigned int> generateLods();    // Returns the indices for all LODs appended together.
+    unsigned int selectLod(const glm::mat4& modelMtx, LodState* lodState) const;    // Without a state, this is the finest LOD that fits the pixel error.
+    void drawLod(const Shader& shader, const glm::mat4& modelMtx, LodState* lodState) const;
+    void bindVertexArray(const Shader& shader) const;    // Binds the position-only stream if the shader doesn't need anything else.
     void generateBuffers();
 };
 
@@ -0,0 +1,453 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+    constexpr unsigned int FORSYTH_CACHE_SIZE = 32;    // Scoring parameters from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+    constexpr float CACHE_DECAY_POWER = 1.5f;
+    constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+    constexpr float VALENCE_BOOST_SCALE = 2.0f;
+    constexpr float VALENCE_BOOST_POWER = 0.5f;
+    
+    float computeVertexScore(int cachePosition, unsigned int numRemainingTriangles) {
+        if (numRemainingTriangles == 0) {    // Vertex is no longer used, so it shouldn't add to any triangle.
+            return -1.0f;
+        }
+        float score = 0.0f;
+        if (cachePosition >= 3) {
+            score = pow(1.0f - static_cast<float>(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        } else if (cachePosition >= 0) {    // Vertices in the last triangle get a fixed score to avoid making long strips.
+            score = LAST_TRIANGLE_SCORE;
+        }
+        return score + VALENCE_BOOST_SCALE * pow(static_cast<float>(numRemainingTriangles), -VALENCE_BOOST_POWER);    // Boost vertices with few triangles left so they get finished off.
+    }
+    
+    unsigned int countTriangleMisses(const vector<unsigned int>& indices, size_t triangle, vector<unsigned int>& cacheTimestamps, unsigned int& timestamp, unsigned int cacheSize) {    // Simulates a FIFO cache, a vertex is in the cache if it was added less than cacheSize misses ago.
+        unsigned int misses = 0;
+        for (size_t i = triangle * 3; i < triangle * 3 + 3; ++i) {
+            if (timestamp - cacheTimestamps[indices[i]] > cacheSize) {
+                cacheTimestamps[indices[i]] = timestamp++;
+                ++misses;
+            }
+        }
+        return misses;
+    }
+    
+    struct Quadric {    // Sum of squared distances to a set of planes, stored as the upper half of a symmetric 4x4 matrix.
+        double a00, a01, a02, a11, a12, a22, b0, b1, b2, c, weight;
+        
+        Quadric() : a00(0.0), a01(0.0), a02(0.0), a11(0.0), a12(0.0), a22(0.0), b0(0.0), b1(0.0), b2(0.0), c(0.0), weight(0.0) {}
+        Quadric(const glm::vec3& normal, float distance, float w) {    // Plane dot(normal, p) + distance = 0 with the given weight.
+            a00 = w * normal.x * normal.x;
+            a01 = w * normal.x * normal.y;
+            a02 = w * normal.x * normal.z;
+            a11 = w * normal.y * normal.y;
+            a12 = w * normal.y * normal.z;
+            a22 = w * normal.z * normal.z;
+            b0 = w * normal.x * distance;
+            b1 = w * normal.y * distance;
+            b2 = w * normal.z * distance;
+            c = w * distance * distance;
+            weight = w;
+        }
+        Quadric& operator+=(const Quadric& q) {
+            a00 += q.a00;
+            a01 += q.a01;
+            a02 += q.a02;
+            a11 += q.a11;
+            a12 += q.a12;
+            a22 += q.a22;
+            b0 += q.b0;
+            b1 += q.b1;
+            b2 += q.b2;
+            c += q.c;
+            weight += q.weight;
+            return *this;
+        }
+        double getError(const glm::vec3& p) const {    // Weighted mean of the squared distances.
+            double error = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z + 2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z + b0 * p.x + b1 * p.y + b2 * p.z) + c;
+            return weight > 0.0 ? max(error, 0.0) / weight : 0.0;
+        }
+    };
+}
+
+float MeshOptimizer::CacheStats::getACMR() const {
+    return numTriangles == 0 ? 0.0f : static_cast<float>(numTransformed) / numTriangles;
+}
+
+float MeshOptimizer::CacheStats::getATVR() const {
+    return numVertices == 0 ? 0.0f : static_cast<float>(numTransformed) / numVertices;
+}
+
+MeshOptimizer::CacheStats& MeshOptimizer::CacheStats::operator+=(const CacheStats& stats) {
+    numTriangles += stats.numTriangles;
+    numVertices += stats.numVertices;
+    numTransformed += stats.numTransformed;
+    return *this;
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::analyzeVertexCache(const vector<unsigned int>& indices, size_t numVertices, unsigned int cacheSize) {
+    CacheStats stats;
+    stats.numTriangles = indices.size() / 3;
+    vector<unsigned int> cacheTimestamps(numVertices, 0);
+    unsigned int timestamp = cacheSize + 1;
+    for (size_t i = 0; i < stats.numTriangles; ++i) {
+        stats.numTransformed += countTriangleMisses(indices, i, cacheTimestamps, timestamp, cacheSize);
+    }
+    
+    vector<bool> vertexUsed(numVertices, false);
+    for (unsigned int index : indices) {
+        if (!vertexUsed[index]) {
+            vertexUsed[index] = true;
+            ++stats.numVertices;
+        }
+    }
+    return stats;
+}
+
+void MeshOptimizer::optimizeVertexCache(vector<unsigned int>& indices, size_t numVertices) {
+    size_t numTriangles = indices.size() / 3;
+    if (numTriangles == 0) {
+        return;
+    }
+    
+    vector<unsigned int> adjacencyOffsets(numVertices + 1, 0);    // Build the list of triangles using each vertex, the lists are packed together in adjacentTriangles.
+    for (unsigned int index : indices) {
+        ++adjacencyOffsets[index + 1];
+    }
+    for (size_t i = 0; i < numVertices; ++i) {
+        adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+    }
+    vector<unsigned int> adjacentTriangles(indices.size());
+    vector<unsigned int> numRemainingTriangles(numVertices, 0);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        unsigned int v = indices[i];
+        adjacentTriangles[adjacencyOffsets[v] + numRemainingTriangles[v]] = static_cast<unsigned int>(i / 3);
+        ++numRemainingTriangles[v];
+    }
+    
+    vector<int> cachePositions(numVertices, -1);
+    vector<float> vertexScores(numVertices);
+    for (size_t i = 0; i < numVertices; ++i) {
+        vertexScores[i] = computeVertexScore(-1, numRemainingTriangles[i]);
+    }
+    vector<float> triangleScores(numTriangles);
+    for (size_t i = 0; i < numTriangles; ++i) {
+        triangleScores[i] = vertexScores[indices[i * 3]] + vertexScores[indices[i * 3 + 1]] + vertexScores[indices[i * 3 + 2]];
+    }
+    vector<bool> triangleAdded(numTriangles, false);
+    
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    vector<unsigned int> cache, newCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+    size_t bestTriangle = max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+    size_t nextUnaddedTriangle = 0;
+    while (true) {
+        triangleAdded[bestTriangle] = true;
+        newCache.clear();
+        for (size_t i = bestTriangle * 3; i < bestTriangle * 3 + 3; ++i) {    // Emit the triangle and remove it from the adjacency of its vertices.
+            unsigned int v = indices[i];
+            result.push_back(v);
+            unsigned int* triangles = &adjacentTriangles[adjacencyOffsets[v]];
+            unsigned int* lastTriangle = triangles + numRemainingTriangles[v] - 1;
+            *find(triangles, lastTriangle, static_cast<unsigned int>(bestTriangle)) = *lastTriangle;
+            --numRemainingTriangles[v];
+            if (find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+                newCache.push_back(v);
+            }
+        }
+        for (unsigned int v : cache) {    // Previous cache entries get pushed back by the new triangle (LRU order).
+            if (find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+                newCache.push_back(v);
+            }
+        }
+        
+        for (size_t i = 0; i < newCache.size(); ++i) {    // Update scores of vertices that moved in the cache and the triangles using them.
+            unsigned int v = newCache[i];
+            cachePositions[v] = (i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1);
+            float score = computeVertexScore(cachePositions[v], numRemainingTriangles[v]);
+            float scoreDelta = score - vertexScores[v];
+            vertexScores[v] = score;
+            for (unsigned int j = adjacencyOffsets[v]; j < adjacencyOffsets[v] + numRemainingTriangles[v]; ++j) {
+                triangleScores[adjacentTriangles[j]] += scoreDelta;
+            }
+        }
+        if (newCache.size() > FORSYTH_CACHE_SIZE) {
+            newCache.resize(FORSYTH_CACHE_SIZE);
+        }
+        cache.swap(newCache);
+        
+        float bestScore = -1.0f;    // Next triangle is the best one using a vertex in the cache.
+        for (unsigned int v : cache) {
+            for (unsigned int j = adjacencyOffsets[v]; j < adjacencyOffsets[v] + numRemainingTriangles[v]; ++j) {
+                unsigned int t = adjacentTriangles[j];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+        if (bestScore < 0.0f) {    // Nothing left in the cache, move on to the next triangle not yet added.
+            while (nextUnaddedTriangle < numTriangles && triangleAdded[nextUnaddedTriangle]) {
+                ++nextUnaddedTriangle;
+            }
+            if (nextUnaddedTriangle == numTriangles) {
+                break;
+            }
+            bestTriangle = nextUnaddedTriangle;
+        }
+    }
+    
+    indices.swap(result);
+}
+
+void MeshOptimizer::optimizeOverdraw(vector<unsigned int>& indices, const vector<glm::vec3>& positions, float threshold) {
+    size_t numTriangles = indices.size() / 3;
+    if (numTriangles == 0) {
+        return;
+    }
+    
+    vector<unsigned int> cacheTimestamps(positions.size(), 0);
+    unsigned int timestamp = DEFAULT_CACHE_SIZE + 1;
+    vector<size_t> hardBoundaries;    // Places where the cache optimized order jumps to a new area of the mesh (all vertices miss).
+    for (size_t i = 0; i < numTriangles; ++i) {
+        if (countTriangleMisses(indices, i, cacheTimestamps, timestamp, DEFAULT_CACHE_SIZE) == 3 || i == 0) {
+            hardBoundaries.push_back(i);
+        }
+    }
+    hardBoundaries.push_back(numTriangles);
+    
+    vector<size_t> clusters;    // Split hard clusters further as long as each piece stays close to the ACMR of the whole cluster.
+    for (size_t c = 0; c + 1 < hardBoundaries.size(); ++c) {
+        size_t start = hardBoundaries[c], end = hardBoundaries[c + 1];
+        timestamp += DEFAULT_CACHE_SIZE + 1;
+        unsigned int clusterMisses = 0;
+        for (size_t i = start; i < end; ++i) {
+            clusterMisses += countTriangleMisses(indices, i, cacheTimestamps, timestamp, DEFAULT_CACHE_SIZE);
+        }
+        float maxACMR = threshold * clusterMisses / (end - start);
+        
+        timestamp += DEFAULT_CACHE_SIZE + 1;
+        clusters.push_back(start);
+        size_t softStart = start;
+        unsigned int softMisses = 0;
+        for (size_t i = start; i < end; ++i) {
+            softMisses += countTriangleMisses(indices, i, cacheTimestamps, timestamp, DEFAULT_CACHE_SIZE);
+            if (i + 1 < end && static_cast<float>(softMisses) / (i + 1 - softStart) <= maxACMR) {
+                clusters.push_back(i + 1);
+                softStart = i + 1;
+                softMisses = 0;
+                timestamp += DEFAULT_CACHE_SIZE + 1;    // Each cluster starts with a cold cache since the order is about to change.
+            }
+        }
+    }
+    clusters.push_back(numTriangles);
+    
+    size_t numClusters = clusters.size() - 1;    // Sort clusters by how much they face outward from the center of the mesh, these are more likely to occlude the others.
+    vector<glm::vec3> clusterCentroids(numClusters, glm::vec3(0.0f)), clusterNormals(numClusters, glm::vec3(0.0f));
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < numClusters; ++c) {
+        float clusterArea = 0.0f;
+        for (size_t i = clusters[c]; i < clusters[c + 1]; ++i) {
+            const glm::vec3& p0 = positions[indices[i * 3]];
+            const glm::vec3& p1 = positions[indices[i * 3 + 1]];
+            const glm::vec3& p2 = positions[indices[i * 3 + 2]];
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);    // Length is twice the triangle area, so the sums are area weighted.
+            float area = glm::length(normal);
+            clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            clusterNormals[c] += normal;
+            clusterArea += area;
+        }
+        meshCentroid += clusterCentroids[c];
+        meshArea += clusterArea;
+        clusterCentroids[c] = (clusterArea > 0.0f ? clusterCentroids[c] / clusterArea : positions[indices[clusters[c] * 3]]);
+    }
+    if (meshArea > 0.0f) {
+        meshCentroid /= meshArea;
+    }
+    
+    vector<pair<float, size_t>> clusterKeys(numClusters);
+    for (size_t c = 0; c < numClusters; ++c) {
+        float normalLength = glm::length(clusterNormals[c]);
+        clusterKeys[c].first = (normalLength > 0.0f ? glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c] / normalLength) : 0.0f);
+        clusterKeys[c].second = c;
+    }
+    stable_sort(clusterKeys.begin(), clusterKeys.end(), [](const pair<float, size_t>& a, const pair<float, size_t>& b) {
+        return a.first > b.first;
+    });
+    
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const pair<float, size_t>& key : clusterKeys) {
+        result.insert(result.end(), indices.begin() + clusters[key.second] * 3, indices.begin() + clusters[key.second + 1] * 3);
+    }
+    indices.swap(result);
+}
+
+vector<unsigned int> MeshOptimizer::simplify(const vector<unsigned int>& indices, const vector<glm::vec3>& positions, size_t targetIndexCount, float targetError, float* resultError) {
+    vector<unsigned int> result(indices);
+    size_t numVertices = positions.size();
+    float maxError = 0.0f;
+    
+    unordered_map<uint64_t, unsigned int> edgeCounts;    // Vertices on an edge used by only one triangle are locked, this includes seams where the vertex is split.
+    edgeCounts.reserve(result.size());
+    for (size_t i = 0; i < result.size(); i += 3) {
+        for (size_t j = 0; j < 3; ++j) {
+            unsigned int a = result[i + j], b = result[i + (j + 1) % 3];
+            ++edgeCounts[(static_cast<uint64_t>(min(a, b)) << 32) | max(a, b)];
+        }
+    }
+    vector<bool> vertexLocked(numVertices, false);
+    for (const auto& edge : edgeCounts) {
+        if (edge.second == 1) {
+            vertexLocked[edge.first >> 32] = true;
+            vertexLocked[edge.first & 0xFFFFFFFF] = true;
+        }
+    }
+    
+    vector<Quadric> quadrics(numVertices);
+    for (size_t i = 0; i < result.size(); i += 3) {
+        const glm::vec3& p0 = positions[result[i]];
+        glm::vec3 normal = glm::cross(positions[result[i + 1]] - p0, positions[result[i + 2]] - p0);
+        float area = glm::length(normal);
+        if (area > 0.0f) {
+            normal /= area;
+            Quadric q(normal, -glm::dot(normal, p0), area);
+            quadrics[result[i]] += q;
+            quadrics[result[i + 1]] += q;
+            quadrics[result[i + 2]] += q;
+        }
+    }
+    
+    struct Collapse {
+        unsigned int source, target;
+        double error;
+    };
+    vector<Collapse> collapses;
+    vector<unsigned int> adjacencyOffsets, adjacentTriangles;
+    vector<unsigned int> remap(numVertices);
+    vector<bool> vertexTouched(numVertices);
+    while (result.size() > targetIndexCount) {    // Each pass collapses the cheapest edges that don't share vertices, then removes degenerate triangles.
+        adjacencyOffsets.assign(numVertices + 1, 0);
+        for (unsigned int index : result) {
+            ++adjacencyOffsets[index + 1];
+        }
+        for (size_t i = 0; i < numVertices; ++i) {
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        }
+        adjacentTriangles.resize(result.size());
+        vector<unsigned int> fillCounts(numVertices, 0);
+        for (size_t i = 0; i < result.size(); ++i) {
+            adjacentTriangles[adjacencyOffsets[result[i]] + fillCounts[result[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+        
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (size_t j = 0; j < 3; ++j) {
+                unsigned int a = result[i + j], b = result[i + (j + 1) % 3];
+                if (!vertexLocked[a]) {
+                    Quadric q = quadrics[a];
+                    q += quadrics[b];
+                    collapses.push_back({a, b, q.getError(positions[b])});
+                }
+                if (!vertexLocked[b]) {
+                    Quadric q = quadrics[b];
+                    q += quadrics[a];
+                    collapses.push_back({b, a, q.getError(positions[a])});
+                }
+            }
+        }
+        sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.error < b.error;
+        });
+        
+        for (size_t i = 0; i < numVertices; ++i) {
+            remap[i] = static_cast<unsigned int>(i);
+        }
+        fill(vertexTouched.begin(), vertexTouched.end(), false);
+        size_t numTriangles = result.size() / 3, numCollapses = 0;
+        for (const Collapse& collapse : collapses) {
+            if (numTriangles * 3 <= targetIndexCount || collapse.error > static_cast<double>(targetError) * targetError) {
+                break;
+            }
+            if (vertexTouched[collapse.source] || vertexTouched[collapse.target]) {
+                continue;
+            }
+            
+            bool flipped = false;    // Moving the source vertex must not turn any of its other triangles inside out.
+            unsigned int numRemoved = 0;
+            for (unsigned int j = adjacencyOffsets[collapse.source]; j < adjacencyOffsets[collapse.source + 1] && !flipped; ++j) {
+                const unsigned int* triangle = &result[adjacentTriangles[j] * 3];
+                if (triangle[0] == collapse.target || triangle[1] == collapse.target || triangle[2] == collapse.target) {
+                    ++numRemoved;
+                    continue;
+                }
+                glm::vec3 p[3], moved[3];
+                for (int k = 0; k < 3; ++k) {
+                    p[k] = positions[triangle[k]];
+                    moved[k] = (triangle[k] == collapse.source ? positions[collapse.target] : p[k]);
+                }
+                glm::vec3 normalBefore = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 normalAfter = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                flipped = (glm::dot(normalBefore, normalAfter) <= 0.0f);
+            }
+            if (flipped) {
+                continue;
+            }
+            
+            remap[collapse.source] = collapse.target;
+            quadrics[collapse.target] += quadrics[collapse.source];
+            for (unsigned int j = adjacencyOffsets[collapse.source]; j < adjacencyOffsets[collapse.source + 1]; ++j) {    // Neighbors can't change this pass since the flip test used their positions.
+                const unsigned int* triangle = &result[adjacentTriangles[j] * 3];
+                vertexTouched[triangle[0]] = true;
+                vertexTouched[triangle[1]] = true;
+                vertexTouched[triangle[2]] = true;
+            }
+            numTriangles -= numRemoved;
+            maxError = max(maxError, static_cast<float>(sqrt(collapse.error)));
+            ++numCollapses;
+        }
+        if (numCollapses == 0) {
+            break;
+        }
+        
+        size_t writeIndex = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if (a != b && b != c && c != a) {
+                result[writeIndex++] = a;
+                result[writeIndex++] = b;
+                result[writeIndex++] = c;
+            }
+        }
+        result.resize(writeIndex);
+    }
+    
+    if (resultError != nullptr) {
+        *resultError = maxError;
+    }
+    return result;
+}
+
+vector<unsigned int> MeshOptimizer::optimizeVertexFetch(vector<unsigned int>& indices, size_t numVertices) {
+    constexpr unsigned int UNUSED = numeric_limits<unsigned int>::max();
+    vector<unsigned int> remap(numVertices, UNUSED);
+    unsigned int nextVertex = 0;
+    for (unsigned int& index : indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = nextVertex++;
+        }
+        index = remap[index];
+    }
+    for (unsigned int& r : remap) {
+        if (r == UNUSED) {
+            r = nextVertex++;
+        }
+    }
+    return remap;
+}
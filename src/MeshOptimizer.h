@@ -0,0 +1,40 @@
+#ifndef MESH_OPTIMIZER_H_
+#define MESH_OPTIMIZER_H_
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+namespace MeshOptimizer {    // Index and vertex reordering for triangle lists, this does not depend on OpenGL.
+    struct CacheStats {
+        size_t numTriangles;
+        size_t numVertices;    // Unique vertices referenced by the indices.
+        size_t numTransformed;    // Vertex shader invocations in a simulated FIFO post-transform cache.
+        
+        CacheStats() : numTriangles(0), numVertices(0), numTransformed(0) {}
+        float getACMR() const;    // Average cache miss ratio, transformed vertices per triangle (0.5 is ideal and 3.0 is the worst).
+        float getATVR() const;    // Average transformed vertex ratio, transformed vertices per vertex (1.0 is ideal).
+        CacheStats& operator+=(const CacheStats& stats);
+    };
+    
+    constexpr unsigned int DEFAULT_CACHE_SIZE = 16;
+    
+    CacheStats analyzeVertexCache(const vector<unsigned int>& indices, size_t numVertices, unsigned int cacheSize = DEFAULT_CACHE_SIZE);
+    void optimizeVertexCache(vector<unsigned int>& indices, size_t numVertices);    // Reorders triangles to reuse recently transformed vertices (Forsyth's linear-speed algorithm).
+    void optimizeOverdraw(vector<unsigned int>& indices, const vector<glm::vec3>& positions, float threshold = 1.05f);    // Splits the triangles into clusters and sorts them so outward facing ones draw first, the ACMR is allowed to grow by the threshold. Should run after optimizeVertexCache().
+    vector<unsigned int> optimizeVertexFetch(vector<unsigned int>& indices, size_t numVertices);    // Renumbers vertices in the order they are first used and returns the remap from old to new index. Unused vertices are moved to the end.
+    vector<unsigned int> simplify(const vector<unsigned int>& indices, const vector<glm::vec3>& positions, size_t targetIndexCount, float targetError, float* resultError = nullptr);    // Collapses edges using quadric error metrics until the target index count is reached or the error would go over targetError (distance in model units). Border and seam vertices stay in place.
+    
+    template<typename T>
+    void remapVertices(vector<T>& vertices, const vector<unsigned int>& remap) {    // Applies the result of optimizeVertexFetch() to a vertex array.
+        vector<T> result(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            result[remap[i]] = vertices[i];
+        }
+        vertices.swap(result);
+    }
+}
+
+#endif
@@ -1,8 +1,14 @@
+#include "Animation.h"
+#include "BinaryModel.h"
+#include "MappedFile.h"
 #include "ModelAbstract.h"
 #include "RenderApp.h"
 #include "Shader.h"
 #include <cassert>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <utility>
 
 ModelAbstract::ModelAbstract() {}
 
@@ -20,6 +26,13 @@ void ModelAbstract::draw(const Shader& shader, const glm::mat4& modelMtx) const
     }
 }
 
+void ModelAbstract::draw(const Shader& shader, const glm::mat4& modelMtx, vector<Mesh::LodState>& lodStates) const {
+    lodStates.resize(meshes_.size());
+    for (size_t i = 0; i < meshes_.size(); ++i) {
+        meshes_[i].draw(shader, modelMtx * meshTransforms_[i], lodStates[i]);
+    }
+}
+
 void ModelAbstract::drawGeometry() const {
     for (const Mesh& m : meshes_) {
         m.drawGeometry();
@@ -32,6 +45,13 @@ void ModelAbstract::drawGeometry(const Shader& shader, const glm::mat4& modelMtx
     }
 }
 
+void ModelAbstract::drawGeometry(const Shader& shader, const glm::mat4& modelMtx, vector<Mesh::LodState>& lodStates) const {
+    lodStates.resize(meshes_.size());
+    for (size_t i = 0; i < meshes_.size(); ++i) {
+        meshes_[i].drawGeometry(shader, modelMtx * meshTransforms_[i], lodStates[i]);
+    }
+}
+
 void ModelAbstract::drawInstanced(unsigned int count) const {
     for (const Mesh& m : meshes_) {
         m.drawInstanced(count);
@@ -44,6 +64,89 @@ void ModelAbstract::drawGeometryInstanced(unsigned int count) const {
     }
 }
 
+void ModelAbstract::loadFile(const string& filename, unordered_map<string, Animation>* animations) {
+    vector<Animation> fileAnimations;
+    if (!loadFileData(filename, &fileAnimations)) {
+        return;
+    }
+    for (Mesh& m : meshes_) {
+        m.upload();
+    }
+    if (animations != nullptr) {
+        Animation::insertAll(move(fileAnimations), animations);
+    }
+}
+
+bool ModelAbstract::loadBinary(const string& filename, BinaryModel::ContentType contentType, uint64_t sourceHash, vector<Animation>* fileAnimations) {
+    assert(meshes_.empty());
+    string binaryFilename = BinaryModel::getFilename(filename);
+    shared_ptr<MappedFile> binaryFile = make_shared<MappedFile>(binaryFilename);    // Meshes keep the file mapped until they are uploaded.
+    if (!binaryFile->isOpen()) {
+        return false;
+    }
+    
+    vector<Animation> animationList;
+    try {
+        BinaryModel::Reader reader(binaryFile->getData(), binaryFile->getSize());
+        if (!BinaryModel::readHeader(reader, contentType, sourceHash)) {
+            if (VERBOSE_OUTPUT_) {
+                cout << "Preprocessed model \"" << binaryFilename << "\" is out of date.\n";
+            }
+            return false;
+        }
+        uint32_t numMeshes = reader.read<uint32_t>();
+        meshes_.reserve(numMeshes);
+        meshTransforms_.reserve(numMeshes);
+        for (uint32_t i = 0; i < numMeshes; ++i) {
+            meshes_.emplace_back();
+            meshes_.back().loadBinary(reader, binaryFile);
+            meshTransforms_.push_back(reader.read<glm::mat4>());
+        }
+        uint32_t numAnimations = reader.read<uint32_t>();
+        animationList.reserve(numAnimations);
+        for (uint32_t i = 0; i < numAnimations; ++i) {
+            animationList.emplace_back(reader);
+        }
+        loadBinaryNodes(reader);    // Nodes are last so nothing else can fail after the derived model has been changed.
+    } catch (runtime_error& ex) {
+        cout << "Warn: Preprocessed model \"" << binaryFilename << "\" is damaged (" << ex.what() << "), loading the source file instead.\n";
+        meshes_.clear();
+        meshTransforms_.clear();
+        return false;
+    }
+    
+    directoryPath_ = filename.substr(0, filename.find_last_of('/'));
+    *fileAnimations = move(animationList);
+    if (VERBOSE_OUTPUT_) {
+        cout << "Loaded preprocessed model \"" << binaryFilename << "\" with " << meshes_.size() << " meshes.\n";
+    }
+    return true;
+}
+
+void ModelAbstract::saveBinary(const string& filename, BinaryModel::ContentType contentType, uint64_t sourceHash, const vector<Animation>& fileAnimations) const {
+    string binaryFilename = BinaryModel::getFilename(filename);
+    BinaryModel::Writer writer(binaryFilename);
+    if (!writer.isOpen()) {
+        cout << "Warn: Unable to write preprocessed model \"" << binaryFilename << "\".\n";
+        return;
+    }
+    BinaryModel::writeHeader(writer, contentType, sourceHash);
+    writer.write<uint32_t>(static_cast<uint32_t>(meshes_.size()));
+    for (size_t i = 0; i < meshes_.size(); ++i) {
+        meshes_[i].saveBinary(writer);
+        writer.write<glm::mat4>(meshTransforms_[i]);
+    }
+    writer.write<uint32_t>(static_cast<uint32_t>(fileAnimations.size()));
+    for (const Animation& a : fileAnimations) {
+        a.saveBinary(writer);
+    }
+    saveBinaryNodes(writer);
+}
+
+void ModelAbstract::loadBinaryNodes(BinaryModel::Reader& reader) {}
+
+void ModelAbstract::saveBinaryNodes(BinaryModel::Writer& writer) const {}
+
 const aiScene* ModelAbstract::loadScene(Assimp::Importer* importer, const string& filename) {
     assert(meshes_.empty());
     if (VERBOSE_OUTPUT_) {
@@ -56,6 +159,8 @@ const aiScene* ModelAbstract::loadScene(Assimp::Importer* importer, const string
         return nullptr;
     }
     directoryPath_ = filename.substr(0, filename.find_last_of('/'));    // Directory path is used later to load the texture files.
+    cacheStatsBefore_ = MeshOptimizer::CacheStats();
+    cacheStatsAfter_ = MeshOptimizer::CacheStats();
     
     if (VERBOSE_OUTPUT_) {
         cout << "  Number of animations: " << scene->mNumAnimations << "\n";
@@ -80,7 +185,8 @@ void ModelAbstract::loadMaterialTextures(aiMaterial* material, aiTextureType typ
         if (VERBOSE_OUTPUT_) {
             cout << "      \"" << str.C_Str() << "\"\n";
         }
-        textures.emplace_back(RenderApp::loadTexture(directoryPath_ + "/" + string(str.C_Str()), type == aiTextureType_DIFFUSE), index);
+        string filename = directoryPath_ + "/" + string(str.C_Str());
+        textures.emplace_back(0, index, filename, type == aiTextureType_DIFFUSE);    // The texture is loaded when the mesh is uploaded.
     }
 }
 
@@ -123,3 +229,33 @@ void ModelAbstract::processMeshAttributes(aiMesh* mesh, const aiScene* scene, ve
 }
 template void ModelAbstract::processMeshAttributes<Mesh::Vertex>(aiMesh* mesh, const aiScene* scene, vector<Mesh::Vertex>& vertices, vector<unsigned int>& indices, vector<Mesh::Texture>& textures);
 template void ModelAbstract::processMeshAttributes<Mesh::VertexBone>(aiMesh* mesh, const aiScene* scene, vector<Mesh::VertexBone>& vertices, vector<unsigned int>& indices, vector<Mesh::Texture>& textures);
+
+template<typename V>
+void ModelAbstract::optimizeMesh(vector<V>& vertices, vector<unsigned int>& indices) {
+    if (indices.size() % 3 != 0) {    // Only triangle lists can be optimized.
+        return;
+    }
+    MeshOptimizer::CacheStats statsBefore = MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+    
+    vector<glm::vec3> positions;
+    positions.reserve(vertices.size());
+    for (const V& v : vertices) {
+        positions.push_back(v.pos);
+    }
+    MeshOptimizer::optimizeVertexCache(indices, vertices.size());
+    MeshOptimizer::optimizeOverdraw(indices, positions);
+    MeshOptimizer::remapVertices(vertices, MeshOptimizer::optimizeVertexFetch(indices, vertices.size()));
+    
+    MeshOptimizer::CacheStats statsAfter = MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+    if (VERBOSE_OUTPUT_) {
+        cout << "      Optimized mesh ACMR " << statsBefore.getACMR() << " -> " << statsAfter.getACMR() << ", ATVR " << statsBefore.getATVR() << " -> " << statsAfter.getATVR() << "\n";
+    }
+    cacheStatsBefore_ += statsBefore;
+    cacheStatsAfter_ += statsAfter;
+}
+template void ModelAbstract::optimizeMesh<Mesh::Vertex>(vector<Mesh::Vertex>& vertices, vector<unsigned int>& indices);
+template void ModelAbstract::optimizeMesh<Mesh::VertexBone>(vector<Mesh::VertexBone>& vertices, vector<unsigned int>& indices);
+
+void ModelAbstract::printOptimizationStats(const string& filename) const {
+    cout << "Model \"" << filename << "\" vertex cache (" << cacheStatsAfter_.numTriangles << " triangles): ACMR " << cacheStatsBefore_.getACMR() << " -> " << cacheStatsAfter_.getACMR() << ", ATVR " << cacheStatsBefore_.getATVR() << " -> " << cacheStatsAfter_.getATVR() << "\n";
+}
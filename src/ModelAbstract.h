@@ -4,8 +4,10 @@
 class Animation;
 class Shader;
 
+#include "BinaryModel.h"
 #include "DrawableInterface.h"
 #include "Mesh.h"
+#include "MeshOptimizer.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -28,24 +30,36 @@ class ModelAbstract : public DrawableInterface {
     
     ModelAbstract();
     virtual ~ModelAbstract();
-    virtual void loadFile(const string& filename, unordered_map<string, Animation>* animations = nullptr) = 0;
+    void loadFile(const string& filename, unordered_map<string, Animation>* animations = nullptr);    // Loads the model and uploads it right away, see ModelLoader to do this in the background.
+    virtual bool loadFileData(const string& filename, vector<Animation>* fileAnimations) = 0;    // CPU part of loadFile(), this doesn't use OpenGL so it can run on a worker thread. The meshes still need an upload() afterwards.
     virtual void applyInstanceBuffer(unsigned int startIndex) const;
     virtual void draw(const Shader& shader, const glm::mat4& modelMtx) const;
+    void draw(const Shader& shader, const glm::mat4& modelMtx, vector<Mesh::LodState>& lodStates) const;    // The LOD states belong to the instance being drawn, with one for each mesh (resized if needed).
     virtual void drawGeometry() const;
     virtual void drawGeometry(const Shader& shader, const glm::mat4& modelMtx) const;
+    void drawGeometry(const Shader& shader, const glm::mat4& modelMtx, vector<Mesh::LodState>& lodStates) const;
     virtual void drawInstanced(unsigned int count) const;
     virtual void drawGeometryInstanced(unsigned int count) const;
     
     protected:
+    MeshOptimizer::CacheStats cacheStatsBefore_, cacheStatsAfter_;    // Totals for all meshes in the model.
+    
     static inline glm::vec3 castVec3(const aiVector3D& v) { return glm::vec3(v.x, v.y, v.z); }
     static inline glm::vec2 castVec2(const aiVector2D& v) { return glm::vec2(v.x, v.y); }
     static inline glm::quat castQuat(const aiQuaternion& q) { return glm::quat(q.w, q.x, q.y, q.z); }
     static inline glm::mat4 castMat4(const aiMatrix4x4& m) { return glm::transpose(glm::make_mat4(&m.a1)); }
     static inline glm::mat3 castMat3(const aiMatrix3x3& m) { return glm::transpose(glm::make_mat3(&m.a1)); }
+    bool loadBinary(const string& filename, BinaryModel::ContentType contentType, uint64_t sourceHash, vector<Animation>* fileAnimations);    // Loads the preprocessed version of the model file. Returns false if it is missing, damaged, or out of date with the source.
+    void saveBinary(const string& filename, BinaryModel::ContentType contentType, uint64_t sourceHash, const vector<Animation>& fileAnimations) const;    // Writes the preprocessed version of the model so the next load can skip assimp.
+    virtual void loadBinaryNodes(BinaryModel::Reader& reader);    // Derived models store their node hierarchy at the end of the preprocessed file, this does nothing by default.
+    virtual void saveBinaryNodes(BinaryModel::Writer& writer) const;
     const aiScene* loadScene(Assimp::Importer* importer, const string& filename);    // Attempts to load the model file into an assimp scene. Returns nullptr on fail.
     void loadMaterialTextures(aiMaterial* material, aiTextureType type, const string& uniformName, unsigned int index, vector<Mesh::Texture>& textures);    // Adds material textures to the textures vector if they exist.
     template<typename V>
     void processMeshAttributes(aiMesh* mesh, const aiScene* scene, vector<V>& vertices, vector<unsigned int>& indices, vector<Mesh::Texture>& textures);    // Loads vertices, indices, and textures for a single mesh.
+    template<typename V>
+    void optimizeMesh(vector<V>& vertices, vector<unsigned int>& indices);    // Reorders indices for the vertex cache and overdraw, then reorders vertices for fetch locality. Must be done after bones have been added.
+    void printOptimizationStats(const string& filename) const;
 };
 
 #endif
@@ -0,0 +1,143 @@
+#include "Animation.h"
+#include "ModelAbstract.h"
+#include "ModelLoader.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+
+ModelLoader::ModelLoader(unsigned int numThreads) {
+    numPending_ = 0;
+    exiting_ = false;
+    if (numThreads == 0) {
+        numThreads = max(thread::hardware_concurrency(), 2u) - 1;
+    }
+    workers_.reserve(numThreads);
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        workers_.emplace_back(&ModelLoader::workerLoop, this);
+    }
+}
+
+ModelLoader::~ModelLoader() {
+    {
+        lock_guard<mutex> lock(jobMutex_);
+        exiting_ = true;
+    }
+    jobCondition_.notify_all();
+    for (thread& t : workers_) {
+        t.join();
+    }
+    
+    exception_ptr error = make_exception_ptr(runtime_error("ModelLoader was destroyed before the model finished loading."));    // The workers are gone, so the queues can be emptied without locking.
+    if (currentUpload_) {
+        currentUpload_->onCancel(error);
+    }
+    for (queue<unique_ptr<Job>>* jobs : {&uploadQueue_, &jobQueue_}) {
+        while (!jobs->empty()) {
+            jobs->front()->onCancel(error);
+            jobs->pop();
+        }
+    }
+    numPending_ = 0;
+}
+
+size_t ModelLoader::getNumPending() const {
+    return numPending_;
+}
+
+void ModelLoader::update(double timeBudget) {
+    double startTime = glfwGetTime();
+    do {
+        if (!currentUpload_) {
+            lock_guard<mutex> lock(uploadMutex_);
+            if (uploadQueue_.empty()) {
+                return;
+            }
+            currentUpload_ = move(uploadQueue_.front());
+            uploadQueue_.pop();
+        }
+        if (uploadStep(*currentUpload_)) {
+            currentUpload_.reset();
+        }
+    } while (glfwGetTime() - startTime < timeBudget);
+}
+
+void ModelLoader::addJob(shared_ptr<ModelAbstract> model, const string& filename, unordered_map<string, Animation>* animations, function<void(bool)>&& onComplete, function<void(exception_ptr)>&& onCancel) {
+    unique_ptr<Job> job = make_unique<Job>();
+    job->model = move(model);
+    job->filename = filename;
+    job->animations = animations;
+    job->onComplete = move(onComplete);
+    job->onCancel = move(onCancel);
+    job->success = false;
+    job->nextTexture = 0;
+    job->nextMesh = 0;
+    ++numPending_;
+    {
+        lock_guard<mutex> lock(jobMutex_);
+        jobQueue_.push(move(job));
+    }
+    jobCondition_.notify_one();
+}
+
+void ModelLoader::workerLoop() {
+    while (true) {
+        unique_ptr<Job> job;
+        {
+            unique_lock<mutex> lock(jobMutex_);
+            jobCondition_.wait(lock, [this] { return exiting_ || !jobQueue_.empty(); });
+            if (exiting_) {
+                return;
+            }
+            job = move(jobQueue_.front());
+            jobQueue_.pop();
+        }
+        processJob(*job);
+        lock_guard<mutex> lock(uploadMutex_);
+        uploadQueue_.push(move(job));
+    }
+}
+
+void ModelLoader::processJob(Job& job) {
+    try {
+        job.success = job.model->loadFileData(job.filename, &job.fileAnimations);
+    } catch (exception& ex) {
+        cout << "Error: Failed to load model \"" << job.filename << "\": " << ex.what() << "\n";
+        job.success = false;
+    }
+    if (!job.success) {
+        return;
+    }
+    
+    unordered_set<string> textureFilenames;    // Decode each image once, the meshes share textures through the RenderApp cache.
+    for (const Mesh& m : job.model->meshes_) {
+        for (const Mesh::Texture& t : m.textures_) {
+            if (t.handle == 0 && !t.filename.empty() && textureFilenames.insert(t.filename + (t.gammaCorrection ? "-g" : "")).second) {
+                job.textures.push_back({t.filename, t.gammaCorrection, RenderApp::decodeImage(t.filename)});
+            }
+        }
+    }
+}
+
+bool ModelLoader::uploadStep(Job& job) {
+    if (job.success && job.nextTexture < job.textures.size()) {
+        const DecodedTexture& texture = job.textures[job.nextTexture];
+        RenderApp::loadTexture(texture.filename, texture.gammaCorrection, true, &texture.image);
+        job.textures[job.nextTexture].image.data.reset();    // Free the pixels now that OpenGL has a copy.
+        ++job.nextTexture;
+        return false;
+    }
+    if (job.success && job.nextMesh < job.model->meshes_.size()) {
+        job.model->meshes_[job.nextMesh].upload();
+        ++job.nextMesh;
+        return false;
+    }
+    
+    if (job.success && job.animations != nullptr) {
+        Animation::insertAll(move(job.fileAnimations), job.animations);
+    }
+    --numPending_;
+    job.onComplete(job.success);
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef MODEL_LOADER_H_
+#define MODEL_LOADER_H_
+
+class Animation;
+class ModelAbstract;
+
+#include "RenderApp.h"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+class ModelLoader {    // Loads models in the background. File parsing, vertex processing, and image decoding run on worker threads, then the OpenGL work is queued for update() on the GL thread.
+    public:
+    ModelLoader(unsigned int numThreads = 0);    // Uses one less than the number of hardware threads if numThreads is zero.
+    ~ModelLoader();    // Waits for the workers to finish their current job. Models that haven't finished loading are dropped and their futures get an exception.
+    ModelLoader(const ModelLoader& loader) = delete;
+    ModelLoader& operator=(const ModelLoader& loader) = delete;
+    template<typename T>
+    shared_future<shared_ptr<T>> loadAsync(const string& filename, unordered_map<string, Animation>* animations = nullptr) {    // The future is ready once the model is fully uploaded, the result is nullptr if the load failed. Animations are added on the GL thread too, so the map must stay alive until then.
+        static_assert(is_base_of<ModelAbstract, T>::value, "T must be a model type.");
+        shared_ptr<T> model = make_shared<T>();
+        shared_ptr<promise<shared_ptr<T>>> modelPromise = make_shared<promise<shared_ptr<T>>>();
+        shared_future<shared_ptr<T>> modelFuture = modelPromise->get_future().share();
+        addJob(model, filename, animations, [model, modelPromise](bool success) {
+            modelPromise->set_value(success ? model : nullptr);
+        }, [modelPromise](exception_ptr error) {
+            modelPromise->set_exception(error);
+        });
+        return modelFuture;
+    }
+    size_t getNumPending() const;    // Number of models that haven't finished loading.
+    void update(double timeBudget);    // Uploads queued textures and meshes until timeBudget (in seconds) is used up, at least one is uploaded per call if any are waiting. Must be called on the GL thread.
+    
+    private:
+    struct DecodedTexture {
+        string filename;
+        bool gammaCorrection;
+        RenderApp::Image image;
+    };
+    struct Job {
+        shared_ptr<ModelAbstract> model;
+        string filename;
+        unordered_map<string, Animation>* animations;
+        function<void(bool)> onComplete;
+        function<void(exception_ptr)> onCancel;    // Called instead of onComplete if the loader is destroyed first.
+        bool success;
+        vector<Animation> fileAnimations;
+        vector<DecodedTexture> textures;
+        size_t nextTexture, nextMesh;    // Upload progress, the job can be spread across several frames.
+    };
+    
+    vector<thread> workers_;
+    mutex jobMutex_, uploadMutex_;
+    condition_variable jobCondition_;
+    queue<unique_ptr<Job>> jobQueue_, uploadQueue_;
+    unique_ptr<Job> currentUpload_;    // Only used by the GL thread.
+    atomic<size_t> numPending_;
+    bool exiting_;
+    
+    void addJob(shared_ptr<ModelAbstract> model, const string& filename, unordered_map<string, Animation>* animations, function<void(bool)>&& onComplete, function<void(exception_ptr)>&& onCancel);
+    void workerLoop();
+    void processJob(Job& job);    // Runs on a worker thread.
+    bool uploadStep(Job& job);    // Uploads one texture or mesh. Returns true when the job is done.
+};
+
+#endif
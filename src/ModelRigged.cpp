@@ -1,42 +1,41 @@
 #include "Animation.h"
 #include "CommonMath.h"
 #include "ModelRigged.h"
+#include "Shader.h"
 #include <glm/gtx/quaternion.hpp>
 #include <cassert>
 #include <iostream>
-#include <stack>
+#include <stdexcept>
 #include <utility>
 
-ModelRigged::ModelRigged() {
-    rootNode_ = nullptr;
-}
+ModelRigged::ModelRigged() {}
 
 ModelRigged::ModelRigged(const string& filename, unordered_map<string, Animation>* animations) {
-    rootNode_ = nullptr;
     loadFile(filename, animations);
 }
 
-ModelRigged::~ModelRigged() {
-    if (rootNode_ != nullptr) {
-        stack<Node*> nodeStack;
-        nodeStack.push(rootNode_);
-        while (!nodeStack.empty()) {
-            Node* first = nodeStack.top();
-            nodeStack.pop();
-            for (Node* n : first->children) {
-                nodeStack.push(n);
-            }
-            delete first;
-        }
-    }
+unsigned int ModelRigged::getNumNodes() const {
+    return static_cast<unsigned int>(nodeParents_.size());
 }
 
-ModelRigged::Node* ModelRigged::getRootNode() const {
-    return rootNode_;
+int ModelRigged::getParentIndex(unsigned int nodeIndex) const {
+    return nodeParents_[nodeIndex];
 }
 
-unsigned int ModelRigged::getNumNodes() const {
-    return numNodes_;
+int ModelRigged::getBoneIndex(unsigned int nodeIndex) const {
+    return nodeBoneIndices_[nodeIndex];
+}
+
+const string& ModelRigged::getNodeName(unsigned int nodeIndex) const {
+    return nodeNames_[nodeIndex];
+}
+
+const glm::mat4& ModelRigged::getNodeTransform(unsigned int nodeIndex) const {
+    return nodeTransforms_[nodeIndex];
+}
+
+const ModelRigged::LocalPose& ModelRigged::getBindPose() const {
+    return bindPose_;
 }
 
 const glm::mat4& ModelRigged::getArmatureRootInv() const {
@@ -47,104 +46,163 @@ void ModelRigged::setArmatureRootInv(const glm::mat4& armatureRootInv) {
     armatureRootInv_ = armatureRootInv;
 }
 
-void ModelRigged::loadFile(const string& filename, unordered_map<string, Animation>* animations) {
+bool ModelRigged::loadFileData(const string& filename, vector<Animation>* fileAnimations) {
+    uint64_t sourceHash = BinaryModel::hashSourceFile(filename);
+    if (loadBinary(filename, BinaryModel::RiggedModel, sourceHash, fileAnimations)) {
+        return true;
+    }
+    
     Assimp::Importer importer;
     const aiScene* scene = loadScene(&importer, filename);
     if (scene == nullptr) {
-        return;
+        return false;
     }
     meshes_.reserve(scene->mNumMeshes);
     meshTransforms_.reserve(scene->mNumMeshes);
-    numNodes_ = 0;
     unordered_map<string, uint8_t> boneMapping;
-    rootNode_ = processNode(nullptr, scene->mRootNode, glm::mat4(1.0f), scene, boneMapping);
+    processNode(-1, scene->mRootNode, glm::mat4(1.0f), scene, boneMapping);
+    printOptimizationStats(filename);
     
-    stack<Node*> nodeStack;    // Traverse node hierarchy again to set bone indices.
-    nodeStack.push(rootNode_);
-    stack<glm::mat4> combinedTransformStack;    // Keep another stack of combined transforms to find the armatureRootInv_.
-    combinedTransformStack.push(rootNode_->transform);
+    vector<glm::mat4> combinedTransforms(nodeParents_.size());    // Go through the nodes again to set bone indices, the combined transforms are used to find the armatureRootInv_.
     bool foundFirstBone = false;
-    while (!nodeStack.empty()) {
-        Node* first = nodeStack.top();
-        nodeStack.pop();
-        glm::mat4 firstCombinedTransform;
-        if (!foundFirstBone) {
-            firstCombinedTransform = combinedTransformStack.top();
-            combinedTransformStack.pop();
-        }
-        auto findResult = boneMapping.find(first->name);
+    for (size_t i = 0; i < nodeParents_.size(); ++i) {
+        glm::mat4 parentTransform = (nodeParents_[i] >= 0 ? combinedTransforms[nodeParents_[i]] : glm::mat4(1.0f));
+        combinedTransforms[i] = parentTransform * nodeTransforms_[i];
+        auto findResult = boneMapping.find(nodeNames_[i]);
         if (findResult != boneMapping.end()) {
-            first->boneIndex = findResult->second;
+            nodeBoneIndices_[i] = findResult->second;
             if (!foundFirstBone) {
                 // When the first bone is found, compute the armatureRootInv_ as the inverse of the armature root transform.
                 // In theory, this can be multiplied by (combinedTransforms * boneOffsetMatrix) to get the identity matrix when the animation matches bind pose.
                 // Some models don't work properly with this, so the setArmatureRootInv() can be used as an override.
                 // This step is key because for whatever reason, animation key frames and boneOffsetMatrices_ are relative to the first bone, not the model origin!
-                armatureRootInv_ = glm::inverse(firstCombinedTransform * glm::inverse(first->transform));
+                armatureRootInv_ = glm::inverse(parentTransform);
                 if (VERBOSE_OUTPUT_) {
-                    cout << "Transform of the armature root computed as " << glm::to_string(firstCombinedTransform * glm::inverse(first->transform)) << ".\n";
+                    cout << "Transform of the armature root computed as " << glm::to_string(parentTransform) << ".\n";
                 }
                 foundFirstBone = true;
             }
         }
-        
-        for (Node* n : first->children) {
-            nodeStack.push(n);
-            if (!foundFirstBone) {
-                combinedTransformStack.push(firstCombinedTransform * n->transform);
-            }
-        }
     }
     
-    if (animations != nullptr) {
-        for (unsigned int i = 0; i < scene->mNumAnimations; ++i) {    // Load all animations of the model.
-            auto insertResult = animations->insert({string(scene->mAnimations[i]->mName.C_Str()), Animation(scene, i)});
-            if (!insertResult.second) {
-                cout << "Error: Found animation with the same name as an existing one.\n";
-            }
-        }
+    *fileAnimations = Animation::loadAllFromScene(scene);
+    saveBinary(filename, BinaryModel::RiggedModel, sourceHash, *fileAnimations);
+    return true;
+}
+
+void ModelRigged::animate(const Animation& animation, double time, vector<glm::mat4>& boneTransforms, vector<Animation::KeyCursor>* keyCursors) const {
+    static thread_local LocalPose pose;    // Reused between calls to avoid allocating each frame.
+    double animationTime = fmod(time * animation.ticksPerSecond_, animation.duration_);
+    sampleAnimation(animation, animationTime, pose, keyCursors);
+    applyPose(pose, boneTransforms);
+}
+
+void ModelRigged::animateWithDynamics(const Animation& animation, double time, const glm::mat4& modelMtx, map<int, DynamicBone>& dynamicBones, vector<glm::mat4>& boneTransforms, vector<Animation::KeyCursor>* keyCursors) const {
+    static thread_local LocalPose pose;
+    double animationTime = fmod(time * animation.ticksPerSecond_, animation.duration_);
+    sampleAnimation(animation, animationTime, pose, keyCursors);
+    applyPoseWithDynamics(pose, modelMtx, dynamicBones, boneTransforms);
+}
+
+void ModelRigged::sampleAnimation(const Animation& animation, double animationTime, LocalPose& pose, vector<Animation::KeyCursor>* keyCursors) const {
+    if (keyCursors != nullptr) {
+        keyCursors->resize(nodeParents_.size());
     }
+    sampleLocalPose(bindAnimation(animation), animationTime, (keyCursors != nullptr ? keyCursors->data() : nullptr), pose);
 }
 
-void ModelRigged::animate(const Animation& animation, double time, vector<glm::mat4>& boneTransforms) const {
+void ModelRigged::applyPose(const LocalPose& pose, vector<glm::mat4>& boneTransforms) const {
     assert(boneTransforms.size() == boneOffsetMatrices_.size());
-    
-    double animationTime = fmod(time * animation.ticksPerSecond_, animation.duration_);
-    animateNodes(rootNode_, animation, animationTime, armatureRootInv_, boneTransforms);
+    concatenatePose(pose, glm::mat4(1.0f), nullptr, boneTransforms);
 }
 
-void ModelRigged::animateWithDynamics(const Animation& animation, double time, const glm::mat4& modelMtx, map<int, DynamicBone>& dynamicBones, vector<glm::mat4>& boneTransforms) const {
+void ModelRigged::applyPoseWithDynamics(const LocalPose& pose, const glm::mat4& modelMtx, map<int, DynamicBone>& dynamicBones, vector<glm::mat4>& boneTransforms) const {
     assert(boneTransforms.size() == boneOffsetMatrices_.size());
-    
-    double animationTime = fmod(time * animation.ticksPerSecond_, animation.duration_);
-    animateNodesWithDynamics(rootNode_, animation, animationTime, modelMtx, dynamicBones, armatureRootInv_, boneTransforms);
+    static thread_local vector<DynamicBone*> dynamicBoneTable;
+    fillDynamicBoneTable(dynamicBones, dynamicBoneTable);
+    concatenatePose(pose, modelMtx, dynamicBoneTable.data(), boneTransforms);
 }
 
-const ModelRigged::Node* ModelRigged::findNode(const string& nodeName) const {
-    stack<Node*> nodeStack;
-    nodeStack.push(rootNode_);
-    while (!nodeStack.empty()) {
-        Node* first = nodeStack.top();
-        nodeStack.pop();
-        
-        if (first->name == nodeName) {
-            return first;
-        }
-        
-        for (Node* n : first->children) {
-            nodeStack.push(n);
+vector<float> ModelRigged::createBoneMask(const string& rootNodeName, float weight) const {
+    vector<float> boneMask(nodeParents_.size(), 0.0f);
+    int rootIndex = findNode(rootNodeName);
+    if (rootIndex < 0) {
+        return boneMask;
+    }
+    boneMask[rootIndex] = weight;
+    for (size_t i = rootIndex + 1; i < nodeParents_.size(); ++i) {    // Children come after their parents, so one pass covers the whole subtree.
+        if (nodeParents_[i] >= 0 && boneMask[nodeParents_[i]] != 0.0f) {
+            boneMask[i] = boneMask[nodeParents_[i]];
         }
     }
+    return boneMask;
+}
+
+int ModelRigged::findNode(const string& nodeName) const {
+    auto findResult = nodeIndices_.find(nodeName);
+    if (findResult != nodeIndices_.end()) {
+        return static_cast<int>(findResult->second);
+    }
     
     cout << "Error: Unable to find node with name " << nodeName << ".\n";
-    return nullptr;
+    return -1;
+}
+
+int ModelRigged::findBoneIndex(const string& nodeName) const {
+    int nodeIndex = findNode(nodeName);
+    return (nodeIndex >= 0 ? nodeBoneIndices_[nodeIndex] : -1);
+}
+
+const ModelRigged::AnimationBinding& ModelRigged::bindAnimation(const Animation& animation) const {
+    {
+        shared_lock<shared_mutex> lock(animationBindingsMutex_);
+        auto findResult = animationBindings_.find(&animation);
+        if (findResult != animationBindings_.end() && isBindingCurrent(findResult->second, animation)) {
+            return findResult->second;
+        }
+    }
+    
+    lock_guard<shared_mutex> lock(animationBindingsMutex_);
+    AnimationBinding& binding = animationBindings_[&animation];
+    if (isBindingCurrent(binding, animation)) {    // Another thread may have bound it first.
+        return binding;
+    }
+    
+    binding.animation = &animation;
+    binding.animationId = animation.id_.get();
+    binding.numChannels = animation.channels_.size();
+    binding.nodeChannels.assign(nodeParents_.size(), nullptr);
+    for (const pair<const string, Animation::Channel>& channel : animation.channels_) {
+        auto findResult = nodeIndices_.find(channel.first);
+        if (findResult != nodeIndices_.end()) {
+            binding.nodeChannels[findResult->second] = &channel.second;
+        }
+    }
+    return binding;
 }
 
-ModelRigged::Node* ModelRigged::processNode(Node* parent, aiNode* node, glm::mat4 combinedTransform, const aiScene* scene, unordered_map<string, uint8_t>& boneMapping) {
+void ModelRigged::unbindAnimation(const Animation& animation) const {
+    lock_guard<shared_mutex> lock(animationBindingsMutex_);
+    animationBindings_.erase(&animation);
+}
+
+void ModelRigged::drawPalettes(const Shader& shader, unsigned int paletteOffset, unsigned int paletteStride, unsigned int count) const {
+    shader.setInt("paletteOffset", static_cast<int>(paletteOffset));
+    shader.setInt("paletteStride", static_cast<int>(paletteStride));
+    for (size_t i = 0; i < meshes_.size(); ++i) {
+        meshes_[i].drawInstanced(shader, meshTransforms_[i], count);
+    }
+}
+
+bool ModelRigged::isBindingCurrent(const AnimationBinding& binding, const Animation& animation) const {
+    return binding.animation == &animation && binding.animationId == animation.id_.get() && binding.numChannels == animation.channels_.size() && binding.nodeChannels.size() == nodeParents_.size();
+}
+
+void ModelRigged::processNode(int parentIndex, aiNode* node, glm::mat4 combinedTransform, const aiScene* scene, unordered_map<string, uint8_t>& boneMapping) {
     glm::mat4 thisTransformMtx = castMat4(node->mTransformation);
     combinedTransform *= thisTransformMtx;
-    Node* newNode = new Node(parent, string(node->mName.C_Str()), numNodes_, thisTransformMtx);
-    ++numNodes_;
+    int nodeIndex = static_cast<int>(nodeParents_.size());
+    addNode(parentIndex, string(node->mName.C_Str()), -1, thisTransformMtx);
     if (VERBOSE_OUTPUT_) {
         cout << "  Node " << node->mName.C_Str() << " has " << node->mNumMeshes << " meshes and " << node->mNumChildren << " children.\n";
         if (thisTransformMtx == glm::mat4(1.0f)) {
@@ -159,9 +217,67 @@ ModelRigged::Node* ModelRigged::processNode(Node* parent, aiNode* node, glm::mat
         meshTransforms_.push_back(combinedTransform);
     }
     for (unsigned int i = 0; i < node->mNumChildren; ++i) {    // Process all child nodes.
-        newNode->children.push_back(processNode(newNode, node->mChildren[i], combinedTransform, scene, boneMapping));
+        processNode(nodeIndex, node->mChildren[i], combinedTransform, scene, boneMapping);
     }
-    return newNode;
+}
+
+void ModelRigged::addNode(int parentIndex, const string& name, int boneIndex, const glm::mat4& transform) {
+    assert(parentIndex < static_cast<int>(nodeParents_.size()));
+    unsigned int nodeIndex = static_cast<unsigned int>(nodeParents_.size());
+    nodeParents_.push_back(parentIndex);
+    nodeBoneIndices_.push_back(boneIndex);
+    nodeTransforms_.push_back(transform);
+    nodeNames_.push_back(name);
+    bindPose_.resize(nodeIndex + 1);
+    CommonMath::decomposeTransform(transform, &bindPose_.translations[nodeIndex], &bindPose_.rotations[nodeIndex], &bindPose_.scales[nodeIndex]);
+    nodeIndices_.insert({name, nodeIndex});    // Keeps the first node if names repeat.
+}
+
+void ModelRigged::loadBinaryNodes(BinaryModel::Reader& reader) {
+    struct NodeData {
+        string name;
+        int parentIndex, boneIndex;
+        glm::mat4 transform;
+    };
+    vector<NodeData> nodeData(reader.read<uint32_t>());    // Read all of the nodes first, they are only added once nothing else can throw.
+    for (size_t i = 0; i < nodeData.size(); ++i) {
+        nodeData[i].name = reader.readString();
+        nodeData[i].parentIndex = reader.read<int32_t>();
+        nodeData[i].boneIndex = reader.read<int32_t>();
+        nodeData[i].transform = reader.read<glm::mat4>();
+        if (nodeData[i].parentIndex >= static_cast<int>(i) || (nodeData[i].parentIndex < 0) != (i == 0)) {    // Parents always come before their children.
+            throw runtime_error("Invalid node hierarchy.");
+        }
+    }
+    vector<glm::mat4> boneOffsetMatrices;
+    reader.readVector(boneOffsetMatrices);
+    glm::mat4 armatureRootInv = reader.read<glm::mat4>();
+    if (nodeData.empty()) {
+        throw runtime_error("Missing node hierarchy.");
+    }
+    for (const NodeData& n : nodeData) {
+        if (n.boneIndex >= static_cast<int>(boneOffsetMatrices.size())) {
+            throw runtime_error("Invalid bone index.");
+        }
+    }
+    
+    for (const NodeData& n : nodeData) {
+        addNode(n.parentIndex, n.name, n.boneIndex, n.transform);
+    }
+    boneOffsetMatrices_ = move(boneOffsetMatrices);
+    armatureRootInv_ = armatureRootInv;
+}
+
+void ModelRigged::saveBinaryNodes(BinaryModel::Writer& writer) const {
+    writer.write<uint32_t>(static_cast<uint32_t>(nodeParents_.size()));
+    for (size_t i = 0; i < nodeParents_.size(); ++i) {
+        writer.writeString(nodeNames_[i]);
+        writer.write<int32_t>(nodeParents_[i]);
+        writer.write<int32_t>(nodeBoneIndices_[i]);
+        writer.write<glm::mat4>(nodeTransforms_[i]);
+    }
+    writer.writeVector(boneOffsetMatrices_);
+    writer.write<glm::mat4>(armatureRootInv_);
 }
 
 Mesh ModelRigged::processMesh(aiMesh* mesh, const aiScene* scene, unordered_map<string, uint8_t>& boneMapping) {
@@ -189,90 +305,108 @@ Mesh ModelRigged::processMesh(aiMesh* mesh, const aiScene* scene, unordered_map<
             vertices[mesh->mBones[i]->mWeights[j].mVertexId].addBone(boneID, mesh->mBones[i]->mWeights[j].mWeight);
         }
     }
+    optimizeMesh(vertices, indices);    // Vertices get reordered, so this must happen after the bone weights are added.
     
-    return Mesh(move(vertices), move(indices), move(textures));
+    Mesh result;
+    result.prepareMesh(move(vertices), move(indices), move(textures), Mesh::PackedAttributes | Mesh::DepthStream);
+    return result;
 }
 
-void ModelRigged::animateNodes(const Node* node, const Animation& animation, double animationTime, glm::mat4 combinedTransform, vector<glm::mat4>& boneTransforms) const {
-    //cout << "animateNodes() on " << node->name << " with id " << node->id << " and boneIndex " << node->boneIndex << "\n";
-    glm::mat4 nodeTransform = node->transform;
-    auto findResult = animation.channels_.find(node->name);
-    if (findResult != animation.channels_.end()) {    // Check if this node has an animation.
-        //cout << "  adding channel transform.\n";
-        nodeTransform = animation.calcChannelTransform(findResult->second, animationTime);
-    }
-    
-    combinedTransform *= nodeTransform;
-    
-    if (node->boneIndex != -1) {    // If this node corresponds to a bone, set the computed transform.
-        //cout << "  setting bone transform.\n";
-        boneTransforms[node->boneIndex] = combinedTransform * boneOffsetMatrices_[node->boneIndex];
-    }
-    
-    //cout << "    evaluating " << node->children.size() << " children.\n";
-    for (size_t i = 0; i < node->children.size(); ++i) {
-        animateNodes(node->children[i], animation, animationTime, combinedTransform, boneTransforms);
+void ModelRigged::sampleLocalPose(const AnimationBinding& binding, double animationTime, Animation::KeyCursor* keyCursors, LocalPose& pose) const {
+    size_t numNodes = nodeParents_.size();
+    pose.resize(numNodes);
+    copy(bindPose_.translations.begin(), bindPose_.translations.end(), pose.translations.begin());    // Start from the bind pose, then overwrite the animated nodes.
+    copy(bindPose_.rotations.begin(), bindPose_.rotations.end(), pose.rotations.begin());
+    copy(bindPose_.scales.begin(), bindPose_.scales.end(), pose.scales.begin());
+    for (size_t i = 0; i < numNodes; ++i) {
+        const Animation::Channel* channel = binding.nodeChannels[i];
+        if (channel != nullptr) {
+            binding.animation->sampleChannel(*channel, animationTime, (keyCursors != nullptr ? &keyCursors[i] : nullptr), &pose.translations[i], &pose.rotations[i], &pose.scales[i]);
+        }
     }
 }
 
-void ModelRigged::animateNodesWithDynamics(const Node* node, const Animation& animation, double animationTime, const glm::mat4& modelMtx, map<int, DynamicBone>& dynamicBones, glm::mat4 combinedTransform, vector<glm::mat4>& boneTransforms) const {
-    glm::mat4 nodeTransform = node->transform;
-    auto findResult = dynamicBones.find(node->boneIndex);
-    if (findResult != dynamicBones.end()) {    // Check if this is a dynamic bone, and override its transforms and any keyframes it may have.
-        DynamicBone& bone = findResult->second;
-        glm::vec3 bonePosLS(0.0f);
-        glm::quat rotateToCOM(1.0f, 0.0f, 0.0f, 0.0f);
-        
+void ModelRigged::concatenatePose(const LocalPose& pose, const glm::mat4& modelMtx, DynamicBone* const* dynamicBoneTable, vector<glm::mat4>& boneTransforms) const {
+    size_t numNodes = nodeParents_.size();
+    static thread_local vector<glm::mat4> combinedTransforms;    // Transform of each node relative to the armature root.
+    combinedTransforms.resize(numNodes);
+    
+    float scaleAvg = 1.0f;
+    glm::mat4 armatureRoot(1.0f);
+    if (dynamicBoneTable != nullptr) {
         float scaleX = glm::length(glm::vec3(modelMtx[0][0], modelMtx[0][1], modelMtx[0][2]));
         float scaleY = glm::length(glm::vec3(modelMtx[1][0], modelMtx[1][1], modelMtx[1][2]));
         float scaleZ = glm::length(glm::vec3(modelMtx[2][0], modelMtx[2][1], modelMtx[2][2]));
-        float scaleAvg = (scaleX + scaleY + scaleZ) / 3.0f;    // Average scaling of the model used to approximate radial clamp in world space.
-        glm::mat4 localToWorldSpace = modelMtx * glm::inverse(armatureRootInv_) * combinedTransform * node->transform;
-        glm::mat4 worldToLocalSpace = glm::inverse(localToWorldSpace);
+        scaleAvg = (scaleX + scaleY + scaleZ) / 3.0f;    // Average scaling of the model used to approximate radial clamp in world space.
+        armatureRoot = modelMtx * glm::inverse(armatureRootInv_);
+    }
+    
+    for (size_t i = 0; i < numNodes; ++i) {
+        const glm::mat4& parentTransform = (nodeParents_[i] >= 0 ? combinedTransforms[nodeParents_[i]] : armatureRootInv_);
+        int boneIndex = nodeBoneIndices_[i];
+        if (dynamicBoneTable != nullptr && boneIndex != -1 && dynamicBoneTable[boneIndex] != nullptr) {    // Check if this is a dynamic bone, and override its transforms and any keyframes it may have.
+            glm::mat4 localToWorldSpace = armatureRoot * parentTransform * nodeTransforms_[i];
+            combinedTransforms[i] = parentTransform * nodeTransforms_[i] * updateDynamicBone(*dynamicBoneTable[boneIndex], localToWorldSpace, scaleAvg);
+        } else {
+            combinedTransforms[i] = parentTransform * CommonMath::composeTransform(pose.translations[i], pose.rotations[i], pose.scales[i]);
+        }
         
-        if (bone.maxDisplacement != 0.0f) {
-            glm::vec3 equilibriumPos = glm::vec3(localToWorldSpace * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-            
-            if (bone.maxDisplacement != numeric_limits<float>::max()) {    // Clamp bone.lastPosition within a circular area bounded by bone.maxDisplacement.
-                bone.lastPosition = clampVec3WithinSphere(bone.lastPosition, equilibriumPos, bone.maxDisplacement * scaleAvg);
-            }
-            
-            bone.springMotion.updateMotion(&bone.lastPosition, &bone.linearVel, equilibriumPos);
-            
-            bonePosLS = glm::vec3(worldToLocalSpace * glm::vec4(bone.lastPosition, 1.0f));
+        if (boneIndex != -1) {    // If this node corresponds to a bone, set the computed transform.
+            boneTransforms[boneIndex] = combinedTransforms[i] * boneOffsetMatrices_[boneIndex];
         }
+    }
+}
+
+void ModelRigged::fillDynamicBoneTable(map<int, DynamicBone>& dynamicBones, vector<DynamicBone*>& dynamicBoneTable) const {    // Swap the map for a table so nodes don't need a lookup each.
+    dynamicBoneTable.assign(boneOffsetMatrices_.size(), nullptr);
+    for (pair<const int, DynamicBone>& bone : dynamicBones) {
+        if (bone.first >= 0 && bone.first < static_cast<int>(dynamicBoneTable.size())) {
+            dynamicBoneTable[bone.first] = &bone.second;
+        }
+    }
+}
+
+glm::mat4 ModelRigged::updateDynamicBone(DynamicBone& bone, const glm::mat4& localToWorldSpace, float scaleAvg) const {
+    if (bone.maxDisplacement != 0.0f) {
+        glm::vec3 equilibriumPos = glm::vec3(localToWorldSpace * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
         
-        if (bone.maxDisplacementCOM != 0.0f) {
-            glm::vec3 equilibriumPosCOM = glm::vec3(localToWorldSpace * glm::vec4(bone.centerOfMassOffset, 1.0f));
-            
-            if (bone.maxDisplacementCOM != numeric_limits<float>::max()) {    // Clamp bone.lastPositionCOM within a circular area bounded by bone.maxDisplacementCOM.
-                bone.lastPositionCOM = clampVec3WithinSphere(bone.lastPositionCOM, equilibriumPosCOM, bone.maxDisplacementCOM * scaleAvg);
-            }
-            
-            bone.springMotionCOM.updateMotion(&bone.lastPositionCOM, &bone.linearVelCOM, equilibriumPosCOM);
-            
-            glm::vec3 equilibriumPosCOMLS = glm::vec3(worldToLocalSpace * glm::vec4(equilibriumPosCOM, 1.0f));
-            glm::vec3 bonePosCOMLS = glm::vec3(worldToLocalSpace * glm::vec4(bone.lastPositionCOM, 1.0f));
-            rotateToCOM = CommonMath::findRotationBetweenVectors(equilibriumPosCOMLS - glm::vec3(0.0f), bonePosCOMLS - glm::vec3(0.0f));
+        if (bone.maxDisplacement != numeric_limits<float>::max()) {    // Clamp bone.lastPosition within a circular area bounded by bone.maxDisplacement.
+            bone.lastPosition = clampVec3WithinSphere(bone.lastPosition, equilibriumPos, bone.maxDisplacement * scaleAvg);
         }
         
-        nodeTransform = node->transform * glm::translate(glm::mat4(1.0f), bonePosLS) * glm::mat4_cast(rotateToCOM);
-    } else {
-        auto findResult2 = animation.channels_.find(node->name);
-        if (findResult2 != animation.channels_.end()) {    // Check if this node has an animation.
-            nodeTransform = animation.calcChannelTransform(findResult2->second, animationTime);
+        bone.springMotion.updateMotion(&bone.lastPosition, &bone.linearVel, equilibriumPos);
+    }
+    
+    if (bone.maxDisplacementCOM != 0.0f) {
+        glm::vec3 equilibriumPosCOM = glm::vec3(localToWorldSpace * glm::vec4(bone.centerOfMassOffset, 1.0f));
+        
+        if (bone.maxDisplacementCOM != numeric_limits<float>::max()) {    // Clamp bone.lastPositionCOM within a circular area bounded by bone.maxDisplacementCOM.
+            bone.lastPositionCOM = clampVec3WithinSphere(bone.lastPositionCOM, equilibriumPosCOM, bone.maxDisplacementCOM * scaleAvg);
         }
+        
+        bone.springMotionCOM.updateMotion(&bone.lastPositionCOM, &bone.linearVelCOM, equilibriumPosCOM);
     }
     
-    combinedTransform *= nodeTransform;
+    return getDynamicBoneTransform(bone, localToWorldSpace);
+}
+
+glm::mat4 ModelRigged::getDynamicBoneTransform(const DynamicBone& bone, const glm::mat4& localToWorldSpace) const {
+    glm::vec3 bonePosLS(0.0f);
+    glm::quat rotateToCOM(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::mat4 worldToLocalSpace = glm::inverse(localToWorldSpace);
     
-    if (node->boneIndex != -1) {    // If this node corresponds to a bone, set the computed transform.
-        boneTransforms[node->boneIndex] = combinedTransform * boneOffsetMatrices_[node->boneIndex];
+    if (bone.maxDisplacement != 0.0f) {
+        bonePosLS = glm::vec3(worldToLocalSpace * glm::vec4(bone.lastPosition, 1.0f));
     }
     
-    for (size_t i = 0; i < node->children.size(); ++i) {
-        animateNodesWithDynamics(node->children[i], animation, animationTime, modelMtx, dynamicBones, combinedTransform, boneTransforms);
+    if (bone.maxDisplacementCOM != 0.0f) {
+        glm::vec3 equilibriumPosCOM = glm::vec3(localToWorldSpace * glm::vec4(bone.centerOfMassOffset, 1.0f));
+        glm::vec3 equilibriumPosCOMLS = glm::vec3(worldToLocalSpace * glm::vec4(equilibriumPosCOM, 1.0f));
+        glm::vec3 bonePosCOMLS = glm::vec3(worldToLocalSpace * glm::vec4(bone.lastPositionCOM, 1.0f));
+        rotateToCOM = CommonMath::findRotationBetweenVectors(equilibriumPosCOMLS - glm::vec3(0.0f), bonePosCOMLS - glm::vec3(0.0f));
     }
+    
+    return glm::translate(glm::mat4(1.0f), bonePosLS) * glm::mat4_cast(rotateToCOM);
 }
 
 glm::vec3 ModelRigged::clampVec3WithinSphere(const glm::vec3& vec, const glm::vec3& origin, float radius) const {
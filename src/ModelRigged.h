@@ -1,29 +1,37 @@
 #ifndef MODEL_RIGGED_H_
 #define MODEL_RIGGED_H_
 
-class Animation;
-
+#include "Animation.h"
 #include "DampedSpringMotion.h"
 #include "ModelAbstract.h"
 #include <limits>
 #include <map>
+#include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 
 using namespace std;
 
 class ModelRigged : public ModelAbstract {
     public:
-    struct Node {
-        Node* parent;
-        vector<Node*> children;
-        string name;
-        unsigned int id;
-        int boneIndex;
-        glm::mat4 transform;
+    struct LocalPose {    // Node transforms relative to the parent, indexed by node. Each component is a separate array so the loops over nodes stay on packed data.
+        vector<glm::vec3> translations;
+        vector<glm::quat> rotations;
+        vector<glm::vec3> scales;
         
-        Node(Node* parent, const string& name, unsigned int id, const glm::mat4& transform) : parent(parent), name(name), id(id), boneIndex(-1), transform(transform) {}
+        void resize(size_t numNodes) {
+            translations.resize(numNodes);
+            rotations.resize(numNodes);
+            scales.resize(numNodes);
+        }
+    };
+    struct AnimationBinding {    // Channels of an animation resolved against the nodes of this model, so evaluating a frame doesn't need any name lookups.
+        const Animation* animation;
+        uint64_t animationId;    // Catches a new animation at the address of a destroyed one.
+        size_t numChannels;    // Used to catch channels being added or removed after binding.
+        vector<const Animation::Channel*> nodeChannels;    // Indexed by node id, null if the node isn't animated.
     };
-    struct DynamicBone {
+    struct DynamicBone {    // The spring motions are for one step, applyPoseWithDynamics() takes a step each call and DynamicBoneSolver steps at a fixed 60 Hz.
         float maxDisplacement;
         float maxDisplacementCOM;
         glm::vec3 centerOfMassOffset;
@@ -61,25 +69,49 @@ class ModelRigged : public ModelAbstract {
     
     ModelRigged();
     ModelRigged(const string& filename, unordered_map<string, Animation>* animations = nullptr);
-    ~ModelRigged();
-    Node* getRootNode() const;
     unsigned int getNumNodes() const;
+    int getParentIndex(unsigned int nodeIndex) const;    // Parents always come before their children, the root node has no parent (-1).
+    int getBoneIndex(unsigned int nodeIndex) const;    // Returns -1 if the node isn't a bone.
+    const string& getNodeName(unsigned int nodeIndex) const;
+    const glm::mat4& getNodeTransform(unsigned int nodeIndex) const;    // Bind transform relative to the parent.
+    const LocalPose& getBindPose() const;
     const glm::mat4& getArmatureRootInv() const;
     void setArmatureRootInv(const glm::mat4& armatureRootInv);
-    void loadFile(const string& filename, unordered_map<string, Animation>* animations = nullptr);
-    void animate(const Animation& animation, double time, vector<glm::mat4>& boneTransforms) const;    // Sets the transforms in the boneTransforms vector to match the given animation at the specified time.
-    void animateWithDynamics(const Animation& animation, double time, const glm::mat4& modelMtx, map<int, DynamicBone>& dynamicBones, vector<glm::mat4>& boneTransforms) const;    // Same process as animate() but additionally applies dynamics/constraints to some bones.
-    const Node* findNode(const string& nodeName) const;
+    bool loadFileData(const string& filename, vector<Animation>* fileAnimations);
+    void animate(const Animation& animation, double time, vector<glm::mat4>& boneTransforms, vector<Animation::KeyCursor>* keyCursors = nullptr) const;    // Sets the transforms in the boneTransforms vector to match the given animation at the specified time. The keyCursors keep the playback position for each node, the caller should keep one set per playing animation.
+    void animateWithDynamics(const Animation& animation, double time, const glm::mat4& modelMtx, map<int, DynamicBone>& dynamicBones, vector<glm::mat4>& boneTransforms, vector<Animation::KeyCursor>* keyCursors = nullptr) const;    // Same process as animate() but additionally applies dynamics/constraints to some bones.
+    void sampleAnimation(const Animation& animation, double animationTime, LocalPose& pose, vector<Animation::KeyCursor>* keyCursors = nullptr) const;    // Sets the pose to match the animation at animationTime (in ticks, not wrapped). Used with applyPose() to blend between animations.
+    void applyPose(const LocalPose& pose, vector<glm::mat4>& boneTransforms) const;    // Sets the bone transforms from a local pose.
+    void applyPoseWithDynamics(const LocalPose& pose, const glm::mat4& modelMtx, map<int, DynamicBone>& dynamicBones, vector<glm::mat4>& boneTransforms) const;
+    glm::mat4 getDynamicBoneTransform(const DynamicBone& bone, const glm::mat4& localToWorldSpace) const;    // Returns the transform to apply after the bind transform for the current positions of the bone, localToWorldSpace is the bind transform of the bone in world space.
+    vector<float> createBoneMask(const string& rootNodeName, float weight = 1.0f) const;    // Returns per-node weights that are set for the named node and everything below it, and zero for the rest.
+    int findNode(const string& nodeName) const;    // Returns the node index, or -1 if it doesn't exist.
+    int findBoneIndex(const string& nodeName) const;    // Returns -1 if the node doesn't exist or isn't a bone.
+    const AnimationBinding& bindAnimation(const Animation& animation) const;    // Returns the cached binding, this is done automatically by animate(). The same animation can be bound to any number of models.
+    void drawPalettes(const Shader& shader, unsigned int paletteOffset, unsigned int paletteStride, unsigned int count) const;    // Draws count instances with palettes stored back to back from paletteOffset (in texels), using one instanced draw per mesh. The shader needs the BONE_BUFFER keyword and the palette buffer bound.
+    void unbindAnimation(const Animation& animation) const;    // Drops the cached binding to free it when the animation is destroyed before the model. Bindings to stale animations are never used, they are rebuilt if the address is reused or the channels are replaced.
     
     private:
-    Node* rootNode_;
-    unsigned int numNodes_;
+    vector<int> nodeParents_;    // The node hierarchy is stored flat in pre-order, so each node comes after its parent.
+    vector<int> nodeBoneIndices_;
+    vector<glm::mat4> nodeTransforms_;    // Bind transform of each node relative to its parent.
+    vector<string> nodeNames_;
+    LocalPose bindPose_;    // The nodeTransforms_ split into components, used for nodes an animation doesn't cover.
+    unordered_map<string, unsigned int> nodeIndices_;
     glm::mat4 armatureRootInv_;
+    mutable unordered_map<const Animation*, AnimationBinding> animationBindings_;    // Bindings are built lazily, so they can change in const functions.
+    mutable shared_mutex animationBindingsMutex_;    // Lookups only need shared access, so many instances can evaluate at once.
     
-    Node* processNode(Node* parent, aiNode* node, glm::mat4 combinedTransform, const aiScene* scene, unordered_map<string, uint8_t>& boneMapping);    // Recursively traverse the scene nodes while adding mesh data. This also builds the node tree and maps bone names.
+    void processNode(int parentIndex, aiNode* node, glm::mat4 combinedTransform, const aiScene* scene, unordered_map<string, uint8_t>& boneMapping);    // Recursively traverse the scene nodes while adding mesh data. This also appends the nodes and maps bone names.
+    void addNode(int parentIndex, const string& name, int boneIndex, const glm::mat4& transform);
     Mesh processMesh(aiMesh* mesh, const aiScene* scene, unordered_map<string, uint8_t>& boneMapping);    // Generate a new mesh and collect any new bone data.
-    void animateNodes(const Node* node, const Animation& animation, double animationTime, glm::mat4 combinedTransform, vector<glm::mat4>& boneTransforms) const;    // Recursively traverse the nodes to set each bone transform.
-    void animateNodesWithDynamics(const Node* node, const Animation& animation, double animationTime, const glm::mat4& modelMtx, map<int, DynamicBone>& dynamicBones, glm::mat4 combinedTransform, vector<glm::mat4>& boneTransforms) const;
+    void loadBinaryNodes(BinaryModel::Reader& reader);    // Reads the node tree in pre-order along with the bone offsets.
+    void saveBinaryNodes(BinaryModel::Writer& writer) const;
+    bool isBindingCurrent(const AnimationBinding& binding, const Animation& animation) const;    // Checks if the binding was built for this animation and model, and the channels haven't changed since.
+    void sampleLocalPose(const AnimationBinding& binding, double animationTime, Animation::KeyCursor* keyCursors, LocalPose& pose) const;    // Fills in the pose of each node from the animation, or the bind pose if it has no channel.
+    void concatenatePose(const LocalPose& pose, const glm::mat4& modelMtx, DynamicBone* const* dynamicBoneTable, vector<glm::mat4>& boneTransforms) const;    // Combines the local transforms down the hierarchy to set each bone transform. The dynamicBoneTable is indexed by bone index and can be null if there are no dynamic bones.
+    void fillDynamicBoneTable(map<int, DynamicBone>& dynamicBones, vector<DynamicBone*>& dynamicBoneTable) const;
+    glm::mat4 updateDynamicBone(DynamicBone& bone, const glm::mat4& localToWorldSpace, float scaleAvg) const;    // Steps the bone motion and returns the transform to apply after the bind transform.
     glm::vec3 clampVec3WithinSphere(const glm::vec3& vec, const glm::vec3& origin, float radius) const;
 };
 
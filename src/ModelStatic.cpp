@@ -10,24 +10,25 @@ ModelStatic::ModelStatic(const string& filename, unordered_map<string, Animation
     loadFile(filename, animations);
 }
 
-void ModelStatic::loadFile(const string& filename, unordered_map<string, Animation>* animations) {
+bool ModelStatic::loadFileData(const string& filename, vector<Animation>* fileAnimations) {
+    uint64_t sourceHash = BinaryModel::hashSourceFile(filename);
+    if (loadBinary(filename, BinaryModel::StaticModel, sourceHash, fileAnimations)) {
+        return true;
+    }
+    
     Assimp::Importer importer;
     const aiScene* scene = loadScene(&importer, filename);
     if (scene == nullptr) {
-        return;
+        return false;
     }
     meshes_.reserve(scene->mNumMeshes);
     meshTransforms_.reserve(scene->mNumMeshes);
     processNode(scene->mRootNode, glm::mat4(1.0f), scene);
+    printOptimizationStats(filename);
     
-    if (animations != nullptr) {
-        for (unsigned int i = 0; i < scene->mNumAnimations; ++i) {    // Load all animations of the model.
-            auto insertResult = animations->insert({string(scene->mAnimations[i]->mName.C_Str()), Animation(scene, i)});
-            if (!insertResult.second) {
-                cout << "Error: Found animation with the same name as an existing one.\n";
-            }
-        }
-    }
+    *fileAnimations = Animation::loadAllFromScene(scene);    // Animations are always saved so the preprocessed file works for any caller.
+    saveBinary(filename, BinaryModel::StaticModel, sourceHash, *fileAnimations);
+    return true;
 }
 
 void ModelStatic::processNode(aiNode* node, glm::mat4 combinedTransform, const aiScene* scene) {
@@ -56,6 +57,9 @@ Mesh ModelStatic::processMesh(aiMesh* mesh, const aiScene* scene) {
     vector<unsigned int> indices;
     vector<Mesh::Texture> textures;
     processMeshAttributes<Mesh::Vertex>(mesh, scene, vertices, indices, textures);
+    optimizeMesh(vertices, indices);
     
-    return Mesh(move(vertices), move(indices), move(textures));
+    Mesh result;
+    result.prepareMesh(move(vertices), move(indices), move(textures), Mesh::PackedAttributes | Mesh::QuantizedPositions | Mesh::DepthStream | Mesh::GenerateLODs);
+    return result;
 }
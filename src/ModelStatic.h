@@ -9,7 +9,7 @@ class ModelStatic : public ModelAbstract {
     public:
     ModelStatic();
     ModelStatic(const string& filename, unordered_map<string, Animation>* animations = nullptr);
-    void loadFile(const string& filename, unordered_map<string, Animation>* animations = nullptr);
+    bool loadFileData(const string& filename, vector<Animation>* fileAnimations);
     
     private:
     void processNode(aiNode* node, glm::mat4 combinedTransform, const aiScene* scene);
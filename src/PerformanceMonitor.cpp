@@ -1,3 +1,4 @@
+#include "FrameAllocator.h"
 #include "PerformanceMonitor.h"
 #include "Shader.h"
 #include <glad/glad.h>
@@ -105,7 +106,7 @@ void PerformanceMonitor::stopGPUTimer() {
     }
 }
 
-void PerformanceMonitor::update() {
+void PerformanceMonitor::update(FrameAllocator& frameAllocator) {
     float sampleSumScaled = 0.0f;    // Update the line graph.
     float sampleMaxScaled = 0.0f;
     float scalingRatio = heightScale_ / lastHeightScale_;
@@ -123,11 +124,11 @@ void PerformanceMonitor::update() {
     glBindBuffer(GL_ARRAY_BUFFER, lineVBO_);
     glBufferSubData(GL_ARRAY_BUFFER, 0, NUM_SAMPLES_ * sizeof(glm::vec4), samplesScaled_);
     
-    string percentOfParentMonitor = "";    // Update text.
-    if (parentMonitor_ != nullptr) {
-        percentOfParentMonitor = "\n(" + to_string(sampleAverage_ / parentMonitor_->sampleAverage_ * 100.0f) + "% of " + parentMonitor_->name_ + ")";
+    if (parentMonitor_ != nullptr) {    // Update text.
+        text_.setString(frameAllocator.format("%s\nAvg: %f ms\n(%f%% of %s)", name_.c_str(), sampleAverage_, sampleAverage_ / parentMonitor_->sampleAverage_ * 100.0f, parentMonitor_->name_.c_str()));
+    } else {
+        text_.setString(frameAllocator.format("%s\nAvg: %f ms", name_.c_str(), sampleAverage_));
     }
-    text_.setString(name_ + "\nAvg: " + to_string(sampleAverage_) + " ms" + percentOfParentMonitor);
 }
 
 void PerformanceMonitor::drawBox(const Shader& shader, const glm::mat4& modelMtx) const {
@@ -1,6 +1,7 @@
 #ifndef PERFORMANCE_MONITOR_H_
 #define PERFORMANCE_MONITOR_H_
 
+class FrameAllocator;
 class Shader;
 
 #include "Text.h"
@@ -26,7 +27,7 @@ class PerformanceMonitor {
     float getSampleAverage() const;
     void startGPUTimer();
     void stopGPUTimer();
-    void update();
+    void update(FrameAllocator& frameAllocator);    // The text is formatted in the frame allocator.
     void drawBox(const Shader& shader, const glm::mat4& modelMtx) const;
     void drawLine(const Shader& shader, const glm::mat4& modelMtx) const;
     void drawText(const Shader& shader, const glm::mat4& modelMtx) const;
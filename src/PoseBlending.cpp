@@ -0,0 +1,118 @@
+#include "PoseBlending.h"
+#include <cassert>
+#include <cmath>
+
+void PoseBlending::blend(const ModelRigged::LocalPose& from, const ModelRigged::LocalPose& to, float weight, const float* boneMask, ModelRigged::LocalPose& result) {
+    size_t numNodes = from.translations.size();
+    assert(to.translations.size() == numNodes && result.translations.size() == numNodes);
+    const float* fromT = &from.translations[0].x;
+    const float* toT = &to.translations[0].x;
+    float* resultT = &result.translations[0].x;
+    const float* fromS = &from.scales[0].x;
+    const float* toS = &to.scales[0].x;
+    float* resultS = &result.scales[0].x;
+    const float* fromR = &from.rotations[0].x;
+    const float* toR = &to.rotations[0].x;
+    float* resultR = &result.rotations[0].x;
+    
+    for (size_t i = 0; i < numNodes; ++i) {
+        float w = weight * (boneMask != nullptr ? boneMask[i] : 1.0f);
+        for (size_t j = i * 3; j < i * 3 + 3; ++j) {
+            resultT[j] = fromT[j] + (toT[j] - fromT[j]) * w;
+            resultS[j] = fromS[j] + (toS[j] - fromS[j]) * w;
+        }
+        
+        const float* a = fromR + i * 4;    // Normalized lerp, flipping the second rotation onto the same hemisphere as the first.
+        const float* b = toR + i * 4;
+        float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+        float bWeight = copysign(w, dot);
+        float q[4];
+        for (int j = 0; j < 4; ++j) {
+            q[j] = a[j] * (1.0f - w) + b[j] * bWeight;
+        }
+        float invLength = 1.0f / sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+        for (int j = 0; j < 4; ++j) {
+            resultR[i * 4 + j] = q[j] * invLength;
+        }
+    }
+}
+
+void PoseBlending::addAdditive(const ModelRigged::LocalPose& base, const ModelRigged::LocalPose& additive, const ModelRigged::LocalPose& reference, float weight, const float* boneMask, ModelRigged::LocalPose& result) {
+    size_t numNodes = base.translations.size();
+    assert(additive.translations.size() == numNodes && reference.translations.size() == numNodes && result.translations.size() == numNodes);
+    const float* baseT = &base.translations[0].x;
+    const float* additiveT = &additive.translations[0].x;
+    const float* referenceT = &reference.translations[0].x;
+    float* resultT = &result.translations[0].x;
+    const float* baseS = &base.scales[0].x;
+    const float* additiveS = &additive.scales[0].x;
+    const float* referenceS = &reference.scales[0].x;
+    float* resultS = &result.scales[0].x;
+    const float* baseR = &base.rotations[0].x;
+    const float* additiveR = &additive.rotations[0].x;
+    const float* referenceR = &reference.rotations[0].x;
+    float* resultR = &result.rotations[0].x;
+    
+    for (size_t i = 0; i < numNodes; ++i) {
+        float w = weight * (boneMask != nullptr ? boneMask[i] : 1.0f);
+        for (size_t j = i * 3; j < i * 3 + 3; ++j) {
+            resultT[j] = baseT[j] + (additiveT[j] - referenceT[j]) * w;
+            resultS[j] = baseS[j] * (1.0f + (additiveS[j] / referenceS[j] - 1.0f) * w);
+        }
+        
+        const float* a = additiveR + i * 4;    // Rotation from the reference to the additive pose (a * conjugate(r)), then nlerp from identity by the weight. Quaternions are stored as x, y, z, w.
+        const float* r = referenceR + i * 4;
+        float d[4] = {
+            -a[3] * r[0] + a[0] * r[3] - a[1] * r[2] + a[2] * r[1],
+            -a[3] * r[1] + a[0] * r[2] + a[1] * r[3] - a[2] * r[0],
+            -a[3] * r[2] - a[0] * r[1] + a[1] * r[0] + a[2] * r[3],
+            a[3] * r[3] + a[0] * r[0] + a[1] * r[1] + a[2] * r[2]
+        };
+        d[0] *= w;
+        d[1] *= w;
+        d[2] *= w;
+        d[3] = copysign(1.0f - w, d[3]) + d[3] * w;
+        float invLength = 1.0f / sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + d[3] * d[3]);
+        for (int j = 0; j < 4; ++j) {
+            d[j] *= invLength;
+        }
+        
+        const float* b = baseR + i * 4;    // Result is d * b, written last so the result can alias the base.
+        float q[4] = {
+            d[3] * b[0] + d[0] * b[3] + d[1] * b[2] - d[2] * b[1],
+            d[3] * b[1] - d[0] * b[2] + d[1] * b[3] + d[2] * b[0],
+            d[3] * b[2] + d[0] * b[1] - d[1] * b[0] + d[2] * b[3],
+            d[3] * b[3] - d[0] * b[0] - d[1] * b[1] - d[2] * b[2]
+        };
+        for (int j = 0; j < 4; ++j) {
+            resultR[i * 4 + j] = q[j];
+        }
+    }
+}
+
+PoseBlending::PosePool::PosePool(size_t numNodes) : numNodes_(numNodes) {}
+
+void PoseBlending::PosePool::setNumNodes(size_t numNodes) {
+    numNodes_ = numNodes;
+    freePoses_.clear();
+    for (unique_ptr<ModelRigged::LocalPose>& pose : poses_) {
+        freePoses_.push_back(pose.get());
+    }
+}
+
+ModelRigged::LocalPose* PoseBlending::PosePool::acquire() {
+    if (freePoses_.empty()) {
+        poses_.push_back(make_unique<ModelRigged::LocalPose>());
+        freePoses_.reserve(poses_.size());    // Releasing never needs to grow the free list.
+        freePoses_.push_back(poses_.back().get());
+    }
+    ModelRigged::LocalPose* pose = freePoses_.back();
+    freePoses_.pop_back();
+    pose->resize(numNodes_);
+    return pose;
+}
+
+void PoseBlending::PosePool::release(ModelRigged::LocalPose* pose) {
+    assert(freePoses_.size() < poses_.size());
+    freePoses_.push_back(pose);
+}
@@ -0,0 +1,30 @@
+#ifndef POSE_BLENDING_H_
+#define POSE_BLENDING_H_
+
+#include "ModelRigged.h"
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+namespace PoseBlending {    // Kernels for combining local poses. These loop over the packed pose arrays with no branches so the compiler can vectorize them, the result can be the same pose as one of the inputs.
+    void blend(const ModelRigged::LocalPose& from, const ModelRigged::LocalPose& to, float weight, const float* boneMask, ModelRigged::LocalPose& result);    // Interpolates from one pose to the other. The boneMask scales the weight of each node and can be null to use the weight everywhere.
+    void addAdditive(const ModelRigged::LocalPose& base, const ModelRigged::LocalPose& additive, const ModelRigged::LocalPose& reference, float weight, const float* boneMask, ModelRigged::LocalPose& result);    // Applies the difference between the additive and reference poses on top of the base pose.
+    
+    class PosePool {    // Hands out pose buffers for temporary results, nothing is allocated once the pool has grown to the most poses used at a time.
+        public:
+        PosePool(size_t numNodes = 0);
+        PosePool(const PosePool& pool) = delete;
+        PosePool& operator=(const PosePool& pool) = delete;
+        void setNumNodes(size_t numNodes);    // Releases all poses, they are resized the next time they are acquired.
+        ModelRigged::LocalPose* acquire();
+        void release(ModelRigged::LocalPose* pose);
+        
+        private:
+        size_t numNodes_;
+        vector<unique_ptr<ModelRigged::LocalPose>> poses_;
+        vector<ModelRigged::LocalPose*> freePoses_;
+    };
+}
+
+#endif
@@ -0,0 +1,294 @@
+#include "PositionBasedSolver.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+PositionBasedSolver::PositionBasedSolver(ThreadPool* threadPool) :
+    threadPool_(threadPool),
+    colorOffsets_(1, 0),
+    colorsDirty_(false),
+    gravity_(0.0f, -9.81f, 0.0f),
+    damping_(0.01f),
+    numIterations_(8),
+    groundHeight_(numeric_limits<float>::lowest()) {
+}
+
+unsigned int PositionBasedSolver::addParticle(const glm::vec3& position, float inverseMass, bool collidesWithCapsules) {
+    positions_.push_back(position);
+    prevPositions_.push_back(position);
+    velocities_.push_back(glm::vec3(0.0f));
+    startPositions_.push_back(position);
+    targets_.push_back(position);
+    inverseMasses_.push_back(inverseMass);
+    collidesWithCapsules_.push_back(collidesWithCapsules ? 1 : 0);
+    return static_cast<unsigned int>(positions_.size() - 1);
+}
+
+unsigned int PositionBasedSolver::addDistanceConstraint(unsigned int a, unsigned int b, float restLength, float stiffness, bool minimumOnly) {
+    assert(a < positions_.size() && b < positions_.size() && a != b);
+    DistanceConstraint constraint;
+    constraint.a = a;
+    constraint.b = b;
+    constraint.restLength = restLength;
+    constraint.stiffness = stiffness;
+    constraint.iterationStiffness = getIterationStiffness(stiffness);
+    constraint.minimumOnly = minimumOnly;
+    constraints_.push_back(constraint);
+    constraintSlots_.push_back(static_cast<unsigned int>(constraints_.size() - 1));
+    colorsDirty_ = true;
+    return static_cast<unsigned int>(constraintSlots_.size() - 1);
+}
+
+unsigned int PositionBasedSolver::addCapsule(unsigned int a, unsigned int b, float radius) {
+    assert(a < positions_.size() && b < positions_.size());
+    capsules_.push_back({a, b, radius});
+    return static_cast<unsigned int>(capsules_.size() - 1);
+}
+
+size_t PositionBasedSolver::getNumParticles() const {
+    return positions_.size();
+}
+
+size_t PositionBasedSolver::getNumConstraints() const {
+    return constraints_.size();
+}
+
+unsigned int PositionBasedSolver::getNumColors() {
+    if (colorsDirty_) {
+        colorConstraints();
+    }
+    return static_cast<unsigned int>(colorOffsets_.size() - 1);
+}
+
+const glm::vec3& PositionBasedSolver::getPosition(unsigned int particle) const {
+    return positions_[particle];
+}
+
+void PositionBasedSolver::setPosition(unsigned int particle, const glm::vec3& position) {
+    positions_[particle] = position;
+    prevPositions_[particle] = position;
+    startPositions_[particle] = position;
+    targets_[particle] = position;
+    velocities_[particle] = glm::vec3(0.0f);
+}
+
+void PositionBasedSolver::setTarget(unsigned int particle, const glm::vec3& target) {
+    targets_[particle] = target;
+}
+
+void PositionBasedSolver::setInverseMass(unsigned int particle, float inverseMass) {
+    if (inverseMass == 0.0f && inverseMasses_[particle] != 0.0f) {    // Hold still until a target is given.
+        targets_[particle] = positions_[particle];
+    }
+    inverseMasses_[particle] = inverseMass;
+}
+
+void PositionBasedSolver::setCollidesWithCapsules(unsigned int particle, bool collidesWithCapsules) {
+    collidesWithCapsules_[particle] = (collidesWithCapsules ? 1 : 0);
+}
+
+void PositionBasedSolver::setRestLength(unsigned int constraint, float restLength) {
+    constraints_[constraintSlots_[constraint]].restLength = restLength;
+}
+
+void PositionBasedSolver::setCapsuleRadius(unsigned int capsule, float radius) {
+    capsules_[capsule].radius = radius;
+}
+
+void PositionBasedSolver::setGravity(const glm::vec3& gravity) {
+    gravity_ = gravity;
+}
+
+void PositionBasedSolver::setDamping(float damping) {
+    damping_ = damping;
+}
+
+void PositionBasedSolver::setNumIterations(unsigned int numIterations) {
+    numIterations_ = max(numIterations, 1u);
+    for (DistanceConstraint& constraint : constraints_) {
+        constraint.iterationStiffness = getIterationStiffness(constraint.stiffness);
+    }
+}
+
+void PositionBasedSolver::setGroundHeight(float groundHeight) {
+    groundHeight_ = groundHeight;
+}
+
+void PositionBasedSolver::step(double deltaTime) {
+    if (deltaTime <= 0.0 || positions_.empty()) {
+        return;
+    }
+    if (colorsDirty_) {
+        colorConstraints();
+    }
+    unsigned int numSteps = static_cast<unsigned int>(ceil(deltaTime / MAX_STEP));
+    numSteps = min(max(numSteps, 1u), MAX_STEPS_PER_FRAME);
+    float timeStep = static_cast<float>(min(deltaTime / numSteps, MAX_STEP));
+    for (size_t i = 0; i < positions_.size(); ++i) {
+        startPositions_[i] = positions_[i];
+    }
+    
+    for (unsigned int s = 0; s < numSteps; ++s) {
+        float kinematicWeight = static_cast<float>(s + 1) / numSteps;
+        runParallel(positions_.size(), [this, timeStep, kinematicWeight](size_t begin, size_t end) {
+            predictPositions(begin, end, timeStep, kinematicWeight);
+        });
+        
+        for (unsigned int i = 0; i < numIterations_; ++i) {
+            for (size_t c = 0; c + 1 < colorOffsets_.size(); ++c) {    // Batches run one after another, the constraints within one don't share particles.
+                size_t batchBegin = colorOffsets_[c], batchSize = colorOffsets_[c + 1] - batchBegin;
+                if (c == MAX_COLORS) {
+                    projectConstraints(batchBegin, batchBegin + batchSize);
+                    continue;
+                }
+                runParallel(batchSize, [this, batchBegin](size_t begin, size_t end) {
+                    projectConstraints(batchBegin + begin, batchBegin + end);
+                });
+            }
+            
+            segments_.resize(capsules_.size());
+            for (size_t j = 0; j < capsules_.size(); ++j) {
+                const Capsule& capsule = capsules_[j];
+                Segment& segment = segments_[j];
+                segment.start = positions_[capsule.a];
+                segment.direction = positions_[capsule.b] - segment.start;
+                float lengthSquared = glm::dot(segment.direction, segment.direction);
+                segment.invLengthSquared = (lengthSquared > 0.0f ? 1.0f / lengthSquared : 0.0f);
+                segment.radius = capsule.radius;
+                segment.a = capsule.a;
+                segment.b = capsule.b;
+            }
+            runParallel(positions_.size(), [this](size_t begin, size_t end) {
+                collideParticles(begin, end);
+            });
+        }
+        
+        runParallel(positions_.size(), [this, timeStep](size_t begin, size_t end) {
+            updateVelocities(begin, end, timeStep);
+        });
+    }
+}
+
+float PositionBasedSolver::getIterationStiffness(float stiffness) const {
+    if (stiffness >= 1.0f) {
+        return 1.0f;
+    }
+    return 1.0f - pow(1.0f - max(stiffness, 0.0f), 1.0f / numIterations_);
+}
+
+void PositionBasedSolver::colorConstraints() {
+    vector<uint64_t> particleColors(positions_.size(), 0);    // Bit for each color already used at the particle.
+    vector<unsigned int> constraintColors(constraints_.size());
+    vector<size_t> colorCounts(MAX_COLORS + 1, 0);
+    for (size_t i = 0; i < constraints_.size(); ++i) {
+        const DistanceConstraint& constraint = constraints_[i];
+        uint64_t freeColors = ~(particleColors[constraint.a] | particleColors[constraint.b]);
+        unsigned int color = 0;
+        while (color < MAX_COLORS && (freeColors & (uint64_t(1) << color)) == 0) {
+            ++color;
+        }
+        if (color < MAX_COLORS) {
+            particleColors[constraint.a] |= uint64_t(1) << color;
+            particleColors[constraint.b] |= uint64_t(1) << color;
+        }
+        constraintColors[i] = color;
+        ++colorCounts[color];
+    }
+    
+    unsigned int numColors = MAX_COLORS + 1;
+    while (numColors > 0 && colorCounts[numColors - 1] == 0) {
+        --numColors;
+    }
+    colorOffsets_.assign(numColors + 1, 0);
+    for (unsigned int c = 0; c < numColors; ++c) {
+        colorOffsets_[c + 1] = colorOffsets_[c] + colorCounts[c];
+    }
+    
+    vector<size_t> nextSlots(colorOffsets_.begin(), colorOffsets_.end() - 1);
+    vector<unsigned int> slotIds(constraints_.size());    // Constraint id at each old slot, so the ids follow the constraints when sorted.
+    for (size_t id = 0; id < constraintSlots_.size(); ++id) {
+        slotIds[constraintSlots_[id]] = static_cast<unsigned int>(id);
+    }
+    vector<DistanceConstraint> sortedConstraints(constraints_.size());
+    for (size_t i = 0; i < constraints_.size(); ++i) {
+        size_t slot = nextSlots[constraintColors[i]]++;
+        sortedConstraints[slot] = constraints_[i];
+        constraintSlots_[slotIds[i]] = static_cast<unsigned int>(slot);
+    }
+    constraints_.swap(sortedConstraints);
+    colorsDirty_ = false;
+}
+
+void PositionBasedSolver::runParallel(size_t count, const function<void(size_t, size_t)>& body) {
+    if (threadPool_ == nullptr || count <= GRAIN_SIZE) {
+        if (count > 0) {
+            body(0, count);
+        }
+        return;
+    }
+    threadPool_->parallelFor(taskGroup_, count, GRAIN_SIZE, body);
+    threadPool_->wait(taskGroup_);
+}
+
+void PositionBasedSolver::predictPositions(size_t begin, size_t end, float timeStep, float kinematicWeight) {
+    for (size_t i = begin; i < end; ++i) {
+        prevPositions_[i] = positions_[i];
+        if (inverseMasses_[i] == 0.0f) {
+            positions_[i] = startPositions_[i] * (1.0f - kinematicWeight) + targets_[i] * kinematicWeight;    // Ends exactly on the target.
+        } else {
+            velocities_[i] = (velocities_[i] + gravity_ * timeStep) * (1.0f - damping_);
+            positions_[i] += velocities_[i] * timeStep;
+        }
+    }
+}
+
+void PositionBasedSolver::projectConstraints(size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        const DistanceConstraint& constraint = constraints_[i];
+        glm::vec3& positionA = positions_[constraint.a];
+        glm::vec3& positionB = positions_[constraint.b];
+        float inverseMassA = inverseMasses_[constraint.a], inverseMassB = inverseMasses_[constraint.b];
+        float inverseMassSum = inverseMassA + inverseMassB;
+        glm::vec3 delta = positionB - positionA;
+        float length = glm::length(delta);
+        if (inverseMassSum == 0.0f || length < 1.0e-6f || (constraint.minimumOnly && length >= constraint.restLength)) {
+            continue;
+        }
+        glm::vec3 correction = delta * ((length - constraint.restLength) / (length * inverseMassSum) * constraint.iterationStiffness);
+        positionA += correction * inverseMassA;
+        positionB -= correction * inverseMassB;
+    }
+}
+
+void PositionBasedSolver::collideParticles(size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        if (inverseMasses_[i] == 0.0f) {
+            continue;
+        }
+        glm::vec3& position = positions_[i];
+        if (collidesWithCapsules_[i]) {
+            for (const Segment& segment : segments_) {
+                if (segment.a == i || segment.b == i) {
+                    continue;
+                }
+                float t = glm::clamp(glm::dot(position - segment.start, segment.direction) * segment.invLengthSquared, 0.0f, 1.0f);
+                glm::vec3 offset = position - (segment.start + segment.direction * t);
+                float distanceSquared = glm::dot(offset, offset);
+                if (distanceSquared < segment.radius * segment.radius && distanceSquared > 1.0e-12f) {
+                    position += offset * (segment.radius / sqrt(distanceSquared) - 1.0f);
+                }
+            }
+        }
+        position.y = max(position.y, groundHeight_);
+    }
+}
+
+void PositionBasedSolver::updateVelocities(size_t begin, size_t end, float timeStep) {
+    for (size_t i = begin; i < end; ++i) {    // Kinematic particles get one too, so they carry their motion if they become dynamic.
+        velocities_[i] = (positions_[i] - prevPositions_[i]) / timeStep;
+        if (inverseMasses_[i] != 0.0f && positions_[i].y <= groundHeight_) {    // Full friction, sliding stops after the step that touched down.
+            velocities_[i] = glm::vec3(0.0f, max(velocities_[i].y, 0.0f), 0.0f);
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef POSITION_BASED_SOLVER_H_
+#define POSITION_BASED_SOLVER_H_
+
+#include "ThreadPool.h"
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+class PositionBasedSolver {    // Position based dynamics for particles joined by distance constraints, shared by the ragdolls and cloth of any number of characters. Constraints are greedily colored so that no two in a batch touch the same particle, then each batch is projected in parallel on the thread pool. Particles also collide with capsules (segments between two particles) and a ground plane.
+    public:
+    static constexpr double MAX_STEP = 1.0 / 60.0;    // Longer frames are split into equal steps of at most this length.
+    static constexpr unsigned int MAX_STEPS_PER_FRAME = 4;    // Time past this is dropped so a long frame doesn't make the next one longer.
+    static constexpr unsigned int MAX_COLORS = 64;    // Constraints that can't fit in these go in one extra batch that runs on a single thread.
+    static constexpr size_t GRAIN_SIZE = 256;    // Constraints or particles per task, anything smaller runs on the calling thread.
+    
+    PositionBasedSolver(ThreadPool* threadPool = nullptr);    // Without a pool everything runs on the calling thread.
+    PositionBasedSolver(const PositionBasedSolver& solver) = delete;
+    PositionBasedSolver& operator=(const PositionBasedSolver& solver) = delete;
+    unsigned int addParticle(const glm::vec3& position, float inverseMass, bool collidesWithCapsules = true);    // An inverse mass of zero makes the particle kinematic, it only moves to its target.
+    unsigned int addDistanceConstraint(unsigned int a, unsigned int b, float restLength, float stiffness = 1.0f, bool minimumOnly = false);    // Stiffness is the fraction of the error removed over all iterations of a step. With minimumOnly the particles are only pushed apart, which is used for angle limits.
+    unsigned int addCapsule(unsigned int a, unsigned int b, float radius);    // Collider around the segment between two particles, it never pushes on its own endpoints.
+    size_t getNumParticles() const;
+    size_t getNumConstraints() const;
+    unsigned int getNumColors();    // Colors the constraints first if any were added.
+    const glm::vec3& getPosition(unsigned int particle) const;
+    void setPosition(unsigned int particle, const glm::vec3& position);    // Teleports the particle and clears its velocity.
+    void setTarget(unsigned int particle, const glm::vec3& target);    // Kinematic particles move in a straight line to the target over the next step() call.
+    void setInverseMass(unsigned int particle, float inverseMass);    // Switching to dynamic keeps the velocity the particle had while kinematic.
+    void setCollidesWithCapsules(unsigned int particle, bool collidesWithCapsules);
+    void setRestLength(unsigned int constraint, float restLength);
+    void setCapsuleRadius(unsigned int capsule, float radius);
+    void setGravity(const glm::vec3& gravity);
+    void setDamping(float damping);    // Fraction of the velocity lost each step.
+    void setNumIterations(unsigned int numIterations);
+    void setGroundHeight(float groundHeight);    // Dynamic particles stay above this height and stop sliding when they touch it.
+    void step(double deltaTime);
+    
+    private:
+    struct DistanceConstraint {
+        unsigned int a, b;
+        float restLength, stiffness;
+        float iterationStiffness;    // Stiffness for one iteration that adds up to the full stiffness over a step.
+        bool minimumOnly;
+    };
+    struct Capsule {
+        unsigned int a, b;
+        float radius;
+    };
+    struct Segment {    // Capsule endpoints copied before the collisions so particles can be moved in parallel.
+        glm::vec3 start, direction;
+        float invLengthSquared, radius;
+        unsigned int a, b;
+    };
+    
+    ThreadPool* threadPool_;
+    ThreadPool::TaskGroup taskGroup_;
+    vector<glm::vec3> positions_, prevPositions_, velocities_;
+    vector<glm::vec3> startPositions_, targets_;    // Kinematic particles move from the start to the target over the steps of a frame.
+    vector<float> inverseMasses_;
+    vector<uint8_t> collidesWithCapsules_;
+    vector<DistanceConstraint> constraints_;    // Sorted by color once colored, colorOffsets_ gives the start of each batch with the end at the back.
+    vector<unsigned int> constraintSlots_;    // Position in constraints_ of each constraint id.
+    vector<size_t> colorOffsets_;
+    bool colorsDirty_;
+    vector<Capsule> capsules_;
+    vector<Segment> segments_;
+    glm::vec3 gravity_;
+    float damping_;
+    unsigned int numIterations_;
+    float groundHeight_;
+    
+    float getIterationStiffness(float stiffness) const;
+    void colorConstraints();    // Gives each constraint the lowest color not already used at either of its particles.
+    void runParallel(size_t count, const function<void(size_t, size_t)>& body);    // Splits [0, count) across the pool and waits for it.
+    void predictPositions(size_t begin, size_t end, float timeStep, float kinematicWeight);
+    void projectConstraints(size_t begin, size_t end);
+    void collideParticles(size_t begin, size_t end);
+    void updateVelocities(size_t begin, size_t end, float timeStep);
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "PreSkinning.h"
+#include "RenderApp.h"
+#include "Shader.h"
+#include <glad/glad.h>
+#include <algorithm>
+
+vector<string> PreSkinning::getFeedbackVaryings() {
+    return {"tfPosition", "tfNormal", "tfTexCoords", "tfTangent"};
+}
+
+PreSkinning::PreSkinning() {
+    glGenBuffers(1, &bufferHandle_);
+    bufferCapacity_ = 0;
+    numVertices_ = 0;
+    layout_.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_POSITION, 3, GL_FLOAT);    // Same order as the varyings.
+    layout_.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_NORMAL, 3, GL_FLOAT);
+    layout_.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_TEX_COORDS, 2, GL_FLOAT);
+    layout_.addAttribute(RenderApp::ATTRIBUTE_LOCATION_V_TANGENT, 4, GL_FLOAT);
+}
+
+PreSkinning::~PreSkinning() {
+    glDeleteBuffers(1, &bufferHandle_);
+}
+
+void PreSkinning::skin(const Shader& shader, const vector<AnimationSystem::PaletteBatch>& batches) {
+    skinnedMeshes_.clear();
+    numVertices_ = 0;
+    for (const AnimationSystem::PaletteBatch& batch : batches) {    // Lay out the copies first so the buffer only gets resized once.
+        if (!batch.preSkinned) {
+            continue;
+        }
+        for (const Mesh& mesh : batch.model->meshes_) {
+            skinnedMeshes_.push_back({&mesh, static_cast<unsigned int>(numVertices_), batch.count});
+            drawArrays_.resize(batch.count);
+            numVertices_ += static_cast<size_t>(mesh.getNumVertices()) * batch.count;
+        }
+    }
+    if (numVertices_ == 0) {
+        return;
+    }
+    
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, bufferHandle_);
+    if (numVertices_ > bufferCapacity_) {
+        bufferCapacity_ = max(numVertices_, bufferCapacity_ * 2);
+        glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, bufferCapacity_ * VERTEX_STRIDE, nullptr, GL_DYNAMIC_COPY);
+    }
+    glEnable(GL_RASTERIZER_DISCARD);
+    vector<SkinnedMesh>::const_iterator skinnedMesh = skinnedMeshes_.begin();
+    for (const AnimationSystem::PaletteBatch& batch : batches) {
+        if (!batch.preSkinned) {
+            continue;
+        }
+        shader.setInt("paletteOffset", static_cast<int>(batch.paletteOffset));
+        shader.setInt("paletteStride", static_cast<int>(batch.paletteStride));
+        for (size_t i = 0; i < batch.model->meshes_.size(); ++i, ++skinnedMesh) {
+            size_t numMeshVertices = static_cast<size_t>(skinnedMesh->mesh->getNumVertices()) * batch.count;
+            if (numMeshVertices == 0) {    // Not uploaded yet.
+                continue;
+            }
+            shader.setMat4("modelMtx", batch.model->meshTransforms_[i]);
+            glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, bufferHandle_, skinnedMesh->baseVertex * VERTEX_STRIDE, numMeshVertices * VERTEX_STRIDE);
+            glBeginTransformFeedback(GL_POINTS);
+            skinnedMesh->mesh->drawPoints(batch.count);
+            glEndTransformFeedback();
+        }
+    }
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+}
+
+void PreSkinning::draw(const Shader& shader) const {
+    for (const SkinnedMesh& skinnedMesh : skinnedMeshes_) {
+        skinnedMesh.mesh->drawSkinned(shader, bufferHandle_, layout_, skinnedMesh.baseVertex, skinnedMesh.count, drawArrays_);
+    }
+}
+
+size_t PreSkinning::getNumVertices() const {
+    return numVertices_;
+}
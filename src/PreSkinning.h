@@ -0,0 +1,40 @@
+#ifndef PRE_SKINNING_H_
+#define PRE_SKINNING_H_
+
+class Shader;
+
+#include "AnimationSystem.h"
+#include "Mesh.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class PreSkinning {    // Skins the animated instances once per frame with transform feedback. The captured vertices are in world space, so the geometry and shadow passes draw them like static meshes instead of blending bones again in each pass.
+    public:
+    static constexpr unsigned int VERTEX_STRIDE = 12 * sizeof(float);    // Position, normal, tex coords, and tangent, all as floats since that is what transform feedback writes.
+    
+    static vector<string> getFeedbackVaryings();    // Outputs of the skinning shader in the order they are captured, for the Shader constructor.
+    PreSkinning();
+    ~PreSkinning();
+    PreSkinning(const PreSkinning& preSkinning) = delete;
+    PreSkinning& operator=(const PreSkinning& preSkinning) = delete;
+    void skin(const Shader& shader, const vector<AnimationSystem::PaletteBatch>& batches);    // Captures every mesh of the batches marked preSkinned, the other batches are skipped. The shader must be in use with the palette buffer bound.
+    void draw(const Shader& shader) const;    // Draws everything captured by the last skin(), the shader should be a variant without skinning.
+    size_t getNumVertices() const;    // Vertices captured by the last skin().
+    
+    private:
+    struct SkinnedMesh {
+        const Mesh* mesh;
+        unsigned int baseVertex, count;    // The copies for each instance follow one after another.
+    };
+    
+    unsigned int bufferHandle_;
+    size_t bufferCapacity_;    // In vertices.
+    size_t numVertices_;
+    Mesh::VertexLayout layout_;
+    vector<SkinnedMesh> skinnedMeshes_;
+    mutable Mesh::MultiDrawArrays drawArrays_;    // Sized by skin() for the largest batch, then refilled for each mesh drawn.
+};
+
+#endif
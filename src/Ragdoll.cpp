@@ -0,0 +1,352 @@
+#include "CommonMath.h"
+#include "Ragdoll.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+Ragdoll::Ragdoll(const ModelRigged& model, PositionBasedSolver& solver) :
+    model_(&model),
+    solver_(&solver),
+    nodeParticles_(model.getNumNodes(), -1),
+    tipParticles_(model.getNumNodes(), -1),
+    directionParticles_(model.getNumNodes(), -1),
+    twistParticles_(model.getNumNodes(), -1),
+    tipOffsets_(model.getNumNodes(), glm::vec3(0.0f, 1.0f, 0.0f)),
+    localTransforms_(model.getNumNodes()),
+    combinedTransforms_(model.getNumNodes()),
+    finalTransforms_(model.getNumNodes()),
+    armatureRoot_(glm::inverse(model.getArmatureRootInv())),
+    armatureRootInv_(model.getArmatureRootInv()),
+    bodyWeight_(0.0f),
+    scaleAvg_(1.0f),
+    hasPose_(false) {
+    
+    for (unsigned int i = 0; i < model.getNumNodes(); ++i) {    // Bind pose until the first setPose(), so particles added before then start somewhere sensible.
+        int parentIndex = model.getParentIndex(i);
+        localTransforms_[i] = model.getNodeTransform(i);
+        combinedTransforms_[i] = (parentIndex >= 0 ? combinedTransforms_[parentIndex] : model.getArmatureRootInv()) * localTransforms_[i];
+        finalTransforms_[i] = combinedTransforms_[i];
+    }
+}
+
+void Ragdoll::addChain(const string& rootNodeName, float maxBendAngle, const glm::vec3& tipOffset) {
+    int rootNode = model_->findNode(rootNodeName);
+    if (rootNode < 0) {
+        return;
+    }
+    int rootParentIndex = model_->getParentIndex(rootNode);
+    if (rootParentIndex >= 0) {    // Gives the first joint something to bend against.
+        addParticle(rootParentIndex, false, Pinned);
+    }
+    addParticle(rootNode, false, Pinned);
+    unsigned int subtreeEnd = getSubtreeEnd(rootNode);
+    vector<bool> inChain(subtreeEnd - rootNode, false);
+    inChain[0] = true;
+    for (unsigned int i = rootNode + 1; i < subtreeEnd; ++i) {
+        int parentIndex = model_->getParentIndex(i);
+        if (!inChain[parentIndex - rootNode] || (nodeParticles_[i] != -1 && particles_[nodeParticles_[i]].kind != Pinned)) {    // Nodes another chain or body already has are left to it.
+            continue;
+        }
+        addParticle(i, false, Chain);
+        addSegmentLinks(i, maxBendAngle);
+        inChain[i - rootNode] = true;
+    }
+    updateDirectionParticles();
+    addTips(rootNode, maxBendAngle, tipOffset);
+}
+
+void Ragdoll::connectChains(const string& rootNodeNameA, const string& rootNodeNameB, float stiffness) {
+    int nodeA = model_->findNode(rootNodeNameA), nodeB = model_->findNode(rootNodeNameB);
+    if (nodeA < 0 || nodeB < 0) {
+        return;
+    }
+    while (true) {    // Follows the first child down both chains together.
+        int particleA = directionParticles_[nodeA], particleB = directionParticles_[nodeB];
+        if (particleA == -1 || particleB == -1) {
+            break;
+        }
+        addLink(particleA, particleB, stiffness);
+        if (particles_[particleA].isTip || particles_[particleB].isTip) {
+            break;
+        }
+        nodeA = particles_[particleA].node;
+        nodeB = particles_[particleB].node;
+    }
+}
+
+void Ragdoll::addBody(const string& rootNodeName, float maxBendAngle) {
+    int rootNode = model_->findNode(rootNodeName);
+    if (rootNode < 0) {
+        return;
+    }
+    addParticle(rootNode, false, Body);
+    unsigned int subtreeEnd = getSubtreeEnd(rootNode);
+    vector<bool> inBody(subtreeEnd - rootNode, false);
+    inBody[0] = true;
+    for (unsigned int i = rootNode + 1; i < subtreeEnd; ++i) {
+        int parentIndex = model_->getParentIndex(i);
+        if (!inBody[parentIndex - rootNode] || (nodeParticles_[i] != -1 && particles_[nodeParticles_[i]].kind != Pinned)) {    // Stops at chains, a pinned chain root becomes part of the body so the chain follows it.
+            continue;
+        }
+        addParticle(i, false, Body);
+        addSegmentLinks(i, maxBendAngle);
+        inBody[i - rootNode] = true;
+    }
+    
+    for (unsigned int i = rootNode; i < subtreeEnd; ++i) {    // Joints branching off the same parent are tied together, so the hips and chest keep their shape.
+        if (!inBody[i - rootNode]) {
+            continue;
+        }
+        vector<unsigned int> children;
+        for (unsigned int j = i + 1; j < subtreeEnd; ++j) {
+            if (model_->getParentIndex(j) == static_cast<int>(i) && inBody[j - rootNode]) {
+                children.push_back(nodeParticles_[j]);
+            }
+        }
+        for (size_t a = 0; a < children.size(); ++a) {
+            for (size_t b = a + 1; b < children.size(); ++b) {
+                addLink(children[a], children[b]);
+            }
+        }
+    }
+    updateDirectionParticles();
+    addTips(rootNode, maxBendAngle, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void Ragdoll::addCapsule(const string& nodeName, float radius) {
+    int node = model_->findNode(nodeName);
+    if (node < 0) {
+        return;
+    }
+    unsigned int particle = addParticle(node, false, Pinned);
+    int endParticle = directionParticles_[node];
+    if (endParticle == -1) {
+        bool hasChild = (static_cast<unsigned int>(node) + 1 < model_->getNumNodes() && model_->getParentIndex(node + 1) == node);    // The first child comes right after its parent.
+        endParticle = addParticle(hasChild ? node + 1 : node, !hasChild, Pinned);
+        updateDirectionParticles();
+    }
+    Collider collider;
+    collider.capsule = solver_->addCapsule(particles_[particle].id, particles_[endParticle].id, radius * scaleAvg_);
+    collider.radius = radius;
+    colliders_.push_back(collider);
+}
+
+void Ragdoll::setBodyWeight(float weight) {
+    bodyWeight_ = glm::clamp(weight, 0.0f, 1.0f);
+    for (const Particle& particle : particles_) {
+        if (particle.kind == Body) {
+            solver_->setInverseMass(particle.id, getInverseMass(Body));
+        }
+    }
+}
+
+float Ragdoll::getBodyWeight() const {
+    return bodyWeight_;
+}
+
+void Ragdoll::setPose(const ModelRigged::LocalPose& pose, const glm::mat4& modelMtx) {
+    assert(pose.translations.size() == localTransforms_.size());
+    for (size_t i = 0; i < localTransforms_.size(); ++i) {
+        int parentIndex = model_->getParentIndex(static_cast<unsigned int>(i));
+        localTransforms_[i] = CommonMath::composeTransform(pose.translations[i], pose.rotations[i], pose.scales[i]);
+        combinedTransforms_[i] = (parentIndex >= 0 ? combinedTransforms_[parentIndex] : model_->getArmatureRootInv()) * localTransforms_[i];
+    }
+    armatureRoot_ = modelMtx * glm::inverse(model_->getArmatureRootInv());
+    armatureRootInv_ = glm::inverse(armatureRoot_);
+    float scaleX = glm::length(glm::vec3(modelMtx[0][0], modelMtx[0][1], modelMtx[0][2]));
+    float scaleY = glm::length(glm::vec3(modelMtx[1][0], modelMtx[1][1], modelMtx[1][2]));
+    float scaleZ = glm::length(glm::vec3(modelMtx[2][0], modelMtx[2][1], modelMtx[2][2]));
+    scaleAvg_ = (scaleX + scaleY + scaleZ) / 3.0f;
+    
+    for (size_t i = 0; i < particles_.size(); ++i) {
+        animatedPositions_[i] = getAnimatedPosition(particles_[i]);
+        if (hasPose_) {
+            solver_->setTarget(particles_[i].id, animatedPositions_[i]);    // Only used by the kinematic ones.
+        } else {
+            solver_->setPosition(particles_[i].id, animatedPositions_[i]);
+        }
+    }
+    for (const Link& link : links_) {    // Lengths follow the animation, so squash and stretch in the clips carries over.
+        solver_->setRestLength(link.constraint, getRestLength(link));
+    }
+    for (const Collider& collider : colliders_) {
+        solver_->setCapsuleRadius(collider.capsule, collider.radius * scaleAvg_);
+    }
+    hasPose_ = true;
+}
+
+void Ragdoll::getBoneTransforms(vector<glm::mat4>& boneTransforms) {
+    assert(boneTransforms.size() == model_->boneOffsetMatrices_.size());
+    for (unsigned int i = 0; i < model_->getNumNodes(); ++i) {
+        int parentIndex = model_->getParentIndex(i);
+        const glm::mat4& parentTransform = (parentIndex >= 0 ? finalTransforms_[parentIndex] : model_->getArmatureRootInv());
+        int particle = nodeParticles_[i], directionParticle = directionParticles_[i];
+        if (particle != -1 && directionParticle != -1 && (isDynamic(particle) || isDynamic(directionParticle))) {
+            glm::vec3 position = getFinalPosition(particle);
+            glm::vec3 animatedDirection = animatedPositions_[directionParticle] - animatedPositions_[particle];
+            glm::vec3 direction = getFinalPosition(directionParticle) - position;
+            glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+            if (glm::dot(animatedDirection, animatedDirection) > 1.0e-12f && glm::dot(direction, direction) > 1.0e-12f) {
+                rotation = CommonMath::findRotationBetweenVectors(animatedDirection, direction);
+                int twistParticle = twistParticles_[i];
+                if (twistParticle != -1) {    // Turn around the new direction so the second child lines up too.
+                    glm::vec3 axis = glm::normalize(direction);
+                    glm::vec3 animatedSide = rotation * (animatedPositions_[twistParticle] - animatedPositions_[particle]);
+                    glm::vec3 side = getFinalPosition(twistParticle) - position;
+                    animatedSide -= axis * glm::dot(animatedSide, axis);
+                    side -= axis * glm::dot(side, axis);
+                    if (glm::dot(animatedSide, animatedSide) > 1.0e-12f && glm::dot(side, side) > 1.0e-12f) {
+                        rotation = CommonMath::findRotationBetweenVectors(animatedSide, side) * rotation;
+                    }
+                }
+            }
+            glm::mat4 worldTransform = armatureRoot_ * combinedTransforms_[i];
+            worldTransform[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            worldTransform = glm::mat4_cast(rotation) * worldTransform;    // Twist and scale still come from the animation.
+            worldTransform[3] = glm::vec4(position, 1.0f);
+            finalTransforms_[i] = armatureRootInv_ * worldTransform;
+        } else {
+            finalTransforms_[i] = parentTransform * localTransforms_[i];
+        }
+        
+        int boneIndex = model_->getBoneIndex(i);
+        if (boneIndex != -1) {
+            boneTransforms[boneIndex] = finalTransforms_[i] * model_->boneOffsetMatrices_[boneIndex];
+        }
+    }
+}
+
+unsigned int Ragdoll::addParticle(unsigned int node, bool isTip, ParticleKind kind) {
+    int& index = (isTip ? tipParticles_[node] : nodeParticles_[node]);
+    if (index != -1) {
+        Particle& particle = particles_[index];
+        if (particle.kind == Pinned && kind != Pinned) {
+            particle.kind = kind;
+            solver_->setInverseMass(particle.id, getInverseMass(kind));
+            solver_->setCollidesWithCapsules(particle.id, kind == Chain);
+        }
+        return index;
+    }
+    
+    Particle particle;
+    particle.node = node;
+    particle.isTip = isTip;
+    particle.kind = kind;
+    glm::vec3 position = getAnimatedPosition(particle);
+    particle.id = solver_->addParticle(position, getInverseMass(kind), kind == Chain);    // The body doesn't collide with its own capsules, those would just fight the joints.
+    particles_.push_back(particle);
+    animatedPositions_.push_back(position);
+    index = static_cast<int>(particles_.size() - 1);
+    return index;
+}
+
+void Ragdoll::addLink(unsigned int a, unsigned int b, float stiffness) {
+    Link link;
+    link.a = a;
+    link.b = b;
+    link.middle = -1;
+    link.cosMaxBend = 1.0f;
+    link.constraint = solver_->addDistanceConstraint(particles_[a].id, particles_[b].id, getRestLength(link), stiffness);
+    links_.push_back(link);
+}
+
+void Ragdoll::addAngleLimit(unsigned int a, unsigned int middle, unsigned int b, float maxBendAngle) {
+    Link link;
+    link.a = a;
+    link.b = b;
+    link.middle = static_cast<int>(middle);
+    link.cosMaxBend = cos(maxBendAngle);
+    link.constraint = solver_->addDistanceConstraint(particles_[a].id, particles_[b].id, getRestLength(link), 1.0f, true);
+    links_.push_back(link);
+}
+
+void Ragdoll::addSegmentLinks(unsigned int node, float maxBendAngle) {
+    int parentIndex = model_->getParentIndex(node);
+    unsigned int particle = nodeParticles_[node], parentParticle = nodeParticles_[parentIndex];
+    addLink(parentParticle, particle);
+    int grandparentIndex = model_->getParentIndex(parentIndex);
+    if (grandparentIndex >= 0 && nodeParticles_[grandparentIndex] != -1) {
+        addAngleLimit(nodeParticles_[grandparentIndex], parentParticle, particle, maxBendAngle);
+    }
+}
+
+void Ragdoll::addTips(unsigned int rootNode, float maxBendAngle, const glm::vec3& tipOffset) {
+    unsigned int subtreeEnd = getSubtreeEnd(rootNode);
+    for (unsigned int i = rootNode; i < subtreeEnd; ++i) {
+        int particle = nodeParticles_[i];
+        if (particle == -1 || directionParticles_[i] != -1 || (particles_[particle].kind == Pinned && i != rootNode)) {
+            continue;
+        }
+        tipOffsets_[i] = tipOffset;
+        ParticleKind kind = (particles_[particle].kind == Body ? Body : Chain);
+        unsigned int tip = addParticle(i, true, kind);
+        addLink(particle, tip);
+        int parentIndex = model_->getParentIndex(i);
+        if (parentIndex >= 0 && nodeParticles_[parentIndex] != -1) {
+            addAngleLimit(nodeParticles_[parentIndex], particle, tip, maxBendAngle);
+        }
+    }
+    updateDirectionParticles();
+}
+
+void Ragdoll::updateDirectionParticles() {
+    vector<int> childParticles(directionParticles_.size(), -1);
+    fill(twistParticles_.begin(), twistParticles_.end(), -1);
+    for (size_t i = directionParticles_.size(); i-- > 0;) {    // Going backwards leaves the first and second child with a particle.
+        int parentIndex = model_->getParentIndex(static_cast<unsigned int>(i));
+        if (parentIndex >= 0 && nodeParticles_[i] != -1) {
+            twistParticles_[parentIndex] = childParticles[parentIndex];
+            childParticles[parentIndex] = nodeParticles_[i];
+        }
+    }
+    for (size_t i = 0; i < directionParticles_.size(); ++i) {
+        directionParticles_[i] = (childParticles[i] != -1 ? childParticles[i] : tipParticles_[i]);
+    }
+}
+
+unsigned int Ragdoll::getSubtreeEnd(unsigned int rootNode) const {
+    unsigned int i = rootNode + 1;
+    while (i < model_->getNumNodes() && model_->getParentIndex(i) >= static_cast<int>(rootNode)) {
+        ++i;
+    }
+    return i;
+}
+
+glm::vec3 Ragdoll::getAnimatedPosition(const Particle& particle) const {
+    glm::vec4 localPosition = (particle.isTip ? glm::vec4(tipOffsets_[particle.node], 1.0f) : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    return glm::vec3(armatureRoot_ * (combinedTransforms_[particle.node] * localPosition));
+}
+
+float Ragdoll::getRestLength(const Link& link) const {
+    float length = glm::length(animatedPositions_[link.b] - animatedPositions_[link.a]);
+    if (link.middle < 0) {
+        return length;
+    }
+    float length1 = glm::length(animatedPositions_[link.middle] - animatedPositions_[link.a]);
+    float length2 = glm::length(animatedPositions_[link.b] - animatedPositions_[link.middle]);
+    float minLength = sqrt(max(length1 * length1 + length2 * length2 + 2.0f * length1 * length2 * link.cosMaxBend, 0.0f));    // Law of cosines for the joint bent as far as it can go.
+    return min(minLength, length);    // Never tighter than the animation, it may bend past the limit.
+}
+
+bool Ragdoll::isDynamic(unsigned int particle) const {
+    return getInverseMass(particles_[particle].kind) != 0.0f;
+}
+
+float Ragdoll::getInverseMass(ParticleKind kind) const {
+    if (kind == Chain) {
+        return 1.0f;
+    }
+    return (kind == Body && bodyWeight_ > 0.0f ? 1.0f : 0.0f);
+}
+
+glm::vec3 Ragdoll::getFinalPosition(unsigned int particle) const {
+    const Particle& p = particles_[particle];
+    if (p.kind == Pinned) {
+        return animatedPositions_[particle];
+    }
+    glm::vec3 simulatedPosition = solver_->getPosition(p.id);
+    if (p.kind == Body) {
+        return animatedPositions_[particle] * (1.0f - bodyWeight_) + simulatedPosition * bodyWeight_;
+    }
+    return simulatedPosition;
+}
@@ -0,0 +1,81 @@
+#ifndef RAGDOLL_H_
+#define RAGDOLL_H_
+
+#include "ModelRigged.h"
+#include "PositionBasedSolver.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class Ragdoll {    // Physics for one instance of a ModelRigged, built from its skeleton with a particle at each joint. A body is a ragdoll blended in with the animation, a chain (skirts, ribbons, hair) hangs from a joint that follows the animation or the body. Each frame call setPose(), step the solver, then getBoneTransforms().
+    public:
+    Ragdoll(const ModelRigged& model, PositionBasedSolver& solver);    // The solver can be shared by many ragdolls, it must outlive this one.
+    Ragdoll(const Ragdoll& ragdoll) = delete;
+    Ragdoll& operator=(const Ragdoll& ragdoll) = delete;
+    void addChain(const string& rootNodeName, float maxBendAngle = glm::radians(45.0f), const glm::vec3& tipOffset = glm::vec3(0.0f, 1.0f, 0.0f));    // Simulates the nodes below the root, the root itself stays put. Leaf nodes point at a tip particle at tipOffset in their local space, the same as DynamicBone::centerOfMassOffset.
+    void connectChains(const string& rootNodeNameA, const string& rootNodeNameB, float stiffness = 0.5f);    // Ties the joints at each depth of two chains together, so strands side by side act like cloth.
+    void addBody(const string& rootNodeName, float maxBendAngle = glm::radians(90.0f));    // Simulates the root and everything below it, except nodes already in a chain. Add chains first so the body stops at them.
+    void addCapsule(const string& nodeName, float radius);    // Collider from the node to its child joint (or tip) that chains bump into, the radius is in model space.
+    void setBodyWeight(float weight);    // Blends the body from the animation (zero, the default) to the simulation (one). The body only falls while this is above zero.
+    float getBodyWeight() const;
+    void setPose(const ModelRigged::LocalPose& pose, const glm::mat4& modelMtx);    // Called before the solver steps, moves the particles that follow the animation.
+    void getBoneTransforms(vector<glm::mat4>& boneTransforms);    // Called after the solver steps, each simulated node is rotated so its joint points the way the particles do.
+    
+    private:
+    enum ParticleKind : uint8_t {
+        Pinned = 0,    // Kinematic, always at the animated position.
+        Chain = 1,
+        Body = 2
+    };
+    struct Particle {
+        unsigned int id;    // Index in the solver.
+        unsigned int node;
+        bool isTip;
+        ParticleKind kind;
+    };
+    struct Link {    // Distance constraint kept at the animated length, or an angle limit on the joint at middle if it's not -1.
+        unsigned int constraint;
+        unsigned int a, b;
+        int middle;
+        float cosMaxBend;
+    };
+    struct Collider {
+        unsigned int capsule;
+        float radius;
+    };
+    
+    const ModelRigged* model_;
+    PositionBasedSolver* solver_;
+    vector<Particle> particles_;
+    vector<int> nodeParticles_, tipParticles_;    // Particle index for each node, or -1 for none.
+    vector<int> directionParticles_;    // First child particle of each node, or its tip. The node is rotated to point at this.
+    vector<int> twistParticles_;    // Second child particle of each node or -1, sets the roll around the direction for joints that branch.
+    vector<glm::vec3> tipOffsets_;
+    vector<Link> links_;
+    vector<Collider> colliders_;
+    vector<glm::mat4> localTransforms_, combinedTransforms_;
+    vector<glm::mat4> finalTransforms_;    // Combined transforms after the simulation.
+    vector<glm::vec3> animatedPositions_;    // World space position of each particle in the animation.
+    glm::mat4 armatureRoot_, armatureRootInv_;    // World space to and from the combined transforms.
+    float bodyWeight_;
+    float scaleAvg_;
+    bool hasPose_;
+    
+    unsigned int addParticle(unsigned int node, bool isTip, ParticleKind kind);    // Returns the existing particle at the node if there is one, a pinned particle is promoted to the given kind.
+    void addLink(unsigned int a, unsigned int b, float stiffness = 1.0f);
+    void addAngleLimit(unsigned int a, unsigned int middle, unsigned int b, float maxBendAngle);    // Keeps a and b far enough apart that the joint at middle doesn't bend past the angle.
+    void addSegmentLinks(unsigned int node, float maxBendAngle);    // Links a new particle at the node to its parent and limits the bend at the parent.
+    void addTips(unsigned int rootNode, float maxBendAngle, const glm::vec3& tipOffset);    // Gives a tip to simulated nodes below the root that don't have a child particle.
+    void updateDirectionParticles();
+    unsigned int getSubtreeEnd(unsigned int rootNode) const;    // Nodes are in pre-order, so the subtree is [rootNode, end).
+    glm::vec3 getAnimatedPosition(const Particle& particle) const;
+    float getRestLength(const Link& link) const;
+    bool isDynamic(unsigned int particle) const;
+    float getInverseMass(ParticleKind kind) const;
+    glm::vec3 getFinalPosition(unsigned int particle) const;
+};
+
+#endif
@@ -1,16 +1,24 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "AllocationCounter.h"
+#include "AnimationSystem.h"
+#include "BonePaletteBuffer.h"
 #include "Camera.h"
 #include "CommonMath.h"
 #include "Font.h"
 #include "Framebuffer.h"
+#include "ModelLoader.h"
 #include "PerformanceMonitor.h"
+#include "PreSkinning.h"
 #include "RenderApp.h"
 #include "Scene.h"
 #include "SceneNode.h"
 #include "Shader.h"
+#include "Text.h"
+#include "ThreadPool.h"
 #include "World.h"
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cmath>
@@ -39,20 +47,34 @@ GLenum RenderApp::glCheckError_(const char* file, int line) {
     return errorCode;
 }
 
-unsigned int RenderApp::loadTexture(const string& filename, bool gammaCorrection, bool flip) {
+RenderApp::Image RenderApp::decodeImage(const string& filename, bool flip) {
+    Image image;
+    image.width = 0;
+    image.height = 0;
+    image.numChannels = 1;
+    stbi_set_flip_vertically_on_load_thread(flip);    // The flip setting is per thread, the global one would race with other loads.
+    image.data = shared_ptr<unsigned char>(stbi_load(filename.c_str(), &image.width, &image.height, &image.numChannels, 0), stbi_image_free);
+    return image;
+}
+
+unsigned int RenderApp::loadTexture(const string& filename, bool gammaCorrection, bool flip, const Image* image) {
     string textureName = filename + (gammaCorrection ? "-g" : "") + (flip ? "-f" : "");
     auto findResult = loadedTextures_.find(textureName);
     if (findResult != loadedTextures_.end()) {
         return findResult->second;
     }
     
-    stbi_set_flip_vertically_on_load(flip);
     //cout << "Loading texture \"" << textureName << "\".\n";
+    Image decodedImage;
+    if (image == nullptr) {
+        decodedImage = decodeImage(filename, flip);
+        image = &decodedImage;
+    }
     unsigned int texHandle;
     glGenTextures(1, &texHandle);
     glBindTexture(GL_TEXTURE_2D, texHandle);
-    int width, height, numChannels = 1;
-    unsigned char* imageData = stbi_load(filename.c_str(), &width, &height, &numChannels, 0);
+    int width = image->width, height = image->height, numChannels = image->numChannels;
+    const unsigned char* imageData = image->data.get();
     GLenum internalFormat, format;
     if (numChannels == 1) {
         internalFormat = GL_RED;
@@ -65,7 +87,6 @@ unsigned int RenderApp::loadTexture(const string& filename, bool gammaCorrection
         format = GL_RGBA;
     } else {
         cout << "Error: Unsupported number of channels (" << numChannels << ").\n";
-        stbi_image_free(imageData);
         imageData = nullptr;
     }
     
@@ -80,7 +101,6 @@ unsigned int RenderApp::loadTexture(const string& filename, bool gammaCorrection
     } else {
         cout << "Error: Unable to load texture.\n";
     }
-    stbi_image_free(imageData);
     
     loadedTextures_[textureName] = texHandle;
     return texHandle;
@@ -93,7 +113,7 @@ unsigned int RenderApp::loadTextureHDR(const string& filename, bool flip) {
         return findResult->second;
     }
     
-    stbi_set_flip_vertically_on_load(flip);
+    stbi_set_flip_vertically_on_load_thread(flip);
     //cout << "Loading texture \"" << textureName << "\".\n";
     unsigned int texHandle;
     glGenTextures(1, &texHandle);
@@ -129,7 +149,7 @@ unsigned int RenderApp::loadCubemap(const string& filename, bool gammaCorrection
         return findResult->second;
     }
     
-    stbi_set_flip_vertically_on_load(flip);    // For skybox cubemap, textures are not flipped to match the specifications of a cubemap.
+    stbi_set_flip_vertically_on_load_thread(flip);    // For skybox cubemap, textures are not flipped to match the specifications of a cubemap.
     string prefix = filename.substr(0, filename.find('.'));
     string postfix = filename.substr(filename.find('.'));
     //cout << "Loading cubemap \"" << textureName << "\".\n";
@@ -224,16 +244,30 @@ RenderApp::RenderApp() :// always use this style for uniform init ##############
     setupShaders();
     setupBuffers();
     setupRender();
+    modelLoader_ = make_unique<ModelLoader>();
+    threadPool_ = make_unique<ThreadPool>();
+    animationSystem_ = make_unique<AnimationSystem>(threadPool_.get());
+    bonePaletteBuffer_ = make_unique<BonePaletteBuffer>();
+    preSkinning_ = make_unique<PreSkinning>();
     
     config_.setVsync(true);
     config_.setBloom(true);
     config_.setSSAO(true);
+    config_.setBonePaletteFormat(BonePaletteBuffer::AffineMatrix);
+    config_.setPreSkinning(true);
     
     shared_ptr<Font> arialFont = make_shared<Font>("fonts/arial.ttf", 15);
     
     performanceMonitors_.emplace(make_pair("FRAME", new PerformanceMonitor("FRAME", arialFont))).first->second->modelMtx_ = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
     performanceMonitors_.emplace(make_pair("SSAO", new PerformanceMonitor("SSAO", arialFont))).first->second->modelMtx_ = glm::translate(glm::mat4(1.0f), glm::vec3(220.0f, 0.0f, 0.0f));
     performanceMonitors_.emplace(make_pair("BLOOM", new PerformanceMonitor("BLOOM", arialFont))).first->second->modelMtx_ = glm::translate(glm::mat4(1.0f), glm::vec3(440.0f, 0.0f, 0.0f));
+    performanceMonitors_.emplace(make_pair("SKINNING", new PerformanceMonitor("SKINNING", arialFont))).first->second->modelMtx_ = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 120.0f, 0.0f));    // Pre-skinning in beginFrame(), compare with the passes below when Configuration::setPreSkinning() is toggled.
+    performanceMonitors_.emplace(make_pair("SHADOWS", new PerformanceMonitor("SHADOWS", arialFont))).first->second->modelMtx_ = glm::translate(glm::mat4(1.0f), glm::vec3(220.0f, 120.0f, 0.0f));
+    performanceMonitors_.emplace(make_pair("GEOMETRY", new PerformanceMonitor("GEOMETRY", arialFont))).first->second->modelMtx_ = glm::translate(glm::mat4(1.0f), glm::vec3(440.0f, 120.0f, 0.0f));
+    allocationText_ = make_unique<Text>();
+    allocationText_->setFont(arialFont);
+    allocationText_->modelMtx_ = glm::translate(glm::mat4(1.0f), glm::vec3(665.0f, PerformanceMonitor::BOX_SIZE_.y - 20.0f, 0.0f));
+    lastAllocationCount_ = AllocationCounter::getCount();
     
     constexpr float SHADOW_BOUND_CORRECTION = 0.8f;    // Split points are exponentially distributed with a linear term. https://developer.download.nvidia.com/SDK/10.5/opengl/src/cascaded_shadow_maps/doc/cascaded_shadow_maps.pdf
     shadowZBounds_[0] = NEAR_PLANE;
@@ -251,19 +285,23 @@ RenderApp::RenderApp() :// always use this style for uniform init ##############
 
 RenderApp::~RenderApp() {
     instantiated_ = false;
+    animationSystem_.reset();
+    threadPool_.reset();
+    bonePaletteBuffer_.reset();
+    preSkinning_.reset();
+    modelLoader_.reset();    // Partly uploaded models need the context.
     
     for (auto& m : performanceMonitors_) {
         delete m.second;
     }
+    allocationText_.reset();
     
     glDeleteBuffers(1, &viewProjectionMtxUBO_);    // Clean up allocated resources.
     geometryShader_.reset();
-    geometryNormalMapShader_.reset();
-    geometrySkinningShader_.reset();
     skyboxShader_.reset();
     lampShader_.reset();
     shadowMapShader_.reset();
-    shadowMapSkinningShader_.reset();
+    skinningShader_.reset();
     debugVectorsShader_.reset();
     forwardRenderShader_.reset();
     forwardPBRShader_.reset();
@@ -322,13 +360,25 @@ Scene* RenderApp::getScene() const {
     return scene_.get();
 }
 
+ModelLoader* RenderApp::getModelLoader() const {
+    return modelLoader_.get();
+}
+
+ThreadPool* RenderApp::getThreadPool() const {
+    return threadPool_.get();
+}
+
+AnimationSystem* RenderApp::getAnimationSystem() const {
+    return animationSystem_.get();
+}
+
 void RenderApp::init() {
     // TODO should perform all GL setup ########################################################
 }
 
 Scene* RenderApp::createScene() {
     assert(!scene_);
-    scene_ = unique_ptr<Scene>(new Scene());
+    scene_ = unique_ptr<Scene>(new Scene("", threadPool_.get()));
     return scene_.get();
 }
 
@@ -457,6 +507,8 @@ void RenderApp::setupOpenGL() {
     if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress))) {    // Load all OpenGL function pointers with GLAD.
         throw runtime_error("Failed to initialize GLAD.");
     }
+    Shader::initProgramCache("shaders/cache");
+    Shader::initParallelCompile();
     
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
@@ -555,15 +607,9 @@ void RenderApp::setupShaders() {
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
     glBindBufferRange(GL_UNIFORM_BUFFER, 0, viewProjectionMtxUBO_, 0, 2 * sizeof(glm::mat4));    // Link to binding point 0.
     
-    geometryShader_ = make_unique<Shader>("shaders/geometry.v.glsl", "shaders/geometry.f.glsl");
+    geometryShader_ = make_unique<Shader>("shaders/geometry.v.glsl", "shaders/geometry.f.glsl", Shader::CompileOnDemand);
     geometryShader_->setUniformBlockBinding("ViewProjectionMtx", 0);
     
-    geometryNormalMapShader_ = make_unique<Shader>("shaders/geometryNormalMap.v.glsl", "shaders/geometryNormalMap.f.glsl");
-    geometryNormalMapShader_->setUniformBlockBinding("ViewProjectionMtx", 0);
-    
-    geometrySkinningShader_ = make_unique<Shader>("shaders/geometrySkinning.v.glsl", "shaders/geometryNormalMap.f.glsl");
-    geometrySkinningShader_->setUniformBlockBinding("ViewProjectionMtx", 0);
-    
     skyboxShader_ = make_unique<Shader>("shaders/skybox.v.glsl", "shaders/skyboxWithGamma.f.glsl");
     skyboxShader_->setUniformBlockBinding("ViewProjectionMtx", 0);
     
@@ -571,38 +617,75 @@ void RenderApp::setupShaders() {
     lampShader_->setUniformBlockBinding("ViewProjectionMtx", 0);
     
     shadowMapShader_ = make_unique<Shader>("shaders/shadowMap.v.glsl", "shaders/shadowMap.f.glsl");
+    shadowMapShader_->preloadVariant(shadowMapShader_->getKeywordMask("SKINNING"));
     
-    shadowMapSkinningShader_ = make_unique<Shader>("shaders/shadowMapSkinning.v.glsl", "shaders/shadowMap.f.glsl");
+    skinningShader_ = make_unique<Shader>("shaders/skinning.v.glsl", PreSkinning::getFeedbackVaryings(), Shader::CompileOnDemand);
+    
+    auto findSceneKeywords = [](const Shader& shader, SceneKeywords* keywords) {
+        keywords->skinning = shader.getKeywordMask("SKINNING");
+        keywords->boneBuffer = shader.getKeywordMask("BONE_BUFFER");
+        keywords->bakedAnimation = shader.getKeywordMask("BAKED_ANIMATION");
+        for (unsigned int i = 0; i < BonePaletteBuffer::NUM_FORMATS; ++i) {
+            const char* keyword = BonePaletteBuffer::getShaderKeyword(static_cast<BonePaletteBuffer::Format>(i));
+            keywords->bonePalette[i] = (keyword != nullptr ? shader.getKeywordMask(keyword) : 0);
+        }
+    };
+    findSceneKeywords(*geometryShader_, &geometryKeywords_);
+    geometryKeywords_.normalMap = geometryShader_->getKeywordMask("NORMAL_MAP");
+    findSceneKeywords(*shadowMapShader_, &shadowMapKeywords_);
+    shadowMapKeywords_.normalMap = 0;    // Shadows don't shade, so there is no normal map variant.
+    for (unsigned int i = 0; i < BonePaletteBuffer::NUM_FORMATS; ++i) {
+        const char* keyword = BonePaletteBuffer::getShaderKeyword(static_cast<BonePaletteBuffer::Format>(i));
+        skinningPaletteKeywords_[i] = (keyword != nullptr ? skinningShader_->getKeywordMask(keyword) : 0);
+    }
     
     debugVectorsShader_ = make_unique<Shader>("shaders/debugVectors.v.glsl", "shaders/debugVectors.g.glsl", "shaders/debugVectors.f.glsl");
     debugVectorsShader_->setUniformBlockBinding("ViewProjectionMtx", 0);
     
-    forwardRenderShader_ = make_unique<Shader>("shaders/pbr/forwardRender.v.glsl", "shaders/pbr/forwardRender.f.glsl");
+    forwardRenderShader_ = make_unique<Shader>("shaders/pbr/forwardRender.v.glsl", "shaders/pbr/forwardRender.f.glsl", Shader::CompileOnDemand);
     forwardRenderShader_->setUniformBlockBinding("ViewProjectionMtx", 0);
     
-    forwardPBRShader_ = make_unique<Shader>("shaders/pbr/forwardRender.v.glsl", "shaders/pbr/forwardPBR.f.glsl");
+    forwardPBRShader_ = make_unique<Shader>("shaders/pbr/forwardRender.v.glsl", "shaders/pbr/forwardPBR.f.glsl", Shader::CompileOnDemand);
     forwardPBRShader_->setUniformBlockBinding("ViewProjectionMtx", 0);
+    forwardPBRShader_->preloadVariant(forwardPBRShader_->getKeywordMask("LIGHT_0") | forwardPBRShader_->getKeywordMask("LIGHT_1") | forwardPBRShader_->getKeywordMask("LIGHT_2") | forwardPBRShader_->getKeywordMask("LIGHT_3"));
     
-    nullLightShader_ = make_unique<Shader>("shaders/effects/nullLight.v.glsl", "shaders/effects/nullLight.f.glsl");
+    nullLightShader_ = make_unique<Shader>("shaders/effects/nullLight.v.glsl", "shaders/effects/nullLight.f.glsl", Shader::CompileOnDemand);
     nullLightShader_->setUniformBlockBinding("ViewProjectionMtx", 0);
     
-    directionalLightShader_ = make_unique<Shader>("shaders/effects/postProcess.v.glsl", "shaders/effects/directionalLight.f.glsl");
+    directionalLightShader_ = make_unique<Shader>("shaders/effects/postProcess.v.glsl", "shaders/effects/directionalLight.f.glsl", Shader::CompileOnDemand);
     
-    pointLightShader_ = make_unique<Shader>("shaders/effects/pointLight.v.glsl", "shaders/effects/pointLight.f.glsl");
+    pointLightShader_ = make_unique<Shader>("shaders/effects/pointLight.v.glsl", "shaders/effects/pointLight.f.glsl", Shader::CompileOnDemand);
     pointLightShader_->setUniformBlockBinding("ViewProjectionMtx", 0);
     
-    spotLightShader_ = make_unique<Shader>("shaders/effects/spotLight.v.glsl", "shaders/effects/spotLight.f.glsl");
+    spotLightShader_ = make_unique<Shader>("shaders/effects/spotLight.v.glsl", "shaders/effects/spotLight.f.glsl", Shader::CompileOnDemand);
     spotLightShader_->setUniformBlockBinding("ViewProjectionMtx", 0);
     
     postProcessShader_ = make_unique<Shader>("shaders/effects/postProcess.v.glsl", "shaders/effects/postProcess.f.glsl");
+    postProcessShader_->preloadVariant(postProcessShader_->getKeywordMask("APPLY_BLOOM"));
     
     bloomShader_ = make_unique<Shader>("shaders/effects/postProcess.v.glsl", "shaders/effects/bloom.f.glsl");
     
     gaussianBlurShader_ = make_unique<Shader>("shaders/effects/postProcess.v.glsl", "shaders/effects/gaussianBlur.f.glsl");
+    gaussianBlurShader_->preloadVariant(gaussianBlurShader_->getKeywordMask("BLUR_HORIZONTAL"));
     
     ssaoShader_ = make_unique<Shader>("shaders/effects/postProcess.v.glsl", "shaders/effects/ssao.f.glsl");
     ssaoShader_->setUniformBlockBinding("ViewProjectionMtx", 0);
-    ssaoShader_->use();
+    
+    ssaoBlurShader_ = make_unique<Shader>("shaders/effects/postProcess.v.glsl", "shaders/effects/ssaoBlur.f.glsl", Shader::CompileOnDemand);
+    
+    textShader_ = make_unique<Shader>("shaders/ui/shape.v.glsl", "shaders/ui/text.f.glsl");
+    
+    shapeShader_ = make_unique<Shader>("shaders/ui/shape.v.glsl", "shaders/ui/shape.f.glsl");
+    
+    equirectToCubeShader_ = make_unique<Shader>("shaders/pbr/cubemap.v.glsl", "shaders/pbr/equirectToCube.f.glsl");
+    
+    radianceConvolutionShader_ = make_unique<Shader>("shaders/pbr/cubemap.v.glsl", "shaders/pbr/radianceConvolution.f.glsl");
+    
+    prefilterEnvShader_ = make_unique<Shader>("shaders/pbr/cubemap.v.glsl", "shaders/pbr/prefilterEnv.f.glsl");
+    
+    integrateBRDFShader_ = make_unique<Shader>("shaders/pbr/integrateBRDF.v.glsl", "shaders/pbr/integrateBRDF.f.glsl");
+    
+    ssaoShader_->use();    // Setting uniforms waits for the program, so this is done after everything else has been submitted.
     constexpr unsigned int SSAO_NUM_SAMPLES = 32;
     vector<glm::vec3> ssaoSampleKernel;
     ssaoSampleKernel.reserve(SSAO_NUM_SAMPLES);
@@ -616,22 +699,8 @@ void RenderApp::setupShaders() {
         ssaoSampleKernel.push_back(sample);
     }
     for (unsigned int i = 0; i < SSAO_NUM_SAMPLES; ++i) {
-        ssaoShader_->setVec3("samples[" + to_string(i) + "]", ssaoSampleKernel[i]);
+        ssaoShader_->setVec3(frameAllocator_.format("samples[%u]", i), ssaoSampleKernel[i]);
     }
-    
-    ssaoBlurShader_ = make_unique<Shader>("shaders/effects/postProcess.v.glsl", "shaders/effects/ssaoBlur.f.glsl");
-    
-    textShader_ = make_unique<Shader>("shaders/ui/shape.v.glsl", "shaders/ui/text.f.glsl");
-    
-    shapeShader_ = make_unique<Shader>("shaders/ui/shape.v.glsl", "shaders/ui/shape.f.glsl");
-    
-    equirectToCubeShader_ = make_unique<Shader>("shaders/pbr/cubemap.v.glsl", "shaders/pbr/equirectToCube.f.glsl");
-    
-    radianceConvolutionShader_ = make_unique<Shader>("shaders/pbr/cubemap.v.glsl", "shaders/pbr/radianceConvolution.f.glsl");
-    
-    prefilterEnvShader_ = make_unique<Shader>("shaders/pbr/cubemap.v.glsl", "shaders/pbr/prefilterEnv.f.glsl");
-    
-    integrateBRDFShader_ = make_unique<Shader>("shaders/pbr/integrateBRDF.v.glsl", "shaders/pbr/integrateBRDF.f.glsl");
 }
 
 void RenderApp::setupBuffers() {
@@ -780,11 +849,28 @@ void RenderApp::beginFrame() {
     lastTime_ = currentTime;
     
     performanceMonitors_.at("FRAME")->startGPUTimer();
+    modelLoader_->update(MODEL_UPLOAD_TIME_BUDGET);
+    animationSystem_->update(deltaTime);
+    if (bonePaletteBuffer_->getFormat() != config_.getBonePaletteFormat()) {
+        bonePaletteBuffer_->setFormat(config_.getBonePaletteFormat());
+    }
+    bonePaletteBuffer_->clear();    // Palettes are uploaded once here and shared by the geometry and shadow passes.
+    animationSystem_->writePalettes(*bonePaletteBuffer_, config_.getPreSkinning());
+    bonePaletteBuffer_->upload();
+    const vector<AnimationSystem::PaletteBatch>& paletteBatches = animationSystem_->getPaletteBatches();
+    performanceMonitors_.at("SKINNING")->startGPUTimer();
+    if (any_of(paletteBatches.begin(), paletteBatches.end(), [](const AnimationSystem::PaletteBatch& batch) { return batch.preSkinned; })) {    // Skin these once here, every pass after draws the results.
+        skinningShader_->use(skinningPaletteKeywords_[bonePaletteBuffer_->getFormat()]);
+        skinningShader_->setInt("bonePalettes", TEXTURE_UNIT_BONE_PALETTES);
+        bonePaletteBuffer_->bind(TEXTURE_UNIT_BONE_PALETTES);
+    }
+    preSkinning_->skin(*skinningShader_, paletteBatches);
+    performanceMonitors_.at("SKINNING")->stopGPUTimer();
+    scene_->updateWorldTransforms();    // Also shared by the shadow and geometry passes.
     
     ++frameCounter_;
     if (currentTime - lastFrameTime_ >= 1.0) {
-        string windowTitle = to_string(frameCounter_) + " FPS (" + to_string(1000.0f / frameCounter_) + " ms/frame)";
-        glfwSetWindowTitle(window_, windowTitle.c_str());
+        glfwSetWindowTitle(window_, frameAllocator_.format("%d FPS (%f ms/frame)", frameCounter_, 1000.0f / frameCounter_));
         frameCounter_ = 0;
         lastFrameTime_ += 1.0;
         if (currentTime - lastFrameTime_ >= 1.0) {
@@ -794,6 +880,7 @@ void RenderApp::beginFrame() {
 }
 
 void RenderApp::drawShadowMaps(const Camera& camera, const World& world) {
+    performanceMonitors_.at("SHADOWS")->startGPUTimer();
     glCullFace(GL_FRONT);
     
     glm::vec2 tanHalfFOV(tan(glm::radians(camera.fov_ / 2.0f)) * (static_cast<float>(windowSize_.x) / windowSize_.y), tan(glm::radians(camera.fov_ / 2.0f)));
@@ -844,9 +931,11 @@ void RenderApp::drawShadowMaps(const Camera& camera, const World& world) {
     }
     
     glCullFace(GL_BACK);
+    performanceMonitors_.at("SHADOWS")->stopGPUTimer();
 }
 
 void RenderApp::geometryPass(const Camera& camera, const World& world) {
+    performanceMonitors_.at("GEOMETRY")->startGPUTimer();
     geometryFBO_->bind();    // Render to geometry buffer (geometry pass).
     glViewport(0, 0, geometryFBO_->getBufferSize().x, geometryFBO_->getBufferSize().y);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -857,6 +946,7 @@ void RenderApp::geometryPass(const Camera& camera, const World& world) {
     geometryFBO_->bind(GL_READ_FRAMEBUFFER);    // Copy depth buffer over.
     renderFBO_->bind(GL_DRAW_FRAMEBUFFER);
     glBlitFramebuffer(0, 0, geometryFBO_->getBufferSize().x, geometryFBO_->getBufferSize().y, 0, 0, renderFBO_->getBufferSize().x, renderFBO_->getBufferSize().y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    performanceMonitors_.at("GEOMETRY")->stopGPUTimer();
 }
 
 void RenderApp::applySSAO() {
@@ -900,7 +990,9 @@ void RenderApp::lightingPass(const Camera& camera, const World& world) {
     glViewport(0, 0, renderFBO_->getBufferSize().x, renderFBO_->getBufferSize().y);
     glClear(GL_COLOR_BUFFER_BIT);
     glm::mat4 viewMtx = camera.getViewMatrix();
-    directionalLightShader_->use();
+    unsigned int variantKey = (config_.getSSAO() ? directionalLightShader_->getKeywordMask("APPLY_SSAO") : 0);
+    variantKey |= (world.sunlightOn_ ? directionalLightShader_->getKeywordMask("APPLY_SHADOWS") : 0);
+    directionalLightShader_->use(variantKey);
     directionalLightShader_->setInt("texPosition", 0);
     glActiveTexture(GL_TEXTURE0);
     geometryFBO_->bindTexture(0);
@@ -910,22 +1002,20 @@ void RenderApp::lightingPass(const Camera& camera, const World& world) {
     directionalLightShader_->setInt("texAlbedoSpec", 2);
     glActiveTexture(GL_TEXTURE2);
     geometryFBO_->bindTexture(2);
-    directionalLightShader_->setInt("texSSAO", 3);
     if (config_.getSSAO()) {
+        directionalLightShader_->setInt("texSSAO", 3);
         glActiveTexture(GL_TEXTURE3);
         ssaoBlurFBO_->bindTexture(0);
     }
-    directionalLightShader_->setBool("applySSAO", config_.getSSAO());
     if (world.sunlightOn_) {
         for (unsigned int i = 0; i < NUM_CASCADED_SHADOWS; ++i) {
-            directionalLightShader_->setInt("shadowMap[" + to_string(i) + "]", 4 + i);
+            directionalLightShader_->setInt(frameAllocator_.format("shadowMap[%u]", i), 4 + i);
             glActiveTexture(GL_TEXTURE4 + i);
             cascadedShadowFBO_[i]->bindTexture(0);
-            directionalLightShader_->setMat4("viewToLightSpace[" + to_string(i) + "]", shadowProjections_[i] * viewToLightSpace_);
-            directionalLightShader_->setFloat("shadowZEnds[" + to_string(i) + "]", shadowZBounds_[i + 1]);
+            directionalLightShader_->setMat4(frameAllocator_.format("viewToLightSpace[%u]", i), shadowProjections_[i] * viewToLightSpace_);
+            directionalLightShader_->setFloat(frameAllocator_.format("shadowZEnds[%u]", i), shadowZBounds_[i + 1]);
         }
     }
-    directionalLightShader_->setBool("applyShadows", world.sunlightOn_);
     directionalLightShader_->setVec3("lightDirectionVS", viewMtx * glm::vec4(-world.sunPosition_, 0.0f));
     if (world.sunlightOn_) {
         directionalLightShader_->setVec3("color", world.sunLight_.color);
@@ -943,7 +1033,8 @@ void RenderApp::lightingPass(const Camera& camera, const World& world) {
     glEnable(GL_STENCIL_TEST);
     glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);    // If stencil test and depth test pass (light volume occluded), set stencil value to glStencilFunc() ref value (prevents light from rendering at that spot).
     
-    pointLightShader_->use();    // Draw scene point lights.
+    unsigned int pointLightVariantKey = (config_.getSSAO() ? pointLightShader_->getKeywordMask("APPLY_SSAO") : 0);
+    pointLightShader_->use(pointLightVariantKey);    // Draw scene point lights.
     pointLightShader_->setInt("texPosition", 0);
     glActiveTexture(GL_TEXTURE0);
     geometryFBO_->bindTexture(0);
@@ -953,12 +1044,11 @@ void RenderApp::lightingPass(const Camera& camera, const World& world) {
     pointLightShader_->setInt("texAlbedoSpec", 2);
     glActiveTexture(GL_TEXTURE2);
     geometryFBO_->bindTexture(2);
-    pointLightShader_->setInt("texSSAO", 3);
     if (config_.getSSAO()) {
+        pointLightShader_->setInt("texSSAO", 3);
         glActiveTexture(GL_TEXTURE3);
         ssaoBlurFBO_->bindTexture(0);
     }
-    pointLightShader_->setBool("applySSAO", config_.getSSAO());
     pointLightShader_->setVec2("renderSize", renderFBO_->getBufferSize());
     //world.lightSphere_.drawGeometryInstanced(static_cast<unsigned int>(world.pointLights_.size()));
     if (world.lampsOn_) {
@@ -969,7 +1059,7 @@ void RenderApp::lightingPass(const Camera& camera, const World& world) {
             glStencilFunc(GL_ALWAYS, 1, 0xFF);
             world.lightSphere_.drawGeometry();
             
-            pointLightShader_->use();    // Second pass, render light volume (back face) where the light is occluded by geometry and not masked by first pass.
+            pointLightShader_->use(pointLightVariantKey);    // Second pass, render light volume (back face) where the light is occluded by geometry and not masked by first pass.
             pointLightShader_->setMat4("modelMtx", world.pointLights_[i].modelMtx);
             pointLightShader_->setVec3("color", world.pointLights_[i].color);
             pointLightShader_->setVec3("phongVals", world.pointLights_[i].phongVals);
@@ -981,7 +1071,8 @@ void RenderApp::lightingPass(const Camera& camera, const World& world) {
         }
     }
     
-    spotLightShader_->use();    // Draw scene spotlights.
+    unsigned int spotLightVariantKey = (config_.getSSAO() ? spotLightShader_->getKeywordMask("APPLY_SSAO") : 0);
+    spotLightShader_->use(spotLightVariantKey);    // Draw scene spotlights.
     spotLightShader_->setInt("texPosition", 0);
     glActiveTexture(GL_TEXTURE0);
     geometryFBO_->bindTexture(0);
@@ -991,12 +1082,11 @@ void RenderApp::lightingPass(const Camera& camera, const World& world) {
     spotLightShader_->setInt("texAlbedoSpec", 2);
     glActiveTexture(GL_TEXTURE2);
     geometryFBO_->bindTexture(2);
-    spotLightShader_->setInt("texSSAO", 3);
     if (config_.getSSAO()) {
+        spotLightShader_->setInt("texSSAO", 3);
         glActiveTexture(GL_TEXTURE3);
         ssaoBlurFBO_->bindTexture(0);
     }
-    spotLightShader_->setBool("applySSAO", config_.getSSAO());
     spotLightShader_->setVec2("renderSize", renderFBO_->getBufferSize());
     
     glm::mat4 flashlightModelMtx = CommonMath::orientAt(camera.getSceneNode()->getPosition(), camera.getSceneNode()->getPosition() + camera.front_, camera.up_);    // Orient the flashlight to the camera direction, and set scale based on the larger cutoff angle.
@@ -1012,7 +1102,7 @@ void RenderApp::lightingPass(const Camera& camera, const World& world) {
             glStencilFunc(GL_ALWAYS, 1, 0xFF);
             world.lightCone_.drawGeometry();
             
-            spotLightShader_->use();
+            spotLightShader_->use(spotLightVariantKey);
             spotLightShader_->setMat4("modelMtx", flashlightModelMtx);
             spotLightShader_->setVec3("color", world.spotLights_[0].color);
             spotLightShader_->setVec3("phongVals", world.spotLights_[0].phongVals);
@@ -1084,16 +1174,17 @@ void RenderApp::applyBloom() {
         renderFBO_->bindTexture(0);
         windowQuad_.drawGeometry();
         
-        gaussianBlurShader_->use();    // Apply Gaussian blur to texture.
-        gaussianBlurShader_->setInt("image", 0);
+        unsigned int horizontalKey = gaussianBlurShader_->getKeywordMask("BLUR_HORIZONTAL");    // Apply Gaussian blur to texture.
         for (unsigned int i = 0; i < 5; ++i) {
             bloom2FBO_->bind();    // Draw to bloom 2 framebuffer.
-            gaussianBlurShader_->setBool("blurHorizontal", true);
+            gaussianBlurShader_->use(horizontalKey);
+            gaussianBlurShader_->setInt("image", 0);
             bloom1FBO_->bindTexture(0);
             windowQuad_.drawGeometry();
             
             bloom1FBO_->bind();    // Draw to bloom 1 framebuffer.
-            gaussianBlurShader_->setBool("blurHorizontal", false);
+            gaussianBlurShader_->use();
+            gaussianBlurShader_->setInt("image", 0);
             bloom2FBO_->bindTexture(0);
             windowQuad_.drawGeometry();
         }
@@ -1105,14 +1196,13 @@ void RenderApp::drawPostProcessing() {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);    // Apply post-processing and render to window.
     glViewport(0, 0, windowSize_.x, windowSize_.y);
     glClear(GL_COLOR_BUFFER_BIT);
-    postProcessShader_->use();
+    postProcessShader_->use(config_.getBloom() ? postProcessShader_->getKeywordMask("APPLY_BLOOM") : 0);
     postProcessShader_->setInt("image", 0);
-    postProcessShader_->setInt("bloomBlur", 1);
     postProcessShader_->setFloat("exposure", 4.0f);
-    postProcessShader_->setBool("applyBloom", config_.getBloom());
     glActiveTexture(GL_TEXTURE0);
     renderFBO_->bindTexture(0);
     if (config_.getBloom()) {
+        postProcessShader_->setInt("bloomBlur", 1);
         glActiveTexture(GL_TEXTURE1);
         bloom1FBO_->bindTexture(0);
     }
@@ -1127,6 +1217,7 @@ void RenderApp::forwardLightingPass() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glm::mat4 viewMtx = camera->getViewMatrix();
     glm::mat4 projectionMtx = glm::perspective(glm::radians(camera->fov_), static_cast<float>(windowSize_.x) / windowSize_.y, NEAR_PLANE, FAR_PLANE);
+    Mesh::setLodView(glm::vec3(glm::inverse(viewMtx)[3]), windowSize_.y / (2.0f * tan(glm::radians(camera->fov_) / 2.0f)));
     
     glBindBuffer(GL_UNIFORM_BUFFER, viewProjectionMtxUBO_);    // Update uniform buffer.
     glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(viewMtx));
@@ -1134,8 +1225,18 @@ void RenderApp::forwardLightingPass() {
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
     
     //Shader* shader = forwardRenderShader_.get();
+    constexpr unsigned int NUM_LIGHTS = 4;
+    static const char* LIGHT_KEYWORDS[NUM_LIGHTS] = {"LIGHT_0", "LIGHT_1", "LIGHT_2", "LIGHT_3"};
+    bool lightStates[NUM_LIGHTS];
+    for (size_t i = 0; i < NUM_LIGHTS; ++i) {
+        lightStates[i] = true;//world.lampsOn_;
+    }
     Shader* shader = forwardPBRShader_.get();
-    shader->use();
+    unsigned int variantKey = 0;
+    for (size_t i = 0; i < NUM_LIGHTS; ++i) {    // Each enabled light selects a variant with that light compiled in.
+        variantKey |= (lightStates[i] ? shader->getKeywordMask(LIGHT_KEYWORDS[i]) : 0);
+    }
+    shader->use(variantKey);
     
     //shader->setVec3("albedo", glm::vec3(0.5f, 0.0f, 0.0f));
     //shader->setFloat("ambientOcclusion", 1.0);
@@ -1163,20 +1264,14 @@ void RenderApp::forwardLightingPass() {
     shader->setVec3("lights[1].attenuationVals", world.spotLights_[0].attenuation);
     shader->setVec2("lights[1].cutOff", world.spotLights_[0].cutOff);
     for (size_t i = 0; i < world.pointLights_.size(); ++i) {
-        shader->setUnsignedInt("lights[" + to_string(i + 2) + "].type", 1);
-        shader->setVec3("lights[" + to_string(i + 2) + "].positionViewSpace", viewMtx * glm::vec4(glm::vec3(world.pointLights_[i].modelMtx[3]), 1.0f));
-        shader->setVec3("lights[" + to_string(i + 2) + "].ambient", world.pointLights_[i].color * world.pointLights_[i].phongVals.x);
-        shader->setVec3("lights[" + to_string(i + 2) + "].diffuse", world.pointLights_[i].color) * world.pointLights_[i].phongVals.y);
-        shader->setVec3("lights[" + to_string(i + 2) + "].specular", world.pointLights_[i].color * world.pointLights_[i].phongVals.z);
-        shader->setVec3("lights[" + to_string(i + 2) + "].attenuationVals", world.pointLights_[i].attenuation);
+        shader->setUnsignedInt(frameAllocator_.format("lights[%zu].type", i + 2), 1);
+        shader->setVec3(frameAllocator_.format("lights[%zu].positionViewSpace", i + 2), viewMtx * glm::vec4(glm::vec3(world.pointLights_[i].modelMtx[3]), 1.0f));
+        shader->setVec3(frameAllocator_.format("lights[%zu].ambient", i + 2), world.pointLights_[i].color * world.pointLights_[i].phongVals.x);
+        shader->setVec3(frameAllocator_.format("lights[%zu].diffuse", i + 2), world.pointLights_[i].color) * world.pointLights_[i].phongVals.y);
+        shader->setVec3(frameAllocator_.format("lights[%zu].specular", i + 2), world.pointLights_[i].color * world.pointLights_[i].phongVals.z);
+        shader->setVec3(frameAllocator_.format("lights[%zu].attenuationVals", i + 2), world.pointLights_[i].attenuation);
     }*/
     
-    constexpr unsigned int NUM_LIGHTS = 4;
-    unsigned int lightStates[NUM_LIGHTS];
-    for (size_t i = 0; i < NUM_LIGHTS; ++i) {
-        lightStates[i] = 1;//(world.lampsOn_ ? 1 : 0);
-    }
-    shader->setUnsignedIntArray("lightStates", NUM_LIGHTS, lightStates);
     glm::vec3 lightPositions[] = {
         glm::vec3(-10.0f,  10.0f, 10.0f),
         glm::vec3( 10.0f,  10.0f, 10.0f),
@@ -1190,9 +1285,9 @@ void RenderApp::forwardLightingPass() {
         glm::vec3(300.0f, 300.0f, 300.0f)
     };
     for (size_t i = 0; i < NUM_LIGHTS; ++i) {
-        shader->setUnsignedInt("lights[" + to_string(i) + "].type", 1);
-        shader->setVec3("lights[" + to_string(i) + "].positionViewSpace", viewMtx * glm::vec4(lightPositions[i], 1.0f));
-        shader->setVec3("lights[" + to_string(i) + "].diffuse", lightColors[i]);
+        shader->setUnsignedInt(frameAllocator_.format("lights[%zu].type", i), 1);
+        shader->setVec3(frameAllocator_.format("lights[%zu].positionViewSpace", i), viewMtx * glm::vec4(lightPositions[i], 1.0f));
+        shader->setVec3(frameAllocator_.format("lights[%zu].diffuse", i), lightColors[i]);
     }
     
     renderScene2(viewMtx, projectionMtx);
@@ -1248,6 +1343,7 @@ void RenderApp::drawGUI() {
     for (const auto& m : performanceMonitors_) {
         m.second->drawText(*textShader_, glm::mat4(1.0f));
     }
+    allocationText_->draw(*textShader_, glm::mat4(1.0f));
     
     glDisable(GL_BLEND);
     glEnable(GL_DEPTH_TEST);
@@ -1257,8 +1353,12 @@ void RenderApp::endFrame() {
     performanceMonitors_.at("FRAME")->stopGPUTimer();
     
     for (const auto& m : performanceMonitors_) {    // Monitor update must occur after drawing.
-        m.second->update();
+        m.second->update(frameAllocator_);
     }
+    size_t allocationCount = AllocationCounter::getCount();    // Counts from the last endFrame(), so event polling and swapping buffers land in the next frame.
+    allocationText_->setString(frameAllocator_.format("Allocations\nper frame: %zu", allocationCount - lastAllocationCount_));
+    lastAllocationCount_ = allocationCount;
+    frameAllocator_.reset();
     
     glfwSwapBuffers(window_);
     glfwPollEvents();
@@ -1266,7 +1366,12 @@ void RenderApp::endFrame() {
 }
 
 void RenderApp::renderScene(const Camera& camera, const World& world, const glm::mat4& viewMtx, const glm::mat4& projectionMtx, bool shadowRender) {
+    glm::vec3 cameraPosition = glm::vec3(glm::inverse(camera.getViewMatrix())[3]);    // LODs are always picked based on distance to the camera, even for shadows.
+    float projectionScale = windowSize_.y / (2.0f * tan(glm::radians(camera.fov_) / 2.0f));
+    Mesh::setLodView(cameraPosition, projectionScale, (shadowRender ? SHADOW_LOD_BIAS : 1.0f), (shadowRender ? 1 : 0));
+    
     Shader* shader;
+    const SceneKeywords& keywords = (shadowRender ? shadowMapKeywords_ : geometryKeywords_);
     if (shadowRender) {
         shader = shadowMapShader_.get();
         shader->use();
@@ -1277,8 +1382,8 @@ void RenderApp::renderScene(const Camera& camera, const World& world, const glm:
         glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(projectionMtx));
         glBindBuffer(GL_UNIFORM_BUFFER, 0);
         
-        shader = geometryNormalMapShader_.get();
-        shader->use();
+        shader = geometryShader_.get();
+        shader->use(keywords.normalMap);
         shader->setInt("texDiffuse", 0);
         shader->setInt("texSpecular", 1);
         shader->setInt("texNormal", 2);
@@ -1291,7 +1396,7 @@ void RenderApp::renderScene(const Camera& camera, const World& world, const glm:
     glBindTexture(GL_TEXTURE_2D, cubeDiffuseMap_);
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, cubeSpecularMap_);
-    vector<glm::vec3> cubePositions = {
+    pmr::vector<glm::vec3> cubePositions({
         glm::vec3( 0.0f,  0.0f,  0.0f),
         glm::vec3( 2.0f,  5.0f, -15.0f),
         glm::vec3(-1.5f, -2.2f, -2.5f),
@@ -1302,7 +1407,7 @@ void RenderApp::renderScene(const Camera& camera, const World& world, const glm:
         glm::vec3( 1.5f,  2.0f, -2.5f),
         glm::vec3( 1.5f,  0.2f, -1.5f),
         glm::vec3(-1.3f,  1.0f, -1.5f)
-    };
+    }, &frameAllocator_);
     for (unsigned int i = 0; i < cubePositions.size(); ++i) {
         glm::mat4 modelMtx = glm::translate(glm::mat4(1.0f), cubePositions[i]);
         float angle = 20.0f * i;
@@ -1321,23 +1426,21 @@ void RenderApp::renderScene(const Camera& camera, const World& world, const glm:
     glBindTexture(GL_TEXTURE_2D, woodTexture_);
     world.cube1_.drawGeometry(*shader, glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.1f, 0.0f)), glm::vec3(15.0f, 0.2f, 15.0f)));
     
-    if (!shadowRender) {    // For some reason, lighting does not work properly when geometryNormalMapShader is used with boot_camp.obj, may want to investigate this ###############################################
-        shader = geometryShader_.get();
+    if (!shadowRender) {    // For some reason, lighting does not work properly when the NORMAL_MAP variant is used with boot_camp.obj, may want to investigate this ###############################################
         shader->use();
         shader->setInt("texDiffuse", 0);
         shader->setInt("texSpecular", 1);
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, blackTexture_);
     }
-    world.sceneTest_.draw(*shader, world.sceneTestTransform_.getTransform());
+    world.sceneTest_.draw(*shader, world.sceneTestTransform_.getTransform(), world.sceneTestLodStates_);
     
+    unsigned int skinningKeywords = keywords.skinning | keywords.boneBuffer | keywords.bonePalette[bonePaletteBuffer_->getFormat()];
     if (shadowRender) {
-        shader = shadowMapSkinningShader_.get();
-        shader->use();
+        shader->use(skinningKeywords);
         shader->setMat4("lightSpaceMtx", projectionMtx * viewMtx);
     } else {
-        shader = geometrySkinningShader_.get();
-        shader->use();
+        shader->use(keywords.normalMap | skinningKeywords);
         shader->setInt("texDiffuse", 0);
         shader->setInt("texSpecular", 1);
         shader->setInt("texNormal", 2);
@@ -1345,14 +1448,45 @@ void RenderApp::renderScene(const Camera& camera, const World& world, const glm:
         glBindTexture(GL_TEXTURE_2D, blueTexture_);
     }
     
-    shader->setMat4Array("boneTransforms", static_cast<unsigned int>(world.modelTestBoneTransforms_.size()), world.modelTestBoneTransforms_.data());
-    world.modelTest_.draw(*shader, world.modelTestTransform_.getTransform());
+    shader->setInt("bonePalettes", TEXTURE_UNIT_BONE_PALETTES);
+    bonePaletteBuffer_->bind(TEXTURE_UNIT_BONE_PALETTES);
+    for (const AnimationSystem::PaletteBatch& batch : animationSystem_->getPaletteBatches()) {    // Every animated instance of a model in one draw per mesh.
+        if (!batch.preSkinned) {
+            batch.model->drawPalettes(*shader, batch.paletteOffset, batch.paletteStride, batch.count);
+        }
+    }
+    
+    if (preSkinning_->getNumVertices() > 0) {    // Already skinned in beginFrame(), so these use the variants without skinning.
+        if (shadowRender) {
+            shader->use();
+            shader->setMat4("lightSpaceMtx", projectionMtx * viewMtx);
+        } else {
+            shader->use(keywords.normalMap);
+            shader->setInt("texDiffuse", 0);
+            shader->setInt("texSpecular", 1);
+            shader->setInt("texNormal", 2);
+        }
+        preSkinning_->draw(*shader);
+    }
+    
+    if (world.crowd_ != nullptr) {    // Baked animations, the shader finds the pose of each instance.
+        unsigned int crowdKeywords = keywords.skinning | keywords.bakedAnimation;
+        if (shadowRender) {
+            shader->use(crowdKeywords);
+            shader->setMat4("lightSpaceMtx", projectionMtx * viewMtx);
+        } else {
+            shader->use(keywords.normalMap | crowdKeywords);
+            shader->setInt("texDiffuse", 0);
+            shader->setInt("texSpecular", 1);
+            shader->setInt("texNormal", 2);
+        }
+        world.crowd_->draw(*shader, static_cast<float>(lastTime_));
+    }
 }
 
 void RenderApp::renderScene2(const glm::mat4& viewMtx, const glm::mat4& projectionMtx) {
     //Shader* shader = forwardRenderShader_.get();
-    Shader* shader = forwardPBRShader_.get();
-    shader->use();
+    Shader* shader = forwardPBRShader_.get();    // Variant is already bound by the caller.
     //shader->setInt("texDiffuse", 0);
     //shader->setInt("texSpecular", 1);
     //shader->setInt("texNormal", 2);
@@ -1393,6 +1527,9 @@ void RenderApp::renderScene2(const glm::mat4& viewMtx, const glm::mat4& projecti
         }
     }*/
     scene_->draw(*shader, glm::mat4(1.0f));
+    if (preSkinning_->getNumVertices() > 0) {    // Animated instances, already skinned in beginFrame().
+        preSkinning_->draw(*shader);
+    }
 }
 
 float RenderApp::randomFloat(float min, float max) {
@@ -1,11 +1,17 @@
 #ifndef RENDER_APP_H_
 #define RENDER_APP_H_
 
+class AnimationSystem;
+class BonePaletteBuffer;
 class Camera;
 class Framebuffer;
+class ModelLoader;
 class PerformanceMonitor;
+class PreSkinning;
 class Scene;
 class Shader;
+class Text;
+class ThreadPool;
 class World;
 
 #include <glad/glad.h>    // OpenGL includes.
@@ -17,6 +23,7 @@ class World;
 
 #include "Configuration.h"
 #include "Event.h"
+#include "FrameAllocator.h"
 #include "Mesh.h"
 #include <atomic>
 #include <memory>
@@ -34,20 +41,30 @@ class RenderApp {
         Uninitialized, Running, Paused, Exiting
     };
     
+    struct Image {    // Decoded image that hasn't been sent to OpenGL yet.
+        int width, height, numChannels;
+        shared_ptr<unsigned char> data;    // Null if the image failed to load.
+    };
+    
     static constexpr glm::ivec2 INITIAL_WINDOW_SIZE = glm::ivec2(800, 600);
     static constexpr float NEAR_PLANE = 0.1f, FAR_PLANE = 100.0f;
     static constexpr unsigned int NUM_CASCADED_SHADOWS = 3;
+    static constexpr float SHADOW_LOD_BIAS = 4.0f;    // Shadow maps can use coarser mesh LODs than the main view.
+    static constexpr double MODEL_UPLOAD_TIME_BUDGET = 0.002;    // Seconds per frame spent sending background loaded models to OpenGL.
+    static constexpr unsigned int TEXTURE_UNIT_BONE_PALETTES = 8;    // Units below this are used by materials and shadow maps.
+    static constexpr unsigned int TEXTURE_UNIT_ANIMATION_FRAMES = 9;
+    static constexpr unsigned int TEXTURE_UNIT_CROWD_INSTANCES = 10;
     static constexpr unsigned int ATTRIBUTE_LOCATION_V_POSITION = 0;
     static constexpr unsigned int ATTRIBUTE_LOCATION_V_NORMAL = 1;
     static constexpr unsigned int ATTRIBUTE_LOCATION_V_TEX_COORDS = 2;
     static constexpr unsigned int ATTRIBUTE_LOCATION_V_TANGENT = 3;
-    static constexpr unsigned int ATTRIBUTE_LOCATION_V_BITANGENT = 4;
     static constexpr unsigned int ATTRIBUTE_LOCATION_V_BONE = 5;
     static constexpr unsigned int ATTRIBUTE_LOCATION_V_WEIGHT = 6;
     Configuration config_;
     
     static GLenum glCheckError_(const char* file, int line);    // Error checking, https://learnopengl.com/In-Practice/Debugging
-    static unsigned int loadTexture(const string& filename, bool gammaCorrection, bool flip = true);    // consider changing to const char * for performance lookups. ##############################################
+    static Image decodeImage(const string& filename, bool flip = true);    // Only uses stb_image, so this can run on a worker thread.
+    static unsigned int loadTexture(const string& filename, bool gammaCorrection, bool flip = true, const Image* image = nullptr);    // Uses the given image instead of reading the file if it isn't null. consider changing to const char * for performance lookups. ##############################################
     static unsigned int loadTextureHDR(const string& filename, bool flip = true);
     static unsigned int loadCubemap(const string& filename, bool gammaCorrection, bool flip = false);
     static unsigned int generateTexture(float r, float g, float b, float a = 1.0f);
@@ -57,6 +74,9 @@ class RenderApp {
     void setState(State state);
     GLFWwindow* getWindowHandle() const;
     Scene* getScene() const;
+    ModelLoader* getModelLoader() const;
+    ThreadPool* getThreadPool() const;
+    AnimationSystem* getAnimationSystem() const;    // Updated at the start of each frame.
     void init();
     Scene* createScene();
     void startRenderThread();
@@ -67,6 +87,11 @@ class RenderApp {
     void close();    // Clean up attached objects and destroy window.
     
     private:
+    struct SceneKeywords {    // Variant bits used by renderScene(), looked up once in setupShaders() so the passes don't search keyword names.
+        unsigned int normalMap, skinning, boneBuffer, bakedAnimation;
+        unsigned int bonePalette[BonePaletteBuffer::NUM_FORMATS];    // Indexed by format, zero for FullMatrix.
+    };
+    
     static bool instantiated_;
     static unordered_map<string, unsigned int> loadedTextures_;
     static queue<Event> eventQueue_;
@@ -75,11 +100,21 @@ class RenderApp {
     GLFWwindow* window_;
     glm::ivec2 windowSize_;
     unique_ptr<Scene> scene_;
+    unique_ptr<ModelLoader> modelLoader_;
+    unique_ptr<ThreadPool> threadPool_;
+    unique_ptr<AnimationSystem> animationSystem_;
+    unique_ptr<BonePaletteBuffer> bonePaletteBuffer_;
+    unique_ptr<PreSkinning> preSkinning_;
     unordered_map<const char*, PerformanceMonitor*> performanceMonitors_;
-    unique_ptr<Shader> geometryShader_, geometryNormalMapShader_, geometrySkinningShader_, skyboxShader_, lampShader_, shadowMapShader_, shadowMapSkinningShader_, debugVectorsShader_, forwardRenderShader_, forwardPBRShader_;
+    FrameAllocator frameAllocator_;    // Transient data for the current frame, reset in endFrame().
+    unique_ptr<Text> allocationText_;    // Heap allocations made during the last frame, should stay at zero once everything is loaded.
+    size_t lastAllocationCount_;
+    unique_ptr<Shader> geometryShader_, skyboxShader_, lampShader_, shadowMapShader_, skinningShader_, debugVectorsShader_, forwardRenderShader_, forwardPBRShader_;
     unique_ptr<Shader> nullLightShader_, directionalLightShader_, pointLightShader_, spotLightShader_, postProcessShader_, bloomShader_, gaussianBlurShader_, ssaoShader_, ssaoBlurShader_;
     unique_ptr<Shader> textShader_, shapeShader_;
     unique_ptr<Shader> equirectToCubeShader_, radianceConvolutionShader_, prefilterEnvShader_, integrateBRDFShader_;
+    SceneKeywords geometryKeywords_, shadowMapKeywords_;
+    unsigned int skinningPaletteKeywords_[BonePaletteBuffer::NUM_FORMATS];
     unique_ptr<Framebuffer> geometryFBO_, renderFBO_, cascadedShadowFBO_[NUM_CASCADED_SHADOWS];
     unique_ptr<Framebuffer> bloom1FBO_, bloom2FBO_, ssaoFBO_, ssaoBlurFBO_;
     unsigned int blackTexture_, whiteTexture_, blueTexture_, cubeDiffuseMap_, cubeSpecularMap_, woodTexture_, skyboxCubemap_, brickDiffuseMap_, brickNormalMap_, ssaoNoiseTexture_, monitorGridTexture_;
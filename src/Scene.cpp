@@ -4,7 +4,6 @@
 #include "Scene.h"
 #include "SceneNode.h"
 #include "Shader.h"
-#include <stack>
 #include <stdexcept>
 
 Scene::~Scene() {}
@@ -83,30 +82,44 @@ void Scene::generateCylinder(const string& name, float radiusBase, float radiusT
     meshes_.emplace(name, cylinder);
 }
 
-Scene::Scene(const string& name) :
+void Scene::updateWorldTransforms() {
+    transformHierarchy_.update();
+    if (nodeOrderVersion_ == transformHierarchy_.getOrderVersion()) {
+        return;
+    }
+    const vector<int>& parentSlots = transformHierarchy_.getParentSlots();
+    nodeOrder_.resize(transformHierarchy_.getNumNodes());
+    nodesAttached_.resize(nodeOrder_.size());
+    nodeOrder_[transformHierarchy_.getSlot(rootNode_->transformHandle_)] = rootNode_.get();
+    for (const unique_ptr<SceneNode>& node : sceneNodes_) {
+        nodeOrder_[transformHierarchy_.getSlot(node->transformHandle_)] = node.get();
+    }
+    for (size_t i = 0; i < nodeOrder_.size(); ++i) {    // Parents come first, so each node can check the one above it.
+        nodesAttached_[i] = (nodeOrder_[i] == rootNode_.get() || (parentSlots[i] >= 0 && nodesAttached_[parentSlots[i]]));
+    }
+    nodeOrderVersion_ = transformHierarchy_.getOrderVersion();
+}
+
+const vector<SceneNode*>& Scene::getNodeOrder() const {
+    return nodeOrder_;
+}
+
+const vector<glm::mat4>& Scene::getWorldTransforms() const {
+    return transformHierarchy_.getWorldTransforms();
+}
+
+Scene::Scene(const string& name, ThreadPool* threadPool) :
     name_(name),
-    rootNode_(unique_ptr<SceneNode>(new SceneNode("root", this))) {
+    transformHierarchy_(threadPool),
+    rootNode_(unique_ptr<SceneNode>(new SceneNode("root", this))),
+    nodeOrderVersion_(transformHierarchy_.getOrderVersion()) {
 }
 
 void Scene::draw(const Shader& shader, const glm::mat4& modelMtx) const {
-    stack<SceneNode*> nodeStack;
-    nodeStack.push(rootNode_.get());
-    stack<glm::mat4> modelMtxStack;
-    modelMtxStack.emplace(1.0f);
-    
-    while (!nodeStack.empty()) {
-        SceneNode* topNode = nodeStack.top();
-        nodeStack.pop();
-        glm::mat4 topModelMtx = modelMtxStack.top();
-        modelMtxStack.pop();
-        
-        topModelMtx *= topNode->getTransform();
-        shader.setMat4("modelMtx", topModelMtx);
-        topNode->draw();
-        
-        for (SceneNode* node : topNode->getChildNodes()) {
-            nodeStack.push(node);
-            modelMtxStack.push(topModelMtx);
+    const vector<glm::mat4>& worldTransforms = transformHierarchy_.getWorldTransforms();
+    for (size_t i = 0; i < nodeOrder_.size(); ++i) {
+        if (nodesAttached_[i]) {
+            nodeOrder_[i]->draw(shader, worldTransforms[i]);
         }
     }
 }
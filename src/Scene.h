@@ -8,6 +8,7 @@ class SceneNode;
 class Shader;
 
 #include "Mesh.h"
+#include "TransformHierarchy.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -35,20 +36,28 @@ class Scene {
     void generateCube(const string& name, float sideLength = 1.0f);
     void generateSphere(const string& name, float radius = 1.0f, int numSectors = 32, int numStacks = 16);
     void generateCylinder(const string& name, float radiusBase = 1.0f, float radiusTop = 1.0f, float height = 2.0f, int numSectors = 32, int numStacks = 1, bool originAtBase = false);
+    void updateWorldTransforms();    // Recomputes the world transforms of nodes that changed (or have a parent that changed). Called once per frame before drawing.
+    const vector<SceneNode*>& getNodeOrder() const;    // Every node sorted by depth, in the same order as getWorldTransforms().
+    const vector<glm::mat4>& getWorldTransforms() const;    // Shared by culling, instancing, and the shadow passes.
     
     private:
     string name_;
+    TransformHierarchy transformHierarchy_;    // Comes before the nodes, they add themselves to it when constructed.
     unique_ptr<SceneNode> rootNode_;
     vector<unique_ptr<Camera>> cameras_;
     vector<unique_ptr<Light>> lights_;
     vector<unique_ptr<SceneNode>> sceneNodes_;
     vector<unique_ptr<Entity>> entities_;
     map<string, shared_ptr<Mesh>> meshes_;    // may want to move into singleton manager or just make static in Mesh #####################################################################
+    vector<SceneNode*> nodeOrder_;
+    vector<uint8_t> nodesAttached_;    // Only nodes under the root get drawn.
+    unsigned int nodeOrderVersion_;
     
-    Scene(const string& name = "");
-    void draw(const Shader& shader, const glm::mat4& modelMtx) const;
+    Scene(const string& name = "", ThreadPool* threadPool = nullptr);
+    void draw(const Shader& shader, const glm::mat4& modelMtx) const;    // Uses the world transforms from the last updateWorldTransforms().
     
     friend class RenderApp;
+    friend class SceneNode;
 };
 
 #endif
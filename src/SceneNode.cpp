@@ -19,6 +19,14 @@ const vector<SceneObject*>& SceneNode::getObjects() const {
     return objects_;
 }
 
+const glm::mat4& SceneNode::getWorldTransform() const {
+    return scene_->transformHierarchy_.getWorldTransform(transformHandle_);
+}
+
+unsigned int SceneNode::getTransformHandle() const {
+    return transformHandle_;
+}
+
 SceneNode* SceneNode::createChildNode(const string& name) {
     SceneNode* child = scene_->createSceneNode(name);
     addChild(child);
@@ -34,6 +42,7 @@ void SceneNode::addChild(SceneNode* child) {
     if (child->parentNode_ == nullptr) {
         child->parentNode_ = this;
         childNodes_.push_back(child);
+        scene_->transformHierarchy_.setParent(child->transformHandle_, transformHandle_);
     } else {
         throw runtime_error("Child already has parent.");
     }
@@ -46,6 +55,7 @@ void SceneNode::removeChild(SceneNode* child) {
                 child->parentNode_ = nullptr;
                 childNodes_[i] = childNodes_.back();
                 childNodes_.pop_back();
+                scene_->transformHierarchy_.setParent(child->transformHandle_, -1);
                 return;
             }
         }
@@ -57,11 +67,16 @@ void SceneNode::removeChild(SceneNode* child) {
 SceneNode::SceneNode(const string& name, Scene* scene) :
     name_(name),
     scene_(scene),
-    parentNode_(nullptr) {
+    parentNode_(nullptr),
+    transformHandle_(scene->transformHierarchy_.addNode()) {
+}
+
+void SceneNode::onTransformChanged() {
+    scene_->transformHierarchy_.setLocalTransform(transformHandle_, getPosition(), getOrientation(), getScale());
 }
 
-void SceneNode::draw() const {
+void SceneNode::draw(const Shader& shader, const glm::mat4& modelMtx) const {
     for (const SceneObject* object : objects_) {
-        object->draw();
+        object->draw(shader, modelMtx);
     }
 }
@@ -20,6 +20,8 @@ class SceneNode : public Transformable {
     SceneNode* getParentNode() const;
     const vector<SceneNode*>& getChildNodes() const;
     const vector<SceneObject*>& getObjects() const;
+    const glm::mat4& getWorldTransform() const;    // Transform from the node to the scene as of the last Scene::updateWorldTransforms().
+    unsigned int getTransformHandle() const;    // Handle of the node in the scene's TransformHierarchy.
     SceneNode* createChildNode(const string& name = "");
     void attachObject(SceneObject* object);
     void addChild(SceneNode* child);
@@ -31,9 +33,11 @@ class SceneNode : public Transformable {
     SceneNode* parentNode_;
     vector<SceneNode*> childNodes_;
     vector<SceneObject*> objects_;
+    unsigned int transformHandle_;
     
     SceneNode(const string& name, Scene* scene);
-    void draw() const;
+    void onTransformChanged();    // Copies the local transform into the hierarchy, which flags the node for the next update.
+    void draw(const Shader& shader, const glm::mat4& modelMtx) const;
     
     friend class Scene;
 };
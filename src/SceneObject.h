@@ -2,7 +2,11 @@
 #define SCENE_OBJECT_
 
 class SceneNode;
+class Shader;
 
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <string>
 
 using namespace std;
@@ -15,7 +19,7 @@ class SceneObject {
     SceneNode* getSceneNode() const;
     
     protected:
-    virtual void draw() const = 0;
+    virtual void draw(const Shader& shader, const glm::mat4& modelMtx) const = 0;    // The modelMtx is the world transform of the node the object is attached to.
     
     private:
     string name_;
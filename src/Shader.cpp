@@ -1,194 +1,474 @@
+#include "CommonMath.h"
 #include "Shader.h"
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
 
-Shader::Shader(const string& vertexShaderPath, const string& fragmentShaderPath) {
-    unsigned int vertexShader = compileShader(vertexShaderPath, GL_VERTEX_SHADER);
-    unsigned int fragmentShader = compileShader(fragmentShaderPath, GL_FRAGMENT_SHADER);
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT    // The loader is generated for core 3.3, so ARB_get_program_binary must be loaded manually.
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR    // Same for KHR_parallel_shader_compile.
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace {
+    typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+    typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+    typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+    typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+    GetProgramBinaryProc getProgramBinary = nullptr;
+    ProgramBinaryProc programBinary = nullptr;
+    ProgramParameteriProc programParameteri = nullptr;
+}
+
+bool Shader::programCacheEnabled_ = false;
+string Shader::programCacheDirectory_;
+string Shader::driverIdentifier_;
+bool Shader::parallelCompileEnabled_ = false;
+
+void Shader::initProgramCache(const string& cacheDirectory) {
+    programCacheEnabled_ = false;
+    if (!glfwExtensionSupported("GL_ARB_get_program_binary")) {
+        cout << "Warn: ARB_get_program_binary is not supported, shader program cache disabled.\n";
+        return;
+    }
+    getProgramBinary = reinterpret_cast<GetProgramBinaryProc>(glfwGetProcAddress("glGetProgramBinary"));
+    programBinary = reinterpret_cast<ProgramBinaryProc>(glfwGetProcAddress("glProgramBinary"));
+    programParameteri = reinterpret_cast<ProgramParameteriProc>(glfwGetProcAddress("glProgramParameteri"));
+    int numBinaryFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numBinaryFormats);
+    if (getProgramBinary == nullptr || programBinary == nullptr || programParameteri == nullptr || numBinaryFormats == 0) {    // Some drivers expose the extension with no usable binary formats.
+        cout << "Warn: No program binary formats available, shader program cache disabled.\n";
+        return;
+    }
     
-    programHandle_ = glCreateProgram();    // Create the program and link the shaders.
-    glAttachShader(programHandle_, vertexShader);
-    glAttachShader(programHandle_, fragmentShader);
-    glLinkProgram(programHandle_);
-    int success;
-    glGetProgramiv(programHandle_, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(programHandle_, 512, nullptr, infoLog);
-        cout << "Error: Failed to link shader: " << infoLog << endl;
+    programCacheDirectory_ = cacheDirectory;
+    driverIdentifier_ = string(reinterpret_cast<const char*>(glGetString(GL_VENDOR))) + "\n";
+    driverIdentifier_ += string(reinterpret_cast<const char*>(glGetString(GL_RENDERER))) + "\n";
+    driverIdentifier_ += string(reinterpret_cast<const char*>(glGetString(GL_VERSION))) + "\n";
+    programCacheEnabled_ = true;
+}
+
+void Shader::initParallelCompile() {
+    MaxShaderCompilerThreadsProc maxShaderCompilerThreads = nullptr;
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+        maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+    } else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile")) {
+        maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(glfwGetProcAddress("glMaxShaderCompilerThreadsARB"));
     }
+    parallelCompileEnabled_ = (maxShaderCompilerThreads != nullptr);
+    if (parallelCompileEnabled_) {
+        maxShaderCompilerThreads(0xFFFFFFFF);    // Let the driver pick the number of threads.
+    }
+}
+
+Shader::Shader(const string& vertexShaderPath, const string& fragmentShaderPath, CompileMode compileMode) :
+    shaderFiles_({{vertexShaderPath, GL_VERTEX_SHADER}, {fragmentShaderPath, GL_FRAGMENT_SHADER}}),
+    activeVariant_(nullptr) {
     
-    glDetachShader(programHandle_, vertexShader);    // Clean up the individual shader parts as they are no longer needed.
-    glDetachShader(programHandle_, fragmentShader);
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    loadSources(compileMode);
 }
 
-Shader::Shader(const string& vertexShaderPath, const string& geometryShaderPath, const string& fragmentShaderPath) {
-    unsigned int vertexShader = compileShader(vertexShaderPath, GL_VERTEX_SHADER);
-    unsigned int geometryShader = compileShader(geometryShaderPath, GL_GEOMETRY_SHADER);
-    unsigned int fragmentShader = compileShader(fragmentShaderPath, GL_FRAGMENT_SHADER);
+Shader::Shader(const string& vertexShaderPath, const string& geometryShaderPath, const string& fragmentShaderPath, CompileMode compileMode) :
+    shaderFiles_({{vertexShaderPath, GL_VERTEX_SHADER}, {geometryShaderPath, GL_GEOMETRY_SHADER}, {fragmentShaderPath, GL_FRAGMENT_SHADER}}),
+    activeVariant_(nullptr) {
     
-    programHandle_ = glCreateProgram();    // Create the program and link the shaders.
-    glAttachShader(programHandle_, vertexShader);
-    glAttachShader(programHandle_, geometryShader);
-    glAttachShader(programHandle_, fragmentShader);
-    glLinkProgram(programHandle_);
-    int success;
-    glGetProgramiv(programHandle_, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(programHandle_, 512, nullptr, infoLog);
-        cout << "Error: Failed to link shader: " << infoLog << endl;
-    }
+    loadSources(compileMode);
+}
+
+Shader::Shader(const string& vertexShaderPath, const vector<string>& feedbackVaryings, CompileMode compileMode) :
+    shaderFiles_({{vertexShaderPath, GL_VERTEX_SHADER}}),
+    feedbackVaryings_(feedbackVaryings),
+    activeVariant_(nullptr) {
     
-    glDetachShader(programHandle_, vertexShader);    // Clean up the individual shader parts as they are no longer needed.
-    glDetachShader(programHandle_, geometryShader);
-    glDetachShader(programHandle_, fragmentShader);
-    glDeleteShader(vertexShader);
-    glDeleteShader(geometryShader);
-    glDeleteShader(fragmentShader);
+    loadSources(compileMode);
 }
 
 Shader::~Shader() {
-    glDeleteProgram(programHandle_);
+    for (auto& variant : variants_) {
+        for (unsigned int shaderHandle : variant.second.pendingShaderHandles) {
+            glDeleteShader(shaderHandle);
+        }
+        glDeleteProgram(variant.second.programHandle);
+    }
+}
+
+unsigned int Shader::getKeywordMask(const char* keyword) const {
+    for (size_t i = 0; i < keywords_.size(); ++i) {
+        if (keywords_[i] == keyword) {
+            return 1u << i;
+        }
+    }
+    cout << "Error: Shader keyword \"" << keyword << "\" is not declared in \"" << shaderFiles_.back().first << "\".\n";
+    return 0;
+}
+
+void Shader::preloadVariant(unsigned int variantKey) const {
+    if (variants_.count(variantKey) == 0) {
+        submit(variantKey);
+    }
+}
+
+bool Shader::isReady(unsigned int variantKey) const {
+    auto variantIter = variants_.find(variantKey);
+    if (variantIter == variants_.end()) {
+        return false;
+    }
+    const Variant& variant = variantIter->second;
+    if (variant.resolved || variant.pendingShaderHandles.empty()) {
+        return true;
+    } else if (!parallelCompileEnabled_) {    // Without the extension there is no way to ask, the driver will just block when the program is needed.
+        return true;
+    }
+    int completed;
+    glGetProgramiv(variant.programHandle, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed != 0;
 }
 
 unsigned int Shader::getHandle() const {
-    return programHandle_;
+    return getActiveVariant().programHandle;
 }
 
-void Shader::setFloat(const string& name, float value) const {
+unsigned int Shader::getAttributeMask() const {
+    return getActiveVariant().attributeMask;
+}
+
+void Shader::setFloat(const char* name, float value) const {
     glUniform1f(getUniformLocation(name), value);
 }
 
-void Shader::setBool(const string& name, bool value) const {
+void Shader::setBool(const char* name, bool value) const {
     glUniform1i(getUniformLocation(name), static_cast<int>(value));
 }
 
-void Shader::setInt(const string& name, int value) const {
+void Shader::setInt(const char* name, int value) const {
     glUniform1i(getUniformLocation(name), value);
 }
 
-void Shader::setUnsignedInt(const string& name, unsigned int value) const {
+void Shader::setUnsignedInt(const char* name, unsigned int value) const {
     glUniform1ui(getUniformLocation(name), value);
 }
 
-void Shader::setFloatArray(const string& name, unsigned int count, const float* valuePtr) const {
+void Shader::setFloatArray(const char* name, unsigned int count, const float* valuePtr) const {
     glUniform1fv(getUniformLocation(name), count, valuePtr);
 }
 
-void Shader::setIntArray(const string& name, unsigned int count, const int* valuePtr) const {
+void Shader::setIntArray(const char* name, unsigned int count, const int* valuePtr) const {
     glUniform1iv(getUniformLocation(name), count, valuePtr);
 }
 
-void Shader::setUnsignedIntArray(const string& name, unsigned int count, const unsigned int* valuePtr) const {
+void Shader::setUnsignedIntArray(const char* name, unsigned int count, const unsigned int* valuePtr) const {
     glUniform1uiv(getUniformLocation(name), count, valuePtr);
 }
 
-void Shader::setVec2(const string& name, const glm::vec2& value) const {
+void Shader::setVec2(const char* name, const glm::vec2& value) const {
     glUniform2fv(getUniformLocation(name), 1, glm::value_ptr(value));
 }
 
-void Shader::setVec2(const string& name, float x, float y) const {
+void Shader::setVec2(const char* name, float x, float y) const {
     glUniform2f(getUniformLocation(name), x, y);
 }
 
-void Shader::setVec3(const string& name, const glm::vec3& value) const {
+void Shader::setVec3(const char* name, const glm::vec3& value) const {
     glUniform3fv(getUniformLocation(name), 1, glm::value_ptr(value));
 }
 
-void Shader::setVec3(const string& name, float x, float y, float z) const {
+void Shader::setVec3(const char* name, float x, float y, float z) const {
     glUniform3f(getUniformLocation(name), x, y, z);
 }
 
-void Shader::setVec4(const string& name, const glm::vec4& value) const {
+void Shader::setVec4(const char* name, const glm::vec4& value) const {
     glUniform4fv(getUniformLocation(name), 1, glm::value_ptr(value));
 }
 
-void Shader::setVec4(const string& name, float x, float y, float z, float w) const {
+void Shader::setVec4(const char* name, float x, float y, float z, float w) const {
     glUniform4f(getUniformLocation(name), x, y, z, w);
 }
 
-void Shader::setVec2Array(const string& name, unsigned int count, const glm::vec2* valuePtr) const {
+void Shader::setVec2Array(const char* name, unsigned int count, const glm::vec2* valuePtr) const {
     glUniform2fv(getUniformLocation(name), count, glm::value_ptr(valuePtr[0]));
 }
 
-void Shader::setVec3Array(const string& name, unsigned int count, const glm::vec3* valuePtr) const {
+void Shader::setVec3Array(const char* name, unsigned int count, const glm::vec3* valuePtr) const {
     glUniform3fv(getUniformLocation(name), count, glm::value_ptr(valuePtr[0]));
 }
 
-void Shader::setVec4Array(const string& name, unsigned int count, const glm::vec4* valuePtr) const {
+void Shader::setVec4Array(const char* name, unsigned int count, const glm::vec4* valuePtr) const {
     glUniform4fv(getUniformLocation(name), count, glm::value_ptr(valuePtr[0]));
 }
 
-void Shader::setMat2(const string& name, const glm::mat2& value) const {
+void Shader::setMat2(const char* name, const glm::mat2& value) const {
     glUniformMatrix2fv(getUniformLocation(name), 1, false, glm::value_ptr(value));
 }
 
-void Shader::setMat3(const string& name, const glm::mat3& value) const {
+void Shader::setMat3(const char* name, const glm::mat3& value) const {
     glUniformMatrix3fv(getUniformLocation(name), 1, false, glm::value_ptr(value));
 }
 
-void Shader::setMat4(const string& name, const glm::mat4& value) const {
+void Shader::setMat4(const char* name, const glm::mat4& value) const {
     glUniformMatrix4fv(getUniformLocation(name), 1, false, glm::value_ptr(value));
 }
 
-void Shader::setMat2Array(const string& name, unsigned int count, const glm::mat2* valuePtr) const {
+void Shader::setMat2Array(const char* name, unsigned int count, const glm::mat2* valuePtr) const {
     glUniformMatrix2fv(getUniformLocation(name), count, false, glm::value_ptr(valuePtr[0]));
 }
 
-void Shader::setMat3Array(const string& name, unsigned int count, const glm::mat3* valuePtr) const {
+void Shader::setMat3Array(const char* name, unsigned int count, const glm::mat3* valuePtr) const {
     glUniformMatrix3fv(getUniformLocation(name), count, false, glm::value_ptr(valuePtr[0]));
 }
 
-void Shader::setMat4Array(const string& name, unsigned int count, const glm::mat4* valuePtr) const {
+void Shader::setMat4Array(const char* name, unsigned int count, const glm::mat4* valuePtr) const {
     glUniformMatrix4fv(getUniformLocation(name), count, false, glm::value_ptr(valuePtr[0]));
 }
 
 void Shader::setUniformBlockBinding(const string& name, unsigned int value) const {
-    unsigned int index = glGetUniformBlockIndex(programHandle_, name.c_str());
-    if (index == GL_INVALID_INDEX) {
-        cout << "Error: Failed to set uniform block binding \"" << name << "\".\n";
+    uniformBlockBindings_.emplace_back(name, value);    // Save the binding for variants that haven't been built yet, setting it doesn't force a variant to finish building.
+    for (const auto& variant : variants_) {
+        if (variant.second.resolved) {
+            applyUniformBlockBinding(variant.second, name, value);
+        }
     }
-    glUniformBlockBinding(programHandle_, index, value);
 }
 
-void Shader::use() const {
-    glUseProgram(programHandle_);
+void Shader::use(unsigned int variantKey) const {
+    auto variantIter = variants_.find(variantKey);
+    Variant& variant = (variantIter != variants_.end() ? variantIter->second : submit(variantKey));
+    if (!variant.resolved) {
+        resolve(variant);
+    }
+    activeVariant_ = &variant;
+    glUseProgram(variant.programHandle);
 }
 
-unsigned int Shader::compileShader(const string& filename, GLenum shaderType) {
+string Shader::readFile(const string& filename) {
     ifstream inputFile(filename);    // Open file and read the source code.
     if (!inputFile) {
         cout << "Error: Unable to open shader file \"" << filename << "\"." << endl;
-        return 0;
+        return "";
     }
     ostringstream fileStream;
     fileStream << inputFile.rdbuf();
-    string shaderString = fileStream.str();
-    const char* shaderCode = shaderString.c_str();
-    inputFile.close();
-    
-    unsigned int shaderHandle = glCreateShader(shaderType);    // Create shader and compile it.
+    return fileStream.str();
+}
+
+unsigned int Shader::compileShader(const string& source, GLenum shaderType) {
+    const char* shaderCode = source.c_str();
+    unsigned int shaderHandle = glCreateShader(shaderType);    // Create shader and compile it, the status is checked when the program resolves.
     glShaderSource(shaderHandle, 1, &shaderCode, nullptr);
     glCompileShader(shaderHandle);
+    return shaderHandle;
+}
+
+void Shader::loadSources(CompileMode compileMode) {
+    sources_.reserve(shaderFiles_.size());
+    for (const pair<string, GLenum>& shaderFile : shaderFiles_) {
+        sources_.push_back(readFile(shaderFile.first));
+        
+        istringstream sourceStream(sources_.back());    // Find the keywords declared in this stage, each stage can use any of them.
+        string line;
+        while (getline(sourceStream, line)) {
+            if (line.compare(0, 16, "#pragma keywords") != 0) {
+                continue;
+            }
+            istringstream lineStream(line.substr(16));
+            string keyword;
+            while (lineStream >> keyword) {
+                if (find(keywords_.begin(), keywords_.end(), keyword) == keywords_.end()) {
+                    keywords_.push_back(keyword);
+                }
+            }
+        }
+    }
+    if (keywords_.size() > MAX_NUM_KEYWORDS) {
+        cout << "Error: In shader \"" << shaderFiles_.back().first << "\": Too many keywords declared (" << keywords_.size() << ").\n";
+        keywords_.resize(MAX_NUM_KEYWORDS);
+    }
+    
+    if (compileMode == CompileAsync) {
+        submit(0);
+    }
+}
+
+string Shader::generateVariantSource(const string& source, unsigned int variantKey) const {
+    if (keywords_.empty()) {
+        return source;
+    }
+    size_t versionPos = source.find("#version");    // Definitions have to come after the version directive.
+    size_t insertPos = (versionPos == string::npos ? 0 : source.find('\n', versionPos));
+    insertPos = (insertPos == string::npos ? source.size() : insertPos + 1);
+    size_t lineNumber = count(source.begin(), source.begin() + insertPos, '\n') + 1;
+    
+    string definitions;
+    for (size_t i = 0; i < keywords_.size(); ++i) {    // Every keyword gets defined as 0 or 1 so it can also be used as a constant.
+        definitions += "#define " + keywords_[i] + ((variantKey & (1u << i)) != 0 ? " 1\n" : " 0\n");
+    }
+    definitions += "#line " + to_string(lineNumber) + "\n";    // Keep line numbers in compile errors matching the file.
+    return source.substr(0, insertPos) + definitions + source.substr(insertPos);
+}
+
+Shader::Variant& Shader::submit(unsigned int variantKey) const {
+    Variant& variant = variants_[variantKey];
+    vector<string> sources;
+    sources.reserve(sources_.size());
+    for (const string& source : sources_) {
+        sources.push_back(generateVariantSource(source, variantKey));
+    }
+    
+    variant.programHandle = glCreateProgram();
+    if (programCacheEnabled_) {    // The cache key covers every source and the driver, so editing a shader or updating the driver causes a miss.
+        uint64_t hash = CommonMath::hashFNV1a(driverIdentifier_.data(), driverIdentifier_.size());
+        for (size_t i = 0; i < shaderFiles_.size(); ++i) {
+            hash = CommonMath::hashFNV1a(&shaderFiles_[i].second, sizeof(GLenum), hash);
+            hash = CommonMath::hashFNV1a(sources[i].data(), sources[i].size() + 1, hash);
+        }
+        for (const string& varying : feedbackVaryings_) {    // The captured varyings are part of the linked program too.
+            hash = CommonMath::hashFNV1a(varying.data(), varying.size() + 1, hash);
+        }
+        char hashString[17];
+        snprintf(hashString, sizeof(hashString), "%016llx", static_cast<unsigned long long>(hash));
+        variant.cacheFilename = programCacheDirectory_ + "/" + hashString + ".bin";
+        
+        if (loadProgramBinary(variant)) {
+            return variant;
+        }
+        programParameteri(variant.programHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    
+    variant.pendingShaderHandles.reserve(shaderFiles_.size());
+    for (size_t i = 0; i < shaderFiles_.size(); ++i) {
+        variant.pendingShaderHandles.push_back(compileShader(sources[i], shaderFiles_[i].second));
+        glAttachShader(variant.programHandle, variant.pendingShaderHandles.back());
+    }
+    if (!feedbackVaryings_.empty()) {    // Must be set before linking.
+        vector<const char*> varyings;
+        varyings.reserve(feedbackVaryings_.size());
+        for (const string& varying : feedbackVaryings_) {
+            varyings.push_back(varying.c_str());
+        }
+        glTransformFeedbackVaryings(variant.programHandle, static_cast<GLsizei>(varyings.size()), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+    }
+    glLinkProgram(variant.programHandle);
+    return variant;
+}
+
+void Shader::resolve(Variant& variant) const {
+    if (!variant.pendingShaderHandles.empty()) {
+        int success;
+        glGetProgramiv(variant.programHandle, GL_LINK_STATUS, &success);
+        if (!success) {
+            for (size_t i = 0; i < variant.pendingShaderHandles.size(); ++i) {    // The link failed, find out if any of the shaders failed to compile first.
+                glGetShaderiv(variant.pendingShaderHandles[i], GL_COMPILE_STATUS, &success);
+                if (!success) {
+                    char infoLog[512];
+                    glGetShaderInfoLog(variant.pendingShaderHandles[i], 512, nullptr, infoLog);
+                    cout << "Error: In shader \"" << shaderFiles_[i].first << "\": " << infoLog << endl;
+                }
+            }
+            char infoLog[512];
+            glGetProgramInfoLog(variant.programHandle, 512, nullptr, infoLog);
+            cout << "Error: Failed to link shader: " << infoLog << endl;
+        } else if (programCacheEnabled_) {
+            saveProgramBinary(variant);
+        }
+        
+        for (unsigned int shaderHandle : variant.pendingShaderHandles) {    // Clean up the individual shader parts as they are no longer needed.
+            glDetachShader(variant.programHandle, shaderHandle);
+            glDeleteShader(shaderHandle);
+        }
+        variant.pendingShaderHandles.clear();
+    }
+    
+    int numAttributes;    // Record which attribute locations the program reads from.
+    glGetProgramiv(variant.programHandle, GL_ACTIVE_ATTRIBUTES, &numAttributes);
+    variant.attributeMask = 0;
+    for (int i = 0; i < numAttributes; ++i) {
+        char name[64];
+        int size;
+        GLenum type;
+        glGetActiveAttrib(variant.programHandle, i, sizeof(name), nullptr, &size, &type, name);
+        int location = glGetAttribLocation(variant.programHandle, name);
+        if (location >= 0 && location < 32) {    // Built-in inputs have no location.
+            variant.attributeMask |= 1u << location;
+        }
+    }
+    
+    variant.resolved = true;
+    for (const pair<string, unsigned int>& blockBinding : uniformBlockBindings_) {
+        applyUniformBlockBinding(variant, blockBinding.first, blockBinding.second);
+    }
+}
+
+Shader::Variant& Shader::getActiveVariant() const {
+    if (activeVariant_ == nullptr) {    // Uniforms are set on the default variant if use() hasn't been called yet.
+        auto variantIter = variants_.find(0);
+        activeVariant_ = &(variantIter != variants_.end() ? variantIter->second : submit(0));
+    }
+    if (!activeVariant_->resolved) {
+        resolve(*activeVariant_);
+    }
+    return *activeVariant_;
+}
+
+bool Shader::loadProgramBinary(Variant& variant) const {
+    ifstream inputFile(variant.cacheFilename, ios::binary);
+    if (!inputFile) {
+        return false;
+    }
+    GLenum binaryFormat;
+    inputFile.read(reinterpret_cast<char*>(&binaryFormat), sizeof(GLenum));
+    if (!inputFile) {
+        return false;
+    }
+    vector<char> binary((istreambuf_iterator<char>(inputFile)), istreambuf_iterator<char>());
+    if (binary.empty()) {
+        return false;
+    }
+    
+    programBinary(variant.programHandle, binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
     int success;
-    glGetShaderiv(shaderHandle, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(shaderHandle, 512, nullptr, infoLog);
-        cout << "Error: In shader \"" << filename << "\": " << infoLog << endl;
-        return 0;
+    glGetProgramiv(variant.programHandle, GL_LINK_STATUS, &success);
+    if (!success) {    // The driver may reject a binary at any time (for example after an update), a new program is needed before compiling from source.
+        glDeleteProgram(variant.programHandle);
+        variant.programHandle = glCreateProgram();
+        return false;
     }
+    return true;
+}
+
+void Shader::saveProgramBinary(const Variant& variant) const {
+    int binaryLength = 0;
+    glGetProgramiv(variant.programHandle, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+    if (binaryLength <= 0) {
+        return;
+    }
+    vector<char> binary(binaryLength);
+    GLenum binaryFormat;
+    getProgramBinary(variant.programHandle, binaryLength, nullptr, &binaryFormat, binary.data());
     
-    return shaderHandle;
+    ofstream outputFile(variant.cacheFilename, ios::binary | ios::trunc);
+    if (!outputFile) {
+        cout << "Warn: Unable to write shader program cache file \"" << variant.cacheFilename << "\".\n";
+        return;
+    }
+    outputFile.write(reinterpret_cast<const char*>(&binaryFormat), sizeof(GLenum));
+    outputFile.write(binary.data(), binary.size());
+}
+
+void Shader::applyUniformBlockBinding(const Variant& variant, const string& name, unsigned int value) const {
+    unsigned int index = glGetUniformBlockIndex(variant.programHandle, name.c_str());
+    if (index == GL_INVALID_INDEX) {
+        cout << "Error: Failed to set uniform block binding \"" << name << "\".\n";
+    }
+    glUniformBlockBinding(variant.programHandle, index, value);
 }
 
-int Shader::getUniformLocation(const string& name) const {
-    int location = glGetUniformLocation(programHandle_, name.c_str());
+int Shader::getUniformLocation(const char* name) const {
+    int location = glGetUniformLocation(getActiveVariant().programHandle, name);
     if (location == -1) {
         cout << "Error: Failed to set uniform \"" << name << "\".\n";
     }
@@ -7,45 +7,90 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
 class Shader {
     public:
-    Shader(const string& vertexShaderPath, const string& fragmentShaderPath);
-    Shader(const string& vertexShaderPath, const string& geometryShaderPath, const string& fragmentShaderPath);
+    enum CompileMode {
+        CompileAsync,    // Compile and link are issued right away, errors are checked the first time the program is used.
+        CompileOnDemand    // Nothing is compiled until the first time the program is used.
+    };
+    
+    static void initProgramCache(const string& cacheDirectory);    // Enables the linked program binary cache if ARB_get_program_binary is available. Requires a current OpenGL context.
+    static void initParallelCompile();    // Allows the driver to compile on background threads if KHR_parallel_shader_compile is available.
+    Shader(const string& vertexShaderPath, const string& fragmentShaderPath, CompileMode compileMode = CompileAsync);
+    Shader(const string& vertexShaderPath, const string& geometryShaderPath, const string& fragmentShaderPath, CompileMode compileMode = CompileAsync);
+    Shader(const string& vertexShaderPath, const vector<string>& feedbackVaryings, CompileMode compileMode = CompileAsync);    // Vertex only program that captures the varyings (interleaved, in the given order) with transform feedback. Draw with GL_RASTERIZER_DISCARD enabled.
     ~Shader();
+    unsigned int getKeywordMask(const char* keyword) const;    // Gets the bit for a keyword declared in the source (with "#pragma keywords"), variant keys are a combination of these.
+    void preloadVariant(unsigned int variantKey) const;    // Submits a variant for compiling ahead of the first time it is used.
+    bool isReady(unsigned int variantKey = 0) const;    // Checks if the variant has finished building (using it before then will stall until the driver is done).
     unsigned int getHandle() const;
-    void setFloat(const string& name, float value) const;
-    void setBool(const string& name, bool value) const;
-    void setInt(const string& name, int value) const;
-    void setUnsignedInt(const string& name, unsigned int value) const;
-    void setFloatArray(const string& name, unsigned int count, const float* valuePtr) const;
-    void setIntArray(const string& name, unsigned int count, const int* valuePtr) const;
-    void setUnsignedIntArray(const string& name, unsigned int count, const unsigned int* valuePtr) const;
-    void setVec2(const string& name, const glm::vec2& value) const;
-    void setVec2(const string& name, float x, float y) const;
-    void setVec3(const string& name, const glm::vec3& value) const;
-    void setVec3(const string& name, float x, float y, float z) const;
-    void setVec4(const string& name, const glm::vec4& value) const;
-    void setVec4(const string& name, float x, float y, float z, float w) const;
-    void setVec2Array(const string& name, unsigned int count, const glm::vec2* valuePtr) const;
-    void setVec3Array(const string& name, unsigned int count, const glm::vec3* valuePtr) const;
-    void setVec4Array(const string& name, unsigned int count, const glm::vec4* valuePtr) const;
-    void setMat2(const string& name, const glm::mat2& value) const;
-    void setMat3(const string& name, const glm::mat3& value) const;
-    void setMat4(const string& name, const glm::mat4& value) const;
-    void setMat2Array(const string& name, unsigned int count, const glm::mat2* valuePtr) const;
-    void setMat3Array(const string& name, unsigned int count, const glm::mat3* valuePtr) const;
-    void setMat4Array(const string& name, unsigned int count, const glm::mat4* valuePtr) const;
+    unsigned int getAttributeMask() const;    // Bitmask of vertex attribute locations used by the active variant (meshes use this to pick a position-only stream for depth passes).
+    void setFloat(const char* name, float value) const;    // Uniform names are taken as C strings so that setting one doesn't build a temporary string on the heap.
+    void setBool(const char* name, bool value) const;
+    void setInt(const char* name, int value) const;
+    void setUnsignedInt(const char* name, unsigned int value) const;
+    void setFloatArray(const char* name, unsigned int count, const float* valuePtr) const;
+    void setIntArray(const char* name, unsigned int count, const int* valuePtr) const;
+    void setUnsignedIntArray(const char* name, unsigned int count, const unsigned int* valuePtr) const;
+    void setVec2(const char* name, const glm::vec2& value) const;
+    void setVec2(const char* name, float x, float y) const;
+    void setVec3(const char* name, const glm::vec3& value) const;
+    void setVec3(const char* name, float x, float y, float z) const;
+    void setVec4(const char* name, const glm::vec4& value) const;
+    void setVec4(const char* name, float x, float y, float z, float w) const;
+    void setVec2Array(const char* name, unsigned int count, const glm::vec2* valuePtr) const;
+    void setVec3Array(const char* name, unsigned int count, const glm::vec3* valuePtr) const;
+    void setVec4Array(const char* name, unsigned int count, const glm::vec4* valuePtr) const;
+    void setMat2(const char* name, const glm::mat2& value) const;
+    void setMat3(const char* name, const glm::mat3& value) const;
+    void setMat4(const char* name, const glm::mat4& value) const;
+    void setMat2Array(const char* name, unsigned int count, const glm::mat2* valuePtr) const;
+    void setMat3Array(const char* name, unsigned int count, const glm::mat3* valuePtr) const;
+    void setMat4Array(const char* name, unsigned int count, const glm::mat4* valuePtr) const;
     void setUniformBlockBinding(const string& name, unsigned int value) const;
-    void use() const;
+    void use(unsigned int variantKey = 0) const;    // Binds the program variant with the given keywords enabled, uniforms are then set on this variant.
     
     private:
-    unsigned int programHandle_;
+    struct Variant {    // One #define-specialized program.
+        unsigned int programHandle;
+        bool resolved;
+        unsigned int attributeMask;    // Bit set for each vertex attribute location read by the program.
+        vector<unsigned int> pendingShaderHandles;    // Shaders still attached to the program while the link is in progress.
+        string cacheFilename;
+        
+        Variant() : programHandle(0), resolved(false), attributeMask(0) {}
+    };
+    
+    static constexpr unsigned int MAX_NUM_KEYWORDS = 32;
+    static bool programCacheEnabled_;
+    static string programCacheDirectory_;
+    static string driverIdentifier_;    // Vendor, renderer, and version strings. Program binaries are only valid for the driver that created them.
+    static bool parallelCompileEnabled_;
+    vector<pair<string, GLenum>> shaderFiles_;
+    vector<string> sources_;
+    vector<string> keywords_;
+    vector<string> feedbackVaryings_;
+    mutable unordered_map<unsigned int, Variant> variants_;    // Variants are built lazily, so they can change in const functions.
+    mutable Variant* activeVariant_;
+    mutable vector<pair<string, unsigned int>> uniformBlockBindings_;
     
-    static unsigned int compileShader(const string& filename, GLenum shaderType);
-    int getUniformLocation(const string& name) const;
+    static string readFile(const string& filename);
+    static unsigned int compileShader(const string& source, GLenum shaderType);
+    void loadSources(CompileMode compileMode);
+    string generateVariantSource(const string& source, unsigned int variantKey) const;
+    Variant& submit(unsigned int variantKey) const;    // Issues the compile and link commands without checking the results.
+    void resolve(Variant& variant) const;    // Waits for the link to finish, reports errors, and applies state that was set before the program existed.
+    Variant& getActiveVariant() const;
+    bool loadProgramBinary(Variant& variant) const;
+    void saveProgramBinary(const Variant& variant) const;
+    void applyUniformBlockBinding(const Variant& variant, const string& name, unsigned int value) const;
+    int getUniformLocation(const char* name) const;
 };
 
 #endif
@@ -29,14 +29,14 @@ const string& Text::getString() const {
     return text_;
 }
 
-void Text::setString(const string& text) {
+void Text::setString(string_view text) {
     if (text_ == text) {
         return;
     }
-    text_ = text;
+    text_.assign(text.data(), text.size());
     
-    vector<glm::vec4> vertices;
-    vertices.reserve(6 * text_.length());
+    vertices_.clear();
+    vertices_.reserve(6 * text_.length());
     float xPosition = 0.0f, yPosition = 0.0f;
     for (char c : text_) {
         auto findResult = font_->getGlyphs().find(c);
@@ -57,27 +57,27 @@ void Text::setString(const string& text) {
             glm::vec2 posTex((static_cast<unsigned int>(c) % 16) * font_->getGlyphSizeMax().x / static_cast<float>(font_->getBitmapSize().x), (static_cast<unsigned int>(c) / 16) * font_->getGlyphSizeMax().y / static_cast<float>(font_->getBitmapSize().y));
             glm::vec2 sizeTex(g->size.x / static_cast<float>(font_->getBitmapSize().x), g->size.y / static_cast<float>(font_->getBitmapSize().y));
             
-            vertices.emplace_back(pos.x,          pos.y + size.y, posTex.x,             posTex.y            );
-            vertices.emplace_back(pos.x,          pos.y,          posTex.x,             posTex.y + sizeTex.y);
-            vertices.emplace_back(pos.x + size.x, pos.y,          posTex.x + sizeTex.x, posTex.y + sizeTex.y);
+            vertices_.emplace_back(pos.x,          pos.y + size.y, posTex.x,             posTex.y            );
+            vertices_.emplace_back(pos.x,          pos.y,          posTex.x,             posTex.y + sizeTex.y);
+            vertices_.emplace_back(pos.x + size.x, pos.y,          posTex.x + sizeTex.x, posTex.y + sizeTex.y);
             
-            vertices.emplace_back(pos.x,          pos.y + size.y, posTex.x,             posTex.y            );
-            vertices.emplace_back(pos.x + size.x, pos.y,          posTex.x + sizeTex.x, posTex.y + sizeTex.y);
-            vertices.emplace_back(pos.x + size.x, pos.y + size.y, posTex.x + sizeTex.x, posTex.y            );
+            vertices_.emplace_back(pos.x,          pos.y + size.y, posTex.x,             posTex.y            );
+            vertices_.emplace_back(pos.x + size.x, pos.y,          posTex.x + sizeTex.x, posTex.y + sizeTex.y);
+            vertices_.emplace_back(pos.x + size.x, pos.y + size.y, posTex.x + sizeTex.x, posTex.y            );
             
             xPosition += (g->advance >> 6);    // Move to next position (advance has units of 1/64 pixels).
         }
     }
-    numVertices_ = static_cast<unsigned int>(vertices.size());
+    numVertices_ = static_cast<unsigned int>(vertices_.size());
     
     glBindVertexArray(vertexArrayHandle_);
     glBindBuffer(GL_ARRAY_BUFFER, vertexBufferHandle_);
     int bufferSize;
     glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &bufferSize);
-    if (bufferSize < static_cast<int>(vertices.size() * sizeof(glm::vec4))) {
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec4), vertices.data(), GL_DYNAMIC_DRAW);
+    if (bufferSize < static_cast<int>(vertices_.size() * sizeof(glm::vec4))) {
+        glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(glm::vec4), vertices_.data(), GL_DYNAMIC_DRAW);
     } else {
-        glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(glm::vec4), vertices.data());
+        glBufferSubData(GL_ARRAY_BUFFER, 0, vertices_.size() * sizeof(glm::vec4), vertices_.data());
     }
 }
 
@@ -10,6 +10,8 @@ class Shader;
 #include <glm/gtc/type_ptr.hpp>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 using namespace std;
 
@@ -21,13 +23,14 @@ class Text : public DrawableInterface {
     ~Text();
     void setFont(shared_ptr<Font> font);
     const string& getString() const;
-    void setString(const string& text);
+    void setString(string_view text);    // Rebuilds the vertices only if the text changed.
     void draw(const Shader& shader, const glm::mat4& modelMtx) const;
     
     private:
     shared_ptr<Font> font_;
     unsigned int vertexArrayHandle_, vertexBufferHandle_;
     string text_;
+    vector<glm::vec4> vertices_;    // Kept between calls to setString() so the capacity gets reused.
     unsigned int numVertices_;
 };
 
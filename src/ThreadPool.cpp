@@ -0,0 +1,141 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace {
+    thread_local const void* currentPool = nullptr;    // Lets submit() find the queue of the worker it's called from.
+    thread_local unsigned int currentWorker = 0;
+}
+
+ThreadPool::TaskGroup::TaskGroup() {
+    numPending_ = 0;
+}
+
+bool ThreadPool::TaskGroup::isDone() const {
+    return numPending_ == 0;
+}
+
+ThreadPool::ThreadPool(unsigned int numThreads) {
+    numQueued_ = 0;
+    nextQueue_ = 0;
+    exiting_ = false;
+    if (numThreads == 0) {
+        numThreads = max(thread::hardware_concurrency(), 2u) - 1;
+    }
+    queues_.reserve(numThreads);
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        queues_.push_back(make_unique<WorkQueue>());
+    }
+    workers_.reserve(numThreads);
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(sleepMutex_);
+        exiting_ = true;
+    }
+    sleepCondition_.notify_all();
+    for (thread& t : workers_) {
+        t.join();
+    }
+}
+
+unsigned int ThreadPool::getNumThreads() const {
+    return static_cast<unsigned int>(workers_.size());
+}
+
+void ThreadPool::submit(TaskGroup& group, function<void()>&& task) {
+    ++group.numPending_;
+    unsigned int queueIndex;
+    if (currentPool == this) {
+        queueIndex = currentWorker;
+    } else {
+        queueIndex = nextQueue_++ % static_cast<unsigned int>(queues_.size());
+    }
+    {
+        lock_guard<mutex> lock(queues_[queueIndex]->queueMutex);
+        queues_[queueIndex]->tasks.push_front({move(task), &group});
+        ++numQueued_;    // Inside the queue lock, so a thief can't take the task and decrement the count before it's counted.
+    }
+    {
+        lock_guard<mutex> lock(sleepMutex_);    // Taking the lock makes sure a worker about to sleep sees the new task.
+    }
+    sleepCondition_.notify_one();
+}
+
+void ThreadPool::parallelFor(TaskGroup& group, size_t count, size_t grainSize, const function<void(size_t, size_t)>& body) {
+    assert(grainSize > 0);
+    for (size_t begin = 0; begin < count; begin += grainSize) {
+        size_t end = min(begin + grainSize, count);
+        submit(group, [body, begin, end] {
+            body(begin, end);
+        });
+    }
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+    unsigned int firstQueue = (currentPool == this ? currentWorker : 0);
+    while (!group.isDone()) {
+        Task task;
+        if (tryPopTask(firstQueue, task)) {
+            runTask(task);
+        } else {
+            unique_lock<mutex> lock(group.doneMutex_);    // Remaining tasks are already running on the workers.
+            group.doneCondition_.wait(lock, [&group] { return group.isDone(); });
+        }
+    }
+    lock_guard<mutex> lock(group.doneMutex_);    // Wait for the last task to let go of the group, the caller may destroy it after this.
+}
+
+void ThreadPool::workerLoop(unsigned int index) {
+    currentPool = this;
+    currentWorker = index;
+    while (true) {
+        Task task;
+        if (tryPopTask(index, task)) {
+            runTask(task);
+            continue;
+        }
+        unique_lock<mutex> lock(sleepMutex_);
+        sleepCondition_.wait(lock, [this] { return exiting_ || numQueued_ > 0; });
+        if (exiting_ && numQueued_ == 0) {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::tryPopTask(unsigned int firstQueue, Task& task) {
+    if (numQueued_ == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        WorkQueue& queue = *queues_[(firstQueue + i) % queues_.size()];
+        lock_guard<mutex> lock(queue.queueMutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {    // Newest task from our own queue is the most likely to be in cache.
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+        } else {
+            task = move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        --numQueued_;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::runTask(Task& task) {
+    task.work();
+    TaskGroup& group = *task.group;
+    lock_guard<mutex> lock(group.doneMutex_);    // Counting down under the lock keeps the group alive until the notify is finished.
+    if (--group.numPending_ == 0) {
+        group.doneCondition_.notify_all();
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class ThreadPool {    // General worker threads for splitting up CPU work. Each worker has its own task queue and steals from the others when it runs dry, so uneven tasks still balance out.
+    public:
+    class TaskGroup {    // Counts the tasks submitted with it so they can be waited on together.
+        public:
+        TaskGroup();
+        TaskGroup(const TaskGroup& group) = delete;
+        TaskGroup& operator=(const TaskGroup& group) = delete;
+        bool isDone() const;
+        
+        private:
+        atomic<size_t> numPending_;
+        mutex doneMutex_;
+        condition_variable doneCondition_;
+        
+        friend class ThreadPool;
+    };
+    
+    ThreadPool(unsigned int numThreads = 0);    // Uses one less than the number of hardware threads if numThreads is zero.
+    ~ThreadPool();    // Finishes all queued tasks before joining the workers.
+    ThreadPool(const ThreadPool& pool) = delete;
+    ThreadPool& operator=(const ThreadPool& pool) = delete;
+    unsigned int getNumThreads() const;
+    void submit(TaskGroup& group, function<void()>&& task);    // Tasks submitted from a worker go to the front of its own queue, others are spread across the workers.
+    void parallelFor(TaskGroup& group, size_t count, size_t grainSize, const function<void(size_t, size_t)>& body);    // Submits body(begin, end) for each range of up to grainSize items in [0, count). The body is copied into each task.
+    void wait(TaskGroup& group);    // Runs queued tasks on the calling thread until the whole group is done.
+    
+    private:
+    struct Task {
+        function<void()> work;
+        TaskGroup* group;
+    };
+    struct WorkQueue {
+        mutex queueMutex;
+        deque<Task> tasks;    // The owner pops from the front, thieves take from the back.
+    };
+    
+    vector<thread> workers_;
+    vector<unique_ptr<WorkQueue>> queues_;
+    atomic<size_t> numQueued_;
+    atomic<unsigned int> nextQueue_;
+    mutex sleepMutex_;
+    condition_variable sleepCondition_;
+    bool exiting_;
+    
+    void workerLoop(unsigned int index);
+    bool tryPopTask(unsigned int firstQueue, Task& task);    // Checks the given queue first and then steals from the rest.
+    void runTask(Task& task);
+};
+
+#endif
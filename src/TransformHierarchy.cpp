@@ -0,0 +1,177 @@
+#include "CommonMath.h"
+#include "TransformHierarchy.h"
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+TransformHierarchy::TransformHierarchy(ThreadPool* threadPool) :
+    threadPool_(threadPool),
+    levelOffsets_(1, 0),
+    orderChanged_(false),
+    anyDirty_(false),
+    orderVersion_(0) {
+}
+
+unsigned int TransformHierarchy::addNode() {
+    unsigned int handle = static_cast<unsigned int>(handleSlots_.size());
+    positions_.emplace_back(0.0f);
+    orientations_.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+    scales_.emplace_back(1.0f);
+    worldTransforms_.emplace_back(1.0f);
+    parentSlots_.push_back(-1);
+    dirty_.push_back(1);
+    slotHandles_.push_back(handle);
+    handleSlots_.push_back(static_cast<unsigned int>(positions_.size() - 1));
+    parentHandles_.push_back(-1);
+    orderChanged_ = true;    // Roots go in the first level, so the new node is out of place at the back.
+    anyDirty_ = true;
+    return handle;
+}
+
+void TransformHierarchy::setParent(unsigned int handle, int parentHandle) {
+    assert(parentHandle < static_cast<int>(parentHandles_.size()) && parentHandle != static_cast<int>(handle));
+    parentHandles_[handle] = parentHandle;
+    dirty_[handleSlots_[handle]] = 1;
+    orderChanged_ = true;
+    anyDirty_ = true;
+}
+
+int TransformHierarchy::getParent(unsigned int handle) const {
+    return parentHandles_[handle];
+}
+
+void TransformHierarchy::setLocalTransform(unsigned int handle, const glm::vec3& position, const glm::quat& orientation, const glm::vec3& scale) {
+    unsigned int slot = handleSlots_[handle];
+    positions_[slot] = position;
+    orientations_[slot] = orientation;
+    scales_[slot] = scale;
+    dirty_[slot] = 1;
+    anyDirty_ = true;
+}
+
+const glm::mat4& TransformHierarchy::getWorldTransform(unsigned int handle) const {
+    return worldTransforms_[handleSlots_[handle]];
+}
+
+size_t TransformHierarchy::getNumNodes() const {
+    return handleSlots_.size();
+}
+
+unsigned int TransformHierarchy::getNumLevels() const {
+    return static_cast<unsigned int>(levelOffsets_.size() - 1);
+}
+
+void TransformHierarchy::update() {
+    if (orderChanged_) {
+        sortByDepth();
+    }
+    if (!anyDirty_) {
+        return;
+    }
+    for (size_t level = 0; level + 1 < levelOffsets_.size(); ++level) {
+        size_t levelBegin = levelOffsets_[level], levelSize = levelOffsets_[level + 1] - levelBegin;
+        if (threadPool_ == nullptr || levelSize <= GRAIN_SIZE) {
+            updateNodes(levelBegin, levelBegin + levelSize);
+            continue;
+        }
+        threadPool_->parallelFor(taskGroup_, levelSize, GRAIN_SIZE, [this, levelBegin](size_t begin, size_t end) {
+            updateNodes(levelBegin + begin, levelBegin + end);
+        });
+        threadPool_->wait(taskGroup_);
+    }
+    fill(dirty_.begin(), dirty_.end(), 0);
+    anyDirty_ = false;
+}
+
+const vector<glm::mat4>& TransformHierarchy::getWorldTransforms() const {
+    return worldTransforms_;
+}
+
+const vector<int>& TransformHierarchy::getParentSlots() const {
+    return parentSlots_;
+}
+
+const vector<unsigned int>& TransformHierarchy::getSlotHandles() const {
+    return slotHandles_;
+}
+
+unsigned int TransformHierarchy::getSlot(unsigned int handle) const {
+    return handleSlots_[handle];
+}
+
+unsigned int TransformHierarchy::getOrderVersion() const {
+    return orderVersion_;
+}
+
+void TransformHierarchy::sortByDepth() {
+    size_t numNodes = parentHandles_.size();
+    vector<int> depths(numNodes, -1);
+    vector<unsigned int> path;
+    int maxDepth = 0;
+    for (size_t i = 0; i < numNodes; ++i) {    // Walks up to the first node with a known depth, then fills in the path back down.
+        int handle = static_cast<int>(i);
+        path.clear();
+        while (handle != -1 && depths[handle] == -1) {
+            path.push_back(handle);
+            if (path.size() > numNodes) {
+                throw runtime_error("Transform hierarchy contains a cycle.");
+            }
+            handle = parentHandles_[handle];
+        }
+        int depth = (handle != -1 ? depths[handle] : -1);
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            depths[*it] = ++depth;
+        }
+        maxDepth = max(maxDepth, depth);
+    }
+    
+    levelOffsets_.assign(maxDepth + 2, 0);
+    for (size_t i = 0; i < numNodes; ++i) {
+        ++levelOffsets_[depths[i] + 1];
+    }
+    for (size_t i = 1; i < levelOffsets_.size(); ++i) {
+        levelOffsets_[i] += levelOffsets_[i - 1];
+    }
+    vector<size_t> nextSlots(levelOffsets_.begin(), levelOffsets_.end() - 1);
+    vector<unsigned int> handleSlots(numNodes);
+    for (size_t i = 0; i < numNodes; ++i) {    // Counting sort, nodes in the same level stay in handle order.
+        handleSlots[i] = static_cast<unsigned int>(nextSlots[depths[i]]++);
+    }
+    
+    vector<glm::vec3> positions(numNodes), scales(numNodes);
+    vector<glm::quat> orientations(numNodes);
+    vector<glm::mat4> worldTransforms(numNodes);
+    vector<int> parentSlots(numNodes);
+    vector<uint8_t> dirty(numNodes);
+    for (size_t i = 0; i < numNodes; ++i) {
+        unsigned int oldSlot = handleSlots_[i], slot = handleSlots[i];
+        positions[slot] = positions_[oldSlot];
+        orientations[slot] = orientations_[oldSlot];
+        scales[slot] = scales_[oldSlot];
+        worldTransforms[slot] = worldTransforms_[oldSlot];
+        dirty[slot] = dirty_[oldSlot];
+        parentSlots[slot] = (parentHandles_[i] != -1 ? static_cast<int>(handleSlots[parentHandles_[i]]) : -1);
+        slotHandles_[slot] = static_cast<unsigned int>(i);
+    }
+    positions_.swap(positions);
+    orientations_.swap(orientations);
+    scales_.swap(scales);
+    worldTransforms_.swap(worldTransforms);
+    parentSlots_.swap(parentSlots);
+    dirty_.swap(dirty);
+    handleSlots_.swap(handleSlots);
+    orderChanged_ = false;
+    ++orderVersion_;
+}
+
+void TransformHierarchy::updateNodes(size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        int parentSlot = parentSlots_[i];
+        if (!dirty_[i] && (parentSlot < 0 || !dirty_[parentSlot])) {
+            continue;
+        }
+        glm::mat4 localTransform = CommonMath::composeTransform(positions_[i], orientations_[i], scales_[i]);
+        worldTransforms_[i] = (parentSlot >= 0 ? worldTransforms_[parentSlot] * localTransform : localTransform);
+        dirty_[i] = 1;    // Passes the change down to the next level.
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef TRANSFORM_HIERARCHY_H_
+#define TRANSFORM_HIERARCHY_H_
+
+#include "ThreadPool.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+class TransformHierarchy {    // Local and world transforms for a forest of nodes, stored as a structure of arrays sorted by depth so every parent comes before its children. The world update goes one depth level at a time, with each level split across the thread pool. Nodes are referred to by handles that stay the same when the arrays get sorted again.
+    public:
+    static constexpr size_t GRAIN_SIZE = 2048;    // Nodes per task in the world update, smaller levels run on the calling thread.
+    
+    TransformHierarchy(ThreadPool* threadPool = nullptr);
+    TransformHierarchy(const TransformHierarchy& hierarchy) = delete;
+    TransformHierarchy& operator=(const TransformHierarchy& hierarchy) = delete;
+    unsigned int addNode();    // Adds a root node with no transform and returns its handle.
+    void setParent(unsigned int handle, int parentHandle);    // A parent of -1 makes the node a root. The arrays get sorted again on the next update().
+    int getParent(unsigned int handle) const;
+    void setLocalTransform(unsigned int handle, const glm::vec3& position, const glm::quat& orientation, const glm::vec3& scale);    // Flags the node, it and everything below it get a new world transform in the next update().
+    const glm::mat4& getWorldTransform(unsigned int handle) const;    // As of the last update().
+    size_t getNumNodes() const;
+    unsigned int getNumLevels() const;    // As of the last update().
+    void update();
+    const vector<glm::mat4>& getWorldTransforms() const;    // Indexed by slot, which is the position in depth order.
+    const vector<int>& getParentSlots() const;    // Parent slot of each slot, -1 for roots.
+    const vector<unsigned int>& getSlotHandles() const;
+    unsigned int getSlot(unsigned int handle) const;
+    unsigned int getOrderVersion() const;    // Changes each time the slots are sorted again.
+    
+    private:
+    ThreadPool* threadPool_;
+    ThreadPool::TaskGroup taskGroup_;
+    vector<glm::vec3> positions_;    // Local transform components and the rest are all indexed by slot.
+    vector<glm::quat> orientations_;
+    vector<glm::vec3> scales_;
+    vector<glm::mat4> worldTransforms_;
+    vector<int> parentSlots_;
+    vector<uint8_t> dirty_;
+    vector<unsigned int> slotHandles_, handleSlots_;
+    vector<int> parentHandles_;    // Indexed by handle, the slots are sorted from this.
+    vector<size_t> levelOffsets_;    // Start of each depth level in the slots, with the end at the back.
+    bool orderChanged_;
+    bool anyDirty_;
+    unsigned int orderVersion_;
+    
+    void sortByDepth();
+    void updateNodes(size_t begin, size_t end);    // Parents are in earlier levels, so the nodes in one level can update in parallel.
+};
+
+#endif
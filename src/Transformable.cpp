@@ -7,6 +7,8 @@ Transformable::Transformable() :
     transformChanged_(true) {
 }
 
+Transformable::~Transformable() {}
+
 const glm::vec3& Transformable::getPosition() const {
     return position_;
 }
@@ -14,6 +16,7 @@ const glm::vec3& Transformable::getPosition() const {
 void Transformable::setPosition(const glm::vec3& position) {
     position_ = position;
     transformChanged_ = true;
+    onTransformChanged();
 }
 
 const glm::quat& Transformable::getOrientation() const {
@@ -23,6 +26,7 @@ const glm::quat& Transformable::getOrientation() const {
 void Transformable::setOrientation(const glm::quat& orientation) {
     orientation_ = orientation;
     transformChanged_ = true;
+    onTransformChanged();
 }
 
 const glm::vec3& Transformable::getScale() const {
@@ -32,6 +36,7 @@ const glm::vec3& Transformable::getScale() const {
 void Transformable::setScale(const glm::vec3& scale) {
     scale_ = scale;
     transformChanged_ = true;
+    onTransformChanged();
 }
 
 const glm::mat4& Transformable::getTransform() const {
@@ -81,3 +86,5 @@ void Transformable::lookAt(const glm::vec3& point, const glm::vec3& upVec) {
     Result[3][2] = dot(f, eye);
     return Result;*/
 }
+
+void Transformable::onTransformChanged() {}
@@ -10,6 +10,7 @@ using namespace std;
 class Transformable {
     public:
     Transformable();
+    virtual ~Transformable();
     const glm::vec3& getPosition() const;
     void setPosition(const glm::vec3& position);
     const glm::quat& getOrientation() const;
@@ -22,6 +23,9 @@ class Transformable {
     void scale(const glm::vec3& factor);
     void lookAt(const glm::vec3& point, const glm::vec3& upVec);
     
+    protected:
+    virtual void onTransformChanged();    // Called after any change to the position, orientation, or scale.
+    
     private:
     glm::vec3 position_;
     glm::quat orientation_;
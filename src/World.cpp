@@ -11,7 +11,8 @@ float World::calcLightRadius(const glm::vec3& color, const glm::vec3& attenuatio
     return (-attenuation.y + sqrt(attenuation.y * attenuation.y - 4.0f * attenuation.z * (attenuation.x - intensityMax / cutoffIntensity))) / (2.0f * attenuation.z);
 }
 
-World::World() :
+World::World(AnimationSystem* animationSystem) :
+    animationSystem_(animationSystem),
     flashlightOn_(false),
     sunlightOn_(true),
     lampsOn_(false),
@@ -32,14 +33,29 @@ World::World() :
     sceneTestTransform_.setPosition(glm::vec3(0.0f, 0.13625f, 0.0f));
     
     modelTest_.loadFile("models/bob_lamp_update/bob_lamp_update.md5mesh", &modelTestAnimations_);
+    modelTestAnimations_.at("").resampleUniform(1.0);    // The md5 keys are already one tick apart, so this only switches the lookups to index arithmetic.
     modelTest_.setArmatureRootInv(glm::inverse(glm::mat4({1.0, 0.0, 0.0, 0.0}, {0.0, 0.0, -1.0, 0.0}, {0.0, 1.0, 0.0, 0.0}, {0.0, 0.0, 0.0, 1.0})));
     //modelTest_.loadFile("models/hellknight/hellknight.md5mesh");
     //modelTest_.loadFile("models/spaceship/Intergalactic Spaceship_Blender_2.8_Packed textures.dae");
     modelTestTransform_.setScale(glm::vec3(0.3f));
     modelTestTransform_.setPosition(glm::vec3(0.0f, 0.0f, 2.0f));
     
-    assert(modelTest_.boneOffsetMatrices_.size() <= ModelRigged::MAX_NUM_BONES);
-    modelTestBoneTransforms_.resize(modelTest_.boneOffsetMatrices_.size(), glm::mat4(1.0f));
+    modelTestInstance_ = animationSystem_->addInstance(modelTest_, modelTestAnimations_.at(""));
+    animationSystem_->setPreSkinning(modelTest_, true);    // Drawn by all three shadow cascades and the geometry pass.
+    animationSystem_->setModelMtx(modelTestInstance_, modelTestTransform_.getTransform());
+    
+    crowdAnimations_ = make_unique<AnimationTexture>(modelTest_);    // Background crowd that plays the baked animation, nothing is evaluated for these on the CPU.
+    unsigned int crowdClip = crowdAnimations_->addClip(modelTestAnimations_.at(""));
+    crowdAnimations_->upload();
+    crowd_ = make_unique<Crowd>(modelTest_, *crowdAnimations_);
+    mt19937 crowdRandom(1);
+    uniform_real_distribution<float> crowdTimeOffset(0.0f, 10.0f);
+    for (int x = 0; x < 32; ++x) {
+        for (int z = 0; z < 32; ++z) {
+            glm::mat4 modelMtx = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(-12.0f + x * 0.75f, 0.0f, -20.0f - z * 0.75f)), glm::vec3(0.3f));
+            crowd_->addInstance(modelMtx, crowdClip, crowdTimeOffset(crowdRandom));
+        }
+    }
     
     sunLight_.color = glm::vec3(1.0f, 1.0f, 1.0f);
     //sunLight_.phongVals = glm::vec3(0.01f, 0.4f, 0.5f);
@@ -118,13 +134,12 @@ void World::nextTick() {
         sunPosition_.x = 0.00001f;
     }
     
-    modelTest_.animate(modelTestAnimations_.at(""), glfwGetTime(), modelTestBoneTransforms_);
+    animationSystem_->setModelMtx(modelTestInstance_, modelTestTransform_.getTransform());
     
     debugVectors_.resize(1);
-    /*const ModelRigged::Node* node;
-    node = modelTest_.findNode("head");
-    if (node != nullptr) {
-        debugVectors_[3] = modelTestTransform_.getTransform() * glm::inverse(modelTest_.getArmatureRootInv()) * modelTestBoneTransforms_[node->boneIndex] * glm::inverse(modelTest_.boneOffsetMatrices_[node->boneIndex]);
+    /*int boneIndex = modelTest_.findBoneIndex("head");
+    if (boneIndex != -1) {
+        debugVectors_[3] = modelTestTransform_.getTransform() * glm::inverse(modelTest_.getArmatureRootInv()) * animationSystem_->getBoneTransforms(modelTestInstance_)[boneIndex] * glm::inverse(modelTest_.boneOffsetMatrices_[boneIndex]);
     }*/
     
     glBindVertexArray(debugVectorsVAO_);
@@ -2,6 +2,9 @@
 #define WORLD_H_
 
 #include "Animation.h"
+#include "AnimationSystem.h"
+#include "AnimationTexture.h"
+#include "Crowd.h"
 #include "ModelRigged.h"
 #include "ModelStatic.h"
 #include "RenderApp.h"
@@ -9,6 +12,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -46,9 +50,13 @@ class World {
     Mesh lightCube_, lightSphere_, lightCone_, cube1_, sphere1_;
     ModelStatic sceneTest_;
     ModelRigged modelTest_;
-    vector<glm::mat4> modelTestBoneTransforms_;
+    AnimationSystem* animationSystem_;
+    unsigned int modelTestInstance_;
     unordered_map<string, Animation> modelTestAnimations_;
     Transformable sceneTestTransform_, modelTestTransform_;
+    mutable vector<Mesh::LodState> sceneTestLodStates_;    // Updated each time sceneTest_ is drawn.
+    unique_ptr<AnimationTexture> crowdAnimations_;
+    unique_ptr<Crowd> crowd_;
     DirectionalLight sunLight_, moonLight_;
     vector<PointLight> pointLights_;
     vector<SpotLight> spotLights_;
@@ -59,7 +67,7 @@ class World {
     vector<glm::mat4> debugVectors_;
     
     static float calcLightRadius(const glm::vec3& color, const glm::vec3& attenuation);    // Determine the maximum bounds of a light source given the color and attenuation factors.
-    World();
+    World(AnimationSystem* animationSystem);
     ~World();
     void nextTick();
     
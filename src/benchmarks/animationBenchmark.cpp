@@ -0,0 +1,100 @@
+#include "../Animation.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// Measures Animation::sampleChannel() for one channel played back in order, against the linear key scan it used before cursors. Build it in release with Animation.cpp and what it links against (BinaryModel.cpp, CommonMath.cpp, MappedFile.cpp, and assimp).
+
+constexpr unsigned int NUM_KEYS = 600;
+constexpr double TICKS_PER_KEY = 1.0;
+constexpr unsigned int NUM_SAMPLES = 1000000;
+constexpr unsigned int NUM_LOOPS = 8;    // Playback wraps around this many times, so the cursor also has to recover from jumping back.
+
+namespace {
+    template<typename T, typename Mix>
+    T scanKeys(const vector<pair<T, double>>& keys, double animationTime, Mix mix) {    // The lookup from before, starting at the first key on every call.
+        if (keys.size() == 1) {
+            return keys[0].first;
+        }
+        unsigned int i = 0;
+        while (i < keys.size() - 1) {
+            if (animationTime < keys[i + 1].second) {
+                break;
+            }
+            ++i;
+        }
+        float t = static_cast<float>((animationTime - keys[i].second) / (keys[i + 1].second - keys[i].second));
+        return mix(keys[i].first, keys[i + 1].first, t);
+    }
+    
+    void scanChannel(const Animation::Channel& channel, double animationTime, glm::vec3* translation, glm::quat* rotation, glm::vec3* scale) {
+        *translation = scanKeys(channel.translationKeys, animationTime, [](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); });
+        *rotation = scanKeys(channel.rotationKeys, animationTime, [](const glm::quat& a, const glm::quat& b, float t) { return glm::slerp(a, b, t); });
+        *scale = scanKeys(channel.scalingKeys, animationTime, [](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); });
+    }
+    
+    template<typename Sample>
+    double measureNsPerSample(const Animation& animation, Sample sample, float* checksum) {
+        double duration = animation.duration_;
+        double step = duration * NUM_LOOPS / NUM_SAMPLES;
+        float sum = 0.0f;
+        auto startTime = chrono::steady_clock::now();
+        for (unsigned int i = 0; i < NUM_SAMPLES; ++i) {
+            glm::vec3 translation, scale;
+            glm::quat rotation;
+            sample(fmod(i * step, duration), &translation, &rotation, &scale);
+            sum += translation.x + translation.y + rotation.w * rotation.x + scale.x;    // Keeps the results alive. The rotation term ignores the sign of the quaternion, so compressed keys land close to the rest.
+        }
+        double elapsedNs = chrono::duration<double, nano>(chrono::steady_clock::now() - startTime).count();
+        *checksum = sum;
+        return elapsedNs / NUM_SAMPLES;
+    }
+}
+
+int main() {
+    Animation animation("benchmark", (NUM_KEYS - 1) * TICKS_PER_KEY, 30.0);
+    Animation::Channel& channel = animation.channels_["node"];
+    for (unsigned int i = 0; i < NUM_KEYS; ++i) {
+        double keyTime = i * TICKS_PER_KEY;
+        channel.translationKeys.emplace_back(glm::vec3(sin(keyTime * 0.1), cos(keyTime * 0.07), keyTime * 0.01), keyTime);
+        channel.rotationKeys.emplace_back(glm::angleAxis(static_cast<float>(keyTime * 0.05), glm::normalize(glm::vec3(1.0f, 2.0f, 3.0f))), keyTime);
+        channel.scalingKeys.emplace_back(glm::vec3(1.0f + 0.1f * static_cast<float>(sin(keyTime * 0.03))), keyTime);
+    }
+    Animation uniformAnimation = animation;
+    uniformAnimation.resampleUniform(TICKS_PER_KEY);    // Same spacing as the source keys, so the samples don't change.
+    const Animation::Channel& uniformChannel = uniformAnimation.channels_.at("node");
+    Animation compressedAnimation = animation;
+    compressedAnimation.compress();
+    const Animation::Channel& compressedChannel = compressedAnimation.channels_.at("node");
+    
+    float scanChecksum, searchChecksum, cursorChecksum, uniformChecksum, compressedChecksum;
+    double scanNs = measureNsPerSample(animation, [&channel](double t, glm::vec3* translation, glm::quat* rotation, glm::vec3* scale) {
+        scanChannel(channel, t, translation, rotation, scale);
+    }, &scanChecksum);
+    double searchNs = measureNsPerSample(animation, [&animation, &channel](double t, glm::vec3* translation, glm::quat* rotation, glm::vec3* scale) {
+        animation.sampleChannel(channel, t, nullptr, translation, rotation, scale);
+    }, &searchChecksum);
+    Animation::KeyCursor cursor;
+    double cursorNs = measureNsPerSample(animation, [&animation, &channel, &cursor](double t, glm::vec3* translation, glm::quat* rotation, glm::vec3* scale) {
+        animation.sampleChannel(channel, t, &cursor, translation, rotation, scale);
+    }, &cursorChecksum);
+    double uniformNs = measureNsPerSample(uniformAnimation, [&uniformAnimation, &uniformChannel](double t, glm::vec3* translation, glm::quat* rotation, glm::vec3* scale) {
+        uniformAnimation.sampleChannel(uniformChannel, t, nullptr, translation, rotation, scale);
+    }, &uniformChecksum);
+    Animation::KeyCursor compressedCursor;
+    double compressedNs = measureNsPerSample(compressedAnimation, [&compressedAnimation, &compressedChannel, &compressedCursor](double t, glm::vec3* translation, glm::quat* rotation, glm::vec3* scale) {
+        compressedAnimation.sampleChannel(compressedChannel, t, &compressedCursor, translation, rotation, scale);
+    }, &compressedChecksum);
+    
+    cout << NUM_KEYS << " keys, " << NUM_SAMPLES << " samples in order over " << NUM_LOOPS << " loops, ns per sampleChannel():\n";
+    cout << "  linear scan (old):      " << scanNs << " (checksum " << scanChecksum << ")\n";
+    cout << "  binary search:          " << searchNs << " (checksum " << searchChecksum << ")\n";
+    cout << "  cursor:                 " << cursorNs << " (checksum " << cursorChecksum << ")\n";
+    cout << "  uniform:                " << uniformNs << " (checksum " << uniformChecksum << ")\n";
+    cout << "  cursor, compressed:     " << compressedNs << " (checksum " << compressedChecksum << ")\n";
+    return 0;
+}
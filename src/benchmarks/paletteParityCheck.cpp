@@ -0,0 +1,199 @@
+#include "../BonePaletteBuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+// Checks that the AffineMatrix and DualQuaternion bone palettes skin vertices the same as FullMatrix. Palettes are encoded with BonePaletteBuffer::encodePalette() and decoded with a copy of the math in shaders/geometry.v.glsl, the largest difference in position and normal is reported for each format. Build it with BonePaletteBuffer.cpp, CommonMath.cpp, and glad.c (no OpenGL context is created).
+
+constexpr unsigned int NUM_BONES = 64;
+constexpr unsigned int NUM_INSTANCES = 16;
+constexpr unsigned int NUM_VERTICES = 100000;
+constexpr float TOLERANCE = 1e-4f;    // Float rounding only, positions are within a few units of the origin.
+
+struct SkinVertex {
+    uint32_t bones;    // Four 8-bit indices, same as vBone.
+    glm::vec4 weights;
+    glm::vec3 position, normal;
+};
+
+struct SkinResult {
+    glm::vec3 position, normal;
+};
+
+namespace {
+    glm::mat4 fetchMatrix(const vector<glm::vec4>& texels, int texel) {
+        return glm::mat4(texels[texel], texels[texel + 1], texels[texel + 2], texels[texel + 3]);
+    }
+    
+    glm::mat4 fetchAffineMatrix(const vector<glm::vec4>& texels, int texel) {    // Stored as the top 3 rows.
+        return glm::transpose(glm::mat4(texels[texel], texels[texel + 1], texels[texel + 2], glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+    }
+    
+    glm::mat4 blendDualQuaternions(const vector<glm::vec4>& texels, int texel, uint32_t bones, const glm::vec4& weights) {    // Quaternions are stored as (x, y, z, w).
+        glm::vec4 pivot = texels[texel + static_cast<int>(bones & 0xFFu) * 2];
+        glm::vec4 real(0.0f);
+        glm::vec4 dual(0.0f);
+        for (unsigned int i = 0; i < 4; ++i) {
+            int boneTexel = texel + static_cast<int>((bones >> (i * 8u)) & 0xFFu) * 2;
+            glm::vec4 boneReal = texels[boneTexel];
+            float weight = (glm::dot(boneReal, pivot) < 0.0f ? -weights[i] : weights[i]);
+            real += boneReal * weight;
+            dual += texels[boneTexel + 1] * weight;
+        }
+        float invLength = 1.0f / glm::length(real);
+        real *= invLength;
+        dual *= invLength;
+        glm::vec3 realXyz(real.x, real.y, real.z), dualXyz(dual.x, dual.y, dual.z);
+        glm::vec3 translation = 2.0f * (real.w * dualXyz - dual.w * realXyz + glm::cross(realXyz, dualXyz));
+        glm::vec3 r2 = realXyz * 2.0f;
+        glm::vec3 rr = realXyz * r2;
+        float xy = real.x * r2.y, xz = real.x * r2.z, yz = real.y * r2.z;
+        float wx = real.w * r2.x, wy = real.w * r2.y, wz = real.w * r2.z;
+        return glm::mat4(
+            glm::vec4(1.0f - rr.y - rr.z, xy + wz, xz - wy, 0.0f),
+            glm::vec4(xy - wz, 1.0f - rr.x - rr.z, yz + wx, 0.0f),
+            glm::vec4(xz + wy, yz - wx, 1.0f - rr.x - rr.y, 0.0f),
+            glm::vec4(translation, 1.0f)
+        );
+    }
+    
+    glm::mat3 normalMatrix(const glm::mat3& m) {
+        glm::mat3 c(glm::cross(m[1], m[2]), glm::cross(m[2], m[0]), glm::cross(m[0], m[1]));
+        return (glm::dot(m[0], c[0]) < 0.0f ? c * -1.0f : c);
+    }
+    
+    SkinResult skinVertex(BonePaletteBuffer::Format format, const vector<glm::vec4>& texels, int paletteBase, const glm::mat4& modelMtx, const glm::mat4& viewMtx, const SkinVertex& vertex) {    // Follows main() in geometry.v.glsl with SKINNING and BONE_BUFFER.
+        glm::mat4 instanceMtx, boneMtx;
+        if (format == BonePaletteBuffer::FullMatrix) {
+            instanceMtx = fetchMatrix(texels, paletteBase) * modelMtx;
+        } else {
+            instanceMtx = fetchAffineMatrix(texels, paletteBase) * modelMtx;
+        }
+        if (format == BonePaletteBuffer::DualQuaternion) {
+            boneMtx = blendDualQuaternions(texels, paletteBase + 3, vertex.bones, vertex.weights);
+        } else {
+            boneMtx = glm::mat4(0.0f);
+            for (unsigned int i = 0; i < 4; ++i) {
+                int bone = static_cast<int>((vertex.bones >> (i * 8u)) & 0xFFu);
+                boneMtx += (format == BonePaletteBuffer::FullMatrix ? fetchMatrix(texels, paletteBase + 4 + bone * 4) : fetchAffineMatrix(texels, paletteBase + 3 + bone * 3)) * vertex.weights[i];
+            }
+        }
+        glm::mat4 modelViewMtx = viewMtx * instanceMtx * boneMtx;
+        
+        SkinResult result;
+        result.position = glm::vec3(modelViewMtx * glm::vec4(vertex.position, 1.0f));
+        glm::mat3 normalMtx = (format == BonePaletteBuffer::FullMatrix ? glm::transpose(glm::inverse(glm::mat3(modelViewMtx))) : normalMatrix(glm::mat3(modelViewMtx)));
+        result.normal = glm::normalize(normalMtx * vertex.normal);
+        return result;
+    }
+    
+    glm::quat randomRotation(mt19937& randNumGenerator) {
+        normal_distribution<float> gaussian;
+        return glm::normalize(glm::quat(gaussian(randNumGenerator), gaussian(randNumGenerator), gaussian(randNumGenerator), gaussian(randNumGenerator)));
+    }
+    
+    glm::vec3 randomVec3(mt19937& randNumGenerator, float min, float max) {
+        uniform_real_distribution<float> range(min, max);
+        return glm::vec3(range(randNumGenerator), range(randNumGenerator), range(randNumGenerator));
+    }
+    
+    glm::mat4 randomTransform(mt19937& randNumGenerator, const glm::vec3& scale) {
+        glm::mat4 transform = glm::mat4_cast(randomRotation(randNumGenerator));
+        transform[0] *= scale.x;
+        transform[1] *= scale.y;
+        transform[2] *= scale.z;
+        transform[3] = glm::vec4(randomVec3(randNumGenerator, -2.0f, 2.0f), 1.0f);
+        return transform;
+    }
+    
+    void findMaxDifference(BonePaletteBuffer::Format format, const vector<glm::mat4>& modelMtxs, const vector<vector<glm::mat4>>& palettes, const glm::mat4& viewMtx, const vector<SkinVertex>& vertices, float* maxPositionDifference, float* maxNormalDifference) {
+        vector<glm::vec4> texels, referenceTexels;
+        vector<int> offsets, referenceOffsets;
+        for (unsigned int i = 0; i < NUM_INSTANCES; ++i) {    // Palettes back to back, the same as a frame of instances.
+            offsets.push_back(static_cast<int>(BonePaletteBuffer::encodePalette(format, modelMtxs[i], palettes[i], &texels)));
+            referenceOffsets.push_back(static_cast<int>(BonePaletteBuffer::encodePalette(BonePaletteBuffer::FullMatrix, modelMtxs[i], palettes[i], &referenceTexels)));
+        }
+        glm::mat4 shaderModelMtx = glm::mat4(1.0f);    // The modelMtx uniform, the instance transform is in the palette.
+        *maxPositionDifference = 0.0f;
+        *maxNormalDifference = 0.0f;
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            unsigned int instance = i % NUM_INSTANCES;
+            SkinResult result = skinVertex(format, texels, offsets[instance], shaderModelMtx, viewMtx, vertices[i]);
+            SkinResult reference = skinVertex(BonePaletteBuffer::FullMatrix, referenceTexels, referenceOffsets[instance], shaderModelMtx, viewMtx, vertices[i]);
+            *maxPositionDifference = max(*maxPositionDifference, glm::length(result.position - reference.position));
+            *maxNormalDifference = max(*maxNormalDifference, glm::length(result.normal - reference.normal));
+        }
+    }
+    
+    bool report(const char* label, float maxPositionDifference, float maxNormalDifference, bool checked) {
+        bool passed = (maxPositionDifference <= TOLERANCE && maxNormalDifference <= TOLERANCE);
+        cout << label << "max position difference " << maxPositionDifference << ", max normal difference " << maxNormalDifference;
+        if (checked) {
+            cout << (passed ? " (pass)\n" : " (FAIL)\n");
+        } else {
+            cout << " (not checked, dual quaternions don't blend like matrices)\n";
+        }
+        return passed || !checked;
+    }
+}
+
+int main() {
+    mt19937 randNumGenerator(7);
+    uniform_real_distribution<float> unitRange(0.0f, 1.0f);
+    uniform_real_distribution<float> scaleRange(0.5f, 1.5f);
+    
+    vector<glm::mat4> modelMtxs;
+    for (unsigned int i = 0; i < NUM_INSTANCES; ++i) {    // Instances can have any affine transform, some of them mirrored.
+        glm::vec3 scale(scaleRange(randNumGenerator), scaleRange(randNumGenerator), scaleRange(randNumGenerator));
+        if (i % 4 == 3) {
+            scale.x = -scale.x;
+        }
+        modelMtxs.push_back(randomTransform(randNumGenerator, scale));
+    }
+    vector<vector<glm::mat4>> scaledPalettes(NUM_INSTANCES), rigidPalettes(NUM_INSTANCES);
+    for (unsigned int i = 0; i < NUM_INSTANCES; ++i) {
+        for (unsigned int j = 0; j < NUM_BONES; ++j) {
+            glm::vec3 scale(scaleRange(randNumGenerator), scaleRange(randNumGenerator), scaleRange(randNumGenerator));
+            if (j % 8 == 7) {
+                scale.z = -scale.z;
+            }
+            scaledPalettes[i].push_back(randomTransform(randNumGenerator, scale));
+            rigidPalettes[i].push_back(randomTransform(randNumGenerator, glm::vec3(1.0f)));    // Dual quaternions drop the scale.
+        }
+    }
+    glm::mat4 viewMtx = randomTransform(randNumGenerator, glm::vec3(1.0f));
+    
+    vector<SkinVertex> blendedVertices(NUM_VERTICES), singleBoneVertices(NUM_VERTICES);
+    for (unsigned int i = 0; i < NUM_VERTICES; ++i) {
+        SkinVertex& v = blendedVertices[i];
+        v.bones = 0;
+        for (unsigned int j = 0; j < 4; ++j) {
+            v.bones |= (randNumGenerator() % NUM_BONES) << (j * 8);
+            v.weights[j] = unitRange(randNumGenerator);
+        }
+        v.weights /= v.weights.x + v.weights.y + v.weights.z + v.weights.w;
+        v.position = randomVec3(randNumGenerator, -1.0f, 1.0f);
+        v.normal = glm::normalize(randomVec3(randNumGenerator, -1.0f, 1.0f));
+        
+        SkinVertex& s = singleBoneVertices[i];
+        s = v;
+        s.bones = v.bones & 0xFFu;
+        s.weights = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+    }
+    
+    cout << NUM_INSTANCES << " instances of " << NUM_BONES << " bones, " << NUM_VERTICES << " vertices, compared against FullMatrix with tolerance " << TOLERANCE << ".\n";
+    bool passed = true;
+    float positionDifference, normalDifference;
+    findMaxDifference(BonePaletteBuffer::AffineMatrix, modelMtxs, scaledPalettes, viewMtx, blendedVertices, &positionDifference, &normalDifference);
+    passed &= report("AffineMatrix, scaled and mirrored bones:   ", positionDifference, normalDifference, true);
+    findMaxDifference(BonePaletteBuffer::DualQuaternion, modelMtxs, rigidPalettes, viewMtx, singleBoneVertices, &positionDifference, &normalDifference);
+    passed &= report("DualQuaternion, rigid bones, one weight:   ", positionDifference, normalDifference, true);
+    findMaxDifference(BonePaletteBuffer::DualQuaternion, modelMtxs, rigidPalettes, viewMtx, blendedVertices, &positionDifference, &normalDifference);
+    passed &= report("DualQuaternion, rigid bones, four weights: ", positionDifference, normalDifference, false);
+    return (passed ? 0 : 1);
+}
@@ -0,0 +1,90 @@
+#include "../PoseBlending.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+// Measures the per-character cost of the Animator blending step: a crossfade between two poses, then a masked additive layer, with the temporary pose taken from a PosePool like Animator::evaluate() does. The sampled poses are made up, so this leaves out sampling the clips. Build it in release with PoseBlending.cpp.
+
+constexpr unsigned int NUM_CHARACTERS = 1000;
+constexpr unsigned int NUM_NODES = 120;
+constexpr unsigned int NUM_SOURCE_POSES = 8;    // Stand-ins for sampled clips, shared between characters.
+constexpr int NUM_FRAMES = 200;
+
+namespace {
+    ModelRigged::LocalPose createRandomPose(mt19937& randNumGenerator) {
+        uniform_real_distribution<float> range(-1.0f, 1.0f);
+        ModelRigged::LocalPose pose;
+        pose.resize(NUM_NODES);
+        for (unsigned int i = 0; i < NUM_NODES; ++i) {
+            pose.translations[i] = glm::vec3(range(randNumGenerator), range(randNumGenerator), range(randNumGenerator));
+            pose.rotations[i] = glm::normalize(glm::quat(range(randNumGenerator), range(randNumGenerator), range(randNumGenerator), range(randNumGenerator)));
+            pose.scales[i] = glm::vec3(1.0f + range(randNumGenerator) * 0.1f);
+        }
+        return pose;
+    }
+    
+    template<typename Evaluate>
+    double measureMicrosecondsPerCharacter(Evaluate evaluate) {
+        auto startTime = chrono::steady_clock::now();
+        for (int frame = 0; frame < NUM_FRAMES; ++frame) {
+            float fadeWeight = static_cast<float>(frame % 50) / 50.0f;
+            for (unsigned int i = 0; i < NUM_CHARACTERS; ++i) {
+                evaluate(i, fadeWeight);
+            }
+        }
+        double elapsedUs = chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count();
+        return elapsedUs / (static_cast<double>(NUM_CHARACTERS) * NUM_FRAMES);
+    }
+}
+
+int main() {
+    mt19937 randNumGenerator(5);
+    vector<ModelRigged::LocalPose> sourcePoses;
+    for (unsigned int i = 0; i < NUM_SOURCE_POSES; ++i) {
+        sourcePoses.push_back(createRandomPose(randNumGenerator));
+    }
+    ModelRigged::LocalPose referencePose = createRandomPose(randNumGenerator);
+    vector<float> upperBodyMask(NUM_NODES, 0.0f);    // Roughly what createBoneMask() gives for a spine node, the later half of the nodes.
+    for (unsigned int i = NUM_NODES / 2; i < NUM_NODES; ++i) {
+        upperBodyMask[i] = 1.0f;
+    }
+    
+    PoseBlending::PosePool posePool(NUM_NODES);
+    vector<ModelRigged::LocalPose*> results(NUM_CHARACTERS);
+    for (ModelRigged::LocalPose*& result : results) {
+        result = posePool.acquire();
+    }
+    
+    auto blendOnly = [&](unsigned int character, float fadeWeight) {
+        const ModelRigged::LocalPose& from = sourcePoses[character % NUM_SOURCE_POSES];
+        const ModelRigged::LocalPose& to = sourcePoses[(character + 1) % NUM_SOURCE_POSES];
+        PoseBlending::blend(from, to, fadeWeight, nullptr, *results[character]);
+    };
+    auto blendAndLayer = [&](unsigned int character, float fadeWeight) {
+        const ModelRigged::LocalPose& from = sourcePoses[character % NUM_SOURCE_POSES];
+        const ModelRigged::LocalPose& to = sourcePoses[(character + 1) % NUM_SOURCE_POSES];
+        const ModelRigged::LocalPose& additive = sourcePoses[(character + 3) % NUM_SOURCE_POSES];
+        ModelRigged::LocalPose* fadePose = posePool.acquire();
+        PoseBlending::blend(from, to, fadeWeight, nullptr, *fadePose);
+        PoseBlending::addAdditive(*fadePose, additive, referencePose, 0.7f, upperBodyMask.data(), *results[character]);
+        posePool.release(fadePose);
+    };
+    
+    cout << NUM_CHARACTERS << " characters, " << NUM_NODES << " nodes, " << NUM_FRAMES << " frames.\n";
+    cout << "Crossfade:                  " << measureMicrosecondsPerCharacter(blendOnly) << " us/character\n";
+    cout << "Crossfade + additive layer: " << measureMicrosecondsPerCharacter(blendAndLayer) << " us/character\n";
+    
+    double checksum = 0.0;    // Keeps the results live.
+    for (const ModelRigged::LocalPose* result : results) {
+        checksum += result->translations[NUM_NODES - 1].x + result->rotations[NUM_NODES - 1].w;
+    }
+    cout << "Checksum " << checksum << "\n";
+    for (ModelRigged::LocalPose* result : results) {
+        posePool.release(result);
+    }
+    return 0;
+}
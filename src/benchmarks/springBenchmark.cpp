@@ -0,0 +1,88 @@
+#include "../DampedSpringMotion.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+// Measures DampedSpringMotion updates in springs per millisecond, comparing one call per spring against the batch overloads. Build it in release with DampedSpringMotion.cpp, the batch kernel picked at runtime depends on the CPU.
+
+constexpr size_t NUM_SPRINGS = 1 << 16;
+constexpr unsigned int NUM_GROUPS = 16;    // Coefficient sets for the indexed update.
+constexpr int NUM_ROUNDS = 2000;
+constexpr int NUM_CHECK_ROUNDS = 10;
+
+struct Springs {
+    vector<float> pos, vel, equilibrium;
+};
+
+template<typename Update>
+double measureSpringsPerMs(Springs springs, Update update) {    // Takes a copy so each run starts from the same state.
+    auto startTime = chrono::steady_clock::now();
+    for (int i = 0; i < NUM_ROUNDS; ++i) {
+        update(springs);
+    }
+    double elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+    return NUM_SPRINGS * static_cast<double>(NUM_ROUNDS) / elapsedMs;
+}
+
+template<typename Update, typename Reference>
+float findMaxDifference(const Springs& springs, Update update, Reference reference) {    // The batch results should match the per-spring calls exactly.
+    Springs a = springs, b = springs;
+    for (int i = 0; i < NUM_CHECK_ROUNDS; ++i) {
+        update(a);
+        reference(b);
+    }
+    float maxDifference = 0.0f;
+    for (size_t i = 0; i < NUM_SPRINGS; ++i) {
+        maxDifference = max(maxDifference, max(abs(a.pos[i] - b.pos[i]), abs(a.vel[i] - b.vel[i])));
+    }
+    return maxDifference;
+}
+
+int main() {
+    mt19937 randNumGenerator(3);
+    uniform_real_distribution<float> range(-1.0f, 1.0f);
+    Springs springs;
+    springs.pos.resize(NUM_SPRINGS);
+    springs.vel.resize(NUM_SPRINGS);
+    springs.equilibrium.resize(NUM_SPRINGS);
+    vector<uint32_t> motionIndices(NUM_SPRINGS);
+    for (size_t i = 0; i < NUM_SPRINGS; ++i) {
+        springs.pos[i] = range(randNumGenerator);
+        springs.vel[i] = range(randNumGenerator) * 0.1f;
+        springs.equilibrium[i] = range(randNumGenerator);
+        motionIndices[i] = randNumGenerator() % NUM_GROUPS;
+    }
+    vector<DampedSpringMotion> motions;
+    for (unsigned int i = 0; i < NUM_GROUPS; ++i) {
+        motions.emplace_back(1.0f, 0.05f + i * 0.02f, 0.3f + i * 0.04f);
+    }
+    const DampedSpringMotion& sharedMotion = motions[3];
+    
+    auto sharedPerSpring = [&sharedMotion](Springs& s) {
+        for (size_t i = 0; i < NUM_SPRINGS; ++i) {
+            sharedMotion.updateMotion(&s.pos[i], &s.vel[i], s.equilibrium[i]);
+        }
+    };
+    auto sharedBatch = [&sharedMotion](Springs& s) {
+        sharedMotion.updateMotion(s.pos.data(), s.vel.data(), s.equilibrium.data(), NUM_SPRINGS);
+    };
+    auto indexedPerSpring = [&motions, &motionIndices](Springs& s) {
+        for (size_t i = 0; i < NUM_SPRINGS; ++i) {
+            motions[motionIndices[i]].updateMotion(&s.pos[i], &s.vel[i], s.equilibrium[i]);
+        }
+    };
+    auto indexedBatch = [&motions, &motionIndices](Springs& s) {
+        DampedSpringMotion::updateMotion(motions.data(), motionIndices.data(), s.pos.data(), s.vel.data(), s.equilibrium.data(), NUM_SPRINGS);
+    };
+    
+    cout << NUM_SPRINGS << " springs, " << NUM_ROUNDS << " rounds, " << NUM_GROUPS << " coefficient sets for the indexed update.\n";
+    cout << "Shared coefficients:  per-spring " << measureSpringsPerMs(springs, sharedPerSpring) << " springs/ms, batch " << measureSpringsPerMs(springs, sharedBatch) << " springs/ms, max difference " << findMaxDifference(springs, sharedBatch, sharedPerSpring) << "\n";
+    cout << "Indexed coefficients: per-spring " << measureSpringsPerMs(springs, indexedPerSpring) << " springs/ms, batch " << measureSpringsPerMs(springs, indexedBatch) << " springs/ms, max difference " << findMaxDifference(springs, indexedBatch, indexedPerSpring) << "\n";
+    return 0;
+}
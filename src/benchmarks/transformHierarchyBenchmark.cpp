@@ -0,0 +1,72 @@
+#include "../TransformHierarchy.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Measures TransformHierarchy::update() on a large scene, once with every node changed and once with a few nodes changed here and there, with and without a thread pool. Build it in release with TransformHierarchy.cpp, ThreadPool.cpp and CommonMath.cpp.
+
+constexpr unsigned int NUM_TREES = 1000;
+constexpr unsigned int NODES_PER_TREE = 100;    // 100k nodes in total.
+constexpr unsigned int NUM_SCATTERED = 1000;    // Nodes changed per round in the scattered case.
+constexpr int NUM_ROUNDS = 50;
+
+namespace {
+    void buildScene(TransformHierarchy& hierarchy) {    // Each tree picks random parents from its earlier nodes, which gives a mix of long chains and wide levels.
+        mt19937 randNumGenerator(7);
+        for (unsigned int i = 0; i < NUM_TREES; ++i) {
+            unsigned int root = hierarchy.addNode();
+            for (unsigned int j = 1; j < NODES_PER_TREE; ++j) {
+                unsigned int handle = hierarchy.addNode();
+                hierarchy.setParent(handle, static_cast<int>(root + randNumGenerator() % j));
+            }
+        }
+        hierarchy.update();    // Sorts the slots, so the rounds only time the world update.
+    }
+    
+    template<typename Change>
+    double measureUpdateMs(TransformHierarchy& hierarchy, Change change) {
+        double totalMs = 0.0;
+        for (int i = 0; i < NUM_ROUNDS; ++i) {
+            change(hierarchy, i);
+            auto startTime = chrono::steady_clock::now();
+            hierarchy.update();
+            totalMs += chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+        }
+        return totalMs / NUM_ROUNDS;
+    }
+}
+
+int main() {
+    mt19937 randNumGenerator(11);
+    vector<unsigned int> scatteredNodes(NUM_SCATTERED * NUM_ROUNDS);
+    for (unsigned int& handle : scatteredNodes) {
+        handle = randNumGenerator() % (NUM_TREES * NODES_PER_TREE);
+    }
+    
+    auto changeAll = [](TransformHierarchy& hierarchy, int round) {
+        glm::vec3 position(0.01f * round, 0.0f, 0.0f);
+        for (unsigned int i = 0; i < hierarchy.getNumNodes(); ++i) {
+            hierarchy.setLocalTransform(i, position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+        }
+    };
+    auto changeScattered = [&scatteredNodes](TransformHierarchy& hierarchy, int round) {
+        glm::vec3 position(0.01f * round, 0.0f, 0.0f);
+        for (unsigned int i = 0; i < NUM_SCATTERED; ++i) {
+            hierarchy.setLocalTransform(scatteredNodes[round * NUM_SCATTERED + i], position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+        }
+    };
+    
+    ThreadPool threadPool;
+    TransformHierarchy serialHierarchy, pooledHierarchy(&threadPool);
+    buildScene(serialHierarchy);
+    buildScene(pooledHierarchy);
+    
+    cout << serialHierarchy.getNumNodes() << " nodes in " << serialHierarchy.getNumLevels() << " levels, " << thread::hardware_concurrency() << " hardware threads, " << NUM_ROUNDS << " rounds.\n";
+    cout << "All dirty:                      serial " << measureUpdateMs(serialHierarchy, changeAll) << " ms, thread pool " << measureUpdateMs(pooledHierarchy, changeAll) << " ms\n";
+    cout << "Scattered (" << NUM_SCATTERED << " changed nodes): serial " << measureUpdateMs(serialHierarchy, changeScattered) << " ms, thread pool " << measureUpdateMs(pooledHierarchy, changeScattered) << " ms\n";
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "../Camera.h"
+#include "../CharacterTest.h"
 #include "../Entity.h"
 #include "../Event.h"
 #include "../RenderApp.h"
@@ -36,8 +37,12 @@ int main(int argc, char** argv) {
     SceneNode* sphere1Node = scene->getRootNode()->createChildNode();
     sphere1Node->attachObject(sphere1);
     
+    CharacterTest character;
+    character.init(app);
+    
     app.startRenderThread();
     while (app.getState() != RenderApp::Exiting) {    // Tick loop.
+        character.update();
         app.tempRender();
         
         processInput(app, camera);
@@ -136,6 +141,8 @@ void processEvent(RenderApp& app, Camera* camera, const Event& e) {
             app.config_.setBloom(!app.config_.getBloom());
         } else if (e.key.code == GLFW_KEY_N) {
             app.config_.setSSAO(!app.config_.getSSAO());
+        } else if (e.key.code == GLFW_KEY_M) {
+            app.config_.setPreSkinning(!app.config_.getPreSkinning());
         }
     } else if (e.type == Event::MouseMove) {
         static glm::vec2 lastMousePos(RenderApp::INITIAL_WINDOW_SIZE.x / 2.0f, RenderApp::INITIAL_WINDOW_SIZE.y / 2.0f);